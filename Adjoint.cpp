@@ -0,0 +1,366 @@
+#include "Adjoint.h"
+#include "CommandLine.h"
+#include "Dual.h"
+#include "Physics.h"
+#include "Reverse.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const char* ADJOINT_PARAMETER_NAMES[ADJOINT_PARAMETERS] = {
+    "theta1", "theta2", "omega1", "omega2", "l1", "l2", "m1", "m2", "g"
+};
+
+struct AdjointState {
+    double t1, t2, w1, w2;
+};
+
+static long long rolloutSteps(const AdjointSettings& s) {
+    return (long long)std::llround(s.time / s.dt);
+}
+
+static bool flippedState(double t1, double t2) {
+    return std::fabs(t1) > M_PI || std::fabs(t2) > M_PI;
+}
+
+template<typename T>
+static T tipObjective(const T& t1, const T& t2, const T& L1, const T& L2, const AdjointSettings& s) {
+    using std::sin;
+    using std::cos;
+    T dx = L1 * sin(t1) + L2 * sin(t2) - s.targetX;
+    T dy = -(L1 * cos(t1)) - L2 * cos(t2) - s.targetY;
+    return 0.5 * (dx * dx + dy * dy);
+}
+
+// Flip time from the state at the start of the step that flips: the step
+// is taken and the crossing of +-pi placed inside it by linear
+// interpolation of the angle.
+template<typename T>
+static T flipObjective(T t1, T t2, T w1, T w2, const T* p, T h, long long k) {
+    T before[2] = { t1, t2 };
+    doublePendulumStep(t1, t2, w1, w2, p[0], p[1], p[2], p[3], p[4], h);
+    T after[2] = { t1, t2 };
+
+    double earliest = 2.0;
+    T fraction(1.0);
+    for (int arm = 0; arm < 2; ++arm) {
+        if (std::fabs(value(after[arm])) > M_PI) {
+            double sign = value(after[arm]) < 0.0 ? -1.0 : 1.0;
+            T crossing = (M_PI - sign * before[arm]) / (sign * after[arm] - sign * before[arm]);
+            if (value(crossing) < earliest) {
+                earliest = value(crossing);
+                fraction = crossing;
+            }
+        }
+    }
+    return h * ((double)k + fraction);
+}
+
+static AdjointState initialState(const double* parameters) {
+    AdjointState x = { parameters[0], parameters[1], parameters[2], parameters[3] };
+    return x;
+}
+
+static void plainStep(AdjointState& x, const double* p, double h) {
+    doublePendulumStep(x.t1, x.t2, x.w1, x.w2, p[0], p[1], p[2], p[3], p[4], h);
+}
+
+// Runs the rollout to the state the objective is taken at: the end of the
+// horizon for the tip target, the start of the flipping step for the flip
+// time. Returns how many steps that is.
+static long long forwardRollout(const double* parameters, const AdjointSettings& s, AdjointState& end, bool& flipped) {
+    long long steps = rolloutSteps(s);
+    AdjointState x = initialState(parameters);
+    flipped = false;
+    for (long long k = 0; k < steps; ++k) {
+        AdjointState previous = x;
+        plainStep(x, parameters + 4, s.dt);
+        if (s.objective == ADJOINT_FLIP_TIME && flippedState(x.t1, x.t2)) {
+            end = previous;
+            flipped = true;
+            return k;
+        }
+    }
+    end = x;
+    return steps;
+}
+
+static double rolloutObjective(const double* parameters, const AdjointSettings& s) {
+    AdjointState end;
+    bool flipped;
+    long long steps = forwardRollout(parameters, s, end, flipped);
+    if (s.objective == ADJOINT_TIP_TARGET) {
+        return tipObjective(end.t1, end.t2, parameters[4], parameters[5], s);
+    }
+    if (!flipped) {
+        return steps * s.dt;
+    }
+    return flipObjective(end.t1, end.t2, end.w1, end.w2, parameters + 4, s.dt, steps);
+}
+
+// Steps that `checkpoints` stored states can reverse when no step is
+// recomputed more than `repetitions` times: binomial(checkpoints +
+// repetitions, checkpoints).
+static double binomialReach(int checkpoints, int repetitions) {
+    double reach = 1.0;
+    for (int i = 1; i <= repetitions; ++i) {
+        reach = reach * (checkpoints + i) / i;
+    }
+    return reach;
+}
+
+class AdjointSweep {
+public:
+    AdjointSweep(const double* parameters, double h) : p(parameters + 4), h(h) {}
+
+    // Carries lambda, the adjoint of the state after step b - 1, back to
+    // the adjoint of `start`, the state before step a, with `free` more
+    // states that may be held.
+    void reverse(const AdjointState& start, long long a, long long b, int free, double lambda[4]) {
+        long long n = b - a;
+        if (n <= 0) {
+            return;
+        }
+        if (n == 1) {
+            adjointStep(start, lambda);
+            return;
+        }
+        if (free == 0) {
+            for (long long k = b - 1; k >= a; --k) {
+                adjointStep(advance(start, a, k), lambda);
+            }
+            return;
+        }
+
+        // split so the left part is reversible from `start` with one less
+        // repetition and the right part from the new checkpoint
+        int repetitions = 1;
+        while (binomialReach(free, repetitions) < (double)n) {
+            ++repetitions;
+        }
+        long long left = std::min((long long)binomialReach(free, repetitions - 1), n - 1);
+        AdjointState middle = advance(start, a, a + left);
+        ++held;
+        peak = std::max(peak, held);
+        reverse(middle, a + left, b, free - 1, lambda);
+        --held;
+        reverse(start, a, a + left, free, lambda);
+    }
+
+    double parameterAdjoint[5] = {};
+    long long forwardSteps = 0;
+    long long reverseSteps = 0;
+    int held = 1;
+    int peak = 1;
+
+private:
+    AdjointState advance(AdjointState x, long long from, long long to) {
+        for (long long k = from; k < to; ++k) {
+            plainStep(x, p, h);
+        }
+        forwardSteps += to - from;
+        return x;
+    }
+
+    void adjointStep(const AdjointState& x, double lambda[4]) {
+        doublePendulumStepAdjoint(x.t1, x.t2, x.w1, x.w2, p[0], p[1], p[2], p[3], p[4], h, lambda, parameterAdjoint);
+        ++reverseSteps;
+    }
+
+    const double* p;
+    double h;
+};
+
+AdjointResult adjointGradient(const double parameters[ADJOINT_PARAMETERS], const AdjointSettings& settings) {
+    AdjointResult result;
+    AdjointState end;
+    long long steps = forwardRollout(parameters, settings, end, result.flipped);
+    result.steps = steps;
+    result.forwardSteps = steps;
+    if (settings.objective == ADJOINT_FLIP_TIME && !result.flipped) {
+        result.value = steps * settings.dt;
+        return result;
+    }
+
+    // the objective itself on a tape gives the adjoint of the end state
+    Tape tape;
+    Var state[4] = {
+        Var::variable(tape, end.t1), Var::variable(tape, end.t2), Var::variable(tape, end.w1), Var::variable(tape, end.w2)
+    };
+    Var p[5];
+    for (int i = 0; i < 5; ++i) {
+        p[i] = Var::variable(tape, parameters[4 + i]);
+    }
+    Var objective = settings.objective == ADJOINT_TIP_TARGET
+        ? tipObjective(state[0], state[1], p[0], p[1], settings)
+        : flipObjective(state[0], state[1], state[2], state[3], p, Var(settings.dt), steps);
+    std::vector<double> adjoints(tape.size(), 0.0);
+    adjoints[objective.index] = 1.0;
+    tape.backpropagate(adjoints);
+    result.value = objective.v;
+
+    double lambda[4];
+    for (int i = 0; i < 4; ++i) {
+        lambda[i] = adjoints[state[i].index];
+    }
+    AdjointSweep sweep(parameters, settings.dt);
+    for (int i = 0; i < 5; ++i) {
+        sweep.parameterAdjoint[i] = adjoints[p[i].index];
+    }
+    sweep.reverse(initialState(parameters), 0, steps, std::max(settings.checkpoints - 1, 0), lambda);
+
+    for (int i = 0; i < 4; ++i) {
+        result.gradient[i] = lambda[i];
+    }
+    for (int i = 0; i < 5; ++i) {
+        result.gradient[4 + i] = sweep.parameterAdjoint[i];
+    }
+    result.forwardSteps += sweep.forwardSteps;
+    result.reverseSteps = sweep.reverseSteps;
+    result.checkpoints = sweep.peak;
+    return result;
+}
+
+AdjointResult forwardGradient(const double parameters[ADJOINT_PARAMETERS], const AdjointSettings& settings) {
+    typedef Dual<double, ADJOINT_PARAMETERS> D;
+    D x[ADJOINT_PARAMETERS];
+    for (int i = 0; i < ADJOINT_PARAMETERS; ++i) {
+        x[i] = D::variable(parameters[i], i);
+    }
+    D* p = x + 4;
+    D h(settings.dt);
+
+    AdjointResult result;
+    long long steps = rolloutSteps(settings);
+    D objective(steps * settings.dt);
+    result.steps = steps;
+    for (long long k = 0; k < steps; ++k) {
+        D previous[4] = { x[0], x[1], x[2], x[3] };
+        doublePendulumStep(x[0], x[1], x[2], x[3], p[0], p[1], p[2], p[3], p[4], h);
+        if (settings.objective == ADJOINT_FLIP_TIME && flippedState(x[0].v, x[1].v)) {
+            objective = flipObjective(previous[0], previous[1], previous[2], previous[3], p, h, k);
+            result.steps = k;
+            result.flipped = true;
+            break;
+        }
+    }
+    if (settings.objective == ADJOINT_TIP_TARGET) {
+        objective = tipObjective(x[0], x[1], p[0], p[1], settings);
+    }
+    result.forwardSteps = result.steps;
+    result.value = objective.v;
+    for (int i = 0; i < ADJOINT_PARAMETERS; ++i) {
+        result.gradient[i] = objective.d[i];
+    }
+    return result;
+}
+
+int runAdjointCommand(int argc, char** argv) {
+    double parameters[ADJOINT_PARAMETERS] = {
+        floatArgument(argc, argv, "--theta1", 2.0f),
+        floatArgument(argc, argv, "--theta2", 2.0f),
+        floatArgument(argc, argv, "--omega1", 0.0f),
+        floatArgument(argc, argv, "--omega2", 0.0f),
+        floatArgument(argc, argv, "--l1", INITIAL_LENGTH),
+        floatArgument(argc, argv, "--l2", INITIAL_LENGTH),
+        floatArgument(argc, argv, "--m1", INITIAL_MASS),
+        floatArgument(argc, argv, "--m2", INITIAL_MASS),
+        floatArgument(argc, argv, "--g", G)
+    };
+
+    AdjointSettings settings;
+    settings.dt = floatArgument(argc, argv, "--dt", (float)settings.dt);
+    settings.time = floatArgument(argc, argv, "--time", (float)settings.time);
+    settings.targetX = floatArgument(argc, argv, "--target-x", (float)settings.targetX);
+    settings.targetY = floatArgument(argc, argv, "--target-y", (float)settings.targetY);
+    settings.checkpoints = intArgument(argc, argv, "--checkpoints", settings.checkpoints);
+    std::string objective = stringArgument(argc, argv, "--objective", "tip");
+    int iterations = intArgument(argc, argv, "--optimize", 0);
+    double rate = floatArgument(argc, argv, "--rate", 0.05f);
+    std::string vary = stringArgument(argc, argv, "--vary", "theta1,theta2,omega1,omega2");
+
+    bool varied[ADJOINT_PARAMETERS] = {};
+    for (int i = 0; i < ADJOINT_PARAMETERS; ++i) {
+        std::string name = ADJOINT_PARAMETER_NAMES[i];
+        varied[i] = ("," + vary + ",").find("," + name + ",") != std::string::npos;
+    }
+    bool valid = settings.dt > 0.0 && settings.time > 0.0 && settings.checkpoints >= 1 && rate > 0.0
+        && (objective == "tip" || objective == "flip");
+    if (!valid) {
+        std::cerr << "Invalid adjoint settings" << std::endl;
+        return -1;
+    }
+    settings.objective = objective == "flip" ? ADJOINT_FLIP_TIME : ADJOINT_TIP_TARGET;
+
+    auto begin = std::chrono::steady_clock::now();
+    double value = rolloutObjective(parameters, settings);
+    double rolloutSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    AdjointResult result = adjointGradient(parameters, settings);
+    double adjointSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << "objective " << value;
+    if (settings.objective == ADJOINT_FLIP_TIME && !result.flipped) {
+        std::cout << " (no flip within " << settings.time << " s, gradient zero)";
+    }
+    std::cout << std::endl;
+    for (int i = 0; i < ADJOINT_PARAMETERS; ++i) {
+        std::cout << "d/d" << ADJOINT_PARAMETER_NAMES[i] << " " << result.gradient[i] << std::endl;
+    }
+    std::cout << result.steps << " steps: rollout " << rolloutSeconds << " s, gradient " << adjointSeconds << " s ("
+        << (rolloutSeconds > 0.0 ? adjointSeconds / rolloutSeconds : 0.0) << "x) with " << result.checkpoints
+        << " checkpoints, " << (double)result.forwardSteps / std::max(result.steps, 1LL) << " forward steps per step"
+        << std::endl;
+
+    if (hasArgument(argc, argv, "--check")) {
+        begin = std::chrono::steady_clock::now();
+        AdjointResult forward = forwardGradient(parameters, settings);
+        double forwardSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        double worst = 0.0;
+        for (int i = 0; i < ADJOINT_PARAMETERS; ++i) {
+            double scale = std::max(std::fabs(forward.gradient[i]), 1e-12);
+            worst = std::max(worst, std::fabs(forward.gradient[i] - result.gradient[i]) / scale);
+        }
+        std::cout << "forward mode " << forwardSeconds << " s, largest relative difference " << worst << std::endl;
+    }
+
+    // gradient steps on the varied parameters, shrinking the step whenever
+    // it fails to improve; the flip time is maximised
+    double sign = settings.objective == ADJOINT_FLIP_TIME ? 1.0 : -1.0;
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        double norm = 0.0;
+        for (int i = 0; i < ADJOINT_PARAMETERS; ++i) {
+            norm += varied[i] ? result.gradient[i] * result.gradient[i] : 0.0;
+        }
+        norm = std::sqrt(norm);
+        if (norm == 0.0 || !std::isfinite(norm)) {
+            break;
+        }
+        double trial[ADJOINT_PARAMETERS];
+        for (int i = 0; i < ADJOINT_PARAMETERS; ++i) {
+            trial[i] = parameters[i] + (varied[i] ? sign * rate * result.gradient[i] / norm : 0.0);
+        }
+        double trialValue = rolloutObjective(trial, settings);
+        if (sign * (trialValue - value) > 0.0) {
+            std::copy(trial, trial + ADJOINT_PARAMETERS, parameters);
+            value = trialValue;
+            rate *= 1.5;
+            result = adjointGradient(parameters, settings);
+        }
+        else {
+            rate *= 0.5;
+        }
+        std::cout << "iteration " << iteration + 1 << " objective " << value << " step " << rate << std::endl;
+    }
+    if (iterations > 0) {
+        for (int i = 0; i < ADJOINT_PARAMETERS; ++i) {
+            std::cout << ADJOINT_PARAMETER_NAMES[i] << " " << parameters[i] << (i + 1 < ADJOINT_PARAMETERS ? "  " : "\n");
+        }
+    }
+    return 0;
+}
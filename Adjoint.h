@@ -0,0 +1,44 @@
+#pragma once
+
+// Parameters are theta1, theta2, omega1, omega2 at t = 0, then L1, L2, M1,
+// M2 and g.
+const int ADJOINT_PARAMETERS = 9;
+extern const char* ADJOINT_PARAMETER_NAMES[ADJOINT_PARAMETERS];
+
+enum AdjointObjective {
+    ADJOINT_TIP_TARGET,     // half the squared distance of the tip from the target at `time`
+    ADJOINT_FLIP_TIME       // time of the first flip, interpolated inside its step; `time` if none
+};
+
+struct AdjointSettings {
+    double dt = 0.001;
+    double time = 10.0;
+    AdjointObjective objective = ADJOINT_TIP_TARGET;
+    double targetX = 1.0;
+    double targetY = 0.0;
+    int checkpoints = 128;
+};
+
+struct AdjointResult {
+    double value = 0.0;
+    double gradient[ADJOINT_PARAMETERS] = {};
+    long long steps = 0;            // length of the rollout
+    long long forwardSteps = 0;     // plain steps taken, including recomputation
+    long long reverseSteps = 0;     // taped steps
+    int checkpoints = 0;            // most states held at once
+    bool flipped = false;
+};
+
+// Gradient of the objective over a symplectic Euler rollout by the discrete
+// adjoint: each step is re-run on a tape and swept backwards, carrying the
+// state adjoint from the end of the rollout to its start. States are
+// recomputed from at most `checkpoints` stored ones placed by the binomial
+// (revolve) schedule, so memory stays bounded and every step is recomputed
+// only a few times even for long horizons.
+AdjointResult adjointGradient(const double parameters[ADJOINT_PARAMETERS], const AdjointSettings& settings);
+
+// The same gradient by forward-mode dual numbers, one tangent per
+// parameter, for checking.
+AdjointResult forwardGradient(const double parameters[ADJOINT_PARAMETERS], const AdjointSettings& settings);
+
+int runAdjointCommand(int argc, char** argv);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+// Blocks each of `count` threads in wait() until all of them have arrived,
+// then releases them together; reusable for the next round straight away.
+class Barrier {
+public:
+    explicit Barrier(int count) : count(count) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        long long arrived = generation;
+        if (++waiting == count) {
+            waiting = 0;
+            ++generation;
+            released.notify_all();
+            return;
+        }
+        released.wait(lock, [&]() { return generation != arrived; });
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    int count;
+    int waiting = 0;
+    long long generation = 0;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cmath>
+
+const int CHAIN_MAX_LINKS = 8;
+
+// Planar chain of n point masses on massless rods hanging from a fixed
+// pivot, angles measured from the downward vertical. With mu_ij the mass
+// carried below link max(i, j), the equations of motion are
+//   sum_j mu_ij L_i L_j (cos(theta_i - theta_j) a_j + sin(theta_i - theta_j) omega_j^2)
+//     + mu_ii g L_i sin(theta_i) = 0,
+// whose symmetric positive definite mass matrix is solved here by Gaussian
+// elimination. n = 2 reproduces doublePendulumAccel.
+//
+// A pivot accelerating by (ax, ay) is the same as gravity g + ay with a
+// sideways pull: pass g + ay and lateral = ax, which adds
+// mu_ii ax L_i cos(theta_i) to the gravity term.
+template<typename T>
+inline void chainAccel(int n, const T* theta, const T* omega, const double* L, const double* M, double g, T* accel,
+    double lateral = 0.0) {
+    using std::sin;
+    using std::cos;
+
+    double below[CHAIN_MAX_LINKS];
+    double carried = 0.0;
+    for (int i = n - 1; i >= 0; --i) {
+        carried += M[i];
+        below[i] = carried;
+    }
+
+    T matrix[CHAIN_MAX_LINKS][CHAIN_MAX_LINKS];
+    T rhs[CHAIN_MAX_LINKS];
+    for (int i = 0; i < n; ++i) {
+        rhs[i] = -(below[i] * g * L[i]) * sin(theta[i]);
+        if (lateral != 0.0) {
+            rhs[i] -= (below[i] * lateral * L[i]) * cos(theta[i]);
+        }
+        for (int j = 0; j < n; ++j) {
+            double mass = below[i > j ? i : j] * L[i] * L[j];
+            T delta = theta[i] - theta[j];
+            matrix[i][j] = mass * cos(delta);
+            rhs[i] -= mass * sin(delta) * omega[j] * omega[j];
+        }
+    }
+
+    for (int k = 0; k < n; ++k) {
+        for (int i = k + 1; i < n; ++i) {
+            T factor = matrix[i][k] / matrix[k][k];
+            for (int j = k + 1; j < n; ++j) {
+                matrix[i][j] -= factor * matrix[k][j];
+            }
+            rhs[i] -= factor * rhs[k];
+        }
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        T sum = rhs[i];
+        for (int j = i + 1; j < n; ++j) {
+            sum -= matrix[i][j] * accel[j];
+        }
+        accel[i] = sum / matrix[i][i];
+    }
+}
+
+// Time derivative of the state theta_1..theta_n, omega_1..omega_n.
+template<typename T>
+inline void chainDerivative(int n, const T* state, const double* L, const double* M, double g, T* rate) {
+    for (int i = 0; i < n; ++i) {
+        rate[i] = state[n + i];
+    }
+    chainAccel(n, state, state + n, L, M, g, rate + n);
+}
+
+template<typename T>
+inline void chainRk4Step(int n, T* state, T h, const double* L, const double* M, double g) {
+    const int size = 2 * n;
+    T k1[2 * CHAIN_MAX_LINKS], k2[2 * CHAIN_MAX_LINKS], k3[2 * CHAIN_MAX_LINKS], k4[2 * CHAIN_MAX_LINKS];
+    T probe[2 * CHAIN_MAX_LINKS] = {};
+    T half = h * 0.5;
+
+    chainDerivative(n, state, L, M, g, k1);
+    for (int i = 0; i < size; ++i) probe[i] = state[i] + half * k1[i];
+    chainDerivative(n, probe, L, M, g, k2);
+    for (int i = 0; i < size; ++i) probe[i] = state[i] + half * k2[i];
+    chainDerivative(n, probe, L, M, g, k3);
+    for (int i = 0; i < size; ++i) probe[i] = state[i] + h * k3[i];
+    chainDerivative(n, probe, L, M, g, k4);
+
+    T sixth = h / 6.0;
+    for (int i = 0; i < size; ++i) {
+        state[i] += sixth * (k1[i] + 2.0 * (k2[i] + k3[i]) + k4[i]);
+    }
+}
+
+template<typename T>
+inline T chainEnergy(int n, const T* theta, const T* omega, const double* L, const double* M, double g) {
+    using std::cos;
+
+    double below[CHAIN_MAX_LINKS];
+    double carried = 0.0;
+    for (int i = n - 1; i >= 0; --i) {
+        carried += M[i];
+        below[i] = carried;
+    }
+
+    T energy(0.0);
+    for (int i = 0; i < n; ++i) {
+        energy -= (below[i] * g * L[i]) * cos(theta[i]);
+        for (int j = 0; j < n; ++j) {
+            double mass = 0.5 * below[i > j ? i : j] * L[i] * L[j];
+            energy += mass * cos(theta[i] - theta[j]) * omega[i] * omega[j];
+        }
+    }
+    return energy;
+}
@@ -0,0 +1,381 @@
+#include "Collisions.h"
+#include "Chain.h"
+#include "CommandLine.h"
+#include "Physics.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+const double COLLISION_MARGIN = 1e-3;  // bobs this fraction of a diameter apart still touch
+const int COLLISION_REBUILD_FRACTION = 8;   // sorted from scratch once more than 1 / this of the bobs change cell
+
+static inline int cellOf(double value, double size) {
+    return (int)std::floor(value / size);
+}
+
+static inline unsigned int hashCell(int cx, int cy, unsigned int mask) {
+    return ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u) & mask;
+}
+
+BobCollisions::BobCollisions(const CollisionSettings& settings) : settings(settings) {}
+
+void BobCollisions::sortCells(CollisionStats& stats) {
+    const int n = (int)cells.size();
+    const int table = (int)starts.size();
+    if ((int)order.size() == n && (int)previousCells.size() == n) {
+        // last step's order minus the bobs that changed cell is still
+        // sorted; the few that did are sorted apart and merged back in
+        movers.clear();
+        for (int i = 0; i < n; ++i) {
+            if (cells[i] != previousCells[i]) {
+                movers.push_back(i);
+            }
+        }
+        stats.moved = (long long)movers.size();
+        if (movers.empty()) {
+            return;
+        }
+        if (stats.moved <= n / COLLISION_REBUILD_FRACTION) {
+            staying.clear();
+            for (unsigned int bob : order) {
+                if (cells[bob] == previousCells[bob]) {
+                    staying.push_back(bob);
+                }
+            }
+            auto byCell = [&](unsigned int first, unsigned int second) { return cells[first] < cells[second]; };
+            std::sort(movers.begin(), movers.end(), byCell);
+            std::merge(staying.begin(), staying.end(), movers.begin(), movers.end(), order.begin(), byCell);
+            previousCells = cells;
+            return;
+        }
+    }
+
+    stats.rebuilt = true;
+    std::fill(starts.begin(), starts.end(), 0u);
+    for (int i = 0; i < n; ++i) {
+        ++starts[cells[i]];
+    }
+    unsigned int sum = 0;
+    for (int b = 0; b < table; ++b) {
+        unsigned int count = starts[b];
+        starts[b] = sum;
+        sum += count;
+    }
+    order.resize(n);
+    for (int i = 0; i < n; ++i) {
+        order[starts[cells[i]]++] = i;
+    }
+    previousCells = cells;
+}
+
+// Adds sign * d(velocity of the bob along n)/d(omega_i) for the links of its chain to row.
+void BobCollisions::normalRow(const ChainScene& scene, int bob, double nx, double ny, double sign, double* row) const {
+    const int first = scene.offset(scene.owner(bob));
+    for (int i = first; i <= bob; ++i) {
+        row[i - first] += sign * scene.length(i) * (cosines[i] * nx + sines[i] * ny);
+    }
+}
+
+void BobCollisions::addContact(const ChainScene& scene, int a, int b, double nx, double ny) {
+    contacts.emplace_back();
+    Contact& contact = contacts.back();
+    contact.chainA = scene.owner(a);
+    contact.chainB = scene.owner(b);
+    contact.response = 0.0;
+    std::fill(contact.gA, contact.gA + CHAIN_MAX_LINKS, 0.0);
+    std::fill(contact.gB, contact.gB + CHAIN_MAX_LINKS, 0.0);
+    normalRow(scene, a, nx, ny, -1.0, contact.gA);
+    normalRow(scene, b, nx, ny, 1.0, contact.chainA == contact.chainB ? contact.gA : contact.gB);
+}
+
+// vector <- M^-1 vector, M_ij = L_i L_j cos(theta_i - theta_j) (mass from max(i, j) down)
+void BobCollisions::applyInverseMass(const ChainScene& scene, int chain, double* vector) const {
+    const int n = scene.links(chain);
+    const int first = scene.offset(chain);
+    double below[CHAIN_MAX_LINKS];
+    double carried = 0.0;
+    for (int i = n - 1; i >= 0; --i) {
+        carried += scene.mass(first + i);
+        below[i] = carried;
+    }
+    double m[CHAIN_MAX_LINKS][CHAIN_MAX_LINKS];
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j <= i; ++j) {
+            m[i][j] = scene.length(first + i) * scene.length(first + j) * below[i]
+                * (cosines[first + i] * cosines[first + j] + sines[first + i] * sines[first + j]);
+        }
+    }
+    // Cholesky, lower triangle in place
+    for (int j = 0; j < n; ++j) {
+        for (int k = 0; k < j; ++k) {
+            m[j][j] -= m[j][k] * m[j][k];
+        }
+        m[j][j] = std::sqrt(m[j][j]);
+        for (int i = j + 1; i < n; ++i) {
+            for (int k = 0; k < j; ++k) {
+                m[i][j] -= m[i][k] * m[j][k];
+            }
+            m[i][j] /= m[j][j];
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        for (int k = 0; k < i; ++k) {
+            vector[i] -= m[i][k] * vector[k];
+        }
+        vector[i] /= m[i][i];
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        for (int k = i + 1; k < n; ++k) {
+            vector[i] -= m[k][i] * vector[k];
+        }
+        vector[i] /= m[i][i];
+    }
+}
+
+void BobCollisions::resolve(ChainScene& scene, CollisionStats* stats) {
+    const int n = scene.links();
+    const double size = 2.0 * settings.radius;
+    const double reach = size * (1.0 + COLLISION_MARGIN);
+    CollisionStats result;
+
+    x.resize(n);
+    y.resize(n);
+    sines.resize(n);
+    cosines.resize(n);
+    for (int c = 0; c < scene.chains(); ++c) {
+        double px, py;
+        scene.anchor(c, px, py);
+        for (int i = scene.offset(c); i < scene.offset(c) + scene.links(c); ++i) {
+            sines[i] = std::sin(scene.theta[i]);
+            cosines[i] = std::cos(scene.theta[i]);
+            px += scene.length(i) * sines[i];
+            py -= scene.length(i) * cosines[i];
+            x[i] = px;
+            y[i] = py;
+        }
+    }
+
+    // a table of at least twice as many slots as bobs keeps hash collisions rare
+    unsigned int table = 1;
+    while (table < 2u * (unsigned int)std::max(n, 1)) {
+        table *= 2;
+    }
+    if (starts.size() != table) {
+        starts.assign(table, 0u);
+        previousCells.clear();
+    }
+    cells.resize(n);
+    for (int i = 0; i < n; ++i) {
+        cells[i] = hashCell(cellOf(x[i], size), cellOf(y[i], size), table - 1);
+    }
+    sortCells(result);
+
+    // positions gathered in cell order, so each cell's bobs sit together
+    sortedX.resize(n);
+    sortedY.resize(n);
+    for (int j = 0; j < n; ++j) {
+        sortedX[j] = x[order[j]];
+        sortedY[j] = y[order[j]];
+    }
+    // first and end of each bucket's run, side by side
+    ranges.assign(2 * (size_t)table, 0u);
+    for (int j = 0; j < n;) {
+        const unsigned int bucket = cells[order[j]];
+        int k = j + 1;
+        while (k < n && cells[order[k]] == bucket) {
+            ++k;
+        }
+        ranges[2 * bucket] = j;
+        ranges[2 * bucket + 1] = k;
+        j = k;
+    }
+
+    // each bob meets the later bobs of its own bucket and everything in
+    // the four cells ahead of it; the other four see it from their side
+    const int ahead[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+    contacts.clear();
+    auto meet = [&](int j, int k) {
+        const int a = order[j], b = order[k];
+        // rods keep neighbours in a chain apart by themselves
+        if ((b == a + 1 || a == b + 1) && scene.owner(a) == scene.owner(b)) {
+            return;
+        }
+        ++result.candidates;
+        double ex = sortedX[k] - sortedX[j], ey = sortedY[k] - sortedY[j];
+        double distance = std::sqrt(ex * ex + ey * ey);
+        if (distance < reach && distance > 0.0) {
+            addContact(scene, a, b, ex / distance, ey / distance);
+        }
+    };
+    for (int j = 0; j < n; ++j) {
+        const unsigned int own = cells[order[j]];
+        for (unsigned int k = j + 1; k < ranges[2 * own + 1]; ++k) {
+            meet(j, k);
+        }
+        const int cx = cellOf(sortedX[j], size), cy = cellOf(sortedY[j], size);
+        unsigned int seen[4];
+        int seenCount = 0;
+        for (const int* offset : ahead) {
+            // a cell hashed into the bucket already scanned is covered there
+            unsigned int bucket = hashCell(cx + offset[0], cy + offset[1], table - 1);
+            if (bucket == own || std::find(seen, seen + seenCount, bucket) != seen + seenCount) {
+                continue;
+            }
+            seen[seenCount++] = bucket;
+            for (unsigned int k = ranges[2 * bucket]; k < ranges[2 * bucket + 1]; ++k) {
+                meet(j, k);
+            }
+        }
+    }
+    result.contacts = (long long)contacts.size();
+
+    // positions stay put while impulses are exchanged, so only omega changes
+    for (int iteration = 0; iteration < settings.iterations; ++iteration) {
+        bool applied = false;
+        for (Contact& contact : contacts) {
+            const bool shared = contact.chainA == contact.chainB;
+            const int nA = scene.links(contact.chainA), nB = shared ? 0 : scene.links(contact.chainB);
+            double* omegaA = scene.omega.data() + scene.offset(contact.chainA);
+            double* omegaB = scene.omega.data() + scene.offset(contact.chainB);
+            double approach = 0.0;
+            for (int i = 0; i < nA; ++i) {
+                approach += contact.gA[i] * omegaA[i];
+            }
+            for (int i = 0; i < nB; ++i) {
+                approach += contact.gB[i] * omegaB[i];
+            }
+            if (approach >= 0.0) {
+                continue;
+            }
+            if (contact.response == 0.0) {
+                std::copy(contact.gA, contact.gA + nA, contact.pushA);
+                std::copy(contact.gB, contact.gB + nB, contact.pushB);
+                applyInverseMass(scene, contact.chainA, contact.pushA);
+                if (!shared) {
+                    applyInverseMass(scene, contact.chainB, contact.pushB);
+                }
+                for (int i = 0; i < nA; ++i) {
+                    contact.response += contact.gA[i] * contact.pushA[i];
+                }
+                for (int i = 0; i < nB; ++i) {
+                    contact.response += contact.gB[i] * contact.pushB[i];
+                }
+            }
+            double impulse = -(1.0 + settings.restitution) * approach / contact.response;
+            for (int i = 0; i < nA; ++i) {
+                omegaA[i] += impulse * contact.pushA[i];
+            }
+            for (int i = 0; i < nB; ++i) {
+                omegaB[i] += impulse * contact.pushB[i];
+            }
+            ++result.impulses;
+            applied = true;
+        }
+        if (!applied) {
+            break;
+        }
+    }
+    if (stats) {
+        *stats = result;
+    }
+}
+
+int runCollideCommand(int argc, char** argv) {
+    CollisionSettings settings;
+    settings.radius = floatArgument(argc, argv, "--radius", PENDULUM_RADIUS);
+    settings.restitution = floatArgument(argc, argv, "--restitution", 1.0f);
+    settings.iterations = intArgument(argc, argv, "--iterations", 8);
+    int balls = intArgument(argc, argv, "--balls", 5);
+    int count = intArgument(argc, argv, "--chains", 50000);
+    int links = intArgument(argc, argv, "--links", 2);
+    int threads = intArgument(argc, argv, "--threads", 0);
+    double h = std::atof(stringArgument(argc, argv, "--dt", "0.001").c_str());
+    int steps = intArgument(argc, argv, "--steps", 200);
+    if (settings.radius <= 0.0 || settings.restitution < 0.0 || settings.iterations < 1 || balls < 1 || count < 1
+        || links < 1 || links > CHAIN_MAX_LINKS || threads < 0 || h <= 0.0 || steps < 1) {
+        std::cerr << "Invalid collision settings" << std::endl;
+        return -1;
+    }
+
+    // Newton's cradle: touching single pendulums, the first pulled back
+    {
+        ChainScene cradle;
+        ChainParameters chain;
+        chain.lengths.assign(1, INITIAL_LENGTH);
+        chain.masses.assign(1, INITIAL_MASS);
+        chain.g = G;
+        for (int k = 0; k < balls; ++k) {
+            double angle = k == 0 ? -0.5 : 0.0, rate = 0.0;
+            cradle.add(2.0 * settings.radius * k, 0.0, chain, &angle, &rate);
+        }
+        BobCollisions collisions(settings);
+        double start = 0.0;
+        for (int k = 0; k < balls; ++k) {
+            start += cradle.energy(k);
+        }
+        // one period of the small swing, so the blow goes along and back
+        double period = 2.0 * M_PI * std::sqrt(INITIAL_LENGTH / G);
+        std::vector<double> widest(balls, 0.0);
+        for (double t = 0.0; t < 0.75 * period; t += h) {
+            cradle.advance(h, 1);
+            collisions.resolve(cradle);
+            if (t > 0.3 * period) {
+                for (int k = 0; k < balls; ++k) {
+                    widest[k] = std::max(widest[k], std::fabs(cradle.theta[k]));
+                }
+            }
+        }
+        double end = 0.0;
+        for (int k = 0; k < balls; ++k) {
+            end += cradle.energy(k);
+        }
+        std::cout << "cradle of " << balls << ", first pulled to 0.5 rad; widest swings after the blow:";
+        for (double swing : widest) {
+            std::cout << " " << swing;
+        }
+        std::cout << "; energy " << start << " -> " << end << std::endl;
+    }
+
+    // a crowd: chains hung closer than their reach so they keep colliding
+    ChainScene crowd;
+    ChainParameters chain;
+    chain.lengths.assign(links, 6.0 * settings.radius / links);
+    chain.masses.assign(links, INITIAL_MASS);
+    chain.g = G;
+    int columns = (int)std::ceil(std::sqrt((double)count));
+    std::vector<double> angles(links), rates(links, 0.0);
+    for (int c = 0; c < count; ++c) {
+        for (int i = 0; i < links; ++i) {
+            angles[i] = std::sin(1.7 * c + 0.9 * i) * 2.5;
+        }
+        crowd.add(5.0 * settings.radius * (c % columns), 5.0 * settings.radius * (c / columns), chain, angles.data(), rates.data());
+    }
+    BobCollisions collisions(settings);
+    CollisionStats stats, total;
+    double stepping = 0.0, resolving = 0.0;
+    int rebuilds = 0;
+    for (int s = 0; s < steps; ++s) {
+        auto begin = std::chrono::steady_clock::now();
+        crowd.advance(h, threads);
+        auto middle = std::chrono::steady_clock::now();
+        collisions.resolve(crowd, &stats);
+        auto end = std::chrono::steady_clock::now();
+        stepping += std::chrono::duration<double>(middle - begin).count();
+        resolving += std::chrono::duration<double>(end - middle).count();
+        total.candidates += stats.candidates;
+        total.contacts += stats.contacts;
+        total.impulses += stats.impulses;
+        total.moved += stats.moved;
+        rebuilds += stats.rebuilt;
+    }
+    std::cout << crowd.links() << " bobs on " << count << " chains, " << steps << " steps: stepping " << stepping * 1e3 / steps
+        << " ms, collisions " << resolving * 1e3 / steps << " ms per step; per step " << (double)total.candidates / steps
+        << " candidate pairs (all pairs would be " << 0.5 * crowd.links() * (crowd.links() - 1.0) << "), "
+        << (double)total.contacts / steps << " contacts, " << (double)total.impulses / steps << " impulses, "
+        << (double)total.moved / steps << " bobs changing cell, " << rebuilds << " rebuilds of the order" << std::endl;
+    return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Chain.h"
+
+#include <vector>
+
+class ChainScene;
+
+struct CollisionSettings {
+    double radius = 0.04;       // of every bob
+    double restitution = 1.0;   // 1 is elastic, 0 perfectly inelastic
+    int iterations = 8;         // sweeps over the contacts per step
+};
+
+struct CollisionStats {
+    long long candidates = 0;   // pairs sharing neighbouring cells
+    long long contacts = 0;     // of them touching and approaching
+    long long impulses = 0;
+    long long moved = 0;        // bobs that changed cell
+    bool rebuilt = false;       // sorted from scratch instead
+};
+
+// Bob-to-bob collisions between the chains of a scene. The broad phase
+// hashes every bob into a uniform grid of cells one bob diameter wide and
+// keeps the bobs sorted by cell; bobs only change cell now and then, so
+// the order from the last step is repaired by merging in the bobs that
+// moved, and only rebuilt by counting sort when many have. Each bob then only
+// meets the bobs in the 3 x 3 cells around it, O(n) for any spread of
+// bobs that does not pile them up. Touching bobs that approach exchange
+// impulses along the line between them, applied to the chains' angular
+// rates through each chain's mass matrix, so the rods stay rigid; the
+// contacts are swept repeatedly (sequential impulses) so a row of
+// touching bobs passes a blow down the line as in Newton's cradle.
+class BobCollisions {
+public:
+    explicit BobCollisions(const CollisionSettings& settings = CollisionSettings());
+
+    // Updates the omegas of the scene; call after each step.
+    void resolve(ChainScene& scene, CollisionStats* stats = nullptr);
+
+private:
+    // The contact's approach speed is gA . omega of a's chain plus gB . omega
+    // of b's (gB is unused when both bobs share a chain); an impulse P adds
+    // P M^-1 g to each, with the products taken the first time it is needed.
+    struct Contact {
+        int chainA, chainB;
+        double gA[CHAIN_MAX_LINKS], gB[CHAIN_MAX_LINKS];
+        double pushA[CHAIN_MAX_LINKS], pushB[CHAIN_MAX_LINKS];
+        double response;            // g . M^-1 g, 0 until computed
+    };
+
+    void sortCells(CollisionStats& stats);
+    void addContact(const ChainScene& scene, int a, int b, double nx, double ny);
+    void normalRow(const ChainScene& scene, int bob, double nx, double ny, double sign, double* row) const;
+    void applyInverseMass(const ChainScene& scene, int chain, double* vector) const;
+
+    CollisionSettings settings;
+    std::vector<double> x, y, sortedX, sortedY, sines, cosines;
+    std::vector<unsigned int> cells, previousCells, order, starts, ranges, movers, staying;
+    std::vector<Contact> contacts;
+};
+
+int runCollideCommand(int argc, char** argv);
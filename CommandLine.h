@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+inline bool hasArgument(int argc, char** argv, const char* name) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline const char* findArgument(int argc, char** argv, const char* name) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::strcmp(argv[i], name) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return nullptr;
+}
+
+inline std::string stringArgument(int argc, char** argv, const char* name, const std::string& fallback) {
+    const char* value = findArgument(argc, argv, name);
+    return value ? std::string(value) : fallback;
+}
+
+inline int intArgument(int argc, char** argv, const char* name, int fallback) {
+    const char* value = findArgument(argc, argv, name);
+    return value ? std::atoi(value) : fallback;
+}
+
+inline float floatArgument(int argc, char** argv, const char* name, float fallback) {
+    const char* value = findArgument(argc, argv, name);
+    return value ? (float)std::atof(value) : fallback;
+}
+
+// A single value, a comma list or start:stop:count; fallback when absent.
+inline std::vector<double> parseValues(const char* text, double fallback) {
+    std::vector<double> values;
+    if (!text) {
+        values.push_back(fallback);
+        return values;
+    }
+    std::string spec(text);
+    double start, stop;
+    int count;
+    if (std::sscanf(spec.c_str(), "%lf:%lf:%d", &start, &stop, &count) == 3 && count > 0) {
+        for (int i = 0; i < count; ++i) {
+            values.push_back(count == 1 ? start : start + (stop - start) * i / (count - 1));
+        }
+        return values;
+    }
+    std::stringstream stream(spec);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(std::atof(item.c_str()));
+        }
+    }
+    return values;
+}
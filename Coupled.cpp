@@ -0,0 +1,368 @@
+#include "Coupled.h"
+#include "Barrier.h"
+#include "CommandLine.h"
+#include "Physics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+int CoupledArray::add(double length, double mass, double angle, double rate) {
+    lengths.push_back(length);
+    masses.push_back(mass);
+    thetas.push_back(angle);
+    omegas.push_back(rate);
+    parts.clear();
+    return size() - 1;
+}
+
+void CoupledArray::couple(int a, int b, double stiffness) {
+    edges.push_back({ a, b, stiffness });
+    parts.clear();
+}
+
+void CoupledArray::partition(int count) {
+    // pull the state back out of any earlier domains
+    for (const Domain& part : parts) {
+        std::copy(part.theta.begin(), part.theta.end(), thetas.begin() + part.begin);
+        std::copy(part.omega.begin(), part.omega.end(), omegas.begin() + part.begin);
+    }
+    const int n = size();
+    count = std::max(std::min(count, n), 1);
+
+    // the springs from both ends, row by row
+    std::vector<int> rowStarts(n + 1, 0);
+    for (const Edge& edge : edges) {
+        ++rowStarts[edge.a + 1];
+        ++rowStarts[edge.b + 1];
+    }
+    for (int i = 0; i < n; ++i) {
+        rowStarts[i + 1] += rowStarts[i];
+    }
+    std::vector<int> columns(rowStarts[n]), fill(rowStarts.begin(), rowStarts.end() - 1);
+    std::vector<double> stiffness(rowStarts[n]);
+    for (const Edge& edge : edges) {
+        columns[fill[edge.a]] = edge.b;
+        stiffness[fill[edge.a]++] = edge.stiffness;
+        columns[fill[edge.b]] = edge.a;
+        stiffness[fill[edge.b]++] = edge.stiffness;
+    }
+
+    std::vector<int> begins(count + 1);
+    for (int d = 0; d <= count; ++d) {
+        begins[d] = (int)((long long)n * d / count);
+    }
+    parts.assign(count, Domain());
+    for (int d = 0; d < count; ++d) {
+        Domain& part = parts[d];
+        part.begin = begins[d];
+        part.end = begins[d + 1];
+        const int local = part.end - part.begin;
+        part.theta.assign(thetas.begin() + part.begin, thetas.begin() + part.end);
+        part.omega.assign(omegas.begin() + part.begin, omegas.begin() + part.end);
+        part.length.assign(lengths.begin() + part.begin, lengths.begin() + part.end);
+        part.mass.assign(masses.begin() + part.begin, masses.begin() + part.end);
+        part.torque.assign(local, 0.0);
+        part.inverseLength.resize(local);
+        part.inverseMassLength.resize(local);
+        for (int i = 0; i < local; ++i) {
+            part.inverseLength[i] = 1.0 / part.length[i];
+            part.inverseMassLength[i] = 1.0 / (part.mass[i] * part.length[i]);
+        }
+        part.rowStarts.assign(1, 0);
+        part.rowStiffness.assign(local, 0.0);
+
+        std::unordered_map<int, int> halo;
+        for (int i = part.begin; i < part.end; ++i) {
+            for (int k = rowStarts[i]; k < rowStarts[i + 1]; ++k) {
+                int j = columns[k];
+                int column;
+                if (j >= part.begin && j < part.end) {
+                    column = j - part.begin;
+                }
+                else {
+                    auto found = halo.find(j);
+                    if (found == halo.end()) {
+                        int owner = (int)(std::upper_bound(begins.begin(), begins.end(), j) - begins.begin()) - 1;
+                        found = halo.emplace(j, local + (int)part.haloDomain.size()).first;
+                        part.haloDomain.push_back(owner);
+                        part.haloIndex.push_back(j - begins[owner]);
+                    }
+                    column = found->second;
+                }
+                part.columns.push_back(column);
+                part.stiffness.push_back(stiffness[k]);
+                part.rowStiffness[i - part.begin] += stiffness[k];
+            }
+            part.rowStarts.push_back((int)part.columns.size());
+        }
+        for (int b = 0; b < 2; ++b) {
+            part.bob[b].assign(2 * (local + part.haloDomain.size()), 0.0);
+            part.inertia[b] = part.reaction[b] = 0.0;
+        }
+    }
+}
+
+long long CoupledArray::haloSize() const {
+    long long total = 0;
+    for (const Domain& part : parts) {
+        total += (long long)part.haloDomain.size();
+    }
+    return total;
+}
+
+void CoupledArray::displace(Domain& part, int buffer) {
+    double* bob = part.bob[buffer].data();
+    for (size_t i = 0; i < part.theta.size(); ++i) {
+        bob[2 * i] = part.length[i] * std::sin(part.theta[i]);
+        bob[2 * i + 1] = -part.length[i] * std::cos(part.theta[i]);
+    }
+}
+
+// The spring force on bob i, sum k (d_j - d_i), projected on its swing direction (cos, sin).
+static inline double springTorque(const double* bob, const int* columns, const double* stiffness, int first, int last,
+    double rowStiffness, double s, double c, int i) {
+    double fx = -rowStiffness * bob[2 * i], fy = -rowStiffness * bob[2 * i + 1];
+    for (int k = first; k < last; ++k) {
+        fx += stiffness[k] * bob[2 * columns[k]];
+        fy += stiffness[k] * bob[2 * columns[k] + 1];
+    }
+    return fx * c + fy * s;
+}
+
+// F . n for every pendulum and the domain's share of the beam equation
+//   (M + sum m sin^2) X'' = -k X - c X' + sum (m L w^2 s + (m g s - F.n + gamma m L w) c)
+void CoupledArray::beamShare(Domain& part, int buffer) {
+    const double* bob = part.bob[buffer].data();
+    double inertia = 0.0, reaction = 0.0;
+    for (int i = 0; i < (int)part.theta.size(); ++i) {
+        double s = bob[2 * i] * part.inverseLength[i], c = -bob[2 * i + 1] * part.inverseLength[i];
+        double m = part.mass[i], L = part.length[i], w = part.omega[i];
+        part.torque[i] = springTorque(bob, part.columns.data(), part.stiffness.data(), part.rowStarts[i], part.rowStarts[i + 1],
+            part.rowStiffness[i], s, c, i);
+        inertia += m * s * s;
+        reaction += m * L * w * w * s + (m * g * s - part.torque[i] + damping * m * L * w) * c;
+    }
+    part.inertia[buffer] = inertia;
+    part.reaction[buffer] = reaction;
+}
+
+void CoupledArray::stepDomain(Domain& part, int buffer, double h, double accel) {
+    const double* bob = part.bob[buffer].data();
+    const bool moving = beam.mass > 0.0;
+    for (int i = 0; i < (int)part.theta.size(); ++i) {
+        double s = bob[2 * i] * part.inverseLength[i], c = -bob[2 * i + 1] * part.inverseLength[i];
+        double torque = moving ? part.torque[i] : springTorque(bob, part.columns.data(), part.stiffness.data(),
+            part.rowStarts[i], part.rowStarts[i + 1], part.rowStiffness[i], s, c, i);
+        double alpha = torque * part.inverseMassLength[i] - (accel * c + g * s) * part.inverseLength[i] - damping * part.omega[i];
+        part.omega[i] += alpha * h;
+        part.theta[i] += part.omega[i] * h;
+    }
+}
+
+void CoupledArray::run(int index, double h, long long steps, long long firstStep, Barrier& barrier) {
+    Domain& part = parts[index];
+    const bool moving = beam.mass > 0.0;
+    // every thread keeps the same copy of the beam, summing the shares in the same order
+    double position = beamX, velocity = beamV;
+    for (long long step = 0; step < steps; ++step) {
+        const int buffer = (int)((firstStep + step) & 1);
+        displace(part, buffer);
+        barrier.wait();
+        double* halo = part.bob[buffer].data() + 2 * part.theta.size();
+        for (size_t k = 0; k < part.haloDomain.size(); ++k) {
+            const double* source = parts[part.haloDomain[k]].bob[buffer].data() + 2 * part.haloIndex[k];
+            halo[2 * k] = source[0];
+            halo[2 * k + 1] = source[1];
+        }
+        double accel = 0.0;
+        if (moving) {
+            beamShare(part, buffer);
+            barrier.wait();
+            double inertia = beam.mass, reaction = -beam.stiffness * position - beam.damping * velocity;
+            for (const Domain& other : parts) {
+                inertia += other.inertia[buffer];
+                reaction += other.reaction[buffer];
+            }
+            accel = reaction / inertia;
+            velocity += accel * h;
+            position += velocity * h;
+        }
+        stepDomain(part, buffer, h, accel);
+    }
+    if (index == 0) {
+        beamX = position;
+        beamV = velocity;
+    }
+}
+
+void CoupledArray::advance(double h, long long steps) {
+    if (parts.empty()) {
+        partition(1);
+    }
+    Barrier barrier(domains());
+    std::vector<std::thread> workers;
+    for (int d = 1; d < domains(); ++d) {
+        workers.emplace_back(&CoupledArray::run, this, d, h, steps, stepCount, std::ref(barrier));
+    }
+    run(0, h, steps, stepCount, barrier);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    stepCount += steps;
+}
+
+double CoupledArray::theta(int element) const {
+    for (const Domain& part : parts) {
+        if (element < part.end) {
+            return part.theta[element - part.begin];
+        }
+    }
+    return thetas[element];
+}
+
+double CoupledArray::omega(int element) const {
+    for (const Domain& part : parts) {
+        if (element < part.end) {
+            return part.omega[element - part.begin];
+        }
+    }
+    return omegas[element];
+}
+
+double CoupledArray::energy() const {
+    std::vector<double> x(size()), y(size());
+    double energy = 0.5 * beam.mass * beamV * beamV + 0.5 * beam.stiffness * beamX * beamX;
+    int i = 0;
+    auto visit = [&](double angle, double rate) {
+        double s = std::sin(angle), c = std::cos(angle), L = lengths[i];
+        double vx = (beam.mass > 0.0 ? beamV : 0.0) + L * rate * c, vy = L * rate * s;
+        x[i] = L * s;
+        y[i] = -L * c;
+        energy += masses[i] * (0.5 * (vx * vx + vy * vy) + g * y[i]);
+        ++i;
+    };
+    if (parts.empty()) {
+        for (int k = 0; k < size(); ++k) {
+            visit(thetas[k], omegas[k]);
+        }
+    }
+    for (const Domain& part : parts) {
+        for (size_t k = 0; k < part.theta.size(); ++k) {
+            visit(part.theta[k], part.omega[k]);
+        }
+    }
+    for (const Edge& edge : edges) {
+        double dx = x[edge.a] - x[edge.b], dy = y[edge.a] - y[edge.b];
+        energy += 0.5 * edge.stiffness * (dx * dx + dy * dy);
+    }
+    return energy;
+}
+
+double CoupledArray::synchrony() const {
+    double sumCos = 0.0, sumSin = 0.0;
+    for (int i = 0; i < size(); ++i) {
+        double phase = std::atan2(-omega(i) / std::sqrt(g / lengths[i]), theta(i));
+        sumCos += std::cos(phase);
+        sumSin += std::sin(phase);
+    }
+    return std::sqrt(sumCos * sumCos + sumSin * sumSin) / size();
+}
+
+// A width x height lattice, each pendulum tied to its right and lower neighbours.
+static void buildLattice(CoupledArray& array, int width, int height, double stiffness, double amplitude, int seed) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> phases(-M_PI, M_PI);
+    std::uniform_real_distribution<double> lengths(0.95, 1.05);
+    for (int i = 0; i < width * height; ++i) {
+        double L = INITIAL_LENGTH * lengths(random);
+        double phase = phases(random);
+        array.add(L, INITIAL_MASS, amplitude * std::cos(phase), -amplitude * std::sqrt(G / L) * std::sin(phase));
+    }
+    for (int row = 0; row < height; ++row) {
+        for (int column = 0; column < width; ++column) {
+            int i = row * width + column;
+            if (column + 1 < width) {
+                array.couple(i, i + 1, stiffness);
+            }
+            if (row + 1 < height) {
+                array.couple(i, i + width, stiffness);
+            }
+        }
+    }
+}
+
+int runCoupledCommand(int argc, char** argv) {
+    int width = intArgument(argc, argv, "--width", 1000);
+    int height = intArgument(argc, argv, "--height", 1000);
+    double stiffness = floatArgument(argc, argv, "--stiffness", 2.0f);
+    double damping = floatArgument(argc, argv, "--damping", 0.0f);
+    double amplitude = floatArgument(argc, argv, "--amplitude", 0.3f);
+    CoupledBeam beam;
+    beam.mass = floatArgument(argc, argv, "--beam-mass", 0.0f);
+    beam.stiffness = floatArgument(argc, argv, "--beam-stiffness", 1000.0f);
+    beam.damping = floatArgument(argc, argv, "--beam-damping", 0.0f);
+    double duration = floatArgument(argc, argv, "--time", 1.0f);
+    double h = std::atof(stringArgument(argc, argv, "--dt", "0.01").c_str());
+    int threads = intArgument(argc, argv, "--threads", 0);
+    int seed = intArgument(argc, argv, "--seed", 1);
+    if (width < 1 || height < 1 || stiffness < 0.0 || damping < 0.0 || beam.mass < 0.0 || duration <= 0.0 || h <= 0.0 || threads < 0) {
+        std::cerr << "Invalid coupled array settings" << std::endl;
+        return -1;
+    }
+    int domains = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    domains = std::max(domains, 1);
+
+    long long steps = std::max((long long)(duration / h + 0.5), 1LL);
+
+    // the domains must not change the answer; a wrong halo shows in the
+    // first step, so a few steps of the requested lattice are enough
+    {
+        const long long checkSteps = std::min(steps, 10LL);
+        CoupledArray one, many;
+        for (CoupledArray* array : { &one, &many }) {
+            buildLattice(*array, width, height, stiffness, amplitude, seed);
+            array->setDamping(damping);
+            array->setBeam(beam);
+            array->setGravity(G);
+        }
+        one.partition(1);
+        many.partition(std::max(domains, 4));
+        one.advance(h, checkSteps);
+        many.advance(h, checkSteps);
+        double difference = 0.0;
+        for (int i = 0; i < one.size(); ++i) {
+            difference = std::max(difference, std::fabs(one.theta(i) - many.theta(i)));
+        }
+        std::cout << width << " x " << height << " in 1 and " << many.domains() << " domains for " << checkSteps
+            << " steps: angles differ by " << difference << std::endl;
+    }
+
+    CoupledArray array;
+    buildLattice(array, width, height, stiffness, amplitude, seed);
+    array.setDamping(damping);
+    array.setBeam(beam);
+    array.setGravity(G);
+    array.partition(domains);
+    double startEnergy = array.energy(), startSynchrony = array.synchrony();
+
+    auto begin = std::chrono::steady_clock::now();
+    array.advance(h, steps);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << array.size() << " pendulums, " << array.springs() << " springs, " << array.domains() << " domains with "
+        << array.haloSize() << " halo slots: " << steps << " steps of " << h << " in " << seconds << " s, "
+        << seconds * 1e9 / ((double)steps * array.size()) << " ns per pendulum and step, " << steps * h / seconds
+        << " x real time" << std::endl;
+    std::cout << "energy " << startEnergy << " -> " << array.energy() << ", synchrony " << startSynchrony << " -> "
+        << array.synchrony();
+    if (beam.mass > 0.0) {
+        std::cout << ", beam at " << array.beamPosition();
+    }
+    std::cout << std::endl;
+    return 0;
+}
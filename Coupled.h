@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+class Barrier;
+
+// Huygens' beam: a horizontal beam on a spring that every pendulum hangs from.
+struct CoupledBeam {
+    double mass = 0.0;          // 0 leaves the pivots fixed
+    double stiffness = 0.0;
+    double damping = 0.0;
+};
+
+// Arrays of single pendulums whose bobs are tied to their neighbours by
+// springs, for synchronization studies. Each spring pulls on the
+// difference of the two bobs' displacements from their own pivots, so the
+// array rests with every pendulum hanging straight. The springs are a
+// sparse graph stored row by row (CSR), and the pendulums optionally hang
+// from one shared beam.
+//
+// partition() splits the array into domains of consecutive pendulums,
+// each stepped by its own thread with symplectic Euler. A domain keeps
+// the couplings of its rows with columns renumbered to its own
+// pendulums, followed by halo slots for the pendulums of other domains it
+// touches. Every step, each thread writes its bob displacements, waits at
+// a barrier, copies its halo from the owning domains and steps its own
+// pendulums. Displacements are double-buffered by step, so one barrier per
+// step suffices; the beam adds a second one to sum its reaction over all
+// domains.
+class CoupledArray {
+public:
+    int add(double length, double mass, double theta, double omega);
+    // A spring of `stiffness` (N/m) between the bobs of pendulums a and b.
+    void couple(int a, int b, double stiffness);
+    void setDamping(double rate) { damping = rate; }     // 1/s, on every pendulum's swing
+    void setBeam(const CoupledBeam& settings) { beam = settings; }
+    void setGravity(double value) { g = value; }
+
+    int size() const { return (int)lengths.size(); }
+    long long springs() const { return (long long)edges.size(); }
+
+    // Builds the domains; state set by add() moves into them.
+    void partition(int domains);
+    int domains() const { return (int)parts.size(); }
+    long long haloSize() const;
+
+    void advance(double h, long long steps);
+
+    double theta(int element) const;
+    double omega(int element) const;
+    double beamPosition() const { return beamX; }
+    double energy() const;
+    // Kuramoto order parameter of the phases atan2(-omega / omega0, theta):
+    // 1 when all swing in step, near 0 when spread out.
+    double synchrony() const;
+
+private:
+    struct Edge {
+        int a, b;
+        double stiffness;
+    };
+
+    struct Domain {
+        int begin, end;
+        std::vector<double> theta, omega, length, mass, torque;
+        std::vector<double> inverseLength, inverseMassLength;
+        std::vector<double> bob[2];             // x, y pairs: own displacements, then the halo
+        std::vector<int> rowStarts, columns;
+        std::vector<double> stiffness, rowStiffness;
+        std::vector<int> haloDomain, haloIndex;
+        double inertia[2], reaction[2];         // this domain's share of the beam sums
+    };
+
+    void run(int domain, double h, long long steps, long long firstStep, Barrier& barrier);
+    void displace(Domain& domain, int buffer);
+    void stepDomain(Domain& domain, int buffer, double h, double beamAccel);
+    void beamShare(Domain& domain, int buffer);
+
+    std::vector<double> lengths, masses, thetas, omegas;
+    std::vector<Edge> edges;
+    std::vector<Domain> parts;
+    double damping = 0.0;
+    double g = 9.81;
+    CoupledBeam beam;
+    double beamX = 0.0, beamV = 0.0;
+    long long stepCount = 0;
+};
+
+int runCoupledCommand(int argc, char** argv);
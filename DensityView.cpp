@@ -0,0 +1,189 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "DensityView.h"
+#include "Histogram.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+const int DENSITY_BINS = 512;
+const int DENSITY_MEMBERS = 4096;
+const int DENSITY_MERGE_EVERY = 100;
+const double DENSITY_OMEGA_MAX = 15.0;
+const int DENSITY_PROJECTIONS = 4;
+const HistogramQuantity DENSITY_AXES[DENSITY_PROJECTIONS][2] = {
+    { HISTOGRAM_THETA1, HISTOGRAM_THETA2 },
+    { HISTOGRAM_THETA1, HISTOGRAM_OMEGA1 },
+    { HISTOGRAM_THETA2, HISTOGRAM_OMEGA2 },
+    { HISTOGRAM_BOB2_X, HISTOGRAM_BOB2_Y },
+};
+
+const char* densityVertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in vec2 aPos;
+layout(location = 1) in vec2 aUV;
+out vec2 uv;
+void main()
+{
+    uv = aUV;
+    gl_Position = vec4(aPos, 0.0, 1.0);
+}
+)";
+
+const char* densityFragmentShaderSource = R"(
+#version 330 core
+in vec2 uv;
+out vec4 FragColor;
+uniform sampler2D density;
+void main()
+{
+    FragColor = texture(density, uv);
+}
+)";
+
+static bool densityEnabled = false;
+static int projection = 0;
+static std::unique_ptr<HistogramEnsemble> ensemble;
+static std::vector<unsigned long long> counts;
+static std::vector<unsigned char> pixels;
+static long long version = 0;
+static unsigned int densityShader = 0, densityVAO = 0, densityVBO = 0, densityTexture = 0;
+
+static unsigned int compileDensityShader() {
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &densityVertexShaderSource, nullptr);
+    glCompileShader(vertexShader);
+
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &densityFragmentShaderSource, nullptr);
+    glCompileShader(fragmentShader);
+
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    return program;
+}
+
+static void startEnsemble() {
+    HistogramSettings settings;
+    settings.L1 = INITIAL_LENGTH;
+    settings.L2 = INITIAL_LENGTH;
+    settings.M1 = INITIAL_MASS;
+    settings.M2 = INITIAL_MASS;
+    settings.g = G;
+    settings.members = DENSITY_MEMBERS;
+    settings.mergeEvery = DENSITY_MERGE_EVERY;
+    settings.threads = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+    for (int i = 0; i < 2; ++i) {
+        HistogramAxis axis;
+        axis.quantity = DENSITY_AXES[projection][i];
+        axis.bins = DENSITY_BINS;
+        defaultHistogramRange(axis, DENSITY_OMEGA_MAX, settings.L1 + settings.L2);
+        settings.axes.push_back(axis);
+    }
+
+    ensemble.reset();
+    ensemble.reset(new HistogramEnsemble(settings));
+    version = 0;
+
+    // start from black rather than the last projection's picture
+    std::fill(pixels.begin(), pixels.end(), 0);
+    glBindTexture(GL_TEXTURE_2D, densityTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, DENSITY_BINS, DENSITY_BINS, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void initDensityView(int width, int height) {
+    (void)width;
+    (void)height;
+    densityShader = compileDensityShader();
+
+    // one full-screen quad; histogram row 0 is the y axis minimum and the
+    // first texture row, so v runs up the screen unflipped
+    float quad[16] = {
+        -1.0f, -1.0f, 0.0f, 0.0f,
+        1.0f, -1.0f, 1.0f, 0.0f,
+        1.0f, 1.0f, 1.0f, 1.0f,
+        -1.0f, 1.0f, 0.0f, 1.0f,
+    };
+    glGenVertexArrays(1, &densityVAO);
+    glGenBuffers(1, &densityVBO);
+    glBindVertexArray(densityVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, densityVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    pixels.assign((size_t)DENSITY_BINS * DENSITY_BINS * 3, 0);
+    glGenTextures(1, &densityTexture);
+    glBindTexture(GL_TEXTURE_2D, densityTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void shutdownDensityView() {
+    ensemble.reset();
+    glDeleteTextures(1, &densityTexture);
+    glDeleteVertexArrays(1, &densityVAO);
+    glDeleteBuffers(1, &densityVBO);
+    glDeleteProgram(densityShader);
+}
+
+bool densityViewActive() {
+    return densityEnabled;
+}
+
+void toggleDensityView() {
+    densityEnabled = !densityEnabled;
+    if (densityEnabled) {
+        startEnsemble();
+    }
+    else {
+        // give the cores back to the pendulum view
+        ensemble.reset();
+    }
+}
+
+void nextDensityProjection() {
+    projection = (projection + 1) % DENSITY_PROJECTIONS;
+    if (densityEnabled) {
+        startEnsemble();
+    }
+}
+
+void renderDensityView() {
+    if (ensemble && ensemble->snapshot(counts, version)) {
+        unsigned long long peak = counts.empty() ? 0 : *std::max_element(counts.begin(), counts.end());
+        for (size_t i = 0; i < counts.size(); ++i) {
+            densityColor(counts[i], peak, &pixels[i * 3]);
+        }
+        glBindTexture(GL_TEXTURE_2D, densityTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DENSITY_BINS, DENSITY_BINS, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUseProgram(densityShader);
+    glUniform1i(glGetUniformLocation(densityShader, "density"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, densityTexture);
+    glBindVertexArray(densityVAO);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
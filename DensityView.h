@@ -0,0 +1,13 @@
+#pragma once
+
+// Live view of a phase-space density histogram. While shown, an ensemble
+// runs on every core but the UI thread and each new reduction is uploaded
+// as a log-scaled texture.
+void initDensityView(int width, int height);
+void shutdownDensityView();
+
+bool densityViewActive();
+void toggleDensityView();
+void nextDensityProjection();
+
+void renderDensityView();
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cmath>
+
+// Forward-mode dual number carrying N directional derivatives. Running the
+// scalar-templated equations of motion on Dual values propagates tangent
+// vectors through them exactly.
+template<typename T, int N>
+struct Dual {
+    T v;
+    T d[N];
+
+    Dual() : v(T(0)) {
+        for (int i = 0; i < N; ++i) d[i] = T(0);
+    }
+    Dual(T value) : v(value) {
+        for (int i = 0; i < N; ++i) d[i] = T(0);
+    }
+
+    static Dual variable(T value, int index) {
+        Dual x(value);
+        x.d[index] = T(1);
+        return x;
+    }
+
+    Dual& operator+=(const Dual& b) { v += b.v; for (int i = 0; i < N; ++i) d[i] += b.d[i]; return *this; }
+    Dual& operator-=(const Dual& b) { v -= b.v; for (int i = 0; i < N; ++i) d[i] -= b.d[i]; return *this; }
+    Dual& operator*=(const Dual& b) { *this = *this * b; return *this; }
+    Dual& operator/=(const Dual& b) { *this = *this / b; return *this; }
+};
+
+template<typename T, int N>
+inline Dual<T, N> operator-(const Dual<T, N>& a) {
+    Dual<T, N> r;
+    r.v = -a.v;
+    for (int i = 0; i < N; ++i) r.d[i] = -a.d[i];
+    return r;
+}
+
+template<typename T, int N>
+inline Dual<T, N> operator+(const Dual<T, N>& a, const Dual<T, N>& b) {
+    Dual<T, N> r;
+    r.v = a.v + b.v;
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] + b.d[i];
+    return r;
+}
+
+template<typename T, int N>
+inline Dual<T, N> operator-(const Dual<T, N>& a, const Dual<T, N>& b) {
+    Dual<T, N> r;
+    r.v = a.v - b.v;
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] - b.d[i];
+    return r;
+}
+
+template<typename T, int N>
+inline Dual<T, N> operator*(const Dual<T, N>& a, const Dual<T, N>& b) {
+    Dual<T, N> r;
+    r.v = a.v * b.v;
+    for (int i = 0; i < N; ++i) r.d[i] = a.d[i] * b.v + a.v * b.d[i];
+    return r;
+}
+
+template<typename T, int N>
+inline Dual<T, N> operator/(const Dual<T, N>& a, const Dual<T, N>& b) {
+    Dual<T, N> r;
+    T inverse = T(1) / b.v;
+    r.v = a.v * inverse;
+    for (int i = 0; i < N; ++i) r.d[i] = (a.d[i] - r.v * b.d[i]) * inverse;
+    return r;
+}
+
+template<typename T, int N> inline Dual<T, N> operator+(const Dual<T, N>& a, T b) { return a + Dual<T, N>(b); }
+template<typename T, int N> inline Dual<T, N> operator+(T a, const Dual<T, N>& b) { return Dual<T, N>(a) + b; }
+template<typename T, int N> inline Dual<T, N> operator-(const Dual<T, N>& a, T b) { return a - Dual<T, N>(b); }
+template<typename T, int N> inline Dual<T, N> operator-(T a, const Dual<T, N>& b) { return Dual<T, N>(a) - b; }
+template<typename T, int N> inline Dual<T, N> operator*(const Dual<T, N>& a, T b) { return a * Dual<T, N>(b); }
+template<typename T, int N> inline Dual<T, N> operator*(T a, const Dual<T, N>& b) { return Dual<T, N>(a) * b; }
+template<typename T, int N> inline Dual<T, N> operator/(const Dual<T, N>& a, T b) { return a / Dual<T, N>(b); }
+template<typename T, int N> inline Dual<T, N> operator/(T a, const Dual<T, N>& b) { return Dual<T, N>(a) / b; }
+
+template<typename T, int N> inline bool operator<(const Dual<T, N>& a, const Dual<T, N>& b) { return a.v < b.v; }
+template<typename T, int N> inline bool operator>(const Dual<T, N>& a, const Dual<T, N>& b) { return a.v > b.v; }
+
+template<typename T, int N>
+inline Dual<T, N> sin(const Dual<T, N>& a) {
+    Dual<T, N> r;
+    r.v = std::sin(a.v);
+    T slope = std::cos(a.v);
+    for (int i = 0; i < N; ++i) r.d[i] = slope * a.d[i];
+    return r;
+}
+
+template<typename T, int N>
+inline Dual<T, N> cos(const Dual<T, N>& a) {
+    Dual<T, N> r;
+    r.v = std::cos(a.v);
+    T slope = -std::sin(a.v);
+    for (int i = 0; i < N; ++i) r.d[i] = slope * a.d[i];
+    return r;
+}
+
+template<typename T, int N>
+inline Dual<T, N> sqrt(const Dual<T, N>& a) {
+    Dual<T, N> r;
+    r.v = std::sqrt(a.v);
+    T slope = r.v > T(0) ? T(0.5) / r.v : T(0);
+    for (int i = 0; i < N; ++i) r.d[i] = slope * a.d[i];
+    return r;
+}
+
+template<typename T, int N>
+inline T value(const Dual<T, N>& a) {
+    return a.v;
+}
+
+inline double value(double a) {
+    return a;
+}
+
+inline float value(float a) {
+    return a;
+}
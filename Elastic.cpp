@@ -0,0 +1,373 @@
+#include "Elastic.h"
+#include "Chain.h"
+#include "CommandLine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+const int ELASTIC_BANDWIDTH = 3;        // a link couples the x, y of its two ends
+
+void elasticToCartesian(const ElasticParameters& parameters, const double* state, double* position, double* velocity) {
+    const int n = parameters.links();
+    double x = 0.0, y = 0.0, vx = 0.0, vy = 0.0;
+    for (int i = 0; i < n; ++i) {
+        double s = std::sin(state[i]), c = std::cos(state[i]);
+        double r = state[n + i], omega = state[2 * n + i], rdot = state[3 * n + i];
+        x += r * s;
+        y -= r * c;
+        vx += rdot * s + r * omega * c;
+        vy += -rdot * c + r * omega * s;
+        position[2 * i] = x;
+        position[2 * i + 1] = y;
+        velocity[2 * i] = vx;
+        velocity[2 * i + 1] = vy;
+    }
+}
+
+void elasticFromCartesian(const ElasticParameters& parameters, const double* position, const double* velocity, double* state) {
+    const int n = parameters.links();
+    double x = 0.0, y = 0.0, vx = 0.0, vy = 0.0;
+    for (int i = 0; i < n; ++i) {
+        double dx = position[2 * i] - x, dy = position[2 * i + 1] - y;
+        double dvx = velocity[2 * i] - vx, dvy = velocity[2 * i + 1] - vy;
+        double r = std::sqrt(dx * dx + dy * dy);
+        double angle = std::atan2(dx, -dy);
+        double s = dx / r, c = -dy / r;
+        state[i] += std::remainder(angle - state[i], 2.0 * M_PI);
+        state[n + i] = r;
+        state[2 * n + i] = (dvx * c + dvy * s) / r;
+        state[3 * n + i] = dvx * s - dvy * c;
+        x = position[2 * i];
+        y = position[2 * i + 1];
+        vx = velocity[2 * i];
+        vy = velocity[2 * i + 1];
+    }
+}
+
+double elasticEnergy(const ElasticParameters& parameters, const double* state) {
+    const int n = parameters.links();
+    std::vector<double> position(2 * n), velocity(2 * n);
+    elasticToCartesian(parameters, state, position.data(), velocity.data());
+    double energy = 0.0;
+    for (int i = 0; i < n; ++i) {
+        double m = parameters.chain.masses[i];
+        double stretch = state[n + i] - parameters.chain.lengths[i];
+        energy += 0.5 * m * (velocity[2 * i] * velocity[2 * i] + velocity[2 * i + 1] * velocity[2 * i + 1]);
+        energy += m * parameters.chain.g * position[2 * i + 1];
+        energy += 0.5 * parameters.stiffness[i] * stretch * stretch;
+    }
+    return energy;
+}
+
+// Gravity, spring and damping forces on each mass, each link pulling along
+// `direction` (unit vectors) if given instead of along itself.
+static void elasticForces(const ElasticParameters& parameters, const double* position, const double* velocity, double* force,
+    const double* direction = nullptr) {
+    const int n = parameters.links();
+    for (int i = 0; i < n; ++i) {
+        force[2 * i] = 0.0;
+        force[2 * i + 1] = -parameters.chain.masses[i] * parameters.chain.g;
+    }
+    for (int i = 0; i < n; ++i) {
+        double dx = position[2 * i] - (i > 0 ? position[2 * i - 2] : 0.0);
+        double dy = position[2 * i + 1] - (i > 0 ? position[2 * i - 1] : 0.0);
+        double dvx = velocity[2 * i] - (i > 0 ? velocity[2 * i - 2] : 0.0);
+        double dvy = velocity[2 * i + 1] - (i > 0 ? velocity[2 * i - 1] : 0.0);
+        double length = std::sqrt(dx * dx + dy * dy);
+        double ux = direction ? direction[2 * i] : dx / length;
+        double uy = direction ? direction[2 * i + 1] : dy / length;
+        double tension = parameters.stiffness[i] * (length - parameters.chain.lengths[i])
+            + parameters.damping[i] * (ux * dvx + uy * dvy);
+        force[2 * i] -= tension * ux;
+        force[2 * i + 1] -= tension * uy;
+        if (i > 0) {
+            force[2 * i - 2] += tension * ux;
+            force[2 * i - 1] += tension * uy;
+        }
+    }
+}
+
+// Lower band of a symmetric matrix, row i holding columns i - w..i at
+// band[i * (w + 1) + (i - j)]; factored in place into L with A = L L^T.
+static bool choleskyBanded(int m, int w, double* band) {
+    for (int i = 0; i < m; ++i) {
+        for (int j = std::max(0, i - w); j <= i; ++j) {
+            double sum = band[i * (w + 1) + (i - j)];
+            for (int k = std::max(0, i - w); k < j; ++k) {
+                sum -= band[i * (w + 1) + (i - k)] * band[j * (w + 1) + (j - k)];
+            }
+            if (i == j) {
+                if (sum <= 0.0) {
+                    return false;
+                }
+                band[i * (w + 1)] = std::sqrt(sum);
+            }
+            else {
+                band[i * (w + 1) + (i - j)] = sum / band[j * (w + 1)];
+            }
+        }
+    }
+    return true;
+}
+
+static void solveCholeskyBanded(int m, int w, const double* band, double* x) {
+    for (int i = 0; i < m; ++i) {
+        for (int k = std::max(0, i - w); k < i; ++k) {
+            x[i] -= band[i * (w + 1) + (i - k)] * x[k];
+        }
+        x[i] /= band[i * (w + 1)];
+    }
+    for (int i = m - 1; i >= 0; --i) {
+        for (int k = i + 1; k <= std::min(m - 1, i + w); ++k) {
+            x[i] -= band[k * (w + 1) + (k - i)] * x[k];
+        }
+        x[i] /= band[i * (w + 1)];
+    }
+}
+
+ElasticStepper::ElasticStepper(const ElasticParameters& parameters, const ElasticSettings& settings)
+    : parameters(parameters), settings(settings) {
+    const int m = 2 * parameters.links();
+    position.resize(m);
+    velocity.resize(m);
+    force.resize(m);
+    probe.resize(m);
+    knownPosition.resize(m);
+    knownVelocity.resize(m);
+    stageVelocity.resize(m);
+    residual.resize(m);
+    direction.resize(m);
+    for (int s = 0; s < 2; ++s) {
+        stageVelocities[s].resize(m);
+        stageAccelerations[s].resize(m);
+    }
+    band.resize(m * (ELASTIC_BANDWIDTH + 1));
+}
+
+// Residual M (V - known) - h g f(X, V), X = knownPosition + h g V, of a
+// stage solve and its banded Jacobian M - h g D - h^2 g^2 K at the current
+// stage velocity, K without compression softening.
+void ElasticStepper::assemble(double hg) {
+    const int n = parameters.links();
+    const int w = ELASTIC_BANDWIDTH;
+    for (int i = 0; i < 2 * n; ++i) {
+        probe[i] = knownPosition[i] + hg * stageVelocity[i];
+    }
+    bool frozen = settings.method == ELASTIC_SYMPLECTIC;
+    elasticForces(parameters, probe.data(), stageVelocity.data(), force.data(), frozen ? direction.data() : nullptr);
+
+    std::fill(band.begin(), band.end(), 0.0);
+    for (int i = 0; i < n; ++i) {
+        double m = parameters.chain.masses[i];
+        band[2 * i * (w + 1)] = band[(2 * i + 1) * (w + 1)] = m;
+        residual[2 * i] = hg * force[2 * i] - m * (stageVelocity[2 * i] - knownVelocity[2 * i]);
+        residual[2 * i + 1] = hg * force[2 * i + 1] - m * (stageVelocity[2 * i + 1] - knownVelocity[2 * i + 1]);
+    }
+    for (int i = 0; i < n; ++i) {
+        double dx = probe[2 * i] - (i > 0 ? probe[2 * i - 2] : 0.0);
+        double dy = probe[2 * i + 1] - (i > 0 ? probe[2 * i - 1] : 0.0);
+        double length = std::sqrt(dx * dx + dy * dy);
+        double ux = frozen ? direction[2 * i] : dx / length;
+        double uy = frozen ? direction[2 * i + 1] : dy / length;
+
+        // -K = k (u u^T + max(0, 1 - rest / length) (I - u u^T)), -D = c u u^T;
+        // with the direction frozen only the first term is kept
+        double transverse = frozen ? 0.0 : std::max(0.0, 1.0 - parameters.chain.lengths[i] / length);
+        double scale = hg * hg * parameters.stiffness[i], damp = hg * parameters.damping[i];
+        double bxx = scale * (ux * ux + transverse * (1.0 - ux * ux)) + damp * ux * ux;
+        double bxy = scale * (1.0 - transverse) * ux * uy + damp * ux * uy;
+        double byy = scale * (uy * uy + transverse * (1.0 - uy * uy)) + damp * uy * uy;
+
+        int xi = 2 * i, yi = 2 * i + 1;
+        band[xi * (w + 1)] += bxx;
+        band[yi * (w + 1)] += byy;
+        band[yi * (w + 1) + 1] += bxy;
+        if (i > 0) {
+            int xj = 2 * i - 2, yj = 2 * i - 1;
+            band[xj * (w + 1)] += bxx;
+            band[yj * (w + 1)] += byy;
+            band[yj * (w + 1) + 1] += bxy;
+            band[xi * (w + 1) + (xi - xj)] -= bxx;
+            band[xi * (w + 1) + (xi - yj)] -= bxy;
+            band[yi * (w + 1) + (yi - xj)] -= bxy;
+            band[yi * (w + 1) + (yi - yj)] -= byy;
+        }
+    }
+}
+
+void ElasticStepper::advance(double* state, double h) {
+    const int m = 2 * parameters.links();
+    double a[2][2] = {}, b[2] = {};
+    int stages = 1;
+    if (settings.method == ELASTIC_IMPLICIT_EULER || settings.method == ELASTIC_SYMPLECTIC) {
+        a[0][0] = b[0] = 1.0;
+    }
+    else {
+        double g = 1.0 - std::sqrt(0.5);
+        a[0][0] = a[1][1] = b[1] = g;
+        a[1][0] = b[0] = 1.0 - g;
+        stages = 2;
+    }
+
+    elasticToCartesian(parameters, state, position.data(), velocity.data());
+    for (int i = 0; i < parameters.links(); ++i) {
+        double dx = position[2 * i] - (i > 0 ? position[2 * i - 2] : 0.0);
+        double dy = position[2 * i + 1] - (i > 0 ? position[2 * i - 1] : 0.0);
+        double length = std::sqrt(dx * dx + dy * dy);
+        direction[2 * i] = dx / length;
+        direction[2 * i + 1] = dy / length;
+    }
+    for (int s = 0; s < stages; ++s) {
+        for (int i = 0; i < m; ++i) {
+            knownPosition[i] = position[i];
+            knownVelocity[i] = velocity[i];
+            for (int j = 0; j < s; ++j) {
+                knownPosition[i] += h * a[s][j] * stageVelocities[j][i];
+                knownVelocity[i] += h * a[s][j] * stageAccelerations[j][i];
+            }
+            stageVelocity[i] = knownVelocity[i];
+        }
+        double hg = h * a[s][s];
+        for (int iteration = 0; iteration < settings.iterations; ++iteration) {
+            assemble(hg);
+            if (!choleskyBanded(m, ELASTIC_BANDWIDTH, band.data())) {
+                break;
+            }
+            solveCholeskyBanded(m, ELASTIC_BANDWIDTH, band.data(), residual.data());
+            for (int i = 0; i < m; ++i) {
+                stageVelocity[i] += residual[i];
+            }
+        }
+        // the stage's acceleration from its own equation rather than from
+        // the stiff forces again
+        for (int i = 0; i < m; ++i) {
+            stageVelocities[s][i] = stageVelocity[i];
+            stageAccelerations[s][i] = (stageVelocity[i] - knownVelocity[i]) / hg;
+        }
+    }
+    for (int i = 0; i < m; ++i) {
+        for (int s = 0; s < stages; ++s) {
+            position[i] += h * b[s] * stageVelocities[s][i];
+            velocity[i] += h * b[s] * stageAccelerations[s][i];
+        }
+    }
+    elasticFromCartesian(parameters, position.data(), velocity.data(), state);
+}
+
+void elasticExplicitStep(const ElasticParameters& parameters, double* state, double h) {
+    const int m = 2 * parameters.links();
+    std::vector<double> position(m), velocity(m), force(m);
+    elasticToCartesian(parameters, state, position.data(), velocity.data());
+    elasticForces(parameters, position.data(), velocity.data(), force.data());
+    for (int i = 0; i < m; ++i) {
+        velocity[i] += h * force[i] / parameters.chain.masses[i / 2];
+        position[i] += h * velocity[i];
+    }
+    elasticFromCartesian(parameters, position.data(), velocity.data(), state);
+}
+
+static void tipPosition(const ElasticParameters& parameters, const double* state, double& x, double& y) {
+    const int n = parameters.links();
+    x = y = 0.0;
+    for (int i = 0; i < n; ++i) {
+        x += state[n + i] * std::sin(state[i]);
+        y -= state[n + i] * std::cos(state[i]);
+    }
+}
+
+int runElasticCommand(int argc, char** argv) {
+    ElasticParameters parameters;
+    bool valid = parseChainArguments(argc, argv, parameters.chain);
+    int n = parameters.links();
+    std::vector<double> stiffness = parseValues(findArgument(argc, argv, "--stiffness"), 1e6);
+    std::vector<double> damping = parseValues(findArgument(argc, argv, "--damping"), 0.0);
+    std::vector<double> angles = parseValues(findArgument(argc, argv, "--angles"), 1.0);
+    std::vector<double> omegas = parseValues(findArgument(argc, argv, "--omegas"), 0.0);
+    double time = floatArgument(argc, argv, "--time", 10.0f);
+    double h = std::atof(stringArgument(argc, argv, "--dt", "0.01").c_str());
+    ElasticSettings settings;
+    std::string method = stringArgument(argc, argv, "--method", "symplectic");
+    settings.method = method == "euler" ? ELASTIC_IMPLICIT_EULER : method == "sdirk2" ? ELASTIC_SDIRK2 : ELASTIC_SYMPLECTIC;
+    settings.iterations = intArgument(argc, argv, "--iterations", settings.iterations);
+    valid = valid && settings.iterations >= 1 && (method == "euler" || method == "sdirk2" || method == "symplectic") && time > 0.0 && h > 0.0
+        && !angles.empty() && !omegas.empty() && !stiffness.empty() && !damping.empty()
+        && ((int)stiffness.size() == 1 || (int)stiffness.size() == n) && ((int)damping.size() == 1 || (int)damping.size() == n);
+    double fastest = 0.0;
+    for (int i = 0; valid && i < n; ++i) {
+        parameters.stiffness.push_back(stiffness[std::min(i, (int)stiffness.size() - 1)]);
+        parameters.damping.push_back(damping[std::min(i, (int)damping.size() - 1)]);
+        valid = parameters.stiffness[i] > 0.0 && parameters.damping[i] >= 0.0;
+        fastest = std::max(fastest, std::sqrt(4.0 * parameters.stiffness[i] / parameters.chain.masses[i]));
+    }
+    if (!valid) {
+        std::cerr << "Invalid elastic chain settings" << std::endl;
+        return -1;
+    }
+
+    // the links at the given angles, each stretched by the static load it
+    // carries
+    std::vector<double> start(4 * n, 0.0);
+    double carried = 0.0;
+    for (int i = n - 1; i >= 0; --i) {
+        carried += parameters.chain.masses[i];
+        start[i] = angles[std::min(i, (int)angles.size() - 1)];
+        start[n + i] = parameters.chain.lengths[i] + carried * parameters.chain.g / parameters.stiffness[i];
+        start[2 * n + i] = omegas[std::min(i, (int)omegas.size() - 1)];
+    }
+    double startEnergy = elasticEnergy(parameters, start.data());
+
+    long long steps = (long long)std::ceil(time / h);
+    h = time / steps;
+    ElasticStepper stepper(parameters, settings);
+    std::vector<double> state = start;
+    double stretch = 0.0;
+    auto begin = std::chrono::steady_clock::now();
+    for (long long k = 0; k < steps; ++k) {
+        stepper.advance(state.data(), h);
+        for (int i = 0; i < n; ++i) {
+            stretch = std::max(stretch, std::fabs(state[n + i] / parameters.chain.lengths[i] - 1.0));
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double x, y;
+    tipPosition(parameters, state.data(), x, y);
+    std::cout << "imex dt " << h << ": " << steps << " steps, " << seconds * 1e9 / steps << " ns per step, energy "
+        << startEnergy << " -> " << elasticEnergy(parameters, state.data()) << ", largest stretch " << stretch
+        << ", tip (" << x << ", " << y << ")" << std::endl;
+
+    // explicit reference at a tenth of its stability limit
+    long long explicitSteps = (long long)std::ceil(time * fastest / 0.2);
+    double explicitStep = time / explicitSteps;
+    std::vector<double> reference = start;
+    begin = std::chrono::steady_clock::now();
+    for (long long k = 0; k < explicitSteps; ++k) {
+        elasticExplicitStep(parameters, reference.data(), explicitStep);
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double rx, ry;
+    tipPosition(parameters, reference.data(), rx, ry);
+    std::cout << "explicit dt " << explicitStep << ": " << explicitSteps << " steps in " << seconds << " s, energy "
+        << elasticEnergy(parameters, reference.data()) << ", tip (" << rx << ", " << ry << "), "
+        << std::hypot(x - rx, y - ry) << " from imex" << std::endl;
+
+    // the rigid chain the springs approach as they stiffen
+    std::vector<double> rigid(2 * n);
+    for (int i = 0; i < n; ++i) {
+        rigid[i] = start[i];
+        rigid[n + i] = start[2 * n + i];
+    }
+    Rk4Stepper rk4(parameters.chain);
+    for (long long k = 0; k < 10 * steps; ++k) {
+        rk4.advance(rigid.data(), h / 10.0);
+    }
+    double gx = 0.0, gy = 0.0;
+    for (int i = 0; i < n; ++i) {
+        gx += parameters.chain.lengths[i] * std::sin(rigid[i]);
+        gy -= parameters.chain.lengths[i] * std::cos(rigid[i]);
+    }
+    std::cout << "rigid tip (" << gx << ", " << gy << "), " << std::hypot(x - gx, y - gy) << " from imex, "
+        << std::hypot(rx - gx, ry - gy) << " from explicit" << std::endl;
+    return 0;
+}
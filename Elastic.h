@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Stepper.h"
+
+#include <vector>
+
+// A chain whose links are springs: the lengths in `chain` are rest lengths,
+// each link pulls with stiffness * stretch and resists stretching at
+// damping * stretch rate. States are in extended polar coordinates,
+// theta_1..theta_n, r_1..r_n, omega_1..omega_n, rdot_1..rdot_n.
+struct ElasticParameters {
+    ChainParameters chain;
+    std::vector<double> stiffness;      // N/m per link
+    std::vector<double> damping;        // N s/m per link, along the link
+
+    int links() const { return chain.links(); }
+};
+
+enum ElasticMethod {
+    // Symplectic Euler with each spring pulling along the link's direction
+    // at the start of the step and by its stretch at the end: SHAKE in the
+    // rigid limit, so the swinging keeps its energy however stiff the
+    // springs while the unresolved stretching is damped out.
+    ELASTIC_SYMPLECTIC,
+    ELASTIC_IMPLICIT_EULER,     // spring forces wholly at the end of the step; dissipative
+    ELASTIC_SDIRK2              // two stages, second order and L-stable, but loses order as the springs stiffen
+};
+
+struct ElasticSettings {
+    ElasticMethod method = ELASTIC_SYMPLECTIC;
+    int iterations = 2;         // Newton iterations per stage; 1 is linearly implicit
+};
+
+// Mass positions and velocities (x, y interleaved, pivot at the origin) of
+// an extended polar state, and back; fromCartesian keeps each angle within
+// pi of the one already in `state`.
+void elasticToCartesian(const ElasticParameters& parameters, const double* state, double* position, double* velocity);
+void elasticFromCartesian(const ElasticParameters& parameters, const double* position, const double* velocity, double* state);
+
+double elasticEnergy(const ElasticParameters& parameters, const double* state);
+
+// IMEX step for stiff springs: gravity is explicit, the spring and damping
+// forces implicit. Worked in the masses' Cartesian coordinates the mass
+// matrix is diagonal and each link only couples its two ends, so a Newton
+// iteration's matrix M - h g D - h^2 g^2 K (g the stage's diagonal
+// coefficient, K and D the force Jacobians) is banded with half bandwidth
+// 3 and symmetric positive definite, and is solved by banded Cholesky in
+// O(n). Compression softening is dropped from K to keep it so.
+class ElasticStepper {
+public:
+    ElasticStepper(const ElasticParameters& parameters, const ElasticSettings& settings = ElasticSettings());
+
+    void advance(double* state, double h);
+
+private:
+    void assemble(double hg);
+
+    ElasticParameters parameters;
+    ElasticSettings settings;
+    std::vector<double> position, velocity, force, band, probe, residual;
+    std::vector<double> knownPosition, knownVelocity, stageVelocity, direction;
+    std::vector<double> stageVelocities[2], stageAccelerations[2];
+};
+
+// Explicit symplectic Euler on the same forces, for reference; stable only
+// below about 2 / sqrt(stiffness / mass).
+void elasticExplicitStep(const ElasticParameters& parameters, double* state, double h);
+
+int runElasticCommand(int argc, char** argv);
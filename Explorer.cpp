@@ -0,0 +1,370 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Explorer.h"
+#include "FlipMap.h"
+#include "ResultCache.h"
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+
+const int EXPLORER_TILE_SIZE = 128;
+const int EXPLORER_STAGES = 3;
+const int EXPLORER_STAGE_RESOLUTION[EXPLORER_STAGES] = { 16, 64, EXPLORER_TILE_SIZE };
+const int EXPLORER_MAX_LEVEL = 30;
+const size_t EXPLORER_MAX_TILES = 1024;
+const int EXPLORER_UPLOADS_PER_FRAME = 16;
+const float EXPLORER_MAX_TIME = 20.0f;
+
+const char* explorerVertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in vec2 aPos;
+layout(location = 1) in vec2 aUV;
+uniform mat4 projection;
+out vec2 uv;
+void main()
+{
+    uv = aUV;
+    gl_Position = projection * vec4(aPos, 0.0, 1.0);
+}
+)";
+
+const char* explorerFragmentShaderSource = R"(
+#version 330 core
+in vec2 uv;
+out vec4 FragColor;
+uniform sampler2D tile;
+void main()
+{
+    FragColor = texture(tile, uv);
+}
+)";
+
+struct ExplorerTile {
+    unsigned int texture = 0;
+    int stage = -1;
+    long long lastSeen = 0;
+    std::shared_ptr<TileJob> job;
+};
+
+static bool explorerEnabled = false;
+static int viewWidth = 0, viewHeight = 0;
+static double centerTheta1 = 0.0, centerTheta2 = 0.0;
+static double thetaPerPixel = 0.0;
+static bool dragging = false;
+static double lastCursorX = 0.0, lastCursorY = 0.0;
+static long long frameIndex = 0;
+
+static std::unique_ptr<TileScheduler> scheduler;
+static std::map<TileKey, ExplorerTile> tiles;
+static std::deque<std::shared_ptr<TileJob>> uploads;
+static unsigned int tileShader = 0, tileVAO = 0, tileVBO = 0;
+
+static double tileSpan(int level) {
+    return 2.0 * M_PI / std::ldexp(1.0, level);
+}
+
+static void computeFlipTile(TileJob& job) {
+    double span = tileSpan(job.key.level);
+
+    FlipMapSettings settings;
+    settings.width = job.resolution;
+    settings.height = job.resolution;
+    settings.theta1Min = -M_PI + job.key.x * span;
+    settings.theta1Max = settings.theta1Min + span;
+    settings.theta2Min = -M_PI + job.key.y * span;
+    settings.theta2Max = settings.theta2Min + span;
+    settings.L1 = INITIAL_LENGTH;
+    settings.L2 = INITIAL_LENGTH;
+    settings.M1 = INITIAL_MASS;
+    settings.M2 = INITIAL_MASS;
+    settings.g = G;
+    settings.dt = dt;
+    settings.maxTime = EXPLORER_MAX_TIME;
+    settings.threads = 1;
+    settings.cancel = &job.cancel;
+    settings.cache = resultCache();
+
+    job.values.resize((size_t)job.resolution * job.resolution);
+    computeFlipMapRegion(settings, 0, 0, job.resolution, job.resolution, job.values.data());
+    if (job.cancel) {
+        return;
+    }
+
+    job.rgb.resize(job.values.size() * 3);
+    for (size_t i = 0; i < job.values.size(); ++i) {
+        flipTimeColor(job.values[i], settings.maxTime, &job.rgb[i * 3]);
+    }
+}
+
+static unsigned int compileExplorerShader() {
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &explorerVertexShaderSource, nullptr);
+    glCompileShader(vertexShader);
+
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &explorerFragmentShaderSource, nullptr);
+    glCompileShader(fragmentShader);
+
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    return program;
+}
+
+void initExplorer(int width, int height) {
+    viewWidth = width;
+    viewHeight = height;
+    resetExplorerView();
+
+    tileShader = compileExplorerShader();
+    glGenVertexArrays(1, &tileVAO);
+    glGenBuffers(1, &tileVBO);
+    glBindVertexArray(tileVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, tileVBO);
+    glBufferData(GL_ARRAY_BUFFER, 16 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    // Leave one core to the UI thread so rendering never waits on tiles.
+    int threads = (int)std::thread::hardware_concurrency() - 1;
+    scheduler.reset(new TileScheduler(std::max(threads, 1)));
+}
+
+void shutdownExplorer() {
+    scheduler.reset();
+    uploads.clear();
+    for (auto& entry : tiles) {
+        if (entry.second.texture) {
+            glDeleteTextures(1, &entry.second.texture);
+        }
+    }
+    tiles.clear();
+    glDeleteVertexArrays(1, &tileVAO);
+    glDeleteBuffers(1, &tileVBO);
+    glDeleteProgram(tileShader);
+}
+
+bool explorerActive() {
+    return explorerEnabled;
+}
+
+void toggleExplorer() {
+    explorerEnabled = !explorerEnabled;
+    dragging = false;
+}
+
+void resetExplorerView() {
+    centerTheta1 = 0.0;
+    centerTheta2 = 0.0;
+    thetaPerPixel = 2.0 * M_PI / std::min(viewWidth, viewHeight);
+}
+
+void explorerMouseButton(GLFWwindow* window, int button, int action) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT) {
+        dragging = action == GLFW_PRESS;
+        glfwGetCursorPos(window, &lastCursorX, &lastCursorY);
+    }
+}
+
+void explorerCursor(double x, double y) {
+    if (dragging) {
+        centerTheta1 -= (x - lastCursorX) * thetaPerPixel;
+        centerTheta2 += (y - lastCursorY) * thetaPerPixel;
+    }
+    lastCursorX = x;
+    lastCursorY = y;
+}
+
+void explorerScroll(GLFWwindow* window, double offset) {
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    double theta1 = centerTheta1 + (x - viewWidth * 0.5) * thetaPerPixel;
+    double theta2 = centerTheta2 - (y - viewHeight * 0.5) * thetaPerPixel;
+
+    double minScale = tileSpan(EXPLORER_MAX_LEVEL) / EXPLORER_TILE_SIZE;
+    double maxScale = 4.0 * M_PI / std::min(viewWidth, viewHeight);
+    thetaPerPixel = std::min(std::max(thetaPerPixel * std::pow(1.25, -offset), minScale), maxScale);
+
+    centerTheta1 = theta1 - (x - viewWidth * 0.5) * thetaPerPixel;
+    centerTheta2 = theta2 + (y - viewHeight * 0.5) * thetaPerPixel;
+}
+
+static void scheduleVisibleTiles() {
+    int level = (int)std::ceil(std::log2(2.0 * M_PI / (EXPLORER_TILE_SIZE * thetaPerPixel)));
+    level = std::min(std::max(level, 0), EXPLORER_MAX_LEVEL);
+    double span = tileSpan(level);
+    long long count = 1LL << level;
+
+    double halfWidth = viewWidth * 0.5 * thetaPerPixel;
+    double halfHeight = viewHeight * 0.5 * thetaPerPixel;
+    long long x0 = std::max(0LL, (long long)std::floor((centerTheta1 - halfWidth + M_PI) / span));
+    long long x1 = std::min(count - 1, (long long)std::floor((centerTheta1 + halfWidth + M_PI) / span));
+    long long y0 = std::max(0LL, (long long)std::floor((centerTheta2 - halfHeight + M_PI) / span));
+    long long y1 = std::min(count - 1, (long long)std::floor((centerTheta2 + halfHeight + M_PI) / span));
+
+    std::vector<TileKey> visible;
+    visible.push_back(TileKey{ 0, 0, 0 });
+    for (long long y = y0; y <= y1; ++y) {
+        for (long long x = x0; x <= x1; ++x) {
+            if (level > 0) {
+                visible.push_back(TileKey{ level, (int)x, (int)y });
+            }
+        }
+    }
+
+    for (const TileKey& key : visible) {
+        ExplorerTile& tile = tiles[key];
+        tile.lastSeen = frameIndex;
+        if (!tile.job && tile.stage + 1 < EXPLORER_STAGES) {
+            std::shared_ptr<TileJob> job = std::make_shared<TileJob>();
+            job->key = key;
+            job->stage = tile.stage + 1;
+            job->resolution = EXPLORER_STAGE_RESOLUTION[job->stage];
+            job->compute = computeFlipTile;
+            tile.job = job;
+            scheduler->submit(job);
+        }
+    }
+
+    for (auto& entry : tiles) {
+        ExplorerTile& tile = entry.second;
+        if (tile.job && tile.lastSeen != frameIndex) {
+            scheduler->cancel(tile.job);
+            tile.job.reset();
+        }
+    }
+
+    // Every visible tile's coarse pass goes before any tile's finer pass,
+    // and within a pass tiles nearest the middle of the screen go first.
+    scheduler->updatePriorities([&](const TileJob& job) {
+        double size = tileSpan(job.key.level);
+        double dx = (-M_PI + (job.key.x + 0.5) * size - centerTheta1) / size;
+        double dy = (-M_PI + (job.key.y + 0.5) * size - centerTheta2) / size;
+        return job.stage * 1.0e6 + job.key.level * 1.0e3 + std::sqrt(dx * dx + dy * dy);
+    });
+}
+
+static void uploadFinishedTiles() {
+    for (std::shared_ptr<TileJob>& job : scheduler->takeFinished()) {
+        uploads.push_back(job);
+    }
+
+    int budget = EXPLORER_UPLOADS_PER_FRAME;
+    while (budget > 0 && !uploads.empty()) {
+        std::shared_ptr<TileJob> job = uploads.front();
+        uploads.pop_front();
+
+        auto found = tiles.find(job->key);
+        if (found == tiles.end() || found->second.job != job || job->cancel) {
+            continue;
+        }
+        ExplorerTile& tile = found->second;
+        if (!tile.texture) {
+            glGenTextures(1, &tile.texture);
+        }
+        glBindTexture(GL_TEXTURE_2D, tile.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, job->resolution, job->resolution, 0, GL_RGB, GL_UNSIGNED_BYTE, job->rgb.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        tile.stage = job->stage;
+        tile.job.reset();
+        --budget;
+    }
+}
+
+static void evictTiles() {
+    if (tiles.size() <= EXPLORER_MAX_TILES) {
+        return;
+    }
+    std::vector<std::pair<long long, TileKey>> candidates;
+    for (auto& entry : tiles) {
+        if (entry.first.level > 0 && !entry.second.job && entry.second.lastSeen != frameIndex) {
+            candidates.push_back(std::make_pair(entry.second.lastSeen, entry.first));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    size_t excess = tiles.size() - EXPLORER_MAX_TILES;
+    for (size_t i = 0; i < candidates.size() && i < excess; ++i) {
+        auto found = tiles.find(candidates[i].second);
+        if (found->second.texture) {
+            glDeleteTextures(1, &found->second.texture);
+        }
+        tiles.erase(found);
+    }
+}
+
+void renderExplorer() {
+    ++frameIndex;
+    scheduleVisibleTiles();
+    uploadFinishedTiles();
+    evictTiles();
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUseProgram(tileShader);
+
+    // Positions are sent relative to the view centre so that deep zooms do
+    // not lose the tile edges to float rounding.
+    float halfWidth = (float)(viewWidth * 0.5 * thetaPerPixel);
+    float halfHeight = (float)(viewHeight * 0.5 * thetaPerPixel);
+    glm::mat4 tileProjection = glm::ortho(-halfWidth, halfWidth, -halfHeight, halfHeight, -1.0f, 1.0f);
+    glUniformMatrix4fv(glGetUniformLocation(tileShader, "projection"), 1, GL_FALSE, glm::value_ptr(tileProjection));
+    glUniform1i(glGetUniformLocation(tileShader, "tile"), 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindVertexArray(tileVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, tileVBO);
+
+    // std::map orders by level, so coarse tiles are drawn first and finer
+    // ones cover them as they arrive.
+    for (auto& entry : tiles) {
+        const TileKey& key = entry.first;
+        const ExplorerTile& tile = entry.second;
+        if (!tile.texture) {
+            continue;
+        }
+        double span = tileSpan(key.level);
+        double left = -M_PI + key.x * span - centerTheta1;
+        double bottom = -M_PI + key.y * span - centerTheta2;
+        if (left > halfWidth || left + span < -halfWidth || bottom > halfHeight || bottom + span < -halfHeight) {
+            continue;
+        }
+
+        float l = (float)left, r = (float)(left + span), b = (float)bottom, t = (float)(bottom + span);
+        float quad[16] = {
+            l, b, 0.0f, 1.0f,
+            r, b, 1.0f, 1.0f,
+            r, t, 1.0f, 0.0f,
+            l, t, 0.0f, 0.0f,
+        };
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(quad), quad);
+        glBindTexture(GL_TEXTURE_2D, tile.texture);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+struct GLFWwindow;
+
+// Pan/zoom viewer for the flip-time map. Tiles are computed coarse-to-fine
+// on every core but the UI thread, visible tiles first, and uploaded as
+// textures as they finish.
+void initExplorer(int width, int height);
+void shutdownExplorer();
+
+bool explorerActive();
+void toggleExplorer();
+void resetExplorerView();
+
+void explorerMouseButton(GLFWwindow* window, int button, int action);
+void explorerCursor(double x, double y);
+void explorerScroll(GLFWwindow* window, double offset);
+
+void renderExplorer();
@@ -0,0 +1,405 @@
+#include "FlipMap.h"
+#include "CommandLine.h"
+#include "LaneScheduler.h"
+#include "PyramidWriter.h"
+#include "ResultCache.h"
+#include "SinCos.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+
+// Lanes are kept in plain arrays and stepped in a branch-free inner loop,
+// with the sines and cosines from sinCos, so the compiler turns it into one
+// SIMD instruction stream per vector; build with -fopt-info-vec (GCC) or
+// /Qvec-report:1 (MSVC) to see FlipKernel::step reported as vectorized.
+// The steps and flip steps are 32-bit ints so they share vectors with
+// float lanes, and a flip is kept as its step number until it is retired
+// because an int-to-float conversion could trap and so is not vectorized.
+const int FLIP_LANES = 8;
+const long long FLIP_CHUNK = 256;
+
+struct FlipMapCounters {
+    std::atomic<long long> pruned{ 0 };
+    std::atomic<long long> flipped{ 0 };
+    std::atomic<long long> steps{ 0 };
+    std::atomic<long long> occupiedSteps{ 0 };
+};
+
+static void pixelAngles(const FlipMapSettings& s, int x0, int y0, int width, long long i, double& theta1, double& theta2) {
+    int px = x0 + (int)(i % width);
+    int py = y0 + (int)(i / width);
+    theta1 = s.theta1Min + (px + 0.5) * (s.theta1Max - s.theta1Min) / s.width;
+    theta2 = s.theta2Max - (py + 0.5) * (s.theta2Max - s.theta2Min) / s.height;
+}
+
+static bool cancelled(const FlipMapSettings& s) {
+    return s.cancel && s.cancel->load(std::memory_order_relaxed);
+}
+
+bool flipMapUsesDouble(const FlipMapSettings& s) {
+    if (s.precision != FLIP_PRECISION_AUTO) {
+        return s.precision == FLIP_PRECISION_DOUBLE;
+    }
+    double spacing = std::min((s.theta1Max - s.theta1Min) / s.width, (s.theta2Max - s.theta2Min) / s.height);
+    double magnitude = std::max(std::max(std::fabs(s.theta1Min), std::fabs(s.theta1Max)),
+        std::max(std::fabs(s.theta2Min), std::fabs(s.theta2Max)));
+    return spacing < 1024.0 * FLT_EPSILON * std::max(magnitude, 1.0);
+}
+
+template<typename T>
+struct FlipKernel {
+    static const int WIDTH = FLIP_LANES;
+    static const int CAPACITY = 8 * FLIP_LANES;
+
+    const FlipMapSettings& s;
+    int x0, y0, width;
+    float* out;
+    T h, L1, L2, M1, M2, g;
+    int maxSteps;
+    long long flipped = 0;
+
+    T t1[CAPACITY], t2[CAPACITY], w1[CAPACITY], w2[CAPACITY];
+    int steps[CAPACITY];
+    int flipStep[CAPACITY];
+    long long member[CAPACITY];
+
+    FlipKernel(const FlipMapSettings& settings, int x0, int y0, int width, float* out)
+        : s(settings), x0(x0), y0(y0), width(width), out(out),
+        h(T(settings.dt)), L1(T(settings.L1)), L2(T(settings.L2)), M1(T(settings.M1)), M2(T(settings.M2)), g(T(settings.g)),
+        maxSteps((int)std::min<double>(settings.maxTime / settings.dt, INT_MAX)) {
+        for (int l = 0; l < CAPACITY; ++l) {
+            t1[l] = t2[l] = w1[l] = w2[l] = T(0);
+            steps[l] = 0;
+            flipStep[l] = (int)FLIP_NEVER;
+            member[l] = -1;
+        }
+    }
+
+    void load(int lane, long long id) {
+        double theta1, theta2;
+        pixelAngles(s, x0, y0, width, id, theta1, theta2);
+        t1[lane] = T(theta1);
+        t2[lane] = T(theta2);
+        w1[lane] = T(0);
+        w2[lane] = T(0);
+        steps[lane] = 0;
+        flipStep[lane] = (int)FLIP_NEVER;
+        member[lane] = id;
+    }
+
+    void move(int from, int to) {
+        t1[to] = t1[from];
+        t2[to] = t2[from];
+        w1[to] = w1[from];
+        w2[to] = w2[from];
+        steps[to] = steps[from];
+        flipStep[to] = flipStep[from];
+        member[to] = member[from];
+    }
+
+    void step(int lanes) {
+        const T pi = T(M_PI), largest = std::numeric_limits<T>::max();
+        const T full = h, l1 = L1, l2 = L2, m1 = M1, m2 = M2, gravity = g;
+        const int last = maxSteps;
+        for (int l = 0; l < lanes; ++l) {
+            // members that are done take zero-length steps until retired,
+            // and only a member still looking records its first event
+            const bool active = steps[l] < last;
+            const T dt = active ? full : T(0);
+            T s1, c1, s2, c2, a1, a2;
+            sinCos(t1[l], s1, c1);
+            sinCos(t2[l], s2, c2);
+            doublePendulumAccelTrig(s1, c1, s2, c2, w1[l], w2[l], l1, l2, m1, m2, gravity, a1, a2);
+            w1[l] += a1 * dt;
+            w2[l] += a2 * dt;
+            t1[l] += w1[l] * dt;
+            t2[l] += w2[l] * dt;
+            steps[l] += active;
+
+            // quiet comparisons, which cannot trap on NaN and so can be done
+            // for every lane, joined by | and & rather than || and &&
+            const bool diverged = !std::islessequal(std::fabs(t1[l]), largest) | !std::islessequal(std::fabs(t2[l]), largest);
+            const bool over = std::isgreater(std::fabs(t1[l]), pi) | std::isgreater(std::fabs(t2[l]), pi);
+            const int event = diverged ? (int)FLIP_DIVERGED : over ? steps[l] : (int)FLIP_NEVER;
+            flipStep[l] = active & (flipStep[l] == (int)FLIP_NEVER) ? event : flipStep[l];
+        }
+    }
+
+    bool finished(int lane) const {
+        return flipStep[lane] != (int)FLIP_NEVER || steps[lane] >= maxSteps || cancelled(s);
+    }
+
+    void retire(int lane) {
+        if (flipStep[lane] >= 0) {
+            out[member[lane]] = (float)((T)flipStep[lane] * h);
+            ++flipped;
+        } else {
+            out[member[lane]] = (float)flipStep[lane];
+        }
+    }
+};
+
+static void flipMapWorker(const FlipMapSettings& s, int x0, int y0, int width, int height, float* out,
+    std::atomic<long long>& next, FlipMapCounters& counters) {
+    const long long total = (long long)width * height;
+    const double barrier = doublePendulumFlipBarrier<double>(s.L1, s.L2, s.M1, s.M2, s.g);
+
+    long long cursor = 0, chunkEnd = 0;
+    long long pruned = 0;
+
+    // Hands out unpruned pixels; pruned ones are answered without a lane.
+    auto nextPixel = [&](long long& id) {
+        for (;;) {
+            if (cancelled(s)) {
+                return false;
+            }
+            if (cursor == chunkEnd) {
+                cursor = next.fetch_add(FLIP_CHUNK);
+                if (cursor >= total) {
+                    cursor = chunkEnd;
+                    return false;
+                }
+                chunkEnd = std::min(cursor + FLIP_CHUNK, total);
+            }
+            long long i = cursor++;
+            double theta1, theta2;
+            pixelAngles(s, x0, y0, width, i, theta1, theta2);
+            if (doublePendulumEnergy<double>(theta1, theta2, 0.0, 0.0, s.L1, s.L2, s.M1, s.M2, s.g) < barrier) {
+                out[i] = FLIP_IMPOSSIBLE;
+                ++pruned;
+                continue;
+            }
+            id = i;
+            return true;
+        }
+    };
+
+    LaneSchedulerStats lanes;
+    long long flipped;
+    if (flipMapUsesDouble(s)) {
+        std::unique_ptr<FlipKernel<double>> kernel(new FlipKernel<double>(s, x0, y0, width, out));
+        lanes = runLaneScheduler(*kernel, nextPixel, s.compactEvery);
+        flipped = kernel->flipped;
+    }
+    else {
+        std::unique_ptr<FlipKernel<float>> kernel(new FlipKernel<float>(s, x0, y0, width, out));
+        lanes = runLaneScheduler(*kernel, nextPixel, s.compactEvery);
+        flipped = kernel->flipped;
+    }
+
+    counters.pruned += pruned;
+    counters.flipped += flipped;
+    counters.steps += lanes.laneSteps;
+    counters.occupiedSteps += lanes.occupiedLaneSteps;
+}
+
+// --compact-every only reorders work, so it stays out of the key; the
+// horizon field keeps maps from before lanes stopped at maxSteps, whose
+// flip times could run past it, from being served.
+static CacheKey flipMapCacheKey(const FlipMapSettings& s, int x0, int y0, int width, int height) {
+    CacheKey key("flipmap");
+    key.add("equations", EQUATIONS_VERSION)
+        .add("integrator", std::string("symplectic-euler"))
+        .add("horizon", std::string("exact"))
+        .add("trig", std::string("polynomial"))
+        .add("precision", std::string(flipMapUsesDouble(s) ? "double" : "float"))
+        .add("dt", s.dt).add("maxTime", s.maxTime).add("g", s.g)
+        .add("L1", s.L1).add("L2", s.L2).add("M1", s.M1).add("M2", s.M2)
+        .add("theta1Min", s.theta1Min).add("theta1Max", s.theta1Max)
+        .add("theta2Min", s.theta2Min).add("theta2Max", s.theta2Max)
+        .add("width", s.width).add("height", s.height)
+        .add("x0", x0).add("y0", y0).add("regionWidth", width).add("regionHeight", height);
+    return key;
+}
+
+void computeFlipMapRegion(const FlipMapSettings& settings, int x0, int y0, int width, int height,
+    float* out, FlipMapStats* stats) {
+    auto start = std::chrono::steady_clock::now();
+    const size_t count = (size_t)width * height;
+
+    if (settings.cache) {
+        std::vector<float> cached;
+        if (settings.cache->loadFloats(flipMapCacheKey(settings, x0, y0, width, height), cached) && cached.size() == count) {
+            std::copy(cached.begin(), cached.end(), out);
+            if (stats) {
+                ++stats->cacheHits;
+                stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            return;
+        }
+    }
+
+    int threadCount = settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency();
+    threadCount = std::max(threadCount, 1);
+
+    std::atomic<long long> next{ 0 };
+    FlipMapCounters counters;
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(flipMapWorker, std::cref(settings), x0, y0, width, height, out,
+            std::ref(next), std::ref(counters));
+    }
+    flipMapWorker(settings, x0, y0, width, height, out, next, counters);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    if (settings.cache && !cancelled(settings)) {
+        settings.cache->storeFloats(flipMapCacheKey(settings, x0, y0, width, height), std::vector<float>(out, out + count));
+    }
+
+    if (stats) {
+        stats->pruned += counters.pruned;
+        stats->flipped += counters.flipped;
+        stats->steps += counters.steps;
+        stats->occupiedSteps += counters.occupiedSteps;
+        stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+std::vector<float> computeFlipMap(const FlipMapSettings& settings, FlipMapStats* stats) {
+    std::vector<float> map((size_t)settings.width * settings.height);
+    computeFlipMapRegion(settings, 0, 0, settings.width, settings.height, map.data(), stats);
+    return map;
+}
+
+void flipTimeColor(float time, float maxTime, unsigned char rgb[3]) {
+    if (time < 0.0f) {
+        rgb[0] = rgb[1] = rgb[2] = 0;
+        return;
+    }
+    float v = std::log1p(time) / std::log1p(maxTime);
+    v = std::min(std::max(v, 0.0f), 1.0f);
+
+    // yellow -> red -> purple -> dark blue as the flip takes longer
+    const float stops[4][3] = { { 1.0f, 0.95f, 0.4f }, { 0.9f, 0.2f, 0.1f }, { 0.45f, 0.1f, 0.5f }, { 0.05f, 0.05f, 0.25f } };
+    float f = v * 3.0f;
+    int i = std::min((int)f, 2);
+    f -= i;
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = (unsigned char)(255.0f * (stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f));
+    }
+}
+
+bool writeFlipMapImage(const std::string& path, const std::vector<float>& map, int width, int height, float maxTime) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<unsigned char> row((size_t)width * 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            flipTimeColor(map[(size_t)y * width + x], maxTime, &row[(size_t)x * 3]);
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return (bool)file;
+}
+
+bool writeFlipMapRaw(const std::string& path, const std::vector<float>& map) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file.write((const char*)map.data(), map.size() * sizeof(float));
+    return (bool)file;
+}
+
+// Computes the map one tile at a time and hands each to the pyramid writer,
+// so the full image never has to exist in memory.
+static int writeFlipMapPyramid(const FlipMapSettings& settings, const std::string& path, int tileSize, int ioThreads) {
+    if (tileSize <= 0) {
+        std::cerr << "Invalid tile size" << std::endl;
+        return -1;
+    }
+    float maxTime = settings.maxTime;
+    PyramidWriter writer(path, settings.width, settings.height, tileSize,
+        [maxTime](float value, unsigned char rgb[3]) { flipTimeColor(value, maxTime, rgb); }, ioThreads);
+
+    FlipMapStats stats;
+    for (int ty = 0; ty < writer.rows(); ++ty) {
+        for (int tx = 0; tx < writer.columns(); ++tx) {
+            int tw = writer.tileWidth(tx), th = writer.tileHeight(ty);
+            std::vector<float> tile((size_t)tw * th);
+            computeFlipMapRegion(settings, tx * tileSize, ty * tileSize, tw, th, tile.data(), &stats);
+            writer.addTile(tx, ty, std::move(tile));
+        }
+    }
+    bool complete = writer.finish();
+
+    std::cout << settings.width << "x" << settings.height << " flip map pyramid: "
+        << stats.flipped << " flipped, " << stats.pruned << " pruned, "
+        << stats.cacheHits << " tiles from cache, " << stats.seconds << " s computing" << std::endl;
+    if (!complete) {
+        std::cerr << "Failed to write " << path << ".dzi" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int runFlipMapCommand(int argc, char** argv) {
+    configureResultCache(argc, argv);
+
+    FlipMapSettings settings;
+    settings.cache = resultCache();
+    int size = intArgument(argc, argv, "--size", 1024);
+    settings.width = intArgument(argc, argv, "--width", size);
+    settings.height = intArgument(argc, argv, "--height", size);
+    settings.L1 = floatArgument(argc, argv, "--l1", INITIAL_LENGTH);
+    settings.L2 = floatArgument(argc, argv, "--l2", INITIAL_LENGTH);
+    settings.M1 = floatArgument(argc, argv, "--m1", INITIAL_MASS);
+    settings.M2 = floatArgument(argc, argv, "--m2", INITIAL_MASS);
+    settings.g = floatArgument(argc, argv, "--g", G);
+    settings.dt = floatArgument(argc, argv, "--dt", dt);
+    settings.maxTime = floatArgument(argc, argv, "--time", settings.maxTime);
+    settings.threads = intArgument(argc, argv, "--threads", 0);
+    settings.compactEvery = intArgument(argc, argv, "--compact-every", settings.compactEvery);
+    std::string precision = stringArgument(argc, argv, "--precision", "auto");
+    if (precision == "float") {
+        settings.precision = FLIP_PRECISION_FLOAT;
+    }
+    else if (precision == "double") {
+        settings.precision = FLIP_PRECISION_DOUBLE;
+    }
+    std::string imagePath = stringArgument(argc, argv, "--out", "flipmap.ppm");
+    std::string rawPath = stringArgument(argc, argv, "--raw", "");
+    std::string pyramidPath = stringArgument(argc, argv, "--dzi", "");
+
+    if (settings.width <= 0 || settings.height <= 0 || settings.dt <= 0.0f || settings.maxTime <= 0.0f) {
+        std::cerr << "Invalid flip map settings" << std::endl;
+        return -1;
+    }
+
+    if (!pyramidPath.empty()) {
+        return writeFlipMapPyramid(settings, pyramidPath, intArgument(argc, argv, "--tile-size", 256),
+            intArgument(argc, argv, "--io-threads", 2));
+    }
+
+    FlipMapStats stats;
+    std::vector<float> map = computeFlipMap(settings, &stats);
+
+    std::cout << settings.width << "x" << settings.height << " flip map in " << stats.seconds << " s: "
+        << stats.flipped << " flipped, " << stats.pruned << " pruned, "
+        << stats.steps << " lane steps, "
+        << (stats.steps > 0 ? 100.0 * stats.occupiedSteps / stats.steps : 0.0) << "% occupied"
+        << (stats.cacheHits > 0 ? " (from cache)" : "") << std::endl;
+
+    if (!imagePath.empty() && !writeFlipMapImage(imagePath, map, settings.width, settings.height, settings.maxTime)) {
+        std::cerr << "Failed to write " << imagePath << std::endl;
+        return -1;
+    }
+    if (!rawPath.empty() && !writeFlipMapRaw(rawPath, map)) {
+        std::cerr << "Failed to write " << rawPath << std::endl;
+        return -1;
+    }
+    return 0;
+}
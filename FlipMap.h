@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "Physics.h"
+
+class ResultCache;
+
+const float FLIP_NEVER = -1.0f;
+const float FLIP_IMPOSSIBLE = -2.0f;
+const float FLIP_DIVERGED = -3.0f;
+
+enum FlipPrecision {
+    FLIP_PRECISION_AUTO,
+    FLIP_PRECISION_FLOAT,
+    FLIP_PRECISION_DOUBLE
+};
+
+struct FlipMapSettings {
+    int width = 1024;
+    int height = 1024;
+    double theta1Min = -M_PI;
+    double theta1Max = M_PI;
+    double theta2Min = -M_PI;
+    double theta2Max = M_PI;
+    float L1 = 0.7f;
+    float L2 = 0.7f;
+    float M1 = 1.0f;
+    float M2 = 1.0f;
+    float g = 9.81f;
+    float dt = 0.01f;
+    float maxTime = 100.0f;
+    int threads = 0;
+    int compactEvery = 16;
+    FlipPrecision precision = FLIP_PRECISION_AUTO;
+    const std::atomic<bool>* cancel = nullptr;
+    ResultCache* cache = nullptr;
+};
+
+struct FlipMapStats {
+    long long pruned = 0;
+    long long flipped = 0;
+    long long steps = 0;
+    long long occupiedSteps = 0;
+    long long cacheHits = 0;
+    double seconds = 0.0;
+};
+
+// Each pixel holds the time of the first flip of either arm, FLIP_NEVER if
+// it did not flip within maxTime, FLIP_IMPOSSIBLE if its energy is below
+// the flip barrier, or FLIP_DIVERGED if the integration blew up.
+// Row 0 is theta2Max, column 0 is theta1Min.
+// AUTO switches to double lanes once neighbouring pixels are too close
+// together for float to tell their initial angles apart.
+bool flipMapUsesDouble(const FlipMapSettings& settings);
+
+std::vector<float> computeFlipMap(const FlipMapSettings& settings, FlipMapStats* stats = nullptr);
+void computeFlipMapRegion(const FlipMapSettings& settings, int x0, int y0, int width, int height,
+    float* out, FlipMapStats* stats = nullptr);
+
+void flipTimeColor(float time, float maxTime, unsigned char rgb[3]);
+bool writeFlipMapImage(const std::string& path, const std::vector<float>& map, int width, int height, float maxTime);
+bool writeFlipMapRaw(const std::string& path, const std::vector<float>& map);
+
+int runFlipMapCommand(int argc, char** argv);
@@ -0,0 +1,379 @@
+#include "Ftle.h"
+#include "CommandLine.h"
+#include "Dual.h"
+#include "LaneScheduler.h"
+#include "Png.h"
+#include "ResultCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+
+const int FTLE_LANES = 4;
+const long long FTLE_CHUNK = 64;
+const int FTLE_RESCALE_EVERY = 32;
+const double FTLE_RESCALE_ABOVE = 1e100;
+
+// Flow state of one seed: where it is, the flow-map gradient with respect
+// to the two seed coordinates (stored as F / exp(logScale)) and how far it
+// has been integrated.
+struct FtleSeed {
+    double state[4];
+    double tangent[2][4];
+    double logScale;
+    long long steps;
+};
+
+static void seedState(const FtleSettings& s, long long i, FtleSeed& seed) {
+    double x = s.xMin + (i % s.width + 0.5) * (s.xMax - s.xMin) / s.width;
+    double y = s.yMax - (i / s.width + 0.5) * (s.yMax - s.yMin) / s.height;
+    std::memset(&seed, 0, sizeof(seed));
+    seed.state[0] = x;
+    if (s.plane == FTLE_PLANE_ANGLES) {
+        seed.state[1] = y;
+        seed.tangent[1][1] = 1.0;
+    }
+    else {
+        seed.state[2] = y;
+        seed.tangent[1][2] = 1.0;
+    }
+    seed.tangent[0][0] = 1.0;
+}
+
+// Advances seeds to `target` steps in lanes. Dual slot k carries tangent k.
+struct FtleKernel {
+    typedef Dual<double, 2> D;
+    static const int WIDTH = FTLE_LANES;
+    static const int CAPACITY = 4 * FTLE_LANES;
+
+    std::vector<FtleSeed>& seeds;
+    long long target;
+    D h, L1, L2, M1, M2, g;
+
+    D t1[CAPACITY], t2[CAPACITY], w1[CAPACITY], w2[CAPACITY];
+    double logScale[CAPACITY];
+    long long steps[CAPACITY];
+    long long member[CAPACITY];
+
+    FtleKernel(const FtleSettings& s, std::vector<FtleSeed>& seeds, long long target)
+        : seeds(seeds), target(target), h(s.dt), L1(s.L1), L2(s.L2), M1(s.M1), M2(s.M2), g(s.g) {
+        for (int l = 0; l < CAPACITY; ++l) {
+            logScale[l] = 0.0;
+            steps[l] = target;
+            member[l] = -1;
+        }
+    }
+
+    void load(int lane, long long id) {
+        const FtleSeed& seed = seeds[id];
+        D* variables[4] = { &t1[lane], &t2[lane], &w1[lane], &w2[lane] };
+        for (int i = 0; i < 4; ++i) {
+            *variables[i] = D(seed.state[i]);
+            for (int k = 0; k < 2; ++k) {
+                variables[i]->d[k] = seed.tangent[k][i];
+            }
+        }
+        logScale[lane] = seed.logScale;
+        steps[lane] = seed.steps;
+        member[lane] = id;
+    }
+
+    void move(int from, int to) {
+        t1[to] = t1[from];
+        t2[to] = t2[from];
+        w1[to] = w1[from];
+        w2[to] = w2[from];
+        logScale[to] = logScale[from];
+        steps[to] = steps[from];
+        member[to] = member[from];
+    }
+
+    void step(int lanes) {
+        for (int l = 0; l < lanes; ++l) {
+            if (steps[l] >= target) {
+                continue;
+            }
+            D a1, a2;
+            doublePendulumAccel(t1[l], t2[l], w1[l], w2[l], L1, L2, M1, M2, g, a1, a2);
+            w1[l] += a1 * h;
+            w2[l] += a2 * h;
+            t1[l] += w1[l] * h;
+            t2[l] += w2[l] * h;
+            if (++steps[l] % FTLE_RESCALE_EVERY == 0) {
+                rescale(l);
+            }
+        }
+    }
+
+    // Only the ratio between the tangents matters for F^T F's eigenvalues up
+    // to a common factor, so both are shrunk together to stay in range.
+    void rescale(int lane) {
+        double largest = 0.0;
+        for (int k = 0; k < 2; ++k) {
+            largest = std::max(largest, std::fabs(t1[lane].d[k]) + std::fabs(t2[lane].d[k])
+                + std::fabs(w1[lane].d[k]) + std::fabs(w2[lane].d[k]));
+        }
+        if (largest > FTLE_RESCALE_ABOVE && std::isfinite(largest)) {
+            for (int k = 0; k < 2; ++k) {
+                t1[lane].d[k] /= largest;
+                t2[lane].d[k] /= largest;
+                w1[lane].d[k] /= largest;
+                w2[lane].d[k] /= largest;
+            }
+            logScale[lane] += std::log(largest);
+        }
+    }
+
+    bool finished(int lane) const {
+        return steps[lane] >= target || !std::isfinite(t1[lane].v) || !std::isfinite(t2[lane].v);
+    }
+
+    void retire(int lane) {
+        FtleSeed& seed = seeds[member[lane]];
+        const D* variables[4] = { &t1[lane], &t2[lane], &w1[lane], &w2[lane] };
+        for (int i = 0; i < 4; ++i) {
+            seed.state[i] = variables[i]->v;
+            for (int k = 0; k < 2; ++k) {
+                seed.tangent[k][i] = variables[i]->d[k];
+            }
+        }
+        seed.logScale = logScale[lane];
+        seed.steps = steps[lane];
+    }
+};
+
+static void ftleWorker(const FtleSettings& s, std::vector<FtleSeed>& seeds, long long target,
+    std::atomic<long long>& next, std::atomic<long long>& laneSteps) {
+    const long long total = (long long)seeds.size();
+    long long cursor = 0, chunkEnd = 0;
+    auto nextSeed = [&](long long& id) {
+        for (;;) {
+            if (cursor >= chunkEnd) {
+                cursor = next.fetch_add(FTLE_CHUNK);
+                chunkEnd = std::min(cursor + FTLE_CHUNK, total);
+                if (cursor >= total) {
+                    return false;
+                }
+            }
+            id = cursor++;
+            // diverged seeds stay where they stopped
+            if (std::isfinite(seeds[id].state[0]) && std::isfinite(seeds[id].state[1])) {
+                return true;
+            }
+        }
+    };
+
+    std::unique_ptr<FtleKernel> kernel(new FtleKernel(s, seeds, target));
+    laneSteps += runLaneScheduler(*kernel, nextSeed, s.compactEvery).laneSteps;
+}
+
+static float ftleValue(const FtleSeed& seed, double time) {
+    if (!std::isfinite(seed.state[0]) || !std::isfinite(seed.state[1]) || time <= 0.0) {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    double a = 0.0, b = 0.0, c = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        a += seed.tangent[0][i] * seed.tangent[0][i];
+        b += seed.tangent[0][i] * seed.tangent[1][i];
+        c += seed.tangent[1][i] * seed.tangent[1][i];
+    }
+    double half = 0.5 * (a - c);
+    double largest = 0.5 * (a + c) + std::sqrt(half * half + b * b);
+    return (float)((seed.logScale + 0.5 * std::log(largest)) / time);
+}
+
+static CacheKey ftleFlowKey(const FtleSettings& s) {
+    CacheKey key("ftle-flow");
+    key.add("equations", EQUATIONS_VERSION)
+        .add("integrator", std::string("symplectic-euler"))
+        .add("plane", (int)s.plane)
+        .add("dt", s.dt).add("g", s.g)
+        .add("L1", s.L1).add("L2", s.L2).add("M1", s.M1).add("M2", s.M2)
+        .add("xMin", s.xMin).add("xMax", s.xMax).add("yMin", s.yMin).add("yMax", s.yMax)
+        .add("width", s.width).add("height", s.height);
+    return key;
+}
+
+std::vector<std::vector<float>> computeFtleFields(const FtleSettings& settings, FtleStats* stats) {
+    auto start = std::chrono::steady_clock::now();
+    const long long count = (long long)settings.width * settings.height;
+    std::vector<double> horizons = settings.horizons;
+    std::sort(horizons.begin(), horizons.end());
+
+    std::vector<FtleSeed> seeds((size_t)count);
+    long long reached = 0;
+    std::vector<char> payload;
+    if (settings.cache && settings.cache->load(ftleFlowKey(settings), payload)
+        && payload.size() == sizeof(reached) + seeds.size() * sizeof(FtleSeed)) {
+        std::memcpy(&reached, payload.data(), sizeof(reached));
+    }
+    long long firstTarget = horizons.empty() ? 0 : (long long)(horizons.front() / settings.dt + 0.5);
+    if (reached > 0 && reached <= firstTarget) {
+        std::memcpy(seeds.data(), payload.data() + sizeof(reached), seeds.size() * sizeof(FtleSeed));
+    }
+    else {
+        reached = 0;
+        for (long long i = 0; i < count; ++i) {
+            seedState(settings, i, seeds[i]);
+        }
+    }
+    payload.clear();
+    payload.shrink_to_fit();
+    if (stats) {
+        stats->resumedFrom = reached * settings.dt;
+    }
+
+    int threadCount = settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency();
+    threadCount = std::max(threadCount, 1);
+    std::atomic<long long> laneSteps{ 0 };
+
+    std::vector<std::vector<float>> fields;
+    long long target = reached;
+    for (double horizon : horizons) {
+        target = std::max(target, (long long)(horizon / settings.dt + 0.5));
+        std::atomic<long long> next{ 0 };
+        std::vector<std::thread> workers;
+        for (int i = 1; i < threadCount; ++i) {
+            workers.emplace_back(ftleWorker, std::cref(settings), std::ref(seeds), target, std::ref(next), std::ref(laneSteps));
+        }
+        ftleWorker(settings, seeds, target, next, laneSteps);
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        std::vector<float> field((size_t)count);
+        for (long long i = 0; i < count; ++i) {
+            field[i] = ftleValue(seeds[i], target * settings.dt);
+        }
+        fields.push_back(std::move(field));
+    }
+
+    if (settings.cache && target > reached) {
+        payload.resize(sizeof(target) + seeds.size() * sizeof(FtleSeed));
+        std::memcpy(payload.data(), &target, sizeof(target));
+        std::memcpy(payload.data() + sizeof(target), seeds.data(), seeds.size() * sizeof(FtleSeed));
+        settings.cache->store(ftleFlowKey(settings), payload.data(), payload.size());
+    }
+
+    if (stats) {
+        stats->steps += laneSteps;
+        stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return fields;
+}
+
+void ftleColor(float value, float maxValue, unsigned char rgb[3]) {
+    if (std::isnan(value)) {
+        rgb[0] = rgb[1] = rgb[2] = 0;
+        return;
+    }
+    float v = maxValue > 0.0f ? value / maxValue : 0.0f;
+    v = std::min(std::max(v, 0.0f), 1.0f);
+
+    // dark blue -> teal -> white as the stretching grows, ridges show bright
+    const float stops[3][3] = { { 0.02f, 0.02f, 0.12f }, { 0.1f, 0.55f, 0.6f }, { 1.0f, 1.0f, 0.95f } };
+    float f = v * 2.0f;
+    int i = std::min((int)f, 1);
+    f -= i;
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = (unsigned char)(255.0f * (stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f));
+    }
+}
+
+// Scales to the 99.5th percentile so a few near-singular seeds do not wash
+// the ridges out.
+static float ftleScale(const std::vector<float>& field) {
+    std::vector<float> finite;
+    for (float value : field) {
+        if (!std::isnan(value)) {
+            finite.push_back(value);
+        }
+    }
+    if (finite.empty()) {
+        return 1.0f;
+    }
+    size_t index = (size_t)(0.995 * (finite.size() - 1));
+    std::nth_element(finite.begin(), finite.begin() + index, finite.end());
+    return finite[index];
+}
+
+int runFtleCommand(int argc, char** argv) {
+    configureResultCache(argc, argv);
+
+    FtleSettings settings;
+    settings.cache = resultCache();
+    int size = intArgument(argc, argv, "--size", settings.width);
+    settings.width = intArgument(argc, argv, "--width", size);
+    settings.height = intArgument(argc, argv, "--height", size);
+    if (stringArgument(argc, argv, "--plane", "angles") == "theta-omega") {
+        settings.plane = FTLE_PLANE_THETA_OMEGA;
+        settings.yMax = floatArgument(argc, argv, "--omega-max", 10.0f);
+        settings.yMin = -settings.yMax;
+    }
+    settings.L1 = floatArgument(argc, argv, "--l1", INITIAL_LENGTH);
+    settings.L2 = floatArgument(argc, argv, "--l2", INITIAL_LENGTH);
+    settings.M1 = floatArgument(argc, argv, "--m1", INITIAL_MASS);
+    settings.M2 = floatArgument(argc, argv, "--m2", INITIAL_MASS);
+    settings.g = floatArgument(argc, argv, "--g", G);
+    settings.dt = floatArgument(argc, argv, "--dt", (float)settings.dt);
+    settings.horizons = parseValues(findArgument(argc, argv, "--horizons"), floatArgument(argc, argv, "--time", 10.0f));
+    settings.threads = intArgument(argc, argv, "--threads", 0);
+    settings.compactEvery = intArgument(argc, argv, "--compact-every", settings.compactEvery);
+    std::string prefix = stringArgument(argc, argv, "--out", "ftle");
+    bool raw = hasArgument(argc, argv, "--raw");
+
+    bool valid = settings.width > 0 && settings.height > 0 && settings.dt > 0.0 && settings.yMax > settings.yMin;
+    for (double horizon : settings.horizons) {
+        valid = valid && horizon > 0.0;
+    }
+    if (!valid || settings.horizons.empty()) {
+        std::cerr << "Invalid FTLE settings" << std::endl;
+        return -1;
+    }
+
+    FtleStats stats;
+    std::vector<std::vector<float>> fields = computeFtleFields(settings, &stats);
+    std::sort(settings.horizons.begin(), settings.horizons.end());
+
+    std::cout << settings.width << "x" << settings.height << " FTLE fields in " << stats.seconds << " s, "
+        << stats.steps << " lane steps";
+    if (stats.resumedFrom > 0.0) {
+        std::cout << " (continued from T = " << stats.resumedFrom << ")";
+    }
+    std::cout << std::endl;
+
+    for (size_t i = 0; i < fields.size(); ++i) {
+        char suffix[64];
+        std::snprintf(suffix, sizeof(suffix), "_T%g", settings.horizons[i]);
+        std::string path = prefix + suffix;
+
+        float scale = ftleScale(fields[i]);
+        std::vector<unsigned char> rgb(fields[i].size() * 3);
+        for (size_t p = 0; p < fields[i].size(); ++p) {
+            ftleColor(fields[i][p], scale, &rgb[p * 3]);
+        }
+        if (!writePng(path + ".png", rgb.data(), settings.width, settings.height)) {
+            std::cerr << "Failed to write " << path << ".png" << std::endl;
+            return -1;
+        }
+        if (raw) {
+            FILE* file = std::fopen((path + ".f32").c_str(), "wb");
+            bool ok = file && std::fwrite(fields[i].data(), sizeof(float), fields[i].size(), file) == fields[i].size();
+            if (file) {
+                ok = std::fclose(file) == 0 && ok;
+            }
+            if (!ok) {
+                std::cerr << "Failed to write " << path << ".f32" << std::endl;
+                return -1;
+            }
+        }
+        std::cout << "T = " << settings.horizons[i] << ": " << path << ".png (scale " << scale << ")" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Physics.h"
+
+class ResultCache;
+
+enum FtlePlane {
+    FTLE_PLANE_ANGLES,      // x = theta1, y = theta2, both arms at rest
+    FTLE_PLANE_THETA_OMEGA  // x = theta1, y = omega1, second arm hanging at rest
+};
+
+struct FtleSettings {
+    int width = 512;
+    int height = 512;
+    FtlePlane plane = FTLE_PLANE_ANGLES;
+    double xMin = -M_PI;
+    double xMax = M_PI;
+    double yMin = -M_PI;
+    double yMax = M_PI;
+    double L1 = 0.7;
+    double L2 = 0.7;
+    double M1 = 1.0;
+    double M2 = 1.0;
+    double g = 9.81;
+    double dt = 0.001;
+    std::vector<double> horizons = std::vector<double>(1, 10.0);
+    int threads = 0;
+    int compactEvery = 16;
+    ResultCache* cache = nullptr;
+};
+
+struct FtleStats {
+    double resumedFrom = 0.0;
+    long long steps = 0;
+    double seconds = 0.0;
+};
+
+// One field per horizon (sorted ascending), width * height values each, row
+// 0 at yMax. A value is the largest finite-time Lyapunov exponent
+// log(sqrt(largest eigenvalue of F^T F)) / T, where F is the gradient of the
+// flow map with respect to the two seed coordinates. F is integrated
+// alongside the seeds as two tangent vectors, so no neighbouring grid points
+// are needed. NaN marks a seed that diverged.
+// The horizons are reached one after another from the same flow state, and
+// with a cache the state at the last horizon is kept, so a later run with a
+// longer horizon continues from it instead of starting over.
+std::vector<std::vector<float>> computeFtleFields(const FtleSettings& settings, FtleStats* stats = nullptr);
+
+void ftleColor(float value, float maxValue, unsigned char rgb[3]);
+
+int runFtleCommand(int argc, char** argv);
@@ -0,0 +1,277 @@
+#include "GaussLegendre.h"
+#include "Chain.h"
+#include "Dual.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int GAUSS_MAX_ITERATIONS = 20;
+const int GAUSS_REFRESH_ITERATIONS = 8;     // refactor once a step needs more than this
+const int GAUSS_MAX_SPLITS = 8;
+const double GAUSS_TOLERANCE = 1e-14;
+
+// LU factorization with partial pivoting of the n x n row-major matrix in
+// place; false if singular.
+static bool factorLu(std::vector<double>& m, std::vector<int>& pivots, int n) {
+    pivots.resize(n);
+    for (int k = 0; k < n; ++k) {
+        int pivot = k;
+        for (int i = k + 1; i < n; ++i) {
+            if (std::fabs(m[i * n + k]) > std::fabs(m[pivot * n + k])) {
+                pivot = i;
+            }
+        }
+        if (m[pivot * n + k] == 0.0) {
+            return false;
+        }
+        pivots[k] = pivot;
+        if (pivot != k) {
+            for (int j = 0; j < n; ++j) {
+                std::swap(m[k * n + j], m[pivot * n + j]);
+            }
+        }
+        for (int i = k + 1; i < n; ++i) {
+            double factor = m[i * n + k] / m[k * n + k];
+            m[i * n + k] = factor;
+            for (int j = k + 1; j < n; ++j) {
+                m[i * n + j] -= factor * m[k * n + j];
+            }
+        }
+    }
+    return true;
+}
+
+static void solveLu(const std::vector<double>& m, const std::vector<int>& pivots, int n, double* x) {
+    for (int k = 0; k < n; ++k) {
+        std::swap(x[k], x[pivots[k]]);
+        for (int i = k + 1; i < n; ++i) {
+            x[i] -= m[i * n + k] * x[k];
+        }
+    }
+    for (int i = n - 1; i >= 0; --i) {
+        for (int j = i + 1; j < n; ++j) {
+            x[i] -= m[i * n + j] * x[j];
+        }
+        x[i] /= m[i * n + i];
+    }
+}
+
+GaussLegendreStepper::GaussLegendreStepper(const ChainParameters& chain, int stageCount)
+    : ChainStepper(chain), stages(stageCount == 2 ? 2 : 3) {
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            a[i][j] = 0.0;
+        }
+        b[i] = c[i] = d[i] = 0.0;
+    }
+    if (stages == 2) {
+        double r = std::sqrt(3.0) / 6.0;
+        c[0] = 0.5 - r; c[1] = 0.5 + r;
+        a[0][0] = 0.25; a[0][1] = 0.25 - r;
+        a[1][0] = 0.25 + r; a[1][1] = 0.25;
+        b[0] = b[1] = 0.5;
+    }
+    else {
+        double r = std::sqrt(15.0);
+        c[0] = 0.5 - r / 10.0; c[1] = 0.5; c[2] = 0.5 + r / 10.0;
+        a[0][0] = 5.0 / 36.0; a[0][1] = 2.0 / 9.0 - r / 15.0; a[0][2] = 5.0 / 36.0 - r / 30.0;
+        a[1][0] = 5.0 / 36.0 + r / 24.0; a[1][1] = 2.0 / 9.0; a[1][2] = 5.0 / 36.0 - r / 24.0;
+        a[2][0] = 5.0 / 36.0 + r / 30.0; a[2][1] = 2.0 / 9.0 + r / 15.0; a[2][2] = 5.0 / 36.0;
+        b[0] = b[2] = 5.0 / 18.0; b[1] = 4.0 / 9.0;
+    }
+
+    // d solves A^T d = b
+    std::vector<double> transpose(stages * stages);
+    std::vector<int> order;
+    for (int i = 0; i < stages; ++i) {
+        for (int j = 0; j < stages; ++j) {
+            transpose[i * stages + j] = a[j][i];
+        }
+        d[i] = b[i];
+    }
+    factorLu(transpose, order, stages);
+    solveLu(transpose, order, stages, d);
+}
+
+void GaussLegendreStepper::refresh(const double* state, double h) {
+    typedef Dual<double, 2 * CHAIN_MAX_LINKS> D;
+    const int n = chain.links();
+    const int size = stages * n;
+
+    D theta[CHAIN_MAX_LINKS], omega[CHAIN_MAX_LINKS], accel[CHAIN_MAX_LINKS];
+    for (int i = 0; i < n; ++i) {
+        theta[i] = D::variable(state[i], i);
+        omega[i] = D::variable(state[n + i], n + i);
+    }
+    chainAccel(n, theta, omega, chain.lengths.data(), chain.masses.data(), chain.g, accel);
+
+    double aa[3][3];
+    for (int i = 0; i < stages; ++i) {
+        for (int k = 0; k < stages; ++k) {
+            aa[i][k] = 0.0;
+            for (int j = 0; j < stages; ++j) {
+                aa[i][k] += a[i][j] * a[j][k];
+            }
+        }
+    }
+
+    // dF_i/dZ_k = delta_ik I - h a_ik dacc/domega - h^2 (A^2)_ik dacc/dtheta
+    lu.assign((size_t)size * size, 0.0);
+    for (int i = 0; i < stages; ++i) {
+        for (int k = 0; k < stages; ++k) {
+            for (int p = 0; p < n; ++p) {
+                for (int q = 0; q < n; ++q) {
+                    double value = -h * a[i][k] * accel[p].d[n + q] - h * h * aa[i][k] * accel[p].d[q];
+                    if (i == k && p == q) {
+                        value += 1.0;
+                    }
+                    lu[(size_t)(i * n + p) * size + k * n + q] = value;
+                }
+            }
+        }
+    }
+    factored = factorLu(lu, pivots, size);
+    factoredStep = h;
+    ++refreshCount;
+}
+
+// Simplified Newton on F_i(Z) = Z_i - h sum_j a_ij acc(Theta_j, Omega_j),
+// with Omega_j = omega0 + Z_j and Theta_j = theta0 + h sum_k a_jk Omega_k.
+bool GaussLegendreStepper::solve(const double* state, double h, std::vector<double>& z) {
+    const int n = chain.links();
+    const int size = stages * n;
+    double theta[CHAIN_MAX_LINKS], omega[CHAIN_MAX_LINKS];
+    double accel[3][CHAIN_MAX_LINKS];
+    double delta[3 * CHAIN_MAX_LINKS];
+    double previousNorm = 0.0;
+
+    for (int iteration = 0; iteration < GAUSS_MAX_ITERATIONS; ++iteration) {
+        for (int j = 0; j < stages; ++j) {
+            for (int p = 0; p < n; ++p) {
+                double sum = 0.0;
+                for (int k = 0; k < stages; ++k) {
+                    sum += a[j][k] * (state[n + p] + z[k * n + p]);
+                }
+                theta[p] = state[p] + h * sum;
+                omega[p] = state[n + p] + z[j * n + p];
+            }
+            chainAccel(n, theta, omega, chain.lengths.data(), chain.masses.data(), chain.g, accel[j]);
+        }
+        for (int i = 0; i < stages; ++i) {
+            for (int p = 0; p < n; ++p) {
+                double sum = 0.0;
+                for (int j = 0; j < stages; ++j) {
+                    sum += a[i][j] * accel[j][p];
+                }
+                delta[i * n + p] = -(z[i * n + p] - h * sum);
+            }
+        }
+        solveLu(lu, pivots, size, delta);
+
+        double norm = 0.0, scale = 1.0;
+        for (int i = 0; i < size; ++i) {
+            z[i] += delta[i];
+            norm = std::max(norm, std::fabs(delta[i]));
+            scale = std::max(scale, std::fabs(state[n + i % n] + z[i]));
+        }
+        ++iterationCount;
+        lastIterations = iteration + 1;
+        if (!std::isfinite(norm)) {
+            return false;
+        }
+        // done at the tolerance, or once roundoff stops the corrections shrinking
+        if (norm <= GAUSS_TOLERANCE * scale || (iteration > 0 && norm >= previousNorm && norm < 1e-10 * scale)) {
+            return true;
+        }
+        if (iteration > 1 && norm >= previousNorm) {
+            return false;
+        }
+        previousNorm = norm;
+    }
+    return false;
+}
+
+bool GaussLegendreStepper::step(double* state, double h, bool force) {
+    const int n = chain.links();
+    const int size = stages * n;
+    std::vector<double> z(size, 0.0);
+
+    // warm start: the last step's collocation polynomial through its start
+    // (t = 0) and stages (t = c_i), evaluated at 1 + c_i
+    if (warm && previousStep == h) {
+        double nodes[4] = { 0.0, c[0], c[1], c[2] };
+        for (int i = 0; i < stages; ++i) {
+            double t = 1.0 + c[i];
+            for (int m = 0; m <= stages; ++m) {
+                double weight = 1.0;
+                for (int l = 0; l <= stages; ++l) {
+                    if (l != m) {
+                        weight *= (t - nodes[l]) / (nodes[m] - nodes[l]);
+                    }
+                }
+                for (int p = 0; p < n; ++p) {
+                    double value = m == 0 ? previousStart[n + p] : previousStages[(m - 1) * n + p];
+                    z[i * n + p] += weight * value;
+                }
+            }
+            for (int p = 0; p < n; ++p) {
+                z[i * n + p] -= state[n + p];
+            }
+        }
+    }
+
+    if (!factored || factoredStep != h || lastIterations > GAUSS_REFRESH_ITERATIONS) {
+        refresh(state, h);
+    }
+    if (!solve(state, h, z)) {
+        // stale Jacobian or a poor guess: refactor here and start over
+        refresh(state, h);
+        std::fill(z.begin(), z.end(), 0.0);
+        bool converged = solve(state, h, z);
+        bool finite = true;
+        for (double value : z) {
+            finite = finite && std::isfinite(value);
+        }
+        if (!converged && (!force || !finite)) {
+            warm = false;
+            return false;
+        }
+        if (!converged) {
+            ++failureCount;
+        }
+    }
+
+    previousStart.assign(state, state + 2 * n);
+    previousStages.resize(size);
+    for (int i = 0; i < size; ++i) {
+        previousStages[i] = state[n + i % n] + z[i];
+    }
+    previousStep = h;
+    warm = true;
+
+    for (int p = 0; p < n; ++p) {
+        double thetaSum = 0.0, omegaSum = 0.0;
+        for (int i = 0; i < stages; ++i) {
+            thetaSum += b[i] * (state[n + p] + z[i * n + p]);
+            omegaSum += d[i] * z[i * n + p];
+        }
+        state[p] += h * thetaSum;
+        state[n + p] += omegaSum;
+    }
+    return true;
+}
+
+// A step the iteration cannot converge is taken as two half steps instead;
+// composing symplectic steps keeps the map symplectic.
+void GaussLegendreStepper::split(double* state, double h, int depth) {
+    if (step(state, h, depth >= GAUSS_MAX_SPLITS)) {
+        return;
+    }
+    ++splitCount;
+    split(state, 0.5 * h, depth + 1);
+    split(state, 0.5 * h, depth + 1);
+}
+
+void GaussLegendreStepper::advance(double* state, double h) {
+    split(state, h, 0);
+}
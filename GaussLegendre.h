@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Stepper.h"
+
+#include <string>
+#include <vector>
+
+// Implicit Gauss-Legendre Runge-Kutta with 2 (order 4) or 3 (order 6)
+// stages. It is symplectic for the non-separable chain Lagrangian, so the
+// energy error stays bounded instead of drifting. The angle stages are
+// linear in the angular velocity stages and are eliminated, leaving s * n
+// unknowns solved by simplified Newton: the iteration matrix comes from the
+// accelerations' Jacobian (through the mass matrix) at the start of a step,
+// and its LU factorization is shared by all stages and iterations and kept
+// across steps until convergence slows. Each step starts from the previous
+// step's collocation polynomial extrapolated forward, and a step that will
+// not converge is halved.
+class GaussLegendreStepper : public ChainStepper {
+public:
+    GaussLegendreStepper(const ChainParameters& chain, int stages);
+
+    void advance(double* state, double h) override;
+    std::string name() const override { return stages == 2 ? "gauss2" : "gauss3"; }
+
+    long long iterations() const { return iterationCount; }
+    long long refreshes() const { return refreshCount; }
+    long long splits() const { return splitCount; }
+    long long failures() const { return failureCount; }     // accepted unconverged at the smallest split
+
+private:
+    void refresh(const double* state, double h);
+    bool solve(const double* state, double h, std::vector<double>& stageOmega);
+    bool step(double* state, double h, bool force);
+    void split(double* state, double h, int depth);
+
+    int stages;
+    double a[3][3];
+    double b[3];
+    double c[3];
+    double d[3];                // b^T A^-1, so omega1 = omega0 + d . Z
+
+    std::vector<double> lu;
+    std::vector<int> pivots;
+    double factoredStep = 0.0;
+    bool factored = false;
+    int lastIterations = 0;
+
+    bool warm = false;
+    double previousStep = 0.0;
+    std::vector<double> previousStart;
+    std::vector<double> previousStages;
+
+    long long iterationCount = 0;
+    long long refreshCount = 0;
+    long long splitCount = 0;
+    long long failureCount = 0;
+};
@@ -0,0 +1,425 @@
+#include "Histogram.h"
+#include "CommandLine.h"
+#include "Png.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+const int HISTOGRAM_BLOCK = 256;
+
+PhaseHistogram::PhaseHistogram(const std::vector<HistogramAxis>& axes, int threads) : axisList(axes) {
+    size_t bins = 1;
+    for (const HistogramAxis& axis : axisList) {
+        scale.push_back(axis.bins / (axis.max - axis.min));
+        stride.push_back((int)bins);
+        wraps.push_back(axis.quantity <= HISTOGRAM_THETA2);
+        bins *= (size_t)std::max(axis.bins, 1);
+        if (axis.quantity >= HISTOGRAM_BOB1_X) {
+            bobs[axis.quantity >= HISTOGRAM_BOB2_X] = true;
+        }
+    }
+    // one spare bin past the end takes the out-of-range samples
+    privateBins.assign((size_t)std::max(threads, 1), std::vector<uint32_t>(bins + 1, 0));
+    scratch.assign(privateBins.size(), std::vector<int>(2 * HISTOGRAM_BLOCK));
+    paddedScratch.assign(privateBins.size(), std::vector<double>(HISTOGRAM_BLOCK));
+    totals.assign(bins, 0);
+}
+
+// Bins one axis of a whole block in a single branch-free single-precision
+// pass. Angles lose their nearest whole turn, rounded by adding and removing
+// 1.5 * 2^23. Positions are offset by one bin so that truncation floors every
+// position that can land in range, and clamped so the conversion cannot
+// overflow; one unsigned compare then tests both ends. The first axis,
+// whose stride is one, starts the block's indices and the others add to
+// them, and only angles are wrapped, so that each pass does just the work
+// it needs; without SSE4.1 a vector of ints is multiplied a pair at a time.
+template<bool WRAP, bool FIRST>
+static void binAxis(const double* source, const HistogramAxis& axis, float perBin, int step, int* index, int* outside) {
+    const float offset = 1.0f - (float)(axis.min * perBin), top = (float)axis.bins + 1.0f;
+    const unsigned binCount = (unsigned)axis.bins;
+    for (int i = 0; i < HISTOGRAM_BLOCK; ++i) {
+        float value = (float)source[i];
+        if (WRAP) {
+            float turns = (value * (float)(0.5 / M_PI) + 12582912.0f) - 12582912.0f;
+            value -= (float)(2.0 * M_PI) * turns;
+        }
+        float position = value * perBin + offset;
+        position = position > 0.0f ? position : 0.0f;
+        position = position < top ? position : top;
+        int bin = (int)position - 1;
+        if (FIRST) {
+            outside[i] = (unsigned)bin >= binCount;
+            index[i] = bin;
+        }
+        else {
+            outside[i] |= (unsigned)bin >= binCount;
+            index[i] += bin * step;
+        }
+    }
+}
+
+void PhaseHistogram::add(int thread, int count, const double* const values[8]) {
+    uint32_t* bins = privateBins[thread].data();
+    int* index = scratch[thread].data();
+    int* outside = index + HISTOGRAM_BLOCK;
+    double* padding = paddedScratch[thread].data();
+    const int spare = (int)totals.size();
+
+    for (int first = 0; first < count; first += HISTOGRAM_BLOCK) {
+        const int n = std::min(HISTOGRAM_BLOCK, count - first);
+        // every pass covers a whole block, so that it has a fixed trip count
+        // and vectorizes even at -O2; a short last block is padded with
+        // zeros, which are binned and never counted
+        for (size_t a = 0; a < axisList.size(); ++a) {
+            const double* source = values[axisList[a].quantity] + first;
+            if (n < HISTOGRAM_BLOCK) {
+                std::copy(source, source + n, padding);
+                std::fill(padding + n, padding + HISTOGRAM_BLOCK, 0.0);
+                source = padding;
+            }
+            const HistogramAxis& axis = axisList[a];
+            const float perBin = (float)scale[a];
+            if (wraps[a]) {
+                if (a == 0) {
+                    binAxis<true, true>(source, axis, perBin, 1, index, outside);
+                }
+                else {
+                    binAxis<true, false>(source, axis, perBin, stride[a], index, outside);
+                }
+            }
+            else if (a == 0) {
+                binAxis<false, true>(source, axis, perBin, 1, index, outside);
+            }
+            else {
+                binAxis<false, false>(source, axis, perBin, stride[a], index, outside);
+            }
+        }
+        for (int i = 0; i < HISTOGRAM_BLOCK; ++i) {
+            index[i] = outside[i] ? spare : index[i];
+        }
+        for (int i = 0; i < n; ++i) {
+            ++bins[index[i]];
+        }
+    }
+}
+
+void PhaseHistogram::reduce(int thread, Barrier& barrier) {
+    const int count = threads();
+    privateBins[thread][totals.size()] = 0;
+    for (int width = 1; width < count; width *= 2) {
+        if (thread % (2 * width) == 0 && thread + width < count) {
+            std::vector<uint32_t>& into = privateBins[thread];
+            std::vector<uint32_t>& from = privateBins[thread + width];
+            for (size_t i = 0; i < totals.size(); ++i) {
+                into[i] += from[i];
+                from[i] = 0;
+            }
+        }
+        barrier.wait();
+    }
+
+    // the root is folded into the totals a slice per thread
+    std::vector<uint32_t>& root = privateBins[0];
+    size_t begin = totals.size() * thread / count, end = totals.size() * (thread + 1) / count;
+    for (size_t i = begin; i < end; ++i) {
+        totals[i] += root[i];
+        root[i] = 0;
+    }
+    barrier.wait();
+}
+
+std::vector<unsigned long long> PhaseHistogram::project(int axisX, int axisY) const {
+    const int binsX = axisList[axisX].bins, binsY = axisList[axisY].bins;
+    std::vector<unsigned long long> image((size_t)binsX * binsY, 0);
+    for (size_t i = 0; i < totals.size(); ++i) {
+        if (totals[i] == 0) {
+            continue;
+        }
+        size_t x = i / stride[axisX] % binsX;
+        size_t y = i / stride[axisY] % binsY;
+        image[(binsY - 1 - y) * binsX + x] += totals[i];
+    }
+    return image;
+}
+
+static int ensembleThreads(const HistogramSettings& s) {
+    int threads = s.threads > 0 ? s.threads : (int)std::thread::hardware_concurrency();
+    return std::max(std::min(threads, s.members), 1);
+}
+
+HistogramEnsemble::HistogramEnsemble(const HistogramSettings& settings)
+    : settings(settings), histogramData(settings.axes, ensembleThreads(settings)), barrier(ensembleThreads(settings)) {
+    // private bins are 32-bit, so no bin may see 2^32 adds between reductions
+    long long limit = (1LL << 31) / std::max(this->settings.members, 1);
+    this->settings.mergeEvery = (int)std::max(std::min<long long>(this->settings.mergeEvery, limit), 1LL);
+
+    int threads = histogramData.threads();
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(&HistogramEnsemble::worker, this, i);
+    }
+}
+
+HistogramEnsemble::~HistogramEnsemble() {
+    stop();
+}
+
+bool HistogramEnsemble::snapshot(std::vector<unsigned long long>& counts, long long& version) {
+    std::lock_guard<std::mutex> lock(publishMutex);
+    publishWanted = true;
+    if (publishedVersion == version) {
+        return false;
+    }
+    counts = published;
+    version = publishedVersion;
+    return true;
+}
+
+void HistogramEnsemble::wait() {
+    for (std::thread& thread : workers) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+void HistogramEnsemble::stop() {
+    stopping = true;
+    wait();
+}
+
+void HistogramEnsemble::worker(int thread) {
+    const HistogramSettings& s = settings;
+    const int threads = histogramData.threads();
+    const int begin = (int)((long long)s.members * thread / threads);
+    const int end = (int)((long long)s.members * (thread + 1) / threads);
+    const int count = end - begin;
+
+    std::vector<double> t1(count), t2(count), w1(count, 0.0), w2(count, 0.0);
+    // the sines and cosines are padded to whole blocks, and the bob
+    // positions worked out from them a block at a time just before binning
+    const size_t padded = ((size_t)count + HISTOGRAM_BLOCK - 1) / HISTOGRAM_BLOCK * HISTOGRAM_BLOCK;
+    std::vector<double> s1(padded), c1(padded), s2(padded), c2(padded);
+    std::vector<double> x1(HISTOGRAM_BLOCK), y1(HISTOGRAM_BLOCK), x2(HISTOGRAM_BLOCK), y2(HISTOGRAM_BLOCK);
+    int side = (int)std::ceil(std::sqrt((double)s.members));
+    for (int i = 0; i < count; ++i) {
+        int member = begin + i;
+        t1[i] = s.theta1 + s.spread * ((member % side + 0.5) / side - 0.5);
+        t2[i] = s.theta2 + s.spread * ((member / side + 0.5) / side - 0.5);
+        s1[i] = std::sin(t1[i]);
+        c1[i] = std::cos(t1[i]);
+        s2[i] = std::sin(t2[i]);
+        c2[i] = std::cos(t2[i]);
+    }
+    const double* const values[8] = { t1.data(), t2.data(), w1.data(), w2.data(), x1.data(), y1.data(), x2.data(), y2.data() };
+    const bool bob1 = histogramData.usesBob(0), bob2 = histogramData.usesBob(1);
+    const double L1 = s.L1, L2 = s.L2;
+    const int sampleEvery = std::max(s.sampleEvery, 1);
+
+    const long long total = s.time > 0.0 ? (long long)(s.time / s.dt + 0.5) : -1;
+    long long done = 0;
+    for (;;) {
+        long long chunk = total < 0 ? s.mergeEvery : std::min<long long>(s.mergeEvery, total - done);
+        long long stepTime = 0, fillTime = 0;
+        for (long long k = 0; k < chunk; ++k) {
+            auto start = std::chrono::steady_clock::now();
+            // the sines and cosines carried between steps serve both the
+            // next acceleration and the bob positions
+            for (int i = 0; i < count; ++i) {
+                double a1, a2;
+                doublePendulumAccelTrig(s1[i], c1[i], s2[i], c2[i], w1[i], w2[i], s.L1, s.L2, s.M1, s.M2, s.g, a1, a2);
+                w1[i] += a1 * s.dt;
+                w2[i] += a2 * s.dt;
+                t1[i] += w1[i] * s.dt;
+                t2[i] += w2[i] * s.dt;
+                s1[i] = std::sin(t1[i]);
+                c1[i] = std::cos(t1[i]);
+                s2[i] = std::sin(t2[i]);
+                c2[i] = std::cos(t2[i]);
+            }
+            auto stepped = std::chrono::steady_clock::now();
+            if ((done + k + 1) % sampleEvery != 0) {
+                stepTime += std::chrono::duration_cast<std::chrono::nanoseconds>(stepped - start).count();
+                continue;
+            }
+            if (bob1 || bob2) {
+                // only the bobs on some axis are worked out
+                for (int first = 0; first < count; first += HISTOGRAM_BLOCK) {
+                    if (bob1) {
+                        for (int i = 0; i < HISTOGRAM_BLOCK; ++i) {
+                            x1[i] = L1 * s1[first + i];
+                            y1[i] = -L1 * c1[first + i];
+                        }
+                    }
+                    if (bob2) {
+                        for (int i = 0; i < HISTOGRAM_BLOCK; ++i) {
+                            x2[i] = L1 * s1[first + i] + L2 * s2[first + i];
+                            y2[i] = -L1 * c1[first + i] - L2 * c2[first + i];
+                        }
+                    }
+                    const double* const block[8] = { t1.data() + first, t2.data() + first, w1.data() + first, w2.data() + first,
+                        x1.data(), y1.data(), x2.data(), y2.data() };
+                    histogramData.add(thread, std::min(HISTOGRAM_BLOCK, count - first), block);
+                }
+            }
+            else {
+                histogramData.add(thread, count, values);
+            }
+            auto filled = std::chrono::steady_clock::now();
+            stepTime += std::chrono::duration_cast<std::chrono::nanoseconds>(stepped - start).count();
+            fillTime += std::chrono::duration_cast<std::chrono::nanoseconds>(filled - stepped).count();
+        }
+        done += chunk;
+        stepNanoseconds += stepTime;
+        fillNanoseconds += fillTime;
+
+        histogramData.reduce(thread, barrier);
+        if (thread == 0) {
+            // totals are only copied out while someone is watching
+            std::lock_guard<std::mutex> lock(publishMutex);
+            if (publishWanted) {
+                published = histogramData.counts();
+                ++publishedVersion;
+                publishWanted = false;
+            }
+            stepsDone = done;
+            finishedRun = stopping || (total >= 0 && done >= total);
+        }
+        barrier.wait();
+        if (finishedRun) {
+            return;
+        }
+    }
+}
+
+void densityColor(unsigned long long count, unsigned long long peak, unsigned char rgb[3]) {
+    if (count == 0 || peak == 0) {
+        rgb[0] = rgb[1] = rgb[2] = 0;
+        return;
+    }
+    float v = (float)(std::log1p((double)count) / std::log1p((double)peak));
+
+    // dark purple -> red -> orange -> pale yellow as the density grows
+    const float stops[4][3] = { { 0.12f, 0.02f, 0.25f }, { 0.7f, 0.1f, 0.3f }, { 0.98f, 0.55f, 0.1f }, { 1.0f, 1.0f, 0.75f } };
+    float f = std::min(std::max(v, 0.0f), 1.0f) * 3.0f;
+    int i = std::min((int)f, 2);
+    f -= i;
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = (unsigned char)(255.0f * (stops[i][c] + (stops[i + 1][c] - stops[i][c]) * f));
+    }
+}
+
+static bool parseQuantity(const std::string& name, HistogramQuantity& quantity) {
+    const char* names[8] = { "theta1", "theta2", "omega1", "omega2", "bob1x", "bob1y", "bob2x", "bob2y" };
+    for (int i = 0; i < 8; ++i) {
+        if (name == names[i]) {
+            quantity = (HistogramQuantity)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Default range for a quantity: a full turn for angles, +-omegaMax for
+// angular velocities and the reach of the arms for bob positions.
+void defaultHistogramRange(HistogramAxis& axis, double omegaMax, double reach) {
+    if (axis.quantity <= HISTOGRAM_THETA2) {
+        axis.min = -M_PI;
+        axis.max = M_PI;
+    }
+    else if (axis.quantity <= HISTOGRAM_OMEGA2) {
+        axis.min = -omegaMax;
+        axis.max = omegaMax;
+    }
+    else {
+        axis.min = -reach;
+        axis.max = reach;
+    }
+}
+
+int runHistogramCommand(int argc, char** argv) {
+    HistogramSettings settings;
+    settings.L1 = floatArgument(argc, argv, "--l1", INITIAL_LENGTH);
+    settings.L2 = floatArgument(argc, argv, "--l2", INITIAL_LENGTH);
+    settings.M1 = floatArgument(argc, argv, "--m1", INITIAL_MASS);
+    settings.M2 = floatArgument(argc, argv, "--m2", INITIAL_MASS);
+    settings.g = floatArgument(argc, argv, "--g", G);
+    settings.dt = floatArgument(argc, argv, "--dt", (float)settings.dt);
+    settings.time = floatArgument(argc, argv, "--time", 100.0f);
+    settings.theta1 = floatArgument(argc, argv, "--theta1", (float)settings.theta1);
+    settings.theta2 = floatArgument(argc, argv, "--theta2", (float)settings.theta2);
+    settings.spread = floatArgument(argc, argv, "--spread", (float)settings.spread);
+    settings.members = intArgument(argc, argv, "--members", settings.members);
+    settings.threads = intArgument(argc, argv, "--threads", 0);
+    settings.mergeEvery = intArgument(argc, argv, "--merge-every", settings.mergeEvery);
+    settings.sampleEvery = intArgument(argc, argv, "--sample-every", settings.sampleEvery);
+    double omegaMax = floatArgument(argc, argv, "--omega-max", 15.0f);
+    std::string imagePath = stringArgument(argc, argv, "--out", "density.png");
+    std::string rawPath = stringArgument(argc, argv, "--raw", "");
+
+    std::vector<double> bins = parseValues(findArgument(argc, argv, "--bins"), 512.0);
+    std::string axisNames = stringArgument(argc, argv, "--axes", "theta1,theta2");
+    settings.axes.clear();
+    size_t start = 0;
+    while (start <= axisNames.size()) {
+        size_t comma = std::min(axisNames.find(',', start), axisNames.size());
+        HistogramAxis axis;
+        if (!parseQuantity(axisNames.substr(start, comma - start), axis.quantity)) {
+            std::cerr << "Unknown histogram axis " << axisNames.substr(start, comma - start) << std::endl;
+            return -1;
+        }
+        defaultHistogramRange(axis, omegaMax, settings.L1 + settings.L2);
+        axis.bins = (int)bins[std::min(settings.axes.size(), bins.size() - 1)];
+        settings.axes.push_back(axis);
+        start = comma + 1;
+    }
+
+    bool valid = settings.axes.size() >= 2 && settings.axes.size() <= 4 && settings.members > 0
+        && settings.dt > 0.0 && settings.time > 0.0 && omegaMax > 0.0;
+    double binCount = 1.0;
+    for (const HistogramAxis& axis : settings.axes) {
+        valid = valid && axis.bins > 0;
+        binCount *= axis.bins;
+    }
+    valid = valid && binCount < 2147483647.0;
+    if (!valid) {
+        std::cerr << "Invalid histogram settings" << std::endl;
+        return -1;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    HistogramEnsemble ensemble(settings);
+    ensemble.wait();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    const PhaseHistogram& histogram = ensemble.histogram();
+    std::cout << settings.members << " members x " << ensemble.steps() << " steps into " << histogram.binCount()
+        << " bins in " << seconds << " s; filling took " << ensemble.fillSeconds() << " s against "
+        << ensemble.stepSeconds() << " s of stepping ("
+        << (ensemble.stepSeconds() > 0.0 ? 100.0 * ensemble.fillSeconds() / ensemble.stepSeconds() : 0.0) << "%)" << std::endl;
+
+    std::vector<unsigned long long> image = histogram.project(0, 1);
+    unsigned long long peak = *std::max_element(image.begin(), image.end());
+    std::vector<unsigned char> rgb(image.size() * 3);
+    for (size_t i = 0; i < image.size(); ++i) {
+        densityColor(image[i], peak, &rgb[i * 3]);
+    }
+    if (!writePng(imagePath, rgb.data(), settings.axes[0].bins, settings.axes[1].bins)) {
+        std::cerr << "Failed to write " << imagePath << std::endl;
+        return -1;
+    }
+    if (!rawPath.empty()) {
+        const std::vector<unsigned long long>& counts = histogram.counts();
+        FILE* file = std::fopen(rawPath.c_str(), "wb");
+        bool ok = file && std::fwrite(counts.data(), sizeof(counts[0]), counts.size(), file) == counts.size();
+        if (file) {
+            ok = std::fclose(file) == 0 && ok;
+        }
+        if (!ok) {
+            std::cerr << "Failed to write " << rawPath << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
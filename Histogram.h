@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Barrier.h"
+#include "Physics.h"
+
+enum HistogramQuantity {
+    HISTOGRAM_THETA1,
+    HISTOGRAM_THETA2,
+    HISTOGRAM_OMEGA1,
+    HISTOGRAM_OMEGA2,
+    HISTOGRAM_BOB1_X,
+    HISTOGRAM_BOB1_Y,
+    HISTOGRAM_BOB2_X,
+    HISTOGRAM_BOB2_Y
+};
+
+// Angles are wrapped to [-pi, pi) before binning. Samples outside
+// [min, max) on any axis are dropped.
+struct HistogramAxis {
+    HistogramQuantity quantity = HISTOGRAM_THETA1;
+    double min = -M_PI;
+    double max = M_PI;
+    int bins = 256;
+};
+
+// N-dimensional histogram over projections of the double pendulum state.
+// Each filling thread owns a private 32-bit bin array so adds need no
+// atomics. reduce() folds them into the shared 64-bit totals by pairwise
+// tree reduction, with every thread doing its share of each round.
+// The bins of all axes multiplied together must stay below 2^31.
+class PhaseHistogram {
+public:
+    PhaseHistogram(const std::vector<HistogramAxis>& axes, int threads);
+
+    const std::vector<HistogramAxis>& axes() const { return axisList; }
+    size_t binCount() const { return totals.size(); }
+    int threads() const { return (int)privateBins.size(); }
+
+    // Whether an axis shows the inner (arm 0) or outer (arm 1) bob.
+    bool usesBob(int arm) const { return bobs[arm]; }
+
+    // Adds `count` samples. values[q][i] is quantity q of sample i; the bob
+    // entries are only read when usesBob() for that arm. Bin indices are computed a
+    // block at a time in straight-line loops and out-of-range samples land
+    // in a spare bin, so the only scattered work is the increment itself.
+    void add(int thread, int count, const double* const values[8]);
+
+    // Every one of threads() threads must call this together; no add() may
+    // run until all of them have returned.
+    void reduce(int thread, Barrier& barrier);
+
+    const std::vector<unsigned long long>& counts() const { return totals; }
+
+    // Sums the totals over every axis but x and y; binsX * binsY values
+    // with row 0 at the top of y.
+    std::vector<unsigned long long> project(int axisX, int axisY) const;
+
+private:
+    std::vector<HistogramAxis> axisList;
+    std::vector<double> scale;
+    std::vector<int> stride;
+    std::vector<int> wraps;
+    bool bobs[2] = { false, false };
+    std::vector<std::vector<uint32_t>> privateBins;
+    std::vector<std::vector<int>> scratch;
+    std::vector<std::vector<double>> paddedScratch;
+    std::vector<unsigned long long> totals;
+};
+
+struct HistogramSettings {
+    double L1 = 0.7;
+    double L2 = 0.7;
+    double M1 = 1.0;
+    double M2 = 1.0;
+    double g = 9.81;
+    double dt = 0.001;
+    double time = 0.0;          // simulated seconds; 0 runs until stopped
+    double theta1 = 2.0;
+    double theta2 = 2.0;
+    double spread = 0.1;
+    int members = 4096;
+    int threads = 0;
+    int mergeEvery = 1000;      // steps between reductions
+    int sampleEvery = 1;        // steps between samples
+    std::vector<HistogramAxis> axes;    // one to four
+};
+
+// Steps an ensemble of double pendulums started in a spread x spread square
+// around (theta1, theta2) at rest, each thread owning a slice of the
+// members, and histograms the state every sampleEvery steps. After each
+// reduction the totals are published if snapshot() has asked for them.
+// Sampling every step of a 2D projection, angles or bob positions, costs
+// under a tenth of the stepping even without AVX (about 9% at -O2 or -O3,
+// 6-7% with -march=native); large 4D histograms, whose increments mostly
+// miss the cache, cost more and may be sampled every few steps, which
+// changes little since consecutive states are strongly correlated.
+class HistogramEnsemble {
+public:
+    explicit HistogramEnsemble(const HistogramSettings& settings);
+    ~HistogramEnsemble();
+
+    // Copies the latest published totals if they are newer than `version`
+    // and asks for the next reduction to publish again.
+    bool snapshot(std::vector<unsigned long long>& counts, long long& version);
+    void wait();
+    void stop();
+
+    const PhaseHistogram& histogram() const { return histogramData; }
+    long long steps() const { return stepsDone.load(); }
+    double fillSeconds() const { return fillNanoseconds.load() * 1e-9; }
+    double stepSeconds() const { return stepNanoseconds.load() * 1e-9; }
+
+private:
+    void worker(int thread);
+
+    HistogramSettings settings;
+    PhaseHistogram histogramData;
+    Barrier barrier;
+    std::atomic<bool> stopping{ false };
+    bool finishedRun = false;
+    std::atomic<long long> stepsDone{ 0 };
+    std::atomic<long long> fillNanoseconds{ 0 };
+    std::atomic<long long> stepNanoseconds{ 0 };
+
+    std::mutex publishMutex;
+    std::vector<unsigned long long> published;
+    long long publishedVersion = 0;
+    bool publishWanted = false;
+    std::vector<std::thread> workers;
+};
+
+// Angles over a full turn, angular velocities over +-omegaMax and bob
+// coordinates over +-reach.
+void defaultHistogramRange(HistogramAxis& axis, double omegaMax, double reach);
+
+void densityColor(unsigned long long count, unsigned long long peak, unsigned char rgb[3]);
+
+int runHistogramCommand(int argc, char** argv);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+
+struct LaneSchedulerStats {
+    long long laneSteps = 0;
+    long long occupiedLaneSteps = 0;
+    long long retired = 0;
+};
+
+// Keeps the front of a kernel's SoA lane buffers packed with live members.
+// Every `compactEvery` steps finished members are retired, their lanes are
+// refilled from `nextMember`, and once that runs dry the tail lanes are moved
+// down into the holes so the stepped range shrinks instead of carrying dead
+// lanes to the end of the run.
+//
+// A kernel provides:
+//   static const int WIDTH, CAPACITY;   // SIMD width, lanes held (multiple of WIDTH)
+//   void load(int lane, long long member);
+//   void move(int from, int to);
+//   void step(int lanes);               // advance lanes [0, lanes) by one step
+//   bool finished(int lane) const;      // must latch: stays true once true
+//   void retire(int lane);              // write the member's result out
+//
+// nextMember(long long& member) returns false once no members are pending.
+template<typename Kernel, typename Source>
+LaneSchedulerStats runLaneScheduler(Kernel& kernel, Source&& nextMember, int compactEvery) {
+    LaneSchedulerStats stats;
+    compactEvery = std::max(compactEvery, 1);
+
+    int active = 0;
+    long long member;
+    while (active < Kernel::CAPACITY && nextMember(member)) {
+        kernel.load(active++, member);
+    }
+
+    while (active > 0) {
+        int stepped = std::min(Kernel::CAPACITY, (active + Kernel::WIDTH - 1) / Kernel::WIDTH * Kernel::WIDTH);
+        for (int k = 0; k < compactEvery; ++k) {
+            kernel.step(stepped);
+        }
+        stats.laneSteps += (long long)stepped * compactEvery;
+        stats.occupiedLaneSteps += (long long)active * compactEvery;
+
+        int lane = 0;
+        while (lane < active) {
+            if (!kernel.finished(lane)) {
+                ++lane;
+                continue;
+            }
+            kernel.retire(lane);
+            ++stats.retired;
+
+            if (nextMember(member)) {
+                kernel.load(lane, member);
+            }
+            else if (lane < --active) {
+                kernel.move(active, lane);
+            }
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,300 @@
+#include "LongChain.h"
+#include "Chain.h"
+#include "CommandLine.h"
+#include "Physics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+const int LONG_CHAIN_SEGMENT_LINKS = 4096;     // fewer per thread costs more to start than it saves
+
+// Row i of the tension system: lower * T_{i-1} + diagonal * T_i + upper * T_{i+1} = rhs.
+static inline void tensionRow(const ChainParameters& chain, const double* theta, const double* omega, int i,
+    double& lower, double& diagonal, double& upper, double& rhs) {
+    const int n = chain.links();
+    double inverse = 1.0 / chain.masses[i];
+    double above = i > 0 ? 1.0 / chain.masses[i - 1] : 0.0;
+    lower = i > 0 ? std::cos(theta[i - 1] - theta[i]) * above : 0.0;
+    diagonal = -(inverse + above);
+    upper = i + 1 < n ? std::cos(theta[i] - theta[i + 1]) * inverse : 0.0;
+    rhs = -chain.lengths[i] * omega[i] * omega[i] - (i == 0 ? chain.g * std::cos(theta[0]) : 0.0);
+}
+
+// alpha_i L_i = T_{i+1} sin(theta_{i+1} - theta_i) / m_i + T_{i-1} sin(theta_{i-1} - theta_i) / m_{i-1},
+// with gravity in place of the rod above for the first link.
+static inline double linkAccel(const ChainParameters& chain, const double* theta, int i, double above, double below) {
+    const int n = chain.links();
+    double accel = i + 1 < n ? below * std::sin(theta[i + 1] - theta[i]) / chain.masses[i] : 0.0;
+    accel += i > 0 ? above * std::sin(theta[i - 1] - theta[i]) / chain.masses[i - 1] : -chain.g * std::sin(theta[0]);
+    return accel / chain.lengths[i];
+}
+
+void longChainAccel(const ChainParameters& chain, const double* theta, const double* omega, double* accel, double* tension) {
+    const int n = chain.links();
+    std::vector<double> sweep(n), solution(n);
+    // Thomas algorithm; no pivoting needed as the rows are diagonally dominant
+    double previousSweep = 0.0, previous = 0.0;
+    for (int i = 0; i < n; ++i) {
+        double lower, diagonal, upper, rhs;
+        tensionRow(chain, theta, omega, i, lower, diagonal, upper, rhs);
+        double pivot = diagonal - lower * previousSweep;
+        sweep[i] = upper / pivot;
+        solution[i] = (rhs - lower * previous) / pivot;
+        previousSweep = sweep[i];
+        previous = solution[i];
+    }
+    for (int i = n - 2; i >= 0; --i) {
+        solution[i] -= sweep[i] * solution[i + 1];
+    }
+    for (int i = 0; i < n; ++i) {
+        accel[i] = linkAccel(chain, theta, i, i > 0 ? solution[i - 1] : 0.0, i + 1 < n ? solution[i + 1] : 0.0);
+        if (tension) {
+            tension[i] = solution[i];
+        }
+    }
+}
+
+ParallelChainSolver::ParallelChainSolver(int threads) {
+    threadCount = std::max(threads > 0 ? threads : (int)std::thread::hardware_concurrency(), 1);
+}
+
+// Thomas elimination of the segment's rows with three right-hand sides:
+// the rows' own, and the couplings to the tensions just outside each end.
+void ParallelChainSolver::eliminate(int segment, const ChainParameters& chain, const double* theta, const double* omega) {
+    const int begin = bounds[segment], end = bounds[segment + 1];
+    double previousSweep = 0.0, previousY = 0.0, previousA = 0.0, previousB = 0.0;
+    for (int i = begin; i < end; ++i) {
+        double lower, diagonal, upper, rhs;
+        tensionRow(chain, theta, omega, i, lower, diagonal, upper, rhs);
+        double outsideLower = i == begin ? lower : 0.0;
+        double outsideUpper = i + 1 == end ? upper : 0.0;
+        if (i == begin) {
+            lower = 0.0;
+        }
+        if (i + 1 == end) {
+            upper = 0.0;
+        }
+        double pivot = diagonal - lower * previousSweep;
+        sweep[i] = upper / pivot;
+        y[i] = (rhs - lower * previousY) / pivot;
+        a[i] = (-outsideLower - lower * previousA) / pivot;
+        b[i] = (-outsideUpper - lower * previousB) / pivot;
+        previousSweep = sweep[i];
+        previousY = y[i];
+        previousA = a[i];
+        previousB = b[i];
+    }
+    for (int i = end - 2; i >= begin; --i) {
+        y[i] -= sweep[i] * y[i + 1];
+        a[i] -= sweep[i] * a[i + 1];
+        b[i] -= sweep[i] * b[i + 1];
+    }
+    leaves[segment] = { y[begin], a[begin], b[begin], y[end - 1], a[end - 1], b[end - 1] };
+}
+
+// Segments begin..end - 1 as one articulated body. The left half's last
+// tension and the right half's first depend on each other; solving that
+// pair expresses both, and so the merged handles, through the tensions
+// outside the merged body.
+ParallelChainSolver::Handles ParallelChainSolver::merge(int begin, int end) {
+    if (end - begin == 1) {
+        return leaves[begin];
+    }
+    int middle = (begin + end) / 2;
+    Handles left = merge(begin, middle);
+    Handles right = merge(middle, end);
+
+    // leftLast = left.yLast + left.aLast L + left.bLast rightFirst
+    // rightFirst = right.yFirst + right.aFirst leftLast + right.bFirst R
+    double determinant = 1.0 - left.bLast * right.aFirst;
+    Handles& split = splits[middle];
+    split.yLast = (left.yLast + left.bLast * right.yFirst) / determinant;
+    split.aLast = left.aLast / determinant;
+    split.bLast = left.bLast * right.bFirst / determinant;
+    split.yFirst = (right.yFirst + right.aFirst * left.yLast) / determinant;
+    split.aFirst = right.aFirst * left.aLast / determinant;
+    split.bFirst = right.bFirst / determinant;
+
+    Handles merged;
+    merged.yFirst = left.yFirst + left.bFirst * split.yFirst;
+    merged.aFirst = left.aFirst + left.bFirst * split.aFirst;
+    merged.bFirst = left.bFirst * split.bFirst;
+    merged.yLast = right.yLast + right.aLast * split.yLast;
+    merged.aLast = right.aLast * split.aLast;
+    merged.bLast = right.bLast + right.aLast * split.bLast;
+    return merged;
+}
+
+void ParallelChainSolver::assign(int begin, int end, double left, double right) {
+    if (end - begin == 1) {
+        outsideLeft[begin] = left;
+        outsideRight[begin] = right;
+        return;
+    }
+    int middle = (begin + end) / 2;
+    const Handles& split = splits[middle];
+    double leftLast = split.yLast + split.aLast * left + split.bLast * right;
+    double rightFirst = split.yFirst + split.aFirst * left + split.bFirst * right;
+    assign(begin, middle, left, rightFirst);
+    assign(middle, end, leftLast, right);
+}
+
+void ParallelChainSolver::recover(int segment, const ChainParameters& chain, const double* theta, double* accel, double* tension) {
+    const int begin = bounds[segment], end = bounds[segment + 1];
+    const double left = outsideLeft[segment], right = outsideRight[segment];
+    double above = left;
+    double current = y[begin] + a[begin] * left + b[begin] * right;
+    for (int i = begin; i < end; ++i) {
+        double below = i + 1 < end ? y[i + 1] + a[i + 1] * left + b[i + 1] * right : right;
+        accel[i] = linkAccel(chain, theta, i, above, below);
+        if (tension) {
+            tension[i] = current;
+        }
+        above = current;
+        current = below;
+    }
+}
+
+void ParallelChainSolver::solve(const ChainParameters& chain, const double* theta, const double* omega, double* accel, double* tension) {
+    const int n = chain.links();
+    const int segments = std::max(std::min(threadCount, n / LONG_CHAIN_SEGMENT_LINKS), 1);
+    bounds.resize(segments + 1);
+    for (int s = 0; s <= segments; ++s) {
+        bounds[s] = (int)((long long)n * s / segments);
+    }
+    sweep.resize(n);
+    y.resize(n);
+    a.resize(n);
+    b.resize(n);
+    leaves.resize(segments);
+    splits.resize(segments);
+    outsideLeft.resize(segments);
+    outsideRight.resize(segments);
+
+    std::vector<std::thread> workers;
+    for (int s = 1; s < segments; ++s) {
+        workers.emplace_back(&ParallelChainSolver::eliminate, this, s, std::cref(chain), theta, omega);
+    }
+    eliminate(0, chain, theta, omega);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+
+    // nothing hangs above the pivot or below the last bob
+    merge(0, segments);
+    assign(0, segments, 0.0, 0.0);
+
+    for (int s = 1; s < segments; ++s) {
+        workers.emplace_back(&ParallelChainSolver::recover, this, s, std::cref(chain), theta, accel, tension);
+    }
+    recover(0, chain, theta, accel, tension);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+double longChainEnergy(const ChainParameters& chain, const double* theta, const double* omega) {
+    double energy = 0.0, y = 0.0, vx = 0.0, vy = 0.0;
+    for (int i = 0; i < chain.links(); ++i) {
+        double s = std::sin(theta[i]), c = std::cos(theta[i]);
+        y -= chain.lengths[i] * c;
+        vx += chain.lengths[i] * omega[i] * c;
+        vy += chain.lengths[i] * omega[i] * s;
+        energy += chain.masses[i] * (0.5 * (vx * vx + vy * vy) + chain.g * y);
+    }
+    return energy;
+}
+
+static double largestDifference(const std::vector<double>& first, const std::vector<double>& second, double& scale) {
+    double difference = 0.0;
+    scale = 0.0;
+    for (size_t i = 0; i < first.size(); ++i) {
+        difference = std::max(difference, std::fabs(first[i] - second[i]));
+        scale = std::max(scale, std::fabs(first[i]));
+    }
+    return difference;
+}
+
+int runLongChainCommand(int argc, char** argv) {
+    int links = (int)std::atof(stringArgument(argc, argv, "--links", "1e6").c_str());
+    double span = floatArgument(argc, argv, "--chain-length", 2.0f);
+    double mass = floatArgument(argc, argv, "--chain-mass", 1.0f);
+    int threads = intArgument(argc, argv, "--threads", 0);
+    int repeats = intArgument(argc, argv, "--repeats", 5);
+    int steps = intArgument(argc, argv, "--steps", 0);
+    double h = std::atof(stringArgument(argc, argv, "--dt", "1e-5").c_str());
+    if (links < 1 || span <= 0.0 || mass <= 0.0 || threads < 0 || repeats < 1 || steps < 0 || h <= 0.0) {
+        std::cerr << "Invalid long chain settings" << std::endl;
+        return -1;
+    }
+
+    ChainParameters chain;
+    chain.lengths.assign(links, span / links);
+    chain.masses.assign(links, mass / links);
+    chain.g = floatArgument(argc, argv, "--g", G);
+    // a curled, spinning start so every row of the system matters
+    std::vector<double> theta(links), omega(links);
+    for (int i = 0; i < links; ++i) {
+        double t = (double)i / links;
+        theta[i] = 1.5 * std::sin(6.0 * M_PI * t) + 0.5;
+        omega[i] = 2.0 * std::cos(10.0 * M_PI * t);
+    }
+
+    if (links <= CHAIN_MAX_LINKS) {
+        std::vector<double> dense(links), fast(links);
+        chainAccel(links, theta.data(), omega.data(), chain.lengths.data(), chain.masses.data(), chain.g, dense.data());
+        longChainAccel(chain, theta.data(), omega.data(), fast.data(), nullptr);
+        double scale;
+        std::cout << "against the mass matrix solve: " << largestDifference(dense, fast, scale) << " of " << scale << std::endl;
+    }
+
+    std::vector<double> accel(links), tension(links);
+    double sequential = 1e30;
+    for (int r = 0; r < repeats; ++r) {
+        auto begin = std::chrono::steady_clock::now();
+        longChainAccel(chain, theta.data(), omega.data(), accel.data(), tension.data());
+        sequential = std::min(sequential, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    }
+    std::cout << links << " links, sequential: " << sequential * 1e3 << " ms" << std::endl;
+
+    int most = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    std::vector<double> parallelAccel(links), parallelTension(links);
+    for (int p = 1; p <= most; p = p < most && p * 2 > most ? most : p * 2) {
+        ParallelChainSolver solver(p);
+        double best = 1e30;
+        for (int r = 0; r < repeats; ++r) {
+            auto begin = std::chrono::steady_clock::now();
+            solver.solve(chain, theta.data(), omega.data(), parallelAccel.data(), parallelTension.data());
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+        }
+        double accelScale, tensionScale;
+        double accelError = largestDifference(accel, parallelAccel, accelScale);
+        double tensionError = largestDifference(tension, parallelTension, tensionScale);
+        std::cout << p << " threads: " << best * 1e3 << " ms, speedup " << sequential / best << ", differs by "
+            << accelError / accelScale << " in acceleration and " << tensionError / tensionScale << " in tension (relative)" << std::endl;
+        if (p == most) {
+            break;
+        }
+    }
+
+    if (steps > 0) {
+        ParallelChainSolver solver(threads);
+        double start = longChainEnergy(chain, theta.data(), omega.data());
+        auto begin = std::chrono::steady_clock::now();
+        for (int k = 0; k < steps; ++k) {
+            solver.solve(chain, theta.data(), omega.data(), accel.data(), nullptr);
+            for (int i = 0; i < links; ++i) {
+                omega[i] += accel[i] * h;
+                theta[i] += omega[i] * h;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << steps << " symplectic Euler steps in " << seconds << " s, energy " << start << " -> "
+            << longChainEnergy(chain, theta.data(), omega.data()) << std::endl;
+    }
+    return 0;
+}
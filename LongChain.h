@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Stepper.h"
+
+#include <vector>
+
+// Angular accelerations of an n-link chain in O(n), for chains far past
+// CHAIN_MAX_LINKS. Instead of the dense mass matrix, the rod tensions are
+// solved for: differentiating each rod's length constraint twice gives
+//   cos(theta_{i-1} - theta_i) / m_{i-1} T_{i-1} - (1 / m_i + 1 / m_{i-1}) T_i
+//     + cos(theta_i - theta_{i+1}) / m_i T_{i+1} = -L_i omega_i^2
+// (plus -g cos(theta_1) on the first rod, whose pivot has no mass), a
+// diagonally dominant tridiagonal system, and the tensions then give each
+// link's acceleration directly. tension may be null.
+void longChainAccel(const ChainParameters& chain, const double* theta, const double* omega, double* accel, double* tension);
+
+// The same solve split over threads, divide and conquer. Each segment of
+// the chain is an articulated body with two handles, the rods at its ends:
+// a thread eliminates the segment's interior, leaving the tensions at its
+// handles as linear functions of the tensions just outside it. Neighbouring
+// segments are merged pairwise up a tree by solving for their shared
+// handles, down to the whole chain whose outside tensions are zero; going
+// back down the tree fixes every segment's outside tensions, and the
+// threads then recover their interiors and accelerations. O(n / p + log p)
+// with p segments.
+class ParallelChainSolver {
+public:
+    explicit ParallelChainSolver(int threads = 0);
+
+    int threads() const { return threadCount; }
+    void solve(const ChainParameters& chain, const double* theta, const double* omega, double* accel, double* tension);
+
+private:
+    // First and last tension of a segment as y + a * outside left + b * outside right.
+    struct Handles {
+        double yFirst, aFirst, bFirst;
+        double yLast, aLast, bLast;
+    };
+
+    Handles merge(int begin, int end);
+    void assign(int begin, int end, double left, double right);
+    void eliminate(int segment, const ChainParameters& chain, const double* theta, const double* omega);
+    void recover(int segment, const ChainParameters& chain, const double* theta, double* accel, double* tension);
+
+    int threadCount;
+    std::vector<int> bounds;                    // segment s is links bounds[s]..bounds[s + 1] - 1
+    std::vector<double> sweep, y, a, b;         // per link
+    std::vector<Handles> leaves;
+    std::vector<Handles> splits;                // by the index of the first segment on the right
+    std::vector<double> outsideLeft, outsideRight;
+};
+
+double longChainEnergy(const ChainParameters& chain, const double* theta, const double* omega);
+
+int runLongChainCommand(int argc, char** argv);
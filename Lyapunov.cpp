@@ -0,0 +1,342 @@
+#include "Lyapunov.h"
+#include "CommandLine.h"
+#include "Dual.h"
+#include "LaneScheduler.h"
+#include "Physics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+
+const int LYAPUNOV_LANES = 4;
+const long long LYAPUNOV_CHUNK = 16;
+
+// One lane per member. Each state variable is a Dual whose K derivative
+// slots are the K tangent vectors, so stepping the state with the usual
+// equations steps the tangents with their Jacobian at the same time.
+template<int K>
+struct LyapunovKernel {
+    typedef Dual<double, K> D;
+    static const int WIDTH = LYAPUNOV_LANES;
+    static const int CAPACITY = 4 * LYAPUNOV_LANES;
+
+    const std::vector<LyapunovMember>& members;
+    const LyapunovSettings& s;
+    double* out;
+    LyapunovOrbit* orbits;
+    double h;
+    long long maxSteps;
+    int every, energyEvery;
+
+    D t1[CAPACITY], t2[CAPACITY], w1[CAPACITY], w2[CAPACITY];
+    double L1[CAPACITY], L2[CAPACITY], M1[CAPACITY], M2[CAPACITY], g[CAPACITY];
+    double logStretch[CAPACITY][K];
+    long long steps[CAPACITY];
+    long long member[CAPACITY];
+    // orbit tracking, only kept up when `orbits` is set
+    double energy0[CAPACITY], drift[CAPACITY];
+    long long wind1[CAPACITY], wind2[CAPACITY], flips[CAPACITY];
+
+    LyapunovKernel(const std::vector<LyapunovMember>& members, const LyapunovSettings& settings, double* out,
+        LyapunovOrbit* orbits)
+        : members(members), s(settings), out(out), orbits(orbits), h(settings.dt),
+        maxSteps((long long)(settings.time / settings.dt)), every(std::max(settings.reorthonormalizeEvery, 1)),
+        energyEvery(std::max(settings.energyEvery, 1)) {
+        for (int l = 0; l < CAPACITY; ++l) {
+            L1[l] = L2[l] = M1[l] = M2[l] = g[l] = 1.0;
+            for (int k = 0; k < K; ++k) {
+                logStretch[l][k] = 0.0;
+            }
+            steps[l] = maxSteps;
+            member[l] = -1;
+            energy0[l] = drift[l] = 0.0;
+            wind1[l] = wind2[l] = flips[l] = 0;
+        }
+    }
+
+    static long long windings(double theta) {
+        return (long long)std::floor((theta + M_PI) / (2.0 * M_PI));
+    }
+
+    double energy(int lane) const {
+        return doublePendulumEnergy(t1[lane].v, t2[lane].v, w1[lane].v, w2[lane].v, L1[lane], L2[lane], M1[lane], M2[lane],
+            g[lane]);
+    }
+
+    void load(int lane, long long id) {
+        const LyapunovMember& m = members[id];
+        D* variables[4] = { &t1[lane], &t2[lane], &w1[lane], &w2[lane] };
+        double values[4] = { m.theta1, m.theta2, m.omega1, m.omega2 };
+        for (int i = 0; i < 4; ++i) {
+            *variables[i] = D(values[i]);
+            if (i < K) {
+                variables[i]->d[i] = 1.0;
+            }
+        }
+        L1[lane] = m.L1;
+        L2[lane] = m.L2;
+        M1[lane] = m.M1;
+        M2[lane] = m.M2;
+        g[lane] = m.g;
+        for (int k = 0; k < K; ++k) {
+            logStretch[lane][k] = 0.0;
+        }
+        steps[lane] = 0;
+        member[lane] = id;
+        if (orbits) {
+            energy0[lane] = energy(lane);
+            drift[lane] = 0.0;
+            wind1[lane] = windings(m.theta1);
+            wind2[lane] = windings(m.theta2);
+            flips[lane] = 0;
+        }
+    }
+
+    void move(int from, int to) {
+        t1[to] = t1[from];
+        t2[to] = t2[from];
+        w1[to] = w1[from];
+        w2[to] = w2[from];
+        L1[to] = L1[from];
+        L2[to] = L2[from];
+        M1[to] = M1[from];
+        M2[to] = M2[from];
+        g[to] = g[from];
+        for (int k = 0; k < K; ++k) {
+            logStretch[to][k] = logStretch[from][k];
+        }
+        steps[to] = steps[from];
+        member[to] = member[from];
+        energy0[to] = energy0[from];
+        drift[to] = drift[from];
+        wind1[to] = wind1[from];
+        wind2[to] = wind2[from];
+        flips[to] = flips[from];
+    }
+
+    void step(int lanes) {
+        const D step(h);
+        for (int l = 0; l < lanes; ++l) {
+            // members that are done wait for retirement without moving on
+            if (steps[l] >= maxSteps) {
+                continue;
+            }
+            D a1, a2;
+            doublePendulumAccel(t1[l], t2[l], w1[l], w2[l], D(L1[l]), D(L2[l]), D(M1[l]), D(M2[l]), D(g[l]), a1, a2);
+            w1[l] += a1 * step;
+            w2[l] += a2 * step;
+            t1[l] += w1[l] * step;
+            t2[l] += w2[l] * step;
+            if (++steps[l] % every == 0 || steps[l] == maxSteps) {
+                reorthonormalize(l);
+            }
+            if (orbits) {
+                track(l);
+            }
+        }
+    }
+
+    void track(int lane) {
+        long long n1 = windings(t1[lane].v), n2 = windings(t2[lane].v);
+        flips[lane] += std::llabs(n1 - wind1[lane]) + std::llabs(n2 - wind2[lane]);
+        wind1[lane] = n1;
+        wind2[lane] = n2;
+        if (steps[lane] % energyEvery == 0) {
+            drift[lane] = std::max(drift[lane], std::fabs(energy(lane) - energy0[lane]));
+        }
+    }
+
+    // Modified Gram-Schmidt, i.e. the Q and diagonal of R in a QR update.
+    void reorthonormalize(int lane) {
+        double v[K][4];
+        for (int k = 0; k < K; ++k) {
+            v[k][0] = t1[lane].d[k];
+            v[k][1] = t2[lane].d[k];
+            v[k][2] = w1[lane].d[k];
+            v[k][3] = w2[lane].d[k];
+        }
+        for (int k = 0; k < K; ++k) {
+            for (int j = 0; j < k; ++j) {
+                double dot = v[k][0] * v[j][0] + v[k][1] * v[j][1] + v[k][2] * v[j][2] + v[k][3] * v[j][3];
+                for (int i = 0; i < 4; ++i) {
+                    v[k][i] -= dot * v[j][i];
+                }
+            }
+            double norm = std::sqrt(v[k][0] * v[k][0] + v[k][1] * v[k][1] + v[k][2] * v[k][2] + v[k][3] * v[k][3]);
+            logStretch[lane][k] += std::log(norm);
+            for (int i = 0; i < 4; ++i) {
+                v[k][i] /= norm;
+            }
+        }
+        for (int k = 0; k < K; ++k) {
+            t1[lane].d[k] = v[k][0];
+            t2[lane].d[k] = v[k][1];
+            w1[lane].d[k] = v[k][2];
+            w2[lane].d[k] = v[k][3];
+        }
+    }
+
+    bool finished(int lane) const {
+        return steps[lane] >= maxSteps || !std::isfinite(t1[lane].v) || !std::isfinite(t2[lane].v);
+    }
+
+    void retire(int lane) {
+        bool diverged = !std::isfinite(t1[lane].v) || !std::isfinite(t2[lane].v);
+        double* exponents = out + member[lane] * K;
+        for (int k = 0; k < K; ++k) {
+            if (diverged) {
+                exponents[k] = std::numeric_limits<double>::quiet_NaN();
+            }
+            else {
+                exponents[k] = steps[lane] > 0 ? logStretch[lane][k] / (steps[lane] * h) : 0.0;
+            }
+        }
+        std::sort(exponents, exponents + K, std::greater<double>());
+        if (orbits) {
+            orbits[member[lane]].energyDrift = drift[lane];
+            orbits[member[lane]].flips = flips[lane];
+        }
+    }
+};
+
+template<int K>
+static void lyapunovWorker(const std::vector<LyapunovMember>& members, const LyapunovSettings& s, double* out,
+    LyapunovOrbit* orbits, std::atomic<long long>& next) {
+    const long long total = (long long)members.size();
+    long long cursor = 0, chunkEnd = 0;
+    auto nextMember = [&](long long& id) {
+        if (cursor >= chunkEnd) {
+            cursor = next.fetch_add(LYAPUNOV_CHUNK);
+            chunkEnd = std::min(cursor + LYAPUNOV_CHUNK, total);
+            if (cursor >= total) {
+                return false;
+            }
+        }
+        id = cursor++;
+        return true;
+    };
+
+    std::unique_ptr<LyapunovKernel<K>> kernel(new LyapunovKernel<K>(members, s, out, orbits));
+    runLaneScheduler(*kernel, nextMember, s.compactEvery);
+}
+
+template<int K>
+static void computeExponents(const std::vector<LyapunovMember>& members, const LyapunovSettings& s, double* out,
+    LyapunovOrbit* orbits) {
+    int threadCount = s.threads > 0 ? s.threads : (int)std::thread::hardware_concurrency();
+    long long chunks = ((long long)members.size() + LYAPUNOV_CHUNK - 1) / LYAPUNOV_CHUNK;
+    threadCount = (int)std::max(std::min<long long>(threadCount, chunks), 1LL);
+
+    std::atomic<long long> next{ 0 };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(lyapunovWorker<K>, std::cref(members), std::cref(s), out, orbits, std::ref(next));
+    }
+    lyapunovWorker<K>(members, s, out, orbits, next);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+std::vector<double> computeLyapunovExponents(const std::vector<LyapunovMember>& members, const LyapunovSettings& settings,
+    std::vector<LyapunovOrbit>* orbits) {
+    int count = std::min(std::max(settings.exponents, 1), 4);
+    std::vector<double> out(members.size() * count, 0.0);
+    LyapunovOrbit* orbitData = nullptr;
+    if (orbits) {
+        orbits->assign(members.size(), LyapunovOrbit());
+        orbitData = orbits->data();
+    }
+    if (members.empty() || settings.dt <= 0.0 || settings.time <= 0.0) {
+        return out;
+    }
+    switch (count) {
+    case 1: computeExponents<1>(members, settings, out.data(), orbitData); break;
+    case 2: computeExponents<2>(members, settings, out.data(), orbitData); break;
+    case 3: computeExponents<3>(members, settings, out.data(), orbitData); break;
+    default: computeExponents<4>(members, settings, out.data(), orbitData); break;
+    }
+    return out;
+}
+
+int runLyapunovCommand(int argc, char** argv) {
+    LyapunovMember base;
+    base.theta1 = floatArgument(argc, argv, "--theta1", 2.0f);
+    base.theta2 = floatArgument(argc, argv, "--theta2", 2.0f);
+    base.omega1 = floatArgument(argc, argv, "--omega1", 0.0f);
+    base.omega2 = floatArgument(argc, argv, "--omega2", 0.0f);
+    base.L1 = floatArgument(argc, argv, "--l1", INITIAL_LENGTH);
+    base.L2 = floatArgument(argc, argv, "--l2", INITIAL_LENGTH);
+    base.M1 = floatArgument(argc, argv, "--m1", INITIAL_MASS);
+    base.M2 = floatArgument(argc, argv, "--m2", INITIAL_MASS);
+    base.g = floatArgument(argc, argv, "--g", G);
+
+    LyapunovSettings settings;
+    settings.dt = floatArgument(argc, argv, "--dt", (float)settings.dt);
+    settings.time = floatArgument(argc, argv, "--time", (float)settings.time);
+    settings.exponents = hasArgument(argc, argv, "--spectrum") ? 4 : intArgument(argc, argv, "--exponents", 1);
+    settings.reorthonormalizeEvery = intArgument(argc, argv, "--reorthonormalize-every", settings.reorthonormalizeEvery);
+    settings.threads = intArgument(argc, argv, "--threads", 0);
+    int count = intArgument(argc, argv, "--members", 1);
+    double spread = floatArgument(argc, argv, "--spread", 0.01f);
+
+    if (count <= 0 || settings.dt <= 0.0 || settings.time <= 0.0 || settings.exponents < 1 || settings.exponents > 4) {
+        std::cerr << "Invalid Lyapunov settings" << std::endl;
+        return -1;
+    }
+
+    // the ensemble fills a square of side `spread` around the given angles
+    std::vector<LyapunovMember> members(count, base);
+    int side = (int)std::ceil(std::sqrt((double)count));
+    for (int i = 0; i < count && count > 1; ++i) {
+        members[i].theta1 += spread * ((i % side + 0.5) / side - 0.5);
+        members[i].theta2 += spread * ((i / side + 0.5) / side - 0.5);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> exponents = computeLyapunovExponents(members, settings);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int diverged = 0;
+    std::vector<double> mean(settings.exponents, 0.0), low(settings.exponents, 1e300), high(settings.exponents, -1e300);
+    for (int i = 0; i < count; ++i) {
+        if (!std::isfinite(exponents[(size_t)i * settings.exponents])) {
+            ++diverged;
+            continue;
+        }
+        for (int k = 0; k < settings.exponents; ++k) {
+            double value = exponents[(size_t)i * settings.exponents + k];
+            mean[k] += value;
+            low[k] = std::min(low[k], value);
+            high[k] = std::max(high[k], value);
+        }
+    }
+
+    std::cout << count << " members, " << settings.time << " s in " << seconds << " s";
+    if (diverged > 0) {
+        std::cout << " (" << diverged << " diverged)";
+    }
+    std::cout << std::endl;
+    if (diverged == count) {
+        return -1;
+    }
+    double sum = 0.0;
+    for (int k = 0; k < settings.exponents; ++k) {
+        mean[k] /= count - diverged;
+        sum += mean[k];
+        std::cout << "lambda" << k + 1 << " " << mean[k];
+        if (count > 1) {
+            std::cout << " (min " << low[k] << ", max " << high[k] << ")";
+        }
+        std::cout << std::endl;
+    }
+    if (settings.exponents == 4) {
+        std::cout << "sum " << sum << std::endl;
+    }
+    return 0;
+}
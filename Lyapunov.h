@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+struct LyapunovMember {
+    double theta1 = 0.0;
+    double theta2 = 0.0;
+    double omega1 = 0.0;
+    double omega2 = 0.0;
+    double L1 = 0.7;
+    double L2 = 0.7;
+    double M1 = 1.0;
+    double M2 = 1.0;
+    double g = 9.81;
+};
+
+struct LyapunovSettings {
+    double dt = 0.001;
+    double time = 60.0;
+    int exponents = 1;
+    int reorthonormalizeEvery = 10;
+    int threads = 0;
+    int compactEvery = 16;
+    int energyEvery = 10;           // steps between energy checks of an orbit
+};
+
+// What the base trajectory of a member did, gathered while its tangents
+// are stepped so callers need not integrate it a second time.
+struct LyapunovOrbit {
+    double energyDrift = 0.0;       // max |E - E0|, checked every energyEvery steps
+    long long flips = 0;            // times either angle crossed +-pi
+};
+
+// Integrates each member with symplectic Euler and carries `exponents`
+// tangent vectors (1 for the maximal exponent, up to 4 for the full
+// spectrum) through the exact linearisation of the same step. Every
+// reorthonormalizeEvery steps the tangents are Gram-Schmidt orthonormalised
+// and the logs of their stretch factors accumulated. Members share lanes
+// through runLaneScheduler, so the ensemble is stepped in SIMD-width batches.
+// Returns `exponents` values per member, largest first; NaN if the member
+// diverged. With `orbits`, also fills one LyapunovOrbit per member.
+std::vector<double> computeLyapunovExponents(const std::vector<LyapunovMember>& members, const LyapunovSettings& settings,
+    std::vector<LyapunovOrbit>* orbits = nullptr);
+
+int runLyapunovCommand(int argc, char** argv);
@@ -3,13 +3,37 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cmath>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
+#include <cstring>
+
+#include "Physics.h"
+#include "FlipMap.h"
+#include "Explorer.h"
+#include "Sweep.h"
+#include "Lyapunov.h"
+#include "Ftle.h"
+#include "Poincare.h"
+#include "Histogram.h"
+#include "PeriodicOrbits.h"
+#include "Adjoint.h"
+#include "Stepper.h"
+#include "Taylor.h"
+#include "Elastic.h"
+#include "Rope.h"
+#include "LongChain.h"
+#include "Parareal.h"
+#include "PendulumTree.h"
+#include "Scene.h"
+#include "Collisions.h"
+#include "CommandLine.h"
+#include "Coupled.h"
+#include "Pivot.h"
+#include "RealTime.h"
+#include "DensityView.h"
+#include "SceneView.h"
 
 const unsigned int h = 800, w = 800;
 
@@ -42,89 +66,87 @@ void main()
 
 glm::mat4 projection;
 std::vector<float> pathVertices;
-std::vector<glm::vec2> pendulums;
-std::vector<float> theta;
-std::vector<float> omega;
+PendulumTree tree;
+const float REST_X = 0.0f;
+const float REST_Y = 0.5f;
+float baseX = REST_X;
+float baseY = REST_Y;
+PivotMotion pivot;
+double pivotTime = 0.0;
+
+// what the renderer needs from a step of the real-time thread
+struct TreeSnapshot {
+    std::vector<float> x, y;
+    float baseX = 0.0f, baseY = 0.0f;
+};
+RealTimeSettings realTimeSettings;
+RealTimeLoop realTime;
+TripleBuffer<TreeSnapshot> snapshots;
 
 void initialize() {
     glViewport(0, 0, w, h);
     projection = glm::ortho(-2.0f, 2.0f, -2.0f, 2.0f, -1.0f, 1.0f);
 
-    pendulums.push_back(glm::vec2(INITIAL_LENGTH, INITIAL_MASS));
-    theta.push_back(M_PI / 1.0f);
-    omega.push_back(0.0f);
-
-    omega[0] = 0.5f;
+    tree.add(-1, INITIAL_LENGTH, INITIAL_MASS, M_PI / 1.0f, 0.5f);
 }
 
-void computePhysics() {
-    if (pendulums.size() < 2) {
-        float L1 = pendulums[0].x;
-        float M1 = pendulums[0].y;
-
-        float a1 = (-G / L1) * sin(theta[0]);
-
-        omega[0] += a1 * dt;
-        theta[0] += omega[0] * dt;
-
-        float baseX = 0.0f;
-        float baseY = 0.5f;
-        float x = baseX + L1 * sin(theta[0]);
-        float y = baseY - L1 * cos(theta[0]);
+void stepTree(double step) {
+    // substeps resolve a shaking pivot, the step alone would alias its forcing
+    int substeps = 1;
+    if (pivot.moving()) {
+        substeps = std::max((int)std::ceil(step / (pivot.timescale() / 40.0)), 1);
+    }
+    for (int k = 0; k < substeps; ++k) {
+        tree.advance(step / substeps, G, &pivot, pivotTime);
+        pivotTime += step / substeps;
+    }
+    double offsetX, offsetY;
+    pivot.position(pivotTime, offsetX, offsetY);
+    baseX = REST_X + (float)offsetX;
+    baseY = REST_Y + (float)offsetY;
+}
 
-        if (pathVertices.size() >= PATH_LIMIT * 2) {
-            pathVertices.erase(pathVertices.begin(), pathVertices.begin() + 2);
-        }
-        pathVertices.push_back(x);
-        pathVertices.push_back(y);
+void tracePath(float x, float y) {
+    if (pathVertices.size() >= PATH_LIMIT * 2) {
+        pathVertices.erase(pathVertices.begin(), pathVertices.begin() + 2);
     }
-    else {
-        for (size_t i = 0; i < pendulums.size(); ++i) {
-            float L1 = pendulums[i].x;
-            float M1 = pendulums[i].y;
-            float L2 = (i + 1 < pendulums.size()) ? pendulums[i + 1].x : 0.0f;
-            float M2 = (i + 1 < pendulums.size()) ? pendulums[i + 1].y : 0.0f;
-
-            if (i + 1 < pendulums.size()) {
-                float deltaTheta = theta[i + 1] - theta[i];
-                float denom1 = (M1 + M2) * L1 - M2 * L1 * cos(deltaTheta) * cos(deltaTheta);
-                float denom2 = (L2 / L1) * denom1;
-
-                float a1 = (M2 * L1 * omega[i] * omega[i] * sin(deltaTheta) * cos(deltaTheta)
-                    + M2 * G * sin(theta[i + 1]) * cos(deltaTheta)
-                    + M2 * L2 * omega[i + 1] * omega[i + 1] * sin(deltaTheta)
-                    - (M1 + M2) * G * sin(theta[i])) / denom1;
-
-                float a2 = (-L1 / L2 * omega[i] * omega[i] * sin(deltaTheta) * cos(deltaTheta)
-                    + G * sin(theta[i]) * cos(deltaTheta)
-                    - G * sin(theta[i + 1])) / denom2;
-
-                omega[i] += a1 * dt;
-                omega[i + 1] += a2 * dt;
-                theta[i] += omega[i] * dt;
-                theta[i + 1] += omega[i + 1] * dt;
-            }
-        }
+    pathVertices.push_back(x);
+    pathVertices.push_back(y);
+}
 
-        if (!pendulums.empty()) {
-            size_t lastIdx = pendulums.size() - 1;
-            float baseX = 0.0f;
-            float baseY = 0.5f;
-            float x = baseX;
-            float y = baseY;
+void computePhysics() {
+    stepTree(dt);
 
-            for (size_t i = 0; i <= lastIdx; ++i) {
-                x += pendulums[i].x * sin(theta[i]);
-                y -= pendulums[i].x * cos(theta[i]);
-            }
+    // trace the bob stored last, the tip of the last branch
+    std::vector<float> x, y;
+    tree.positions(baseX, baseY, x, y);
+    tracePath(x.back(), y.back());
+}
 
-            if (pathVertices.size() >= PATH_LIMIT * 2) {
-                pathVertices.erase(pathVertices.begin(), pathVertices.begin() + 2);
-            }
-            pathVertices.push_back(x);
-            pathVertices.push_back(y);
-        }
+// Hands the tree to a thread stepping it at the fixed rate; the window
+// only draws the newest snapshot, so a slow frame never delays a step.
+// The tree stays as it is until the window closes.
+void startRealTime() {
+    for (TreeSnapshot& snapshot : snapshots.buffers) {
+        snapshot.x.assign(tree.size(), 0.0f);
+        snapshot.y.assign(tree.size(), 0.0f);
     }
+    const double step = 1.0 / realTimeSettings.rate;
+    // the first step sizes the solver's scratch
+    stepTree(step);
+    TreeSnapshot& first = snapshots.back();
+    tree.positions(baseX, baseY, first.x, first.y);
+    first.baseX = baseX;
+    first.baseY = baseY;
+    snapshots.publish();
+    realTime.start(realTimeSettings, [step]() {
+        stepTree(step);
+        TreeSnapshot& out = snapshots.back();
+        tree.positions(baseX, baseY, out.x, out.y);
+        out.baseX = baseX;
+        out.baseY = baseY;
+        snapshots.publish();
+    });
 }
 
 std::vector<float> generateCircleVertices(float cx, float cy, float radius, int segments) {
@@ -151,33 +173,41 @@ void render(GLFWwindow* window, unsigned int VAO, unsigned int VBO, unsigned int
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-    float baseX = 0.0f;
-    float baseY = 0.5f;
-
-    float prevX = baseX;
-    float prevY = baseY;
+    // baseX and baseY belong to the stepping thread while it runs, so the
+    // pivot is only read from them here when nothing else is stepping
+    std::vector<float> bobX, bobY;
+    float pivotX, pivotY;
+    if (realTime.running()) {
+        const TreeSnapshot& snapshot = snapshots.read();
+        bobX = snapshot.x;
+        bobY = snapshot.y;
+        pivotX = snapshot.baseX;
+        pivotY = snapshot.baseY;
+        tracePath(bobX.back(), bobY.back());
+    }
+    else {
+        pivotX = baseX;
+        pivotY = baseY;
+        tree.positions(baseX, baseY, bobX, bobY);
+    }
 
     std::vector<float> lineVertices;
 
-    for (size_t i = 0; i < pendulums.size(); ++i) {
-        float x = prevX + pendulums[i].x * sin(theta[i]);
-        float y = prevY - pendulums[i].x * cos(theta[i]);
+    for (int i = 0; i < tree.size(); ++i) {
+        int parent = tree.parent(i);
+        float x = bobX[i];
+        float y = bobY[i];
 
-        if (i >= 0) {
-            lineVertices.push_back(prevX);
-            lineVertices.push_back(prevY);
-            lineVertices.push_back(x);
-            lineVertices.push_back(y);
-        }
+        lineVertices.push_back(parent >= 0 ? bobX[parent] : pivotX);
+        lineVertices.push_back(parent >= 0 ? bobY[parent] : pivotY);
+        lineVertices.push_back(x);
+        lineVertices.push_back(y);
 
         int circleSegments = 30;
         float circleRadius = PENDULUM_RADIUS;
         std::vector<float> circleVertices = generateCircleVertices(x, y, circleRadius, circleSegments);
         glBufferData(GL_ARRAY_BUFFER, circleVertices.size() * sizeof(float), circleVertices.data(), GL_DYNAMIC_DRAW);
         glDrawArrays(GL_TRIANGLE_FAN, 0, circleSegments + 1);
-
-        prevX = x;
-        prevY = y;
     }
 
     if (!lineVertices.empty()) {
@@ -195,36 +225,161 @@ void render(GLFWwindow* window, unsigned int VAO, unsigned int VBO, unsigned int
 }
 
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
-    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-        if (!pendulums.empty()) {
-            float baseX = 0.0f;
-            float baseY = 0.75f;
-            float x = baseX;
-            float y = baseY;
-
-            for (size_t i = 0; i < pendulums.size(); ++i) {
-                x += pendulums[i].x * sin(theta[i]);
-                y -= pendulums[i].x * cos(theta[i]);
-            }
+    if (explorerActive()) {
+        explorerMouseButton(window, button, action);
+        return;
+    }
+    if (realTime.running()) {
+        return;
+    }
 
-            pendulums.push_back(glm::vec2(INITIAL_LENGTH, INITIAL_MASS));
-            theta.push_back(M_PI / 4.0f);
-            omega.push_back(0.0f);
-        }
+    // the bob under the cursor, or the pivot
+    double cursorX, cursorY;
+    int width, height;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+    glfwGetWindowSize(window, &width, &height);
+    double worldX = 4.0 * cursorX / width - 2.0;
+    double worldY = 2.0 - 4.0 * cursorY / height;
+    int picked = tree.nearest(baseX, baseY, worldX, worldY);
+
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        tree.add(picked, INITIAL_LENGTH, INITIAL_MASS, M_PI / 4.0f, 0.0f);
     }
     else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
-        if (pendulums.size() > 1) {
-            pendulums.pop_back();
-            theta.pop_back();
-            omega.pop_back();
+        // drops the picked bob with everything hanging from it, keeping one
+        if (picked >= 0 && tree.subtreeEnd(picked) - picked < tree.size()) {
+            tree.remove(picked);
+            pathVertices.clear();
         }
-        else if (pendulums.size() == 1) {
+        else if (tree.size() == 1) {
             pathVertices.clear();
         }
     }
 }
 
-int main() {
+void cursorPosCallback(GLFWwindow* window, double x, double y) {
+    if (explorerActive()) {
+        explorerCursor(x, y);
+    }
+}
+
+void scrollCallback(GLFWwindow* window, double xOffset, double yOffset) {
+    if (explorerActive()) {
+        explorerScroll(window, yOffset);
+    }
+}
+
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS) {
+        return;
+    }
+    if (key == GLFW_KEY_M) {
+        if (densityViewActive()) {
+            toggleDensityView();
+        }
+        if (sceneViewActive()) {
+            toggleSceneView();
+        }
+        toggleExplorer();
+    }
+    else if (key == GLFW_KEY_H) {
+        if (explorerActive()) {
+            toggleExplorer();
+        }
+        if (sceneViewActive()) {
+            toggleSceneView();
+        }
+        toggleDensityView();
+    }
+    else if (key == GLFW_KEY_W) {
+        if (explorerActive()) {
+            toggleExplorer();
+        }
+        if (densityViewActive()) {
+            toggleDensityView();
+        }
+        toggleSceneView();
+    }
+    else if (key == GLFW_KEY_P && densityViewActive()) {
+        nextDensityProjection();
+    }
+    else if (key == GLFW_KEY_R && explorerActive()) {
+        resetExplorerView();
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--flipmap") == 0) {
+        return runFlipMapCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--sweep") == 0) {
+        return runSweepCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--lyapunov") == 0) {
+        return runLyapunovCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--ftle") == 0) {
+        return runFtleCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--poincare") == 0) {
+        return runPoincareCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--histogram") == 0) {
+        return runHistogramCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--orbits") == 0) {
+        return runOrbitsCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--adjoint") == 0) {
+        return runAdjointCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--taylor") == 0) {
+        return runTaylorCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--drift") == 0) {
+        return runDriftCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--elastic") == 0) {
+        return runElasticCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--rope") == 0) {
+        return runRopeCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--longchain") == 0) {
+        return runLongChainCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--parareal") == 0) {
+        return runPararealCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--tree") == 0) {
+        return runTreeCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--scene") == 0) {
+        return runSceneCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--collide") == 0) {
+        return runCollideCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--coupled") == 0) {
+        return runCoupledCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--driven") == 0) {
+        return runDrivenCommand(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--realtime") == 0) {
+        return runRealTimeCommand(argc, argv);
+    }
+    if (!parsePivotArguments(argc, argv, pivot)) {
+        std::cerr << "Invalid pivot settings" << std::endl;
+        return -1;
+    }
+    realTimeSettings.rate = floatArgument(argc, argv, "--fixed-rate", 0.0f);
+    // locking all memory is a process-wide change, so the window asks for it
+    if (!parseRealTimeArguments(argc, argv, realTimeSettings, false) || realTimeSettings.rate < 0.0) {
+        std::cerr << "Invalid real-time settings" << std::endl;
+        return -1;
+    }
+
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW" << std::endl;
         return -1;
@@ -244,6 +399,9 @@ int main() {
     gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
 
     glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    glfwSetCursorPosCallback(window, cursorPosCallback);
+    glfwSetScrollCallback(window, scrollCallback);
+    glfwSetKeyCallback(window, keyCallback);
 
     unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
@@ -274,15 +432,41 @@ int main() {
     glBindVertexArray(0);
 
     initialize();
+    initExplorer(w, h);
+    initDensityView(w, h);
+    initSceneView(w, h);
     glfwSwapInterval(1);
+    if (realTimeSettings.rate > 0.0) {
+        startRealTime();
+    }
 
     while (!glfwWindowShouldClose(window)) {
-        computePhysics();
-        render(window, VAO, VBO, shaderProgram);
+        if (explorerActive()) {
+            renderExplorer();
+        }
+        else if (densityViewActive()) {
+            renderDensityView();
+        }
+        else if (sceneViewActive()) {
+            renderSceneView();
+        }
+        else {
+            if (!realTime.running()) {
+                computePhysics();
+            }
+            render(window, VAO, VBO, shaderProgram);
+        }
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    if (realTime.running()) {
+        realTime.stop();
+        printRealTimeStats(realTimeSettings, realTime.stats());
+    }
+    shutdownSceneView();
+    shutdownDensityView();
+    shutdownExplorer();
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
 
@@ -0,0 +1,166 @@
+#include "Parareal.h"
+#include "CommandLine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+// `duration` in equal steps of at most `step`, with a stepper of its own.
+static void propagate(const std::string& name, const ChainParameters& chain, double tolerance,
+    double* state, double duration, double step) {
+    std::unique_ptr<ChainStepper> stepper = makeStepper(name, chain, tolerance);
+    long long steps = std::max((long long)std::ceil(duration / step - 1e-9), 1LL);
+    double h = duration / steps;
+    for (long long k = 0; k < steps; ++k) {
+        stepper->advance(state, h);
+    }
+}
+
+static double largestChange(const std::vector<double>& before, const std::vector<double>& after) {
+    double change = 0.0, scale = 1.0;
+    for (size_t i = 0; i < after.size(); ++i) {
+        change = std::max(change, std::fabs(after[i] - before[i]));
+        scale = std::max(scale, std::fabs(after[i]));
+    }
+    return change / scale;
+}
+
+bool pararealIntegrate(const ChainParameters& chain, std::vector<double>& state, double duration,
+    const PararealSettings& settings, PararealStats* stats) {
+    if (!makeStepper(settings.coarse, chain, settings.tolerance) || !makeStepper(settings.fine, chain, settings.tolerance)) {
+        return false;
+    }
+    int threadCount = settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency();
+    threadCount = std::max(threadCount, 1);
+    const int slices = settings.slices > 0 ? settings.slices : threadCount;
+    const int maxIterations = settings.maxIterations > 0 ? std::min(settings.maxIterations, slices) : slices;
+    const double slice = duration / slices;
+    auto begin = std::chrono::steady_clock::now();
+
+    // starts[n] is slice n's start state, coarse[n] the coarse propagation of it
+    std::vector<std::vector<double>> starts(slices + 1, state), coarse(slices), fine(slices);
+    for (int n = 0; n < slices; ++n) {
+        coarse[n] = starts[n];
+        propagate(settings.coarse, chain, settings.tolerance, coarse[n].data(), slice, settings.coarseStep);
+        starts[n + 1] = coarse[n];
+    }
+    double coarseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    PararealStats result;
+    result.slices = slices;
+    result.coarseSeconds = coarseSeconds;
+    std::vector<double> fineSeconds(slices);
+    for (int iteration = 1; iteration <= maxIterations; ++iteration) {
+        // slices before first already start on the serial fine trajectory
+        const int first = iteration - 1;
+        std::atomic<int> next{ first };
+        auto work = [&]() {
+            for (int n = next++; n < slices; n = next++) {
+                auto sliceBegin = std::chrono::steady_clock::now();
+                fine[n] = starts[n];
+                propagate(settings.fine, chain, settings.tolerance, fine[n].data(), slice, settings.fineStep);
+                fineSeconds[n] = std::chrono::duration<double>(std::chrono::steady_clock::now() - sliceBegin).count();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int i = 1; i < std::min(threadCount, slices - first); ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        for (int n = first; n < slices; ++n) {
+            result.fineSeconds += fineSeconds[n];
+        }
+        result.fineSlices += slices - first;
+
+        // the first slice's start did not move, so its new coarse value is its old one
+        double change = 0.0;
+        std::vector<double> propagated;
+        for (int n = first; n < slices; ++n) {
+            propagated = starts[n];
+            if (n > first) {
+                propagate(settings.coarse, chain, settings.tolerance, propagated.data(), slice, settings.coarseStep);
+            }
+            else {
+                propagated = coarse[n];
+            }
+            std::vector<double> corrected(propagated.size());
+            for (size_t i = 0; i < corrected.size(); ++i) {
+                corrected[i] = propagated[i] + fine[n][i] - coarse[n][i];
+            }
+            change = std::max(change, largestChange(starts[n + 1], corrected));
+            coarse[n] = propagated;
+            starts[n + 1] = corrected;
+        }
+        result.iterations = iteration;
+        result.changes.push_back(change);
+        if (change <= settings.convergence || iteration == slices) {
+            result.converged = true;
+            break;
+        }
+    }
+
+    state = starts[slices];
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    if (stats) {
+        *stats = result;
+    }
+    return true;
+}
+
+int runPararealCommand(int argc, char** argv) {
+    ChainParameters chain;
+    bool valid = parseChainArguments(argc, argv, chain);
+    int n = chain.links();
+    std::vector<double> angles = parseValues(findArgument(argc, argv, "--angles"), 1.0);
+    std::vector<double> omegas = parseValues(findArgument(argc, argv, "--omegas"), 0.0);
+    double duration = std::atof(stringArgument(argc, argv, "--time", "20").c_str());
+    PararealSettings settings;
+    settings.coarse = stringArgument(argc, argv, "--coarse", settings.coarse);
+    settings.fine = stringArgument(argc, argv, "--fine", settings.fine);
+    settings.coarseStep = std::atof(stringArgument(argc, argv, "--coarse-dt", "0.02").c_str());
+    settings.fineStep = std::atof(stringArgument(argc, argv, "--fine-dt", "0.001").c_str());
+    settings.tolerance = std::atof(stringArgument(argc, argv, "--tolerance", "1e-12").c_str());
+    settings.slices = intArgument(argc, argv, "--slices", 0);
+    settings.maxIterations = intArgument(argc, argv, "--iterations", 0);
+    settings.convergence = std::atof(stringArgument(argc, argv, "--convergence", "1e-9").c_str());
+    settings.threads = intArgument(argc, argv, "--threads", 0);
+    valid = valid && duration > 0.0 && settings.coarseStep > 0.0 && settings.fineStep > 0.0 && settings.slices >= 0
+        && settings.maxIterations >= 0 && settings.threads >= 0 && !angles.empty() && !omegas.empty();
+
+    std::vector<double> start(2 * n);
+    for (int i = 0; i < n; ++i) {
+        start[i] = angles[std::min(i, (int)angles.size() - 1)];
+        start[n + i] = omegas[std::min(i, (int)omegas.size() - 1)];
+    }
+    std::vector<double> state = start;
+    PararealStats stats;
+    if (!valid || !pararealIntegrate(chain, state, duration, settings, &stats)) {
+        std::cerr << "Invalid parareal settings" << std::endl;
+        return -1;
+    }
+    for (size_t k = 0; k < stats.changes.size(); ++k) {
+        std::cout << "iteration " << k + 1 << ": largest change " << stats.changes[k] << std::endl;
+    }
+
+    // the serial fine run Parareal is meant to reproduce
+    std::vector<double> serial = start;
+    auto begin = std::chrono::steady_clock::now();
+    propagate(settings.fine, chain, settings.tolerance, serial.data(), duration, settings.fineStep);
+    double serialSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    // with a core per slice an iteration costs one slice of fine work and a coarse sweep
+    double ideal = serialSeconds / (stats.iterations * (serialSeconds / stats.slices + stats.coarseSeconds) + stats.coarseSeconds);
+    std::cout << settings.coarse << " dt " << settings.coarseStep << " / " << settings.fine << " dt " << settings.fineStep
+        << ", " << stats.slices << " slices: " << (stats.converged ? "converged" : "not converged") << " after "
+        << stats.iterations << " iterations, " << stats.fineSlices << " fine slices" << std::endl;
+    std::cout << "parareal " << stats.seconds << " s, serial fine " << serialSeconds << " s: speedup "
+        << serialSeconds / stats.seconds << " here, " << ideal << " with a core per slice; differs from serial by "
+        << largestChange(serial, state) << std::endl;
+    return 0;
+}
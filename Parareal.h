@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Stepper.h"
+
+#include <string>
+#include <vector>
+
+struct PararealSettings {
+    std::string coarse = "rk2";
+    std::string fine = "gauss2";
+    double coarseStep = 0.02;
+    double fineStep = 0.001;
+    double tolerance = 1e-12;   // for adaptive integrators
+    int slices = 0;             // 0 gives one per thread
+    int maxIterations = 0;      // 0 allows as many as slices, where it is exact
+    double convergence = 1e-9;  // largest change of a slice's start state
+    int threads = 0;
+};
+
+struct PararealStats {
+    int slices = 0;
+    int iterations = 0;
+    bool converged = false;
+    double seconds = 0.0;
+    double coarseSeconds = 0.0;     // one coarse sweep over the whole horizon
+    double fineSeconds = 0.0;       // fine propagation summed over all slices and iterations
+    long long fineSlices = 0;       // fine propagations run
+    std::vector<double> changes;    // largest change of a start state, per iteration
+};
+
+// Parareal over time slices of one trajectory: a coarse sweep gives each
+// slice a starting state, every slice is then propagated finely in
+// parallel from its current start, and a sequential sweep corrects the
+// starts with U_{n+1} = G(U_n) + F(U_n^old) - G(U_n^old) until they stop
+// changing. After k iterations the first k slices equal a serial fine run,
+// so it is exact after as many iterations as slices; slices already exact
+// are not propagated again. Both propagators come from makeStepper, fresh
+// for every slice so that neither depends on what it stepped before.
+// `state` holds the start and receives the end; false for an unknown
+// integrator.
+bool pararealIntegrate(const ChainParameters& chain, std::vector<double>& state, double duration,
+    const PararealSettings& settings, PararealStats* stats);
+
+int runPararealCommand(int argc, char** argv);
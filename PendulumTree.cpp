@@ -0,0 +1,273 @@
+#include "PendulumTree.h"
+#include "Chain.h"
+#include "CommandLine.h"
+#include "Physics.h"
+#include "Pivot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+int PendulumTree::add(int parent, double length, double mass, double angle, double rate) {
+    const int at = parent >= 0 ? ends[parent] : size();
+    for (int i = 0; i < size(); ++i) {
+        if (parents[i] >= at) {
+            ++parents[i];
+        }
+        if (i >= at) {
+            ++ends[i];
+        }
+    }
+    // the new node lands inside every ancestor's range
+    for (int ancestor = parent; ancestor >= 0; ancestor = parents[ancestor]) {
+        ++ends[ancestor];
+    }
+    parents.insert(parents.begin() + at, parent);
+    ends.insert(ends.begin() + at, at + 1);
+    lengths.insert(lengths.begin() + at, length);
+    masses.insert(masses.begin() + at, mass);
+    theta.insert(theta.begin() + at, angle);
+    omega.insert(omega.begin() + at, rate);
+    return at;
+}
+
+void PendulumTree::remove(int node) {
+    const int end = ends[node];
+    const int count = end - node;
+    for (int ancestor = parents[node]; ancestor >= 0; ancestor = parents[ancestor]) {
+        ends[ancestor] -= count;
+    }
+    for (int i = end; i < size(); ++i) {
+        if (parents[i] >= end) {
+            parents[i] -= count;
+        }
+        ends[i] -= count;
+    }
+    parents.erase(parents.begin() + node, parents.begin() + end);
+    ends.erase(ends.begin() + node, ends.begin() + end);
+    lengths.erase(lengths.begin() + node, lengths.begin() + end);
+    masses.erase(masses.begin() + node, masses.begin() + end);
+    theta.erase(theta.begin() + node, theta.begin() + end);
+    omega.erase(omega.begin() + node, omega.begin() + end);
+}
+
+void PendulumTree::clear() {
+    parents.clear();
+    ends.clear();
+    lengths.clear();
+    masses.clear();
+    theta.clear();
+    omega.clear();
+}
+
+// The force a rod exerts on its bob is I a + b, with a the bob's
+// acceleration, I the articulated inertia of the subtree hanging from the
+// bob and b its bias force. A rod pinned at both ends pushes only along
+// itself, so its component along n (perpendicular to the rod) vanishes,
+// which fixes the rod's angular acceleration given its parent's
+// acceleration; folding that in gives the parent's share
+// I - u u^T / (n.u) with u = I n.
+void PendulumTree::accelerations(const double* angle, const double* rate, double g, double* accel, double pivotX, double pivotY) {
+    const int n = size();
+    inertiaXX.assign(masses.begin(), masses.end());
+    inertiaXY.assign(n, 0.0);
+    inertiaYY.assign(masses.begin(), masses.end());
+    biasX.assign(n, 0.0);
+    biasY.resize(n);
+    for (int i = 0; i < n; ++i) {
+        biasY[i] = masses[i] * g;
+    }
+    projectedX.resize(n);
+    projectedY.resize(n);
+    projectedInertia.resize(n);
+    projectedBias.resize(n);
+    accelX.resize(n);
+    accelY.resize(n);
+
+    // children come after their parents, so counting down finishes each
+    // subtree before its root is passed up
+    for (int i = n - 1; i >= 0; --i) {
+        double s = std::sin(angle[i]), c = std::cos(angle[i]);
+        double xx = inertiaXX[i], xy = inertiaXY[i], yy = inertiaYY[i];
+        // u = I n with n = (c, s); the bias includes the centripetal term -L omega^2 I e, e = (s, -c)
+        double ux = xx * c + xy * s, uy = xy * c + yy * s;
+        double spin = lengths[i] * rate[i] * rate[i];
+        double zx = biasX[i] - spin * (xx * s - xy * c);
+        double zy = biasY[i] - spin * (xy * s - yy * c);
+        double d = c * ux + s * uy;
+        double nz = c * zx + s * zy;
+        projectedX[i] = ux;
+        projectedY[i] = uy;
+        projectedInertia[i] = d;
+        projectedBias[i] = nz;
+        int p = parents[i];
+        if (p >= 0) {
+            inertiaXX[p] += xx - ux * ux / d;
+            inertiaXY[p] += xy - ux * uy / d;
+            inertiaYY[p] += yy - uy * uy / d;
+            biasX[p] += zx - ux * nz / d;
+            biasY[p] += zy - uy * nz / d;
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        int p = parents[i];
+        double px = p >= 0 ? accelX[p] : pivotX, py = p >= 0 ? accelY[p] : pivotY;
+        double s = std::sin(angle[i]), c = std::cos(angle[i]);
+        double tangential = -(projectedX[i] * px + projectedY[i] * py + projectedBias[i]) / projectedInertia[i];
+        double spin = lengths[i] * rate[i] * rate[i];
+        accel[i] = tangential / lengths[i];
+        accelX[i] = px + tangential * c - spin * s;
+        accelY[i] = py + tangential * s + spin * c;
+    }
+}
+
+void PendulumTree::advance(double h, double g, const PivotMotion* pivot, double time) {
+    const int n = size();
+    stages.resize(5 * (size_t)n);
+    double* sumTheta = stages.data();
+    double* sumOmega = sumTheta + n;
+    double* probeTheta = sumOmega + n;
+    double* probeOmega = probeTheta + n;
+    double* accel = probeOmega + n;
+
+    double pivotX = 0.0, pivotY = 0.0;
+    if (pivot) {
+        pivot->acceleration(time, pivotX, pivotY);
+    }
+    accelerations(theta.data(), omega.data(), g, accel, pivotX, pivotY);
+    for (int i = 0; i < n; ++i) {
+        sumTheta[i] = omega[i];
+        sumOmega[i] = accel[i];
+        probeTheta[i] = theta[i] + 0.5 * h * omega[i];
+        probeOmega[i] = omega[i] + 0.5 * h * accel[i];
+    }
+    for (int stage = 1; stage < 4; ++stage) {
+        if (pivot) {
+            pivot->acceleration(time + (stage < 3 ? 0.5 * h : h), pivotX, pivotY);
+        }
+        accelerations(probeTheta, probeOmega, g, accel, pivotX, pivotY);
+        double weight = stage < 3 ? 2.0 : 1.0;
+        double reach = stage < 2 ? 0.5 * h : h;
+        for (int i = 0; i < n; ++i) {
+            sumTheta[i] += weight * probeOmega[i];
+            sumOmega[i] += weight * accel[i];
+            probeTheta[i] = theta[i] + reach * probeOmega[i];
+            probeOmega[i] = omega[i] + reach * accel[i];
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        theta[i] += h / 6.0 * sumTheta[i];
+        omega[i] += h / 6.0 * sumOmega[i];
+    }
+}
+
+double PendulumTree::energy(double g) const {
+    const int n = size();
+    std::vector<double> y(n), vx(n), vy(n);
+    double energy = 0.0;
+    for (int i = 0; i < n; ++i) {
+        int p = parents[i];
+        double s = std::sin(theta[i]), c = std::cos(theta[i]);
+        y[i] = (p >= 0 ? y[p] : 0.0) - lengths[i] * c;
+        vx[i] = (p >= 0 ? vx[p] : 0.0) + lengths[i] * omega[i] * c;
+        vy[i] = (p >= 0 ? vy[p] : 0.0) + lengths[i] * omega[i] * s;
+        energy += masses[i] * (0.5 * (vx[i] * vx[i] + vy[i] * vy[i]) + g * y[i]);
+    }
+    return energy;
+}
+
+void PendulumTree::positions(double baseX, double baseY, std::vector<float>& x, std::vector<float>& y) const {
+    const int n = size();
+    x.resize(n);
+    y.resize(n);
+    for (int i = 0; i < n; ++i) {
+        int p = parents[i];
+        x[i] = (float)((p >= 0 ? x[p] : baseX) + lengths[i] * std::sin(theta[i]));
+        y[i] = (float)((p >= 0 ? y[p] : baseY) - lengths[i] * std::cos(theta[i]));
+    }
+}
+
+int PendulumTree::nearest(double baseX, double baseY, double x, double y) const {
+    std::vector<float> bobX, bobY;
+    positions(baseX, baseY, bobX, bobY);
+    int best = -1;
+    double bestDistance = (x - baseX) * (x - baseX) + (y - baseY) * (y - baseY);
+    for (int i = 0; i < size(); ++i) {
+        double distance = (x - bobX[i]) * (x - bobX[i]) + (y - bobY[i]) * (y - bobY[i]);
+        if (distance < bestDistance) {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+int runTreeCommand(int argc, char** argv) {
+    int nodes = intArgument(argc, argv, "--nodes", 1000);
+    double length = floatArgument(argc, argv, "--length", INITIAL_LENGTH);
+    double mass = floatArgument(argc, argv, "--mass", INITIAL_MASS);
+    double g = floatArgument(argc, argv, "--g", G);
+    double spread = floatArgument(argc, argv, "--angle", 1.0f);
+    double duration = floatArgument(argc, argv, "--time", 10.0f);
+    double h = std::atof(stringArgument(argc, argv, "--dt", "0.001").c_str());
+    int seed = intArgument(argc, argv, "--seed", 1);
+    if (nodes < 1 || length <= 0.0 || mass <= 0.0 || duration <= 0.0 || h <= 0.0) {
+        std::cerr << "Invalid tree settings" << std::endl;
+        return -1;
+    }
+
+    // a straight chain must match the chain equations
+    double worst = 0.0;
+    for (int n = 1; n <= CHAIN_MAX_LINKS; ++n) {
+        PendulumTree chain;
+        std::vector<double> lengths, masses;
+        for (int i = 0; i < n; ++i) {
+            chain.add(i - 1, length * (1.0 + 0.1 * i), mass * (1.0 + 0.3 * i), 0.4 * i - 1.0, 0.5 - 0.2 * i);
+            lengths.push_back(chain.length(i));
+            masses.push_back(chain.mass(i));
+        }
+        std::vector<double> fromTree(n), fromChain(n);
+        chain.accelerations(chain.theta.data(), chain.omega.data(), g, fromTree.data());
+        chainAccel(n, chain.theta.data(), chain.omega.data(), lengths.data(), masses.data(), g, fromChain.data());
+        for (int i = 0; i < n; ++i) {
+            worst = std::max(worst, std::fabs(fromTree[i] - fromChain[i]) / std::max(std::fabs(fromChain[i]), 1.0));
+        }
+    }
+    std::cout << "straight chains of up to " << CHAIN_MAX_LINKS << " links against the chain solver: " << worst << std::endl;
+
+    // a random mobile: every bob hangs from a random earlier one, built in
+    // random order so insertion keeps reshuffling the storage
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> angles(-spread, spread);
+    PendulumTree tree;
+    int depth = 0;
+    for (int k = 0; k < nodes; ++k) {
+        int parent = k == 0 ? -1 : std::uniform_int_distribution<int>(0, tree.size() - 1)(random);
+        tree.add(parent, length / std::sqrt((double)nodes), mass / nodes, angles(random), 0.0);
+    }
+    for (int i = 0; i < tree.size(); ++i) {
+        int levels = 0;
+        for (int p = i; p >= 0; p = tree.parent(p)) {
+            ++levels;
+        }
+        depth = std::max(depth, levels);
+    }
+
+    long long steps = std::max((long long)(duration / h + 0.5), 1LL);
+    double start = tree.energy(g), drift = 0.0;
+    auto begin = std::chrono::steady_clock::now();
+    for (long long k = 0; k < steps; ++k) {
+        tree.advance(h, g);
+        if ((k + 1) % 100 == 0 || k + 1 == steps) {
+            drift = std::max(drift, std::fabs(tree.energy(g) - start));
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << nodes << " bobs, " << depth << " deep: " << steps << " RK4 steps of " << h << ", "
+        << seconds * 1e9 / ((double)steps * nodes) << " ns per bob and step, worst energy error " << drift
+        << " of " << std::fabs(start) << std::endl;
+    return 0;
+}
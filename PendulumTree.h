@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+class PivotMotion;
+
+// Pendulums hanging from one another in a tree (a mobile): every bob hangs
+// on a massless rod from its parent bob, or from the pivot for parent -1,
+// and any bob may carry several. Nodes are kept in depth-first order in
+// parallel arrays, so a node's subtree is the contiguous range
+// node..subtreeEnd(node) - 1 and every parent comes before its children.
+// Angles are absolute, from straight down.
+class PendulumTree {
+public:
+    int size() const { return (int)parents.size(); }
+    int parent(int node) const { return parents[node]; }
+    int subtreeEnd(int node) const { return ends[node]; }
+    double length(int node) const { return lengths[node]; }
+    double mass(int node) const { return masses[node]; }
+
+    std::vector<double> theta, omega;
+
+    // Hangs a new bob from `parent` (-1 for the pivot) after its existing
+    // children and returns its index; later nodes move up by one.
+    int add(int parent, double length, double mass, double theta, double omega);
+    // Drops the node with its whole subtree.
+    void remove(int node);
+    void clear();
+
+    // Angular accelerations of every rod in O(n) by the articulated-body
+    // method. With point bobs an articulated inertia is a 2 x 2 matrix: a
+    // pass from the leaves up folds each subtree into the inertia and bias
+    // force its rod sees at its top, and a pass down from the pivot
+    // resolves each rod's acceleration from its parent's, starting from
+    // the pivot's (pivotX, pivotY).
+    void accelerations(const double* theta, const double* omega, double g, double* accel,
+        double pivotX = 0.0, double pivotY = 0.0);
+
+    // Classic RK4 step of the whole tree, from `time` when the pivot moves.
+    void advance(double h, double g, const PivotMotion* pivot = nullptr, double time = 0.0);
+
+    double energy(double g) const;
+
+    // Bob positions for the pivot at (baseX, baseY).
+    void positions(double baseX, double baseY, std::vector<float>& x, std::vector<float>& y) const;
+
+    // The bob nearest (x, y), or -1 if the pivot is nearer.
+    int nearest(double baseX, double baseY, double x, double y) const;
+
+private:
+    std::vector<int> parents, ends;
+    std::vector<double> lengths, masses;
+
+    // articulated-body scratch, per node
+    std::vector<double> inertiaXX, inertiaXY, inertiaYY, biasX, biasY;
+    std::vector<double> projectedX, projectedY, projectedInertia, projectedBias, accelX, accelY;
+    std::vector<double> stages;
+};
+
+int runTreeCommand(int argc, char** argv);
@@ -0,0 +1,695 @@
+#include "PeriodicOrbits.h"
+#include "Chain.h"
+#include "CommandLine.h"
+#include "Dual.h"
+#include "Physics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+
+const int ORBIT_MAX_LINKS = 4;
+const int ORBIT_MIN_STEPS = 8;
+const int ORBIT_LINE_SEARCH_STEPS = 8;
+const int ORBIT_TRIAL_ITERATIONS = 8;       // after these the residual must be small...
+const double ORBIT_TRIAL_RESIDUAL = 1e-3;   // ...or the seed is dropped
+const double ORBIT_RANK_TOLERANCE = 1e-14;
+const int EIGENVALUE_ITERATIONS = 200;
+
+static double wrapAngle(double angle) {
+    return angle - 2.0 * M_PI * std::floor((angle + M_PI) / (2.0 * M_PI));
+}
+
+template<typename T>
+static void chainDerivative(int n, const T* state, const OrbitSettings& s, T* rate) {
+    chainDerivative(n, state, s.lengths.data(), s.masses.data(), s.g, rate);
+}
+
+template<typename T>
+static void chainRk4Step(int n, T* state, T h, const OrbitSettings& s) {
+    chainRk4Step(n, state, h, s.lengths.data(), s.masses.data(), s.g);
+}
+
+static double chainStateEnergy(int n, const double* state, const OrbitSettings& s) {
+    return chainEnergy(n, state, state + n, s.lengths.data(), s.masses.data(), s.g);
+}
+
+// Flows one arc of period / segments in `steps` RK4 steps. With `jacobian`
+// also fills the 2n x (2n + 1) derivative of the end state with respect to
+// the start state and the period, row-major.
+template<int LINKS>
+static bool flowArc(const double* start, double period, int steps, const OrbitSettings& s, double* end, double* jacobian) {
+    const int size = 2 * LINKS;
+    double h = period / ((double)s.segments * steps);
+    bool finite = true;
+
+    if (!jacobian) {
+        double state[size];
+        std::copy(start, start + size, state);
+        for (int step = 0; step < steps; ++step) {
+            chainRk4Step(LINKS, state, h, s);
+        }
+        for (int i = 0; i < size; ++i) {
+            end[i] = state[i];
+            finite = finite && std::isfinite(state[i]);
+        }
+        return finite;
+    }
+
+    typedef Dual<double, size + 1> Number;
+    Number state[size];
+    for (int i = 0; i < size; ++i) {
+        state[i] = Number::variable(start[i], i);
+    }
+    Number step(h);
+    step.d[size] = 1.0 / ((double)s.segments * steps);
+    for (int k = 0; k < steps; ++k) {
+        chainRk4Step(LINKS, state, step, s);
+    }
+    for (int i = 0; i < size; ++i) {
+        end[i] = state[i].v;
+        for (int j = 0; j <= size; ++j) {
+            jacobian[i * (size + 1) + j] = state[i].d[j];
+            finite = finite && std::isfinite(state[i].d[j]);
+        }
+        finite = finite && std::isfinite(state[i].v);
+    }
+    return finite;
+}
+
+template<int LINKS>
+static bool flowArcs(const std::vector<double>& points, double period, int steps, const OrbitSettings& s,
+    std::vector<double>& ends, double* jacobians, int threads) {
+    const int size = 2 * LINKS;
+    std::atomic<bool> ok{ true };
+    threads = std::max(std::min(threads, s.segments), 1);
+
+    auto run = [&](int first) {
+        for (int k = first; k < s.segments; k += threads) {
+            double* jacobian = jacobians ? jacobians + (size_t)k * size * (size + 1) : nullptr;
+            if (!flowArc<LINKS>(&points[(size_t)k * size], period, steps, s, &ends[(size_t)k * size], jacobian)) {
+                ok = false;
+            }
+        }
+    };
+    std::vector<std::thread> helpers;
+    for (int t = 1; t < threads; ++t) {
+        helpers.emplace_back(run, t);
+    }
+    run(0);
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+    return ok;
+}
+
+// Least-squares solution of the rows x cols system (rows >= cols) by
+// Householder QR; false if the matrix is numerically rank deficient.
+static bool solveLeastSquares(std::vector<double>& a, std::vector<double>& b, int rows, int cols, std::vector<double>& x) {
+    std::vector<double> diagonal(cols);
+    for (int k = 0; k < cols; ++k) {
+        double norm = 0.0;
+        for (int i = k; i < rows; ++i) {
+            norm += a[(size_t)i * cols + k] * a[(size_t)i * cols + k];
+        }
+        norm = std::sqrt(norm);
+        if (norm == 0.0) {
+            return false;
+        }
+        double alpha = a[(size_t)k * cols + k] > 0.0 ? -norm : norm;
+        a[(size_t)k * cols + k] -= alpha;
+        double length = 0.0;
+        for (int i = k; i < rows; ++i) {
+            length += a[(size_t)i * cols + k] * a[(size_t)i * cols + k];
+        }
+        for (int j = k + 1; j < cols; ++j) {
+            double dot = 0.0;
+            for (int i = k; i < rows; ++i) {
+                dot += a[(size_t)i * cols + k] * a[(size_t)i * cols + j];
+            }
+            double factor = 2.0 * dot / length;
+            for (int i = k; i < rows; ++i) {
+                a[(size_t)i * cols + j] -= factor * a[(size_t)i * cols + k];
+            }
+        }
+        double dot = 0.0;
+        for (int i = k; i < rows; ++i) {
+            dot += a[(size_t)i * cols + k] * b[i];
+        }
+        double factor = 2.0 * dot / length;
+        for (int i = k; i < rows; ++i) {
+            b[i] -= factor * a[(size_t)i * cols + k];
+        }
+        diagonal[k] = alpha;
+    }
+
+    double largest = 0.0;
+    for (double value : diagonal) {
+        largest = std::max(largest, std::fabs(value));
+    }
+    x.assign(cols, 0.0);
+    for (int k = cols - 1; k >= 0; --k) {
+        if (std::fabs(diagonal[k]) <= ORBIT_RANK_TOLERANCE * largest) {
+            return false;
+        }
+        double sum = b[k];
+        for (int j = k + 1; j < cols; ++j) {
+            sum -= a[(size_t)k * cols + j] * x[j];
+        }
+        x[k] = sum / diagonal[k];
+    }
+    return true;
+}
+
+// Eigenvalues of a small dense real matrix by shifted complex QR iteration
+// with Givens rotations, deflating one eigenvalue at a time off the bottom
+// row. Largest modulus first.
+static std::vector<std::complex<double>> eigenvalues(const std::vector<double>& matrix, int n) {
+    typedef std::complex<double> Complex;
+    std::vector<Complex> a(matrix.begin(), matrix.end());
+    std::vector<Complex> values;
+    std::vector<double> cosines(n * n);
+    std::vector<Complex> sines(n * n);
+    double scale = 0.0;
+    for (const Complex& value : a) {
+        scale = std::max(scale, std::abs(value));
+    }
+
+    int active = n;
+    int iterations = 0;
+    while (active > 0) {
+        int m = active;
+        double below = 0.0;
+        for (int j = 0; j + 1 < m; ++j) {
+            below = std::max(below, std::abs(a[(m - 1) * n + j]));
+        }
+        if (m == 1 || below <= 1e-15 * (std::abs(a[(m - 1) * n + m - 1]) + scale) || iterations > EIGENVALUE_ITERATIONS) {
+            values.push_back(a[(m - 1) * n + m - 1]);
+            --active;
+            iterations = 0;
+            continue;
+        }
+        ++iterations;
+
+        // Wilkinson shift from the trailing 2 x 2 block, with an occasional
+        // exceptional shift to break cycles
+        Complex p = a[(m - 2) * n + m - 2], q = a[(m - 2) * n + m - 1];
+        Complex r = a[(m - 1) * n + m - 2], t = a[(m - 1) * n + m - 1];
+        Complex mean = 0.5 * (p + t);
+        Complex root = std::sqrt(0.25 * (p - t) * (p - t) + q * r);
+        Complex shift = std::abs(mean + root - t) < std::abs(mean - root - t) ? mean + root : mean - root;
+        if (iterations % 11 == 10) {
+            shift = t + below;
+        }
+
+        for (int i = 0; i < m; ++i) {
+            a[i * n + i] -= shift;
+        }
+        int rotations = 0;
+        for (int j = 0; j + 1 < m; ++j) {
+            for (int i = m - 1; i > j; --i) {
+                Complex x = a[(i - 1) * n + j], y = a[i * n + j];
+                double c;
+                Complex s;
+                double length = std::sqrt(std::norm(x) + std::norm(y));
+                if (std::abs(x) == 0.0) {
+                    c = 0.0;
+                    s = 1.0;
+                }
+                else {
+                    c = std::abs(x) / length;
+                    s = (x / std::abs(x)) * std::conj(y) / length;
+                }
+                for (int k = 0; k < m; ++k) {
+                    Complex u = a[(i - 1) * n + k], v = a[i * n + k];
+                    a[(i - 1) * n + k] = c * u + s * v;
+                    a[i * n + k] = -std::conj(s) * u + c * v;
+                }
+                cosines[rotations] = c;
+                sines[rotations] = s;
+                ++rotations;
+            }
+        }
+        rotations = 0;
+        for (int j = 0; j + 1 < m; ++j) {
+            for (int i = m - 1; i > j; --i) {
+                double c = cosines[rotations];
+                Complex s = sines[rotations];
+                ++rotations;
+                for (int k = 0; k < m; ++k) {
+                    Complex u = a[k * n + i - 1], v = a[k * n + i];
+                    a[k * n + i - 1] = u * c + v * std::conj(s);
+                    a[k * n + i] = -u * s + v * c;
+                }
+            }
+        }
+        for (int i = 0; i < m; ++i) {
+            a[i * n + i] += shift;
+        }
+    }
+
+    std::sort(values.begin(), values.end(), [](const Complex& x, const Complex& y) { return std::abs(x) > std::abs(y); });
+    return values;
+}
+
+template<int LINKS>
+static PeriodicOrbit refineSeed(const OrbitSeed& seed, const OrbitSettings& s, int arcThreads) {
+    const int size = 2 * LINKS;
+    const int arcs = s.segments;
+    const int unknowns = arcs * size + 1;
+    const int rows = unknowns + 1;
+    PeriodicOrbit orbit;
+
+    double period = seed.period;
+    if (!(period >= s.minPeriod && period <= s.maxPeriod)) {
+        orbit.status = ORBIT_PERIOD_OUT_OF_RANGE;
+        return orbit;
+    }
+    // the step count stays fixed so the arc maps are smooth in the period
+    int steps = std::max(ORBIT_MIN_STEPS, (int)std::ceil(period / (arcs * s.dt)));
+
+    std::vector<double> points((size_t)arcs * size);
+    std::copy(seed.state.begin(), seed.state.end(), points.begin());
+    double h = period / ((double)arcs * steps);
+    for (int k = 1; k < arcs; ++k) {
+        std::copy(&points[(size_t)(k - 1) * size], &points[(size_t)k * size], &points[(size_t)k * size]);
+        for (int step = 0; step < steps; ++step) {
+            chainRk4Step(LINKS, &points[(size_t)k * size], h, s);
+        }
+    }
+    double targetEnergy = chainStateEnergy(LINKS, points.data(), s);
+
+    std::vector<double> ends(points.size());
+    std::vector<double> jacobians((size_t)arcs * size * (size + 1));
+    auto evaluate = [&](const std::vector<double>& x, double T, bool withJacobian, std::vector<double>& residual) {
+        residual.assign(unknowns, 0.0);
+        if (!flowArcs<LINKS>(x, T, steps, s, ends, withJacobian ? jacobians.data() : nullptr, arcThreads)) {
+            return std::numeric_limits<double>::infinity();
+        }
+        double sum = 0.0;
+        for (int k = 0; k < arcs; ++k) {
+            int next = (k + 1) % arcs;
+            for (int i = 0; i < size; ++i) {
+                double difference = ends[(size_t)k * size + i] - x[(size_t)next * size + i];
+                if (next == 0 && i < LINKS) {
+                    // the orbit may close after whole turns of an arm
+                    difference -= 2.0 * M_PI * std::round(difference / (2.0 * M_PI));
+                }
+                residual[(size_t)k * size + i] = difference;
+                sum += difference * difference;
+            }
+        }
+        residual[unknowns - 1] = chainStateEnergy(LINKS, x.data(), s) - targetEnergy;
+        sum += residual[unknowns - 1] * residual[unknowns - 1];
+        return std::sqrt(sum);
+    };
+
+    std::vector<double> residual, trialResidual, trialPoints, matrix, rhs, delta;
+    double current = evaluate(points, period, true, residual);
+    for (int iteration = 0;; ++iteration) {
+        orbit.iterations = iteration;
+        orbit.residual = current;
+        if (!std::isfinite(current)) {
+            orbit.status = ORBIT_DIVERGED;
+            return orbit;
+        }
+        if (current < s.tolerance) {
+            break;
+        }
+        if (iteration >= s.maxIterations || (iteration >= ORBIT_TRIAL_ITERATIONS && current > ORBIT_TRIAL_RESIDUAL)) {
+            orbit.status = ORBIT_NOT_CONVERGING;
+            return orbit;
+        }
+
+        // shooting rows, then energy and phase rows on the first point
+        matrix.assign((size_t)rows * unknowns, 0.0);
+        rhs.assign(rows, 0.0);
+        for (int k = 0; k < arcs; ++k) {
+            int next = (k + 1) % arcs;
+            const double* jacobian = &jacobians[(size_t)k * size * (size + 1)];
+            for (int i = 0; i < size; ++i) {
+                double* row = &matrix[(size_t)(k * size + i) * unknowns];
+                for (int j = 0; j < size; ++j) {
+                    row[k * size + j] += jacobian[i * (size + 1) + j];
+                }
+                row[next * size + i] -= 1.0;
+                row[unknowns - 1] = jacobian[i * (size + 1) + size];
+                rhs[k * size + i] = -residual[(size_t)k * size + i];
+            }
+        }
+        typedef Dual<double, size> Gradient;
+        Gradient first[size];
+        for (int i = 0; i < size; ++i) {
+            first[i] = Gradient::variable(points[i], i);
+        }
+        Gradient energy = chainEnergy(LINKS, first, first + LINKS, s.lengths.data(), s.masses.data(), s.g);
+        double flow[size];
+        chainDerivative(LINKS, points.data(), s, flow);
+        for (int j = 0; j < size; ++j) {
+            matrix[(size_t)(rows - 2) * unknowns + j] = energy.d[j];
+            matrix[(size_t)(rows - 1) * unknowns + j] = flow[j];
+        }
+        rhs[rows - 2] = -residual[unknowns - 1];
+        if (!solveLeastSquares(matrix, rhs, rows, unknowns, delta)) {
+            orbit.status = ORBIT_DIVERGED;
+            return orbit;
+        }
+
+        // damped step: the full step carries the Jacobian along since it is
+        // almost always taken, shorter ones are tried on the flow alone
+        bool accepted = false;
+        double lambda = 1.0;
+        for (int attempt = 0; attempt < ORBIT_LINE_SEARCH_STEPS && !accepted; ++attempt, lambda *= 0.5) {
+            trialPoints = points;
+            for (size_t i = 0; i < points.size(); ++i) {
+                trialPoints[i] += lambda * delta[i];
+            }
+            double trialPeriod = period + lambda * delta[unknowns - 1];
+            if (!(trialPeriod >= s.minPeriod && trialPeriod <= s.maxPeriod)) {
+                continue;
+            }
+            double trial = evaluate(trialPoints, trialPeriod, attempt == 0, trialResidual);
+            if (trial < (1.0 - 1e-4 * lambda) * current) {
+                accepted = true;
+                points.swap(trialPoints);
+                period = trialPeriod;
+                current = attempt == 0 ? trial : evaluate(points, period, true, trialResidual);
+                residual.swap(trialResidual);
+            }
+        }
+        if (!accepted) {
+            orbit.status = ORBIT_STALLED;
+            return orbit;
+        }
+    }
+
+    orbit.status = ORBIT_CONVERGED;
+    orbit.state.assign(points.begin(), points.begin() + size);
+    for (int i = 0; i < LINKS; ++i) {
+        orbit.state[i] = wrapAngle(orbit.state[i]);
+    }
+    orbit.period = period;
+    orbit.energy = chainStateEnergy(LINKS, points.data(), s);
+
+    // monodromy matrix: the arc Jacobians chained around the orbit
+    std::vector<double> monodromy(size * size, 0.0), product(size * size);
+    for (int i = 0; i < size; ++i) {
+        monodromy[i * size + i] = 1.0;
+    }
+    for (int k = 0; k < arcs; ++k) {
+        const double* jacobian = &jacobians[(size_t)k * size * (size + 1)];
+        for (int i = 0; i < size; ++i) {
+            for (int j = 0; j < size; ++j) {
+                double sum = 0.0;
+                for (int l = 0; l < size; ++l) {
+                    sum += jacobian[i * (size + 1) + l] * monodromy[l * size + j];
+                }
+                product[i * size + j] = sum;
+            }
+        }
+        monodromy.swap(product);
+    }
+    orbit.multipliers = eigenvalues(monodromy, size);
+    return orbit;
+}
+
+std::vector<PeriodicOrbit> findPeriodicOrbits(const std::vector<OrbitSeed>& seeds, const OrbitSettings& settings) {
+    std::vector<PeriodicOrbit> orbits(seeds.size());
+    int links = (int)settings.lengths.size();
+    if (seeds.empty() || links < 2 || links > ORBIT_MAX_LINKS || (int)settings.masses.size() != links
+        || settings.segments < 1 || settings.dt <= 0.0) {
+        return orbits;
+    }
+
+    int threadCount = std::max(settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency(), 1);
+    int seedThreads = (int)std::min((size_t)threadCount, seeds.size());
+    int arcThreads = std::max(threadCount / seedThreads, 1);
+
+    std::atomic<size_t> next{ 0 };
+    auto worker = [&]() {
+        for (size_t i = next++; i < seeds.size(); i = next++) {
+            if ((int)seeds[i].state.size() != 2 * links) {
+                continue;
+            }
+            switch (links) {
+            case 2: orbits[i] = refineSeed<2>(seeds[i], settings, arcThreads); break;
+            case 3: orbits[i] = refineSeed<3>(seeds[i], settings, arcThreads); break;
+            default: orbits[i] = refineSeed<4>(seeds[i], settings, arcThreads); break;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < seedThreads; ++t) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+    return orbits;
+}
+
+static void recurrencesOf(const std::vector<double>& start, const OrbitSettings& s, const RecurrenceSettings& r,
+    std::vector<OrbitSeed>& seeds) {
+    const int n = (int)s.lengths.size();
+    const int size = 2 * n;
+    double sampleTime = s.dt * r.sampleEvery;
+    long long samples = (long long)(r.time / sampleTime) + 1;
+    long long minLag = std::max((long long)std::ceil(s.minPeriod / sampleTime), 1LL);
+    long long maxLag = (long long)(s.maxPeriod / sampleTime);
+    double reach = 0.0;
+    for (double length : s.lengths) {
+        reach += length;
+    }
+    double omegaScale = std::sqrt(reach / s.g);
+
+    std::vector<double> history((size_t)samples * size);
+    double state[2 * ORBIT_MAX_LINKS];
+    std::copy(start.begin(), start.end(), state);
+
+    // a close return is reported at the sample where it is closest
+    long long nextAllowed = minLag;
+    double candidate = r.threshold;
+    long long candidateSample = -1, candidateLag = 0;
+    for (long long i = 0; i < samples && (int)seeds.size() < r.seedsPerStart; ++i) {
+        for (int step = 0; step < r.sampleEvery && i > 0; ++step) {
+            chainRk4Step(n, state, s.dt, s);
+        }
+        if (!std::isfinite(state[0])) {
+            break;
+        }
+        std::copy(state, state + size, &history[(size_t)i * size]);
+        if (i < nextAllowed) {
+            continue;
+        }
+
+        double best = std::numeric_limits<double>::infinity();
+        long long bestLag = 0;
+        for (long long lag = minLag; lag <= std::min(maxLag, i); ++lag) {
+            const double* then = &history[(size_t)(i - lag) * size];
+            double distance = 0.0;
+            for (int k = 0; k < n; ++k) {
+                double angle = wrapAngle(state[k] - then[k]);
+                double omega = (state[n + k] - then[n + k]) * omegaScale;
+                distance += angle * angle + omega * omega;
+            }
+            if (distance < best) {
+                best = distance;
+                bestLag = lag;
+            }
+        }
+        best = std::sqrt(best);
+
+        if (best < candidate) {
+            candidate = best;
+            candidateSample = i;
+            candidateLag = bestLag;
+        }
+        else if (candidateSample >= 0) {
+            OrbitSeed seed;
+            const double* then = &history[(size_t)(candidateSample - candidateLag) * size];
+            seed.state.assign(then, then + size);
+            seed.period = candidateLag * sampleTime;
+            seeds.push_back(seed);
+            nextAllowed = i + minLag;
+            candidate = r.threshold;
+            candidateSample = -1;
+        }
+    }
+}
+
+std::vector<OrbitSeed> findRecurrenceSeeds(const std::vector<std::vector<double>>& starts, const OrbitSettings& settings,
+    const RecurrenceSettings& recurrence) {
+    std::vector<std::vector<OrbitSeed>> found(starts.size());
+    int links = (int)settings.lengths.size();
+    if (links >= 2 && links <= ORBIT_MAX_LINKS && (int)settings.masses.size() == links && settings.dt > 0.0
+        && recurrence.sampleEvery > 0) {
+        int threadCount = std::max(settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency(), 1);
+        std::atomic<size_t> next{ 0 };
+        auto worker = [&]() {
+            for (size_t i = next++; i < starts.size(); i = next++) {
+                if ((int)starts[i].size() == 2 * links) {
+                    recurrencesOf(starts[i], settings, recurrence, found[i]);
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int t = 0; t < std::min(threadCount, (int)starts.size()); ++t) {
+            workers.emplace_back(worker);
+        }
+        for (std::thread& thread : workers) {
+            thread.join();
+        }
+    }
+
+    std::vector<OrbitSeed> seeds;
+    for (const std::vector<OrbitSeed>& list : found) {
+        seeds.insert(seeds.end(), list.begin(), list.end());
+    }
+    return seeds;
+}
+
+int runOrbitsCommand(int argc, char** argv) {
+    OrbitSettings settings;
+    int links = intArgument(argc, argv, "--links", 2);
+    std::vector<double> lengths = parseValues(findArgument(argc, argv, "--length"), INITIAL_LENGTH);
+    std::vector<double> masses = parseValues(findArgument(argc, argv, "--mass"), INITIAL_MASS);
+    settings.g = floatArgument(argc, argv, "--g", G);
+    settings.dt = floatArgument(argc, argv, "--dt", (float)settings.dt);
+    settings.segments = intArgument(argc, argv, "--segments", settings.segments);
+    settings.maxIterations = intArgument(argc, argv, "--max-iterations", settings.maxIterations);
+    settings.tolerance = floatArgument(argc, argv, "--tolerance", (float)settings.tolerance);
+    settings.minPeriod = floatArgument(argc, argv, "--min-period", (float)settings.minPeriod);
+    settings.maxPeriod = floatArgument(argc, argv, "--max-period", (float)settings.maxPeriod);
+    settings.threads = intArgument(argc, argv, "--threads", 0);
+
+    RecurrenceSettings recurrence;
+    recurrence.time = floatArgument(argc, argv, "--time", (float)recurrence.time);
+    recurrence.sampleEvery = intArgument(argc, argv, "--sample-every", recurrence.sampleEvery);
+    recurrence.threshold = floatArgument(argc, argv, "--threshold", (float)recurrence.threshold);
+    recurrence.seedsPerStart = intArgument(argc, argv, "--seeds-per-member", recurrence.seedsPerStart);
+    int members = intArgument(argc, argv, "--members", 8);
+    double spread = floatArgument(argc, argv, "--spread", 1.5f);
+    unsigned int randomSeed = (unsigned int)intArgument(argc, argv, "--seed", 1);
+    std::string seedPath = stringArgument(argc, argv, "--seeds", "");
+    std::string outPath = stringArgument(argc, argv, "--out", "orbits.csv");
+
+    bool valid = links >= 2 && links <= ORBIT_MAX_LINKS && !lengths.empty() && !masses.empty()
+        && ((int)lengths.size() == 1 || (int)lengths.size() == links) && ((int)masses.size() == 1 || (int)masses.size() == links)
+        && settings.dt > 0.0 && settings.segments > 0 && settings.tolerance > 0.0 && settings.minPeriod > 0.0
+        && settings.maxPeriod > settings.minPeriod && members > 0 && recurrence.sampleEvery > 0;
+    for (int i = 0; i < links && valid; ++i) {
+        settings.lengths.resize(links);
+        settings.masses.resize(links);
+        settings.lengths[i] = lengths[std::min(i, (int)lengths.size() - 1)];
+        settings.masses[i] = masses[std::min(i, (int)masses.size() - 1)];
+        valid = settings.lengths[i] > 0.0 && settings.masses[i] > 0.0;
+    }
+    if (!valid) {
+        std::cerr << "Invalid orbit settings" << std::endl;
+        return -1;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<OrbitSeed> seeds;
+    if (!seedPath.empty()) {
+        // one seed per line: period, then the angles and angular velocities
+        std::ifstream file(seedPath);
+        if (!file) {
+            std::cerr << "Failed to open " << seedPath << std::endl;
+            return -1;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            std::replace(line.begin(), line.end(), ',', ' ');
+            std::stringstream stream(line);
+            OrbitSeed seed;
+            double value;
+            if (line.empty() || line[0] == '#' || !(stream >> seed.period)) {
+                continue;
+            }
+            while (stream >> value) {
+                seed.state.push_back(value);
+            }
+            if ((int)seed.state.size() == 2 * links) {
+                seeds.push_back(seed);
+            }
+        }
+    }
+    else {
+        // released from rest at random angles
+        std::mt19937 random(randomSeed);
+        std::uniform_real_distribution<double> angle(-spread, spread);
+        std::vector<std::vector<double>> starts(members, std::vector<double>(2 * links, 0.0));
+        for (std::vector<double>& start : starts) {
+            for (int i = 0; i < links; ++i) {
+                start[i] = angle(random);
+            }
+        }
+        seeds = findRecurrenceSeeds(starts, settings, recurrence);
+    }
+    double seedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << seeds.size() << " seeds in " << seedSeconds << " s" << std::endl;
+
+    begin = std::chrono::steady_clock::now();
+    std::vector<PeriodicOrbit> orbits = findPeriodicOrbits(seeds, settings);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    int counts[ORBIT_NOT_CONVERGING + 1] = {};
+    std::vector<const PeriodicOrbit*> found;
+    for (const PeriodicOrbit& orbit : orbits) {
+        ++counts[orbit.status];
+        if (orbit.status == ORBIT_CONVERGED) {
+            found.push_back(&orbit);
+        }
+    }
+    // seeds that converged to the same orbit at a different phase, or to a
+    // repeated traversal of a shorter one
+    std::sort(found.begin(), found.end(), [](const PeriodicOrbit* a, const PeriodicOrbit* b) { return a->period < b->period; });
+    std::vector<const PeriodicOrbit*> distinct;
+    for (const PeriodicOrbit* orbit : found) {
+        bool repeat = false;
+        for (const PeriodicOrbit* other : distinct) {
+            double turns = std::round(orbit->period / other->period);
+            repeat = repeat || (std::fabs(orbit->period - turns * other->period) < 1e-6 * orbit->period
+                && std::fabs(orbit->energy - other->energy) < 1e-6 * (std::fabs(orbit->energy) + 1.0));
+        }
+        if (!repeat) {
+            distinct.push_back(orbit);
+        }
+    }
+
+    std::ofstream out(outPath);
+    if (!out) {
+        std::cerr << "Failed to write " << outPath << std::endl;
+        return -1;
+    }
+    out << "period,energy,residual,iterations";
+    for (int i = 0; i < links; ++i) out << ",theta" << i + 1;
+    for (int i = 0; i < links; ++i) out << ",omega" << i + 1;
+    for (int i = 0; i < 2 * links; ++i) out << ",multiplier" << i + 1 << "_re,multiplier" << i + 1 << "_im";
+    out << "\n" << std::setprecision(17);
+    for (const PeriodicOrbit* orbit : distinct) {
+        out << orbit->period << "," << orbit->energy << "," << orbit->residual << "," << orbit->iterations;
+        for (double value : orbit->state) out << "," << value;
+        for (const std::complex<double>& multiplier : orbit->multipliers) out << "," << multiplier.real() << "," << multiplier.imag();
+        out << "\n";
+    }
+
+    std::cout << seeds.size() << " seeds in " << seconds << " s: " << counts[ORBIT_CONVERGED] << " converged ("
+        << distinct.size() << " distinct), " << counts[ORBIT_NOT_CONVERGING] << " not converging, "
+        << counts[ORBIT_STALLED] << " stalled, " << counts[ORBIT_PERIOD_OUT_OF_RANGE] << " out of period range, "
+        << counts[ORBIT_DIVERGED] << " diverged" << std::endl;
+    for (const PeriodicOrbit* orbit : distinct) {
+        std::cout << "T " << orbit->period << "  E " << orbit->energy << "  |multiplier|max "
+            << (orbit->multipliers.empty() ? 0.0 : std::abs(orbit->multipliers[0])) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+// States are theta_1..theta_n followed by omega_1..omega_n for a chain of
+// n = lengths.size() links (2 or 3 for the double and triple pendulum, up
+// to 4).
+struct OrbitSettings {
+    std::vector<double> lengths{ 0.7, 0.7 };
+    std::vector<double> masses{ 1.0, 1.0 };
+    double g = 9.81;
+    double dt = 0.002;          // nominal RK4 step; each seed fixes its step count from it
+    int segments = 8;
+    int maxIterations = 30;
+    double tolerance = 1e-9;
+    double minPeriod = 0.5;
+    double maxPeriod = 20.0;
+    int threads = 0;
+};
+
+struct RecurrenceSettings {
+    double time = 200.0;
+    int sampleEvery = 5;        // steps between stored states
+    double threshold = 0.1;     // return distance in wrapped angles and omega * sqrt(L / g)
+    int seedsPerStart = 8;
+};
+
+struct OrbitSeed {
+    std::vector<double> state;
+    double period = 0.0;
+};
+
+enum OrbitStatus {
+    ORBIT_CONVERGED,
+    ORBIT_DIVERGED,             // the flow or the linear solve blew up
+    ORBIT_PERIOD_OUT_OF_RANGE,
+    ORBIT_STALLED,              // the damped step stopped reducing the residual
+    ORBIT_NOT_CONVERGING        // still far off after the trial iterations
+};
+
+struct PeriodicOrbit {
+    OrbitStatus status = ORBIT_DIVERGED;
+    std::vector<double> state;
+    double period = 0.0;
+    double energy = 0.0;
+    double residual = 0.0;
+    int iterations = 0;
+    std::vector<std::complex<double>> multipliers;  // largest modulus first
+};
+
+// Integrates each start and reports the states the trajectory comes back
+// close to after between minPeriod and maxPeriod, with the return time as
+// the period guess. Starts are spread over the threads.
+std::vector<OrbitSeed> findRecurrenceSeeds(const std::vector<std::vector<double>>& starts, const OrbitSettings& settings,
+    const RecurrenceSettings& recurrence);
+
+// Refines each seed by damped Newton on the multiple-shooting system: the
+// guess is cut into `segments` arcs and the unknowns are the arc start
+// states plus the period, with the energy held at the seed's and a phase
+// condition fixing the point along the orbit. Arc Jacobians come from
+// integrating the variational equations alongside the flow (dual numbers
+// through the RK4 steps), and the Floquet multipliers are the eigenvalues
+// of their product once converged. Seeds are spread over the threads;
+// with fewer seeds than threads the arcs of each seed run in parallel.
+// Seeds whose Newton iteration stalls or stays far off are dropped early.
+std::vector<PeriodicOrbit> findPeriodicOrbits(const std::vector<OrbitSeed>& seeds, const OrbitSettings& settings);
+
+int runOrbitsCommand(int argc, char** argv);
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Bump whenever the equations of motion change so cached results computed
+// with the old ones are not reused.
+const int EQUATIONS_VERSION = 2;
+
+extern float G;
+extern float PENDULUM_RADIUS;
+extern float INITIAL_LENGTH;
+extern float INITIAL_MASS;
+extern float dt;
+
+template<typename T>
+inline void doublePendulumAccel(T theta1, T theta2, T omega1, T omega2,
+    T L1, T L2, T M1, T M2, T g, T& a1, T& a2) {
+    using std::sin;
+    using std::cos;
+
+    T deltaTheta = theta2 - theta1;
+    T sinDelta = sin(deltaTheta);
+    T cosDelta = cos(deltaTheta);
+    T denom1 = (M1 + M2) * L1 - M2 * L1 * cosDelta * cosDelta;
+    T denom2 = (L2 / L1) * denom1;
+
+    a1 = (M2 * L1 * omega1 * omega1 * sinDelta * cosDelta
+        + M2 * g * sin(theta2) * cosDelta
+        + M2 * L2 * omega2 * omega2 * sinDelta
+        - (M1 + M2) * g * sin(theta1)) / denom1;
+
+    a2 = (-M2 * L2 * omega2 * omega2 * sinDelta * cosDelta
+        + (M1 + M2) * (g * sin(theta1) * cosDelta
+            - L1 * omega1 * omega1 * sinDelta
+            - g * sin(theta2))) / denom2;
+}
+
+// doublePendulumAccel for callers that already hold the sines and cosines
+// of both angles; the difference angle comes from the addition formulas.
+template<typename T>
+inline void doublePendulumAccelTrig(T sin1, T cos1, T sin2, T cos2, T omega1, T omega2,
+    T L1, T L2, T M1, T M2, T g, T& a1, T& a2) {
+    T sinDelta = sin2 * cos1 - cos2 * sin1;
+    T cosDelta = cos2 * cos1 + sin2 * sin1;
+    T denom1 = (M1 + M2) * L1 - M2 * L1 * cosDelta * cosDelta;
+    T denom2 = (L2 / L1) * denom1;
+
+    a1 = (M2 * L1 * omega1 * omega1 * sinDelta * cosDelta
+        + M2 * g * sin2 * cosDelta
+        + M2 * L2 * omega2 * omega2 * sinDelta
+        - (M1 + M2) * g * sin1) / denom1;
+
+    a2 = (-M2 * L2 * omega2 * omega2 * sinDelta * cosDelta
+        + (M1 + M2) * (g * sin1 * cosDelta
+            - L1 * omega1 * omega1 * sinDelta
+            - g * sin2)) / denom2;
+}
+
+// One symplectic Euler step, the integrator of the live view and the maps.
+// Templated like the accelerations so dual and taped scalars can be run
+// through whole rollouts.
+template<typename T>
+inline void doublePendulumStep(T& theta1, T& theta2, T& omega1, T& omega2,
+    T L1, T L2, T M1, T M2, T g, T h) {
+    T a1, a2;
+    doublePendulumAccel(theta1, theta2, omega1, omega2, L1, L2, M1, M2, g, a1, a2);
+    omega1 += a1 * h;
+    omega2 += a2 * h;
+    theta1 += omega1 * h;
+    theta2 += omega2 * h;
+}
+
+// Reverse-mode derivative of doublePendulumAccel: given the adjoints abar1
+// and abar2 of the accelerations, adds the adjoints of theta1, theta2,
+// omega1, omega2, L1, L2, M1, M2 and g to bar[0..8].
+inline void doublePendulumAccelAdjoint(double theta1, double theta2, double omega1, double omega2,
+    double L1, double L2, double M1, double M2, double g, double abar1, double abar2, double bar[9]) {
+    double deltaTheta = theta2 - theta1;
+    double sinDelta = std::sin(deltaTheta);
+    double cosDelta = std::cos(deltaTheta);
+    double sin1 = std::sin(theta1);
+    double sin2 = std::sin(theta2);
+    double total = M1 + M2;
+    double w1 = omega1 * omega1;
+    double w2 = omega2 * omega2;
+    double shape = total - M2 * cosDelta * cosDelta;
+    double denom1 = L1 * shape;
+    double denom2 = (L2 / L1) * denom1;
+    double rest = g * sin1 * cosDelta - L1 * w1 * sinDelta - g * sin2;
+    double a1 = (M2 * L1 * w1 * sinDelta * cosDelta + M2 * g * sin2 * cosDelta + M2 * L2 * w2 * sinDelta - total * g * sin1) / denom1;
+    double a2 = (-M2 * L2 * w2 * sinDelta * cosDelta + total * rest) / denom2;
+
+    double nbar1 = abar1 / denom1;
+    double nbar2 = abar2 / denom2;
+    double denom2bar = -abar2 * a2 / denom2;
+    double denom1bar = -abar1 * a1 / denom1 + denom2bar * L2 / L1;
+    double sinBar = 0.0, cosBar = 0.0, sin1Bar = 0.0, sin2Bar = 0.0, totalBar = 0.0;
+    bar[5] += denom2bar * denom1 / L1;
+    bar[4] += -denom2bar * denom2 / L1 + denom1bar * shape;
+    totalBar += denom1bar * L1;
+    bar[7] += -denom1bar * L1 * cosDelta * cosDelta;
+    cosBar += -denom1bar * L1 * M2 * 2.0 * cosDelta;
+
+    bar[7] += nbar1 * (L1 * w1 * sinDelta * cosDelta + g * sin2 * cosDelta + L2 * w2 * sinDelta);
+    bar[4] += nbar1 * M2 * w1 * sinDelta * cosDelta;
+    bar[5] += nbar1 * M2 * w2 * sinDelta;
+    bar[2] += nbar1 * M2 * L1 * 2.0 * omega1 * sinDelta * cosDelta;
+    bar[3] += nbar1 * M2 * L2 * 2.0 * omega2 * sinDelta;
+    bar[8] += nbar1 * (M2 * sin2 * cosDelta - total * sin1);
+    sinBar += nbar1 * (M2 * L1 * w1 * cosDelta + M2 * L2 * w2);
+    cosBar += nbar1 * (M2 * L1 * w1 * sinDelta + M2 * g * sin2);
+    sin1Bar += -nbar1 * total * g;
+    sin2Bar += nbar1 * M2 * g * cosDelta;
+    totalBar += -nbar1 * g * sin1;
+
+    double restBar = nbar2 * total;
+    bar[7] += -nbar2 * L2 * w2 * sinDelta * cosDelta;
+    bar[5] += -nbar2 * M2 * w2 * sinDelta * cosDelta;
+    bar[3] += -nbar2 * M2 * L2 * 2.0 * omega2 * sinDelta * cosDelta;
+    sinBar += -nbar2 * M2 * L2 * w2 * cosDelta;
+    cosBar += -nbar2 * M2 * L2 * w2 * sinDelta;
+    totalBar += nbar2 * rest;
+    bar[8] += restBar * (sin1 * cosDelta - sin2);
+    bar[4] += -restBar * w1 * sinDelta;
+    bar[2] += -restBar * L1 * 2.0 * omega1 * sinDelta;
+    sinBar += -restBar * L1 * w1;
+    cosBar += restBar * g * sin1;
+    sin1Bar += restBar * g * cosDelta;
+    sin2Bar += -restBar * g;
+
+    double deltaBar = sinBar * cosDelta - cosBar * sinDelta;
+    bar[0] += -deltaBar + sin1Bar * std::cos(theta1);
+    bar[1] += deltaBar + sin2Bar * std::cos(theta2);
+    bar[6] += totalBar;
+    bar[7] += totalBar;
+}
+
+// Reverse-mode derivative of doublePendulumStep: lambda holds the adjoint
+// of the state after the step on entry and before it on return, and the
+// adjoints of L1, L2, M1, M2 and g are added to parameterBar.
+inline void doublePendulumStepAdjoint(double theta1, double theta2, double omega1, double omega2,
+    double L1, double L2, double M1, double M2, double g, double h, double lambda[4], double parameterBar[5]) {
+    double omega1Bar = lambda[2] + lambda[0] * h;
+    double omega2Bar = lambda[3] + lambda[1] * h;
+    double bar[9] = { lambda[0], lambda[1], omega1Bar, omega2Bar, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    doublePendulumAccelAdjoint(theta1, theta2, omega1, omega2, L1, L2, M1, M2, g, omega1Bar * h, omega2Bar * h, bar);
+    for (int i = 0; i < 4; ++i) {
+        lambda[i] = bar[i];
+    }
+    for (int i = 0; i < 5; ++i) {
+        parameterBar[i] += bar[4 + i];
+    }
+}
+
+template<typename T>
+inline T doublePendulumEnergy(T theta1, T theta2, T omega1, T omega2,
+    T L1, T L2, T M1, T M2, T g) {
+    using std::cos;
+
+    T kinetic = T(0.5) * (M1 + M2) * L1 * L1 * omega1 * omega1
+        + T(0.5) * M2 * L2 * L2 * omega2 * omega2
+        + M2 * L1 * L2 * omega1 * omega2 * cos(theta1 - theta2);
+    T potential = -(M1 + M2) * g * L1 * cos(theta1) - M2 * g * L2 * cos(theta2);
+    return kinetic + potential;
+}
+
+// Lowest energy at which either arm can pass through the upright position:
+// the cheaper of (theta1 = pi, theta2 = 0) and (theta1 = 0, theta2 = pi).
+// Below it a flip is impossible no matter how long we integrate.
+template<typename T>
+inline T doublePendulumFlipBarrier(T L1, T L2, T M1, T M2, T g) {
+    T first = (M1 + M2) * g * L1 - M2 * g * L2;
+    T second = -(M1 + M2) * g * L1 + M2 * g * L2;
+    return first < second ? first : second;
+}
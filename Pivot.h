@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Stepper.h"
+
+#include <string>
+#include <vector>
+
+// Prescribed motion of a pivot about its rest position, either a sinusoid
+// along each axis at one frequency or keyframes of a script. Scripts are
+// lines of "t x y", interpolated by Catmull-Rom cubics and held still
+// before the first and after the last keyframe.
+class PivotMotion {
+public:
+    // x = amplitudeX sin(2 pi f t), y = amplitudeY cos(2 pi f t)
+    static PivotMotion sine(double amplitudeX, double amplitudeY, double frequency);
+    static bool load(const std::string& path, PivotMotion& motion);
+
+    bool moving() const { return frequency > 0.0 || times.size() > 1; }
+    void position(double t, double& x, double& y) const;
+    void acceleration(double t, double& x, double& y) const;
+    // The shortest time the motion changes over: the period of a sinusoid
+    // or the closest keyframes of a script.
+    double timescale() const;
+
+private:
+    void segment(double t, int& k, double& u, double& span) const;
+
+    double amplitudeX = 0.0, amplitudeY = 0.0, frequency = 0.0;
+    std::vector<double> times, xs, ys;
+};
+
+// --pivot-x, --pivot-y and --pivot-frequency (Hz), or --pivot-script FILE.
+bool parsePivotArguments(int argc, char** argv, PivotMotion& motion, float amplitudeY = 0.0f, float frequency = 0.0f);
+
+// Angular accelerations of a chain whose pivot moves by `pivot`, at time t.
+void drivenChainAccel(const ChainParameters& chain, const PivotMotion& pivot, double t, const double* theta,
+    const double* omega, double* accel);
+
+// Multirate step of a chain on a moving pivot, split into the pull of the
+// pivot's acceleration (fast) and gravity and the rods (slow):
+//   omega += h/2 slow;  `substeps` Runge-Kutta-Nystrom steps of the fast part;  omega += h/2 slow
+// The fast part needs only the mass matrix, rebuilt from one sine and
+// cosine per link, so a substep costs a fraction of chainAccel's n^2 sines
+// and cosines, and three of them buy fourth order in the substep. Each
+// half kick evaluates the slow part once, at the velocity the previous
+// kick's acceleration `slow` predicts for the kick's middle, which keeps
+// the step second order in h; fill `slow` with chainAccel of the starting
+// state (fixed pivot) before the first step. The slow part keeps the
+// rods' omega^2 terms, which carry the wiggle the forcing drives into the
+// relative angles, so a chain of several links forced hard needs h close
+// to the substep. `time` advances by h.
+void multirateChainStep(const ChainParameters& chain, const PivotMotion& pivot, double& time, double h, int substeps,
+    double* theta, double* omega, double* slow);
+
+int runDrivenCommand(int argc, char** argv);
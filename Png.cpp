@@ -0,0 +1,254 @@
+#include "Png.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+const int DEFLATE_WINDOW = 32768;
+const int DEFLATE_HASH_BITS = 15;
+const int DEFLATE_MAX_CHAIN = 32;
+const int DEFLATE_MIN_MATCH = 3;
+const int DEFLATE_MAX_MATCH = 258;
+
+const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const int DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const int DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+struct BitWriter {
+    std::vector<unsigned char>& out;
+    uint32_t bits = 0;
+    int count = 0;
+
+    explicit BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+    void put(uint32_t value, int n) {
+        bits |= value << count;
+        count += n;
+        while (count >= 8) {
+            out.push_back((unsigned char)(bits & 0xff));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    // Huffman codes are defined most significant bit first.
+    void putCode(uint32_t code, int n) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < n; ++i) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        put(reversed, n);
+    }
+
+    void flush() {
+        if (count > 0) {
+            out.push_back((unsigned char)(bits & 0xff));
+        }
+        bits = 0;
+        count = 0;
+    }
+};
+
+static void putLiteral(BitWriter& writer, int value) {
+    if (value < 144) writer.putCode(0x30 + value, 8);
+    else if (value < 256) writer.putCode(0x190 + value - 144, 9);
+    else if (value < 280) writer.putCode(value - 256, 7);
+    else writer.putCode(0xc0 + value - 280, 8);
+}
+
+static void putMatch(BitWriter& writer, int length, int distance) {
+    int l = 28;
+    while (LENGTH_BASE[l] > length) --l;
+    putLiteral(writer, 257 + l);
+    writer.put(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+
+    int d = 29;
+    while (DISTANCE_BASE[d] > distance) --d;
+    writer.putCode(d, 5);
+    writer.put(distance - DISTANCE_BASE[d], DISTANCE_EXTRA[d]);
+}
+
+static uint32_t adler32(const unsigned char* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < size; ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+static std::vector<unsigned char> zlibCompress(const unsigned char* data, size_t size) {
+    std::vector<unsigned char> out;
+    out.push_back(0x78);
+    out.push_back(0x01);
+
+    BitWriter writer(out);
+    writer.put(1, 1);
+    writer.put(1, 2);
+
+    std::vector<int> head(1 << DEFLATE_HASH_BITS, -1);
+    std::vector<int> prev(DEFLATE_WINDOW, -1);
+    auto hashAt = [&](size_t i) {
+        return (int)(((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << DEFLATE_HASH_BITS) - 1));
+    };
+    auto insert = [&](size_t i) {
+        if (i + DEFLATE_MIN_MATCH <= size) {
+            int h = hashAt(i);
+            prev[i % DEFLATE_WINDOW] = head[h];
+            head[h] = (int)i;
+        }
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        int bestLength = 0, bestDistance = 0;
+        if (i + DEFLATE_MIN_MATCH <= size) {
+            int limit = (int)std::min<size_t>(DEFLATE_MAX_MATCH, size - i);
+            int candidate = head[hashAt(i)];
+            for (int chain = 0; candidate >= 0 && chain < DEFLATE_MAX_CHAIN; ++chain) {
+                int distance = (int)i - candidate;
+                if (distance > DEFLATE_WINDOW - 1) {
+                    break;
+                }
+                int length = 0;
+                while (length < limit && data[candidate + length] == data[i + length]) {
+                    ++length;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = distance;
+                    if (length == limit) {
+                        break;
+                    }
+                }
+                int next = prev[candidate % DEFLATE_WINDOW];
+                if (next >= candidate) {
+                    break;
+                }
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= DEFLATE_MIN_MATCH) {
+            putMatch(writer, bestLength, bestDistance);
+            for (int k = 0; k < bestLength; ++k) {
+                insert(i + k);
+            }
+            i += bestLength;
+        }
+        else {
+            putLiteral(writer, data[i]);
+            insert(i);
+            ++i;
+        }
+    }
+    putLiteral(writer, 256);
+    writer.flush();
+
+    uint32_t checksum = adler32(data, size);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((unsigned char)(checksum >> shift));
+    }
+    return out;
+}
+
+static std::vector<uint32_t> makeCrcTable() {
+    std::vector<uint32_t> table(256);
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        table[n] = c;
+    }
+    return table;
+}
+
+static uint32_t crc32(const unsigned char* data, size_t size) {
+    static const std::vector<uint32_t> table = makeCrcTable();
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void putUint32(std::vector<unsigned char>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((unsigned char)(value >> shift));
+    }
+}
+
+static void putChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data) {
+    putUint32(out, (uint32_t)data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putUint32(out, crc32(&out[start], out.size() - start));
+}
+
+static int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+std::vector<unsigned char> encodePng(const unsigned char* rgb, int width, int height) {
+    const size_t stride = (size_t)width * 3;
+    std::vector<unsigned char> filtered;
+    filtered.reserve((stride + 1) * height);
+
+    // Per row, keep whichever filter gives the smallest sum of absolute
+    // residuals, the usual heuristic for compressible output.
+    std::vector<unsigned char> candidate(stride), best(stride);
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* row = rgb + y * stride;
+        const unsigned char* above = y > 0 ? row - stride : nullptr;
+        long bestScore = -1;
+        int bestFilter = 0;
+        for (int filter = 0; filter < 5; ++filter) {
+            long score = 0;
+            for (size_t i = 0; i < stride; ++i) {
+                int a = i >= 3 ? row[i - 3] : 0;
+                int b = above ? above[i] : 0;
+                int c = (above && i >= 3) ? above[i - 3] : 0;
+                int predicted = filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : filter == 4 ? paeth(a, b, c) : 0;
+                candidate[i] = (unsigned char)(row[i] - predicted);
+                score += std::abs((int)(signed char)candidate[i]);
+            }
+            if (bestScore < 0 || score < bestScore) {
+                bestScore = score;
+                bestFilter = filter;
+                best.swap(candidate);
+            }
+        }
+        filtered.push_back((unsigned char)bestFilter);
+        filtered.insert(filtered.end(), best.begin(), best.end());
+    }
+
+    std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    std::vector<unsigned char> header;
+    putUint32(header, (uint32_t)width);
+    putUint32(header, (uint32_t)height);
+    header.push_back(8);
+    header.push_back(2);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    putChunk(png, "IHDR", header);
+    putChunk(png, "IDAT", zlibCompress(filtered.data(), filtered.size()));
+    putChunk(png, "IEND", std::vector<unsigned char>());
+    return png;
+}
+
+bool writePng(const std::string& path, const unsigned char* rgb, int width, int height) {
+    std::vector<unsigned char> png = encodePng(rgb, width, height);
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)png.data(), png.size());
+    return (bool)file;
+}
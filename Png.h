@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Self-contained 8-bit RGB PNG encoder: adaptive row filters and a single
+// fixed-Huffman deflate block with LZ77 matching.
+std::vector<unsigned char> encodePng(const unsigned char* rgb, int width, int height);
+bool writePng(const std::string& path, const unsigned char* rgb, int width, int height);
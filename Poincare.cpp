@@ -0,0 +1,386 @@
+#include "Poincare.h"
+#include "CommandLine.h"
+#include "LaneScheduler.h"
+#include "Physics.h"
+#include "Png.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+const int POINCARE_LANES = 8;
+const long long POINCARE_CHUNK = 64;
+const size_t POINCARE_BLOCK = 1 << 16;
+const char POINCARE_MAGIC[8] = { 'P', 'N', 'D', 'P', 'O', 'I', 'N', 'C' };
+const uint32_t POINCARE_FORMAT = 1;
+
+// Lanes past the active range and lanes whose member has been moved away
+// keep being stepped with the rest but never report crossings.
+const long long POINCARE_DEAD = 1LL << 62;
+
+struct PoincareHeader {
+    char magic[8];
+    uint32_t format;
+    int32_t coordinate;
+    int32_t direction;
+    uint32_t reserved;
+    double value;
+    uint64_t count;
+};
+
+static double wrapAngle(double angle) {
+    return angle - 2.0 * M_PI * std::floor((angle + M_PI) / (2.0 * M_PI));
+}
+
+static double hermite(double y0, double d0, double y1, double d1, double s) {
+    double s2 = s * s, s3 = s2 * s;
+    return (2.0 * s3 - 3.0 * s2 + 1.0) * y0 + (s3 - 2.0 * s2 + s) * d0 + (3.0 * s2 - 2.0 * s3) * y1 + (s3 - s2) * d1;
+}
+
+static double hermiteSlope(double y0, double d0, double y1, double d1, double s) {
+    double s2 = s * s;
+    return (6.0 * s2 - 6.0 * s) * y0 + (3.0 * s2 - 4.0 * s + 1.0) * d0 + (6.0 * s - 6.0 * s2) * y1 + (3.0 * s2 - 2.0 * s) * d1;
+}
+
+// Root of the interpolant in [0, 1] given y0 and y1 of opposite sign:
+// Newton steps, falling back to bisection whenever one leaves the bracket.
+static double hermiteRoot(double y0, double d0, double y1, double d1) {
+    double low = 0.0, high = 1.0;
+    double s = y0 / (y0 - y1);
+    for (int i = 0; i < 32; ++i) {
+        double y = hermite(y0, d0, y1, d1, s);
+        if ((y < 0.0) == (y0 < 0.0)) {
+            low = s;
+        }
+        else {
+            high = s;
+        }
+        double slope = hermiteSlope(y0, d0, y1, d1, s);
+        double next = slope != 0.0 ? s - y / slope : 0.5 * (low + high);
+        if (!(next > low && next < high)) {
+            next = 0.5 * (low + high);
+        }
+        if (std::fabs(next - s) < 1e-13) {
+            return next;
+        }
+        s = next;
+    }
+    return s;
+}
+
+struct PoincareKernel {
+    static const int WIDTH = POINCARE_LANES;
+    static const int CAPACITY = 8 * POINCARE_LANES;
+
+    const std::vector<std::array<double, 4>>& starts;
+    const PoincareSettings& s;
+    const std::function<void(std::vector<PoincarePoint>&)>& flush;
+    double h;
+    long long maxSteps;
+    std::vector<PoincarePoint> buffer;
+    long long points = 0;
+
+    // current and previous state, with the acceleration at each
+    double x[6][CAPACITY];
+    double p[6][CAPACITY];
+    long long steps[CAPACITY];
+    long long member[CAPACITY];
+
+    PoincareKernel(const std::vector<std::array<double, 4>>& starts, const PoincareSettings& settings,
+        const std::function<void(std::vector<PoincarePoint>&)>& flush)
+        : starts(starts), s(settings), flush(flush), h(settings.dt), maxSteps((long long)(settings.time / settings.dt)) {
+        for (int l = 0; l < CAPACITY; ++l) {
+            for (int i = 0; i < 6; ++i) {
+                x[i][l] = p[i][l] = 0.0;
+            }
+            steps[l] = POINCARE_DEAD;
+            member[l] = -1;
+        }
+        buffer.reserve(POINCARE_BLOCK);
+    }
+
+    ~PoincareKernel() {
+        if (!buffer.empty()) {
+            flush(buffer);
+        }
+    }
+
+    void load(int lane, long long id) {
+        for (int i = 0; i < 4; ++i) {
+            x[i][lane] = starts[id][i];
+        }
+        doublePendulumAccel(x[0][lane], x[1][lane], x[2][lane], x[3][lane], s.L1, s.L2, s.M1, s.M2, s.g, x[4][lane], x[5][lane]);
+        steps[lane] = 0;
+        member[lane] = id;
+    }
+
+    void move(int from, int to) {
+        for (int i = 0; i < 6; ++i) {
+            x[i][to] = x[i][from];
+        }
+        steps[to] = steps[from];
+        member[to] = member[from];
+        steps[from] = POINCARE_DEAD;
+    }
+
+    void step(int lanes) {
+        double* t1 = x[0];
+        double* t2 = x[1];
+        double* w1 = x[2];
+        double* w2 = x[3];
+        double* a1 = x[4];
+        double* a2 = x[5];
+        for (int i = 0; i < 6; ++i) {
+            std::copy(x[i], x[i] + lanes, p[i]);
+        }
+        // the acceleration at the new state is both the next kick and the
+        // end slope of the interpolant, so each step costs one evaluation
+        for (int l = 0; l < lanes; ++l) {
+            w1[l] += a1[l] * h;
+            w2[l] += a2[l] * h;
+            t1[l] += w1[l] * h;
+            t2[l] += w2[l] * h;
+            doublePendulumAccel(t1[l], t2[l], w1[l], w2[l], s.L1, s.L2, s.M1, s.M2, s.g, a1[l], a2[l]);
+            ++steps[l];
+        }
+
+        const int c = s.section.coordinate;
+        const bool angle = c == POINCARE_THETA1 || c == POINCARE_THETA2;
+        for (int l = 0; l < lanes; ++l) {
+            if (steps[l] > maxSteps) {
+                continue;
+            }
+            double f0 = angle ? wrapAngle(p[c][l] - s.section.value) : p[c][l] - s.section.value;
+            double f1 = f0 + (x[c][l] - p[c][l]);
+            bool up = f0 < 0.0 && f1 >= 0.0;
+            bool down = f0 >= 0.0 && f1 < 0.0;
+            if ((up && s.section.direction >= 0) || (down && s.section.direction <= 0)) {
+                crossing(l, f0, f1);
+            }
+        }
+    }
+
+    void crossing(int lane, double f0, double f1) {
+        // coordinate i has slope coordinate i + 2 (theta -> omega -> accel)
+        const int c = s.section.coordinate;
+        double root = hermiteRoot(f0, h * p[c + 2][lane], f1, h * x[c + 2][lane]);
+
+        PoincarePoint point;
+        point.trajectory = (uint32_t)member[lane];
+        point.time = (float)((steps[lane] - 1 + root) * h);
+        int k = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (i == c) {
+                continue;
+            }
+            double value = hermite(p[i][lane], h * p[i + 2][lane], x[i][lane], h * x[i + 2][lane], root);
+            point.coordinates[k++] = (float)(i < 2 ? wrapAngle(value) : value);
+        }
+        buffer.push_back(point);
+        ++points;
+        if (buffer.size() >= POINCARE_BLOCK) {
+            flush(buffer);
+        }
+    }
+
+    bool finished(int lane) const {
+        return steps[lane] >= maxSteps || !std::isfinite(x[0][lane]) || !std::isfinite(x[1][lane]);
+    }
+
+    void retire(int lane) {
+        steps[lane] = POINCARE_DEAD;
+    }
+};
+
+PoincareStats computePoincareSection(const std::vector<std::array<double, 4>>& starts, const PoincareSettings& settings,
+    const PoincareSink& sink) {
+    auto start = std::chrono::steady_clock::now();
+    PoincareStats stats;
+    if (starts.empty() || settings.dt <= 0.0 || settings.time <= 0.0) {
+        return stats;
+    }
+
+    std::mutex sinkMutex;
+    std::function<void(std::vector<PoincarePoint>&)> flush = [&](std::vector<PoincarePoint>& buffer) {
+        {
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            sink(buffer.data(), buffer.size());
+        }
+        buffer.clear();
+    };
+
+    const long long total = (long long)starts.size();
+    std::atomic<long long> next{ 0 };
+    std::atomic<long long> points{ 0 };
+    std::atomic<long long> steps{ 0 };
+    auto worker = [&]() {
+        long long cursor = 0, chunkEnd = 0;
+        auto nextStart = [&](long long& id) {
+            if (cursor >= chunkEnd) {
+                cursor = next.fetch_add(POINCARE_CHUNK);
+                chunkEnd = std::min(cursor + POINCARE_CHUNK, total);
+                if (cursor >= total) {
+                    return false;
+                }
+            }
+            id = cursor++;
+            return true;
+        };
+        std::unique_ptr<PoincareKernel> kernel(new PoincareKernel(starts, settings, flush));
+        steps += runLaneScheduler(*kernel, nextStart, settings.compactEvery).laneSteps;
+        points += kernel->points;
+    };
+
+    int threadCount = settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency();
+    threadCount = (int)std::max(std::min<long long>(threadCount, (total + POINCARE_CHUNK - 1) / POINCARE_CHUNK), 1LL);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    stats.points = points;
+    stats.steps = steps;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// Starts on theta1 = 0 with omega1 > 0 at the given energy above the
+// hanging rest state, spread over (theta2, omega2) by an R2 sequence.
+static std::vector<std::array<double, 4>> energySurfaceStarts(const PoincareSettings& s, double energy, int count) {
+    std::vector<std::array<double, 4>> starts;
+    double omegaMax = std::sqrt(2.0 * energy / (s.M2 * s.L2 * s.L2 * (1.0 - s.M2 / (s.M1 + s.M2))));
+    const double a1 = 0.7548776662466927, a2 = 0.5698402909980532;
+    for (long long i = 0; (int)starts.size() < count && i < 1000LL * count; ++i) {
+        double theta2 = -M_PI + 2.0 * M_PI * std::fmod(0.5 + a1 * i, 1.0);
+        double omega2 = omegaMax * (2.0 * std::fmod(0.5 + a2 * i, 1.0) - 1.0);
+        double kinetic = energy - s.M2 * s.g * s.L2 * (1.0 - std::cos(theta2));
+
+        // kinetic energy as a quadratic in omega1
+        double A = 0.5 * (s.M1 + s.M2) * s.L1 * s.L1;
+        double B = s.M2 * s.L1 * s.L2 * omega2 * std::cos(theta2);
+        double C = 0.5 * s.M2 * s.L2 * s.L2 * omega2 * omega2 - kinetic;
+        double discriminant = B * B - 4.0 * A * C;
+        if (kinetic < 0.0 || discriminant < 0.0) {
+            continue;
+        }
+        double omega1 = (-B + std::sqrt(discriminant)) / (2.0 * A);
+        if (omega1 > 0.0) {
+            starts.push_back({ 0.0, theta2, omega1, omega2 });
+        }
+    }
+    return starts;
+}
+
+int runPoincareCommand(int argc, char** argv) {
+    PoincareSettings settings;
+    settings.L1 = floatArgument(argc, argv, "--l1", INITIAL_LENGTH);
+    settings.L2 = floatArgument(argc, argv, "--l2", INITIAL_LENGTH);
+    settings.M1 = floatArgument(argc, argv, "--m1", INITIAL_MASS);
+    settings.M2 = floatArgument(argc, argv, "--m2", INITIAL_MASS);
+    settings.g = floatArgument(argc, argv, "--g", G);
+    settings.dt = floatArgument(argc, argv, "--dt", (float)settings.dt);
+    settings.time = floatArgument(argc, argv, "--time", (float)settings.time);
+    settings.threads = intArgument(argc, argv, "--threads", 0);
+    settings.compactEvery = intArgument(argc, argv, "--compact-every", settings.compactEvery);
+
+    const char* names[4] = { "theta1", "theta2", "omega1", "omega2" };
+    std::string coordinate = stringArgument(argc, argv, "--section", "theta1");
+    int index = (int)(std::find(names, names + 4, coordinate) - names);
+    std::string direction = stringArgument(argc, argv, "--direction", "up");
+    settings.section.value = floatArgument(argc, argv, "--value", 0.0f);
+    settings.section.direction = direction == "down" ? -1 : direction == "both" ? 0 : 1;
+
+    double energy = floatArgument(argc, argv, "--energy", 10.0f);
+    int members = intArgument(argc, argv, "--members", 1000);
+    std::string outPath = stringArgument(argc, argv, "--out", "section.pcl");
+    std::string imagePath = stringArgument(argc, argv, "--image", "");
+    int imageSize = intArgument(argc, argv, "--image-size", 1024);
+
+    if (index == 4 || members <= 0 || energy <= 0.0 || settings.dt <= 0.0 || settings.time <= 0.0 || imageSize <= 0) {
+        std::cerr << "Invalid Poincare settings" << std::endl;
+        return -1;
+    }
+    settings.section.coordinate = (PoincareCoordinate)index;
+
+    std::vector<std::array<double, 4>> starts = energySurfaceStarts(settings, energy, members);
+    if (starts.empty()) {
+        std::cerr << "No starts at energy " << energy << std::endl;
+        return -1;
+    }
+
+    FILE* file = std::fopen(outPath.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open " << outPath << std::endl;
+        return -1;
+    }
+    PoincareHeader header;
+    std::memcpy(header.magic, POINCARE_MAGIC, sizeof(header.magic));
+    header.format = POINCARE_FORMAT;
+    header.coordinate = index;
+    header.direction = settings.section.direction;
+    header.reserved = 0;
+    header.value = settings.section.value;
+    header.count = 0;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+    // the image plots the other arm's angle against its angular velocity
+    const int plotted[4][2] = { { 0, 2 }, { 0, 1 }, { 1, 2 }, { 0, 2 } };
+    std::vector<float> plot;
+    PoincareStats stats = computePoincareSection(starts, settings, [&](const PoincarePoint* points, size_t count) {
+        ok = ok && std::fwrite(points, sizeof(PoincarePoint), count, file) == count;
+        header.count += count;
+        if (!imagePath.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                plot.push_back(points[i].coordinates[plotted[index][0]]);
+                plot.push_back(points[i].coordinates[plotted[index][1]]);
+            }
+        }
+    });
+    ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Failed to write " << outPath << std::endl;
+        return -1;
+    }
+
+    std::cout << starts.size() << " trajectories, " << stats.points << " section points in " << stats.seconds << " s ("
+        << stats.steps << " lane steps), written to " << outPath << std::endl;
+
+    if (!imagePath.empty()) {
+        const float xRange = (float)M_PI;
+        float yRange = 1e-6f;
+        for (size_t i = 1; i < plot.size(); i += 2) {
+            yRange = std::max(yRange, std::fabs(plot[i]));
+        }
+        std::vector<unsigned int> density((size_t)imageSize * imageSize, 0);
+        unsigned int peak = 1;
+        for (size_t i = 0; i + 1 < plot.size(); i += 2) {
+            int px = (int)((plot[i] / xRange * 0.5f + 0.5f) * (imageSize - 1) + 0.5f);
+            int py = (int)((0.5f - plot[i + 1] / yRange * 0.5f) * (imageSize - 1) + 0.5f);
+            if (px >= 0 && px < imageSize && py >= 0 && py < imageSize) {
+                peak = std::max(peak, ++density[(size_t)py * imageSize + px]);
+            }
+        }
+        std::vector<unsigned char> rgb(density.size() * 3);
+        for (size_t i = 0; i < density.size(); ++i) {
+            float v = density[i] > 0 ? 0.25f + 0.75f * std::log1p((float)density[i]) / std::log1p((float)peak) : 0.0f;
+            rgb[i * 3] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = (unsigned char)(255.0f * v);
+        }
+        if (!writePng(imagePath, rgb.data(), imageSize, imageSize)) {
+            std::cerr << "Failed to write " << imagePath << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
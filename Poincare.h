@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+enum PoincareCoordinate {
+    POINCARE_THETA1,
+    POINCARE_THETA2,
+    POINCARE_OMEGA1,
+    POINCARE_OMEGA2
+};
+
+// The surface coordinate == value, crossed upward (+1), downward (-1) or
+// either way (0). Angle sections are taken modulo 2 pi.
+struct PoincareSection {
+    PoincareCoordinate coordinate = POINCARE_THETA1;
+    double value = 0.0;
+    int direction = 1;
+};
+
+struct PoincareSettings {
+    double L1 = 0.7;
+    double L2 = 0.7;
+    double M1 = 1.0;
+    double M2 = 1.0;
+    double g = 9.81;
+    double dt = 0.001;
+    double time = 100.0;
+    PoincareSection section;
+    int threads = 0;
+    int compactEvery = 16;
+};
+
+// One crossing: the other three coordinates in theta1, theta2, omega1,
+// omega2 order with the section coordinate left out, angles wrapped to
+// [-pi, pi).
+struct PoincarePoint {
+    uint32_t trajectory;
+    float time;
+    float coordinates[3];
+};
+
+struct PoincareStats {
+    long long points = 0;
+    long long steps = 0;
+    double seconds = 0.0;
+};
+
+// Called with blocks of points, never from two threads at once.
+typedef std::function<void(const PoincarePoint* points, size_t count)> PoincareSink;
+
+// Integrates every start (theta1, theta2, omega1, omega2) in lane batches.
+// A crossing is detected from the sign of the section function at
+// consecutive steps. It is then located inside the step by root-finding on
+// the cubic Hermite interpolant of the step's end states and derivatives,
+// which also gives the other coordinates at the crossing. Each thread
+// fills its own buffer and hands it to `sink` when full.
+PoincareStats computePoincareSection(const std::vector<std::array<double, 4>>& starts, const PoincareSettings& settings,
+    const PoincareSink& sink);
+
+// Writes the points as a point-cloud file: a 40 byte header ("PNDPOINC",
+// format, coordinate, direction, value, point count) followed by packed
+// 20 byte PoincarePoint records, all little-endian.
+int runPoincareCommand(int argc, char** argv);
@@ -0,0 +1,99 @@
+#include "Projection.h"
+#include "Chain.h"
+
+#include <algorithm>
+#include <cmath>
+
+const int PROJECTION_ITERATIONS = 8;
+
+EnergyProjectionStepper::EnergyProjectionStepper(std::unique_ptr<ChainStepper> inner, int every)
+    : ChainStepper(inner->parameters()), inner(std::move(inner)), every(std::max(every, 1)) {
+}
+
+void EnergyProjectionStepper::advance(double* state, double h) {
+    if (!targetSet) {
+        setTarget(energy(state));
+    }
+    inner->advance(state, h);
+    if (++stepCount % every == 0) {
+        project(state);
+    }
+}
+
+void EnergyProjectionStepper::project(double* state) {
+    const int n = chain.links();
+    const double* L = chain.lengths.data();
+    const double* M = chain.masses.data();
+    double ex[CHAIN_MAX_LINKS], ey[CHAIN_MAX_LINKS];
+    double vx[CHAIN_MAX_LINKS], vy[CHAIN_MAX_LINKS];
+    double ux[CHAIN_MAX_LINKS], uy[CHAIN_MAX_LINKS];
+    double gradient[CHAIN_MAX_LINKS];
+
+    // mass velocities v_k = sum_{j <= k} L_j omega_j e_j, and the potential
+    double potential = 0.0, height = 0.0, x = 0.0, y = 0.0;
+    for (int k = 0; k < n; ++k) {
+        ex[k] = L[k] * std::cos(state[k]);
+        ey[k] = L[k] * std::sin(state[k]);
+        x += ex[k] * state[n + k];
+        y += ey[k] * state[n + k];
+        vx[k] = x;
+        vy[k] = y;
+        height -= ex[k];
+        potential += M[k] * chain.g * height;
+    }
+    double kinetic = target - potential;
+    if (kinetic < 0.0) {
+        ++skippedCount;
+        return;
+    }
+
+    // dT/domega_j = L_j e_j . sum_{k >= j} m_k v_k
+    double px = 0.0, py = 0.0;
+    for (int j = n - 1; j >= 0; --j) {
+        px += M[j] * vx[j];
+        py += M[j] * vy[j];
+        gradient[j] = ex[j] * px + ey[j] * py;
+    }
+    // how the mass velocities move along the gradient
+    x = y = 0.0;
+    for (int k = 0; k < n; ++k) {
+        x += ex[k] * gradient[k];
+        y += ey[k] * gradient[k];
+        ux[k] = x;
+        uy[k] = y;
+    }
+
+    // T(s) = 1/2 sum m_k |v_k + s u_k|^2 = kinetic
+    double s = 0.0;
+    double tolerance = 1e-14 * std::max(std::max(std::fabs(target), std::fabs(potential)), kinetic);
+    bool converged = false;
+    for (int iteration = 0; iteration < PROJECTION_ITERATIONS && !converged; ++iteration) {
+        double value = -kinetic, slope = 0.0;
+        for (int k = 0; k < n; ++k) {
+            double wx = vx[k] + s * ux[k], wy = vy[k] + s * uy[k];
+            value += 0.5 * M[k] * (wx * wx + wy * wy);
+            slope += M[k] * (wx * ux[k] + wy * uy[k]);
+        }
+        converged = std::fabs(value) <= tolerance;
+        if (!converged) {
+            if (slope == 0.0) {
+                break;
+            }
+            s -= value / slope;
+        }
+    }
+    // the line misses the energy surface (or omega is zero)
+    if (!converged) {
+        ++skippedCount;
+        return;
+    }
+
+    last = 0.0;
+    for (int j = 0; j < n; ++j) {
+        state[n + j] += s * gradient[j];
+        last = std::max(last, std::fabs(s * gradient[j]));
+    }
+    largest = std::max(largest, last);
+    total += last;
+    ++projectionCount;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Stepper.h"
+
+#include <memory>
+#include <string>
+
+// Wraps any integrator and, every `every` steps, moves omega back onto the
+// energy surface of the first state it was given. The correction is along
+// the kinetic energy's omega gradient (the generalized momentum), with the
+// step length from a scalar Newton solve; the angles are left alone. Both
+// are O(n) through the Cartesian velocities of the masses.
+class EnergyProjectionStepper : public ChainStepper {
+public:
+    EnergyProjectionStepper(std::unique_ptr<ChainStepper> inner, int every = 1);
+
+    void advance(double* state, double h) override;
+    std::string name() const override { return inner->name() + "+project"; }
+
+    // Projects onto this energy from now on instead of the starting one.
+    void setTarget(double energy) { target = energy; targetSet = true; }
+
+    long long projections() const { return projectionCount; }
+    long long skipped() const { return skippedCount; }      // the angles alone exceeded the energy
+    double lastCorrection() const { return last; }          // largest |delta omega| of the last projection
+    double largestCorrection() const { return largest; }
+    double meanCorrection() const { return projectionCount > 0 ? total / projectionCount : 0.0; }
+
+private:
+    void project(double* state);
+
+    std::unique_ptr<ChainStepper> inner;
+    int every;
+    long long stepCount = 0;
+    double target = 0.0;
+    bool targetSet = false;
+
+    long long projectionCount = 0;
+    long long skippedCount = 0;
+    double last = 0.0;
+    double largest = 0.0;
+    double total = 0.0;
+};
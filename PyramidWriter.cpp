@@ -0,0 +1,239 @@
+#include "PyramidWriter.h"
+#include "Png.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+PyramidWriter::PyramidWriter(const std::string& path, int width, int height, int tileSize, Colorizer colorizer,
+    int ioThreads, int maxQueuedTiles)
+    : path(path), width(width), height(height), tileSize(tileSize), maxLevel(0),
+    maxQueued((size_t)std::max(maxQueuedTiles, 1)), colorizer(colorizer) {
+    while ((1LL << maxLevel) < std::max(width, height)) {
+        ++maxLevel;
+    }
+
+    std::error_code error;
+    fs::create_directories(path + "_tiles", error);
+    for (int level = 0; level <= maxLevel; ++level) {
+        fs::create_directories(path + "_files/" + std::to_string(level), error);
+    }
+    std::ofstream index(path + "_tiles/index.txt");
+    index << "width " << width << "\nheight " << height << "\ntile " << tileSize << "\nformat float32\n";
+
+    for (int i = 0; i < std::max(ioThreads, 1); ++i) {
+        workers.emplace_back(&PyramidWriter::workerLoop, this);
+    }
+}
+
+PyramidWriter::~PyramidWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+int PyramidWriter::levelWidth(int level) const {
+    int shift = maxLevel - level;
+    return std::max(1, (int)((width + (1LL << shift) - 1) >> shift));
+}
+
+int PyramidWriter::levelHeight(int level) const {
+    int shift = maxLevel - level;
+    return std::max(1, (int)((height + (1LL << shift) - 1) >> shift));
+}
+
+int PyramidWriter::tileExtent(int levelSize, int index) const {
+    return std::min(tileSize, levelSize - index * tileSize);
+}
+
+std::string PyramidWriter::tilePath(int level, int x, int y, const char* extension) const {
+    return path + "_files/" + std::to_string(level) + "/" + std::to_string(x) + "_" + std::to_string(y) + extension;
+}
+
+void PyramidWriter::addTile(int tileX, int tileY, std::vector<float> values) {
+    std::unique_lock<std::mutex> lock(mutex);
+    spaceReady.wait(lock, [this]() { return jobs.size() < maxQueued; });
+    Job job;
+    job.level = maxLevel;
+    job.x = tileX;
+    job.y = tileY;
+    job.values = std::move(values);
+    jobs.push_back(std::move(job));
+    jobReady.notify_one();
+}
+
+bool PyramidWriter::finish() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]() { return jobs.empty() && running == 0; });
+
+    // Anything still counted here is a parent whose children never all
+    // arrived, i.e. base tiles are missing.
+    bool complete = !failed && childCounts.empty();
+    lock.unlock();
+
+    std::ofstream dzi(path + ".dzi");
+    dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" Format=\"png\" Overlap=\"0\" TileSize=\""
+        << tileSize << "\">\n"
+        << "  <Size Width=\"" << width << "\" Height=\"" << height << "\"/>\n"
+        << "</Image>\n";
+    return complete && (bool)dzi;
+}
+
+void PyramidWriter::workerLoop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            ++running;
+        }
+        spaceReady.notify_one();
+
+        if (job.level == maxLevel) {
+            writeBaseTile(job);
+        }
+        else {
+            writeParentTile(job);
+        }
+        if (job.level > 0) {
+            childDone(job.level - 1, job.x / 2, job.y / 2);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        --running;
+        if (jobs.empty() && running == 0) {
+            idle.notify_all();
+        }
+    }
+}
+
+void PyramidWriter::writeBaseTile(Job& job) {
+    int tw = tileWidth(job.x), th = tileHeight(job.y);
+    {
+        std::ofstream raw(path + "_tiles/" + std::to_string(job.x) + "_" + std::to_string(job.y) + ".f32", std::ios::binary);
+        raw.write((const char*)job.values.data(), job.values.size() * sizeof(float));
+        if (!raw) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failed = true;
+        }
+    }
+
+    std::vector<unsigned char> rgb((size_t)tw * th * 3);
+    for (size_t i = 0; i < (size_t)tw * th; ++i) {
+        colorizer(job.values[i], &rgb[i * 3]);
+    }
+    job.values.clear();
+    job.values.shrink_to_fit();
+    writeTileImage(job.level, job.x, job.y, rgb);
+}
+
+void PyramidWriter::writeParentTile(const Job& job) {
+    const int child = job.level + 1;
+    const int childWidth = levelWidth(child), childHeight = levelHeight(child);
+    const int tw = tileExtent(levelWidth(job.level), job.x);
+    const int th = tileExtent(levelHeight(job.level), job.y);
+
+    std::vector<unsigned char> children[2][2];
+    for (int dy = 0; dy < 2; ++dy) {
+        for (int dx = 0; dx < 2; ++dx) {
+            int cx = job.x * 2 + dx, cy = job.y * 2 + dy;
+            if (cx >= levelColumns(child) || cy >= levelRows(child)) {
+                continue;
+            }
+            std::string childPath = tilePath(child, cx, cy, ".rgb");
+            std::vector<unsigned char>& pixels = children[dy][dx];
+            pixels.resize((size_t)tileExtent(childWidth, cx) * tileExtent(childHeight, cy) * 3);
+            std::ifstream file(childPath, std::ios::binary);
+            if (!file.read((char*)pixels.data(), pixels.size())) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = true;
+            }
+            file.close();
+            std::error_code error;
+            fs::remove(childPath, error);
+        }
+    }
+
+    std::vector<unsigned char> rgb((size_t)tw * th * 3);
+    for (int j = 0; j < th; ++j) {
+        for (int i = 0; i < tw; ++i) {
+            int sum[3] = { 0, 0, 0 };
+            int samples = 0;
+            for (int sy = 0; sy < 2; ++sy) {
+                for (int sx = 0; sx < 2; ++sx) {
+                    int gx = 2 * (job.x * tileSize + i) + sx;
+                    int gy = 2 * (job.y * tileSize + j) + sy;
+                    if (gx >= childWidth || gy >= childHeight) {
+                        continue;
+                    }
+                    int cx = gx / tileSize, cy = gy / tileSize;
+                    const std::vector<unsigned char>& pixels = children[cy - job.y * 2][cx - job.x * 2];
+                    size_t offset = ((size_t)(gy % tileSize) * tileExtent(childWidth, cx) + gx % tileSize) * 3;
+                    for (int c = 0; c < 3; ++c) {
+                        sum[c] += pixels[offset + c];
+                    }
+                    ++samples;
+                }
+            }
+            for (int c = 0; c < 3; ++c) {
+                rgb[((size_t)j * tw + i) * 3 + c] = (unsigned char)(samples > 0 ? (sum[c] + samples / 2) / samples : 0);
+            }
+        }
+    }
+    writeTileImage(job.level, job.x, job.y, rgb);
+}
+
+void PyramidWriter::writeTileImage(int level, int x, int y, const std::vector<unsigned char>& rgb) {
+    int tw = tileExtent(levelWidth(level), x), th = tileExtent(levelHeight(level), y);
+    bool ok = writePng(tilePath(level, x, y, ".png"), rgb.data(), tw, th);
+
+    // the parent reads the plain pixels back rather than decoding the PNG
+    if (level > 0) {
+        std::ofstream file(tilePath(level, x, y, ".rgb"), std::ios::binary);
+        file.write((const char*)rgb.data(), rgb.size());
+        ok = ok && (bool)file;
+    }
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = true;
+    }
+}
+
+void PyramidWriter::childDone(int level, int x, int y) {
+    int expected = 0;
+    for (int dy = 0; dy < 2; ++dy) {
+        for (int dx = 0; dx < 2; ++dx) {
+            if (x * 2 + dx < levelColumns(level + 1) && y * 2 + dy < levelRows(level + 1)) {
+                ++expected;
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto key = std::make_pair(level, std::make_pair(x, y));
+    if (++childCounts[key] < expected) {
+        return;
+    }
+    childCounts.erase(key);
+
+    // parents jump the queue so their children's scratch files go quickly
+    Job job;
+    job.level = level;
+    job.x = x;
+    job.y = y;
+    jobs.push_front(std::move(job));
+    jobReady.notify_one();
+}
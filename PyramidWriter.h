@@ -0,0 +1,69 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams a map too large for memory to disk as a Deep Zoom (DZI) pyramid.
+// Base tiles may arrive in any order. Each is kept as raw floats under
+// <path>_tiles/ and as a PNG at the finest level of <path>_files/. A parent
+// tile is downsampled as soon as all of its children exist, reading them
+// back from disk. The I/O threads encode and write in parallel with
+// whoever produces the tiles. addTile() blocks once maxQueuedTiles are
+// waiting, so memory stays bounded by the queue, not the image.
+class PyramidWriter {
+public:
+    typedef std::function<void(float value, unsigned char rgb[3])> Colorizer;
+
+    PyramidWriter(const std::string& path, int width, int height, int tileSize, Colorizer colorizer,
+        int ioThreads = 2, int maxQueuedTiles = 8);
+    ~PyramidWriter();
+
+    int columns() const { return levelColumns(maxLevel); }
+    int rows() const { return levelRows(maxLevel); }
+    int tileWidth(int tileX) const { return tileExtent(levelWidth(maxLevel), tileX); }
+    int tileHeight(int tileY) const { return tileExtent(levelHeight(maxLevel), tileY); }
+
+    void addTile(int tileX, int tileY, std::vector<float> values);
+    bool finish();
+
+private:
+    struct Job {
+        int level = 0;
+        int x = 0;
+        int y = 0;
+        std::vector<float> values;
+    };
+
+    int levelWidth(int level) const;
+    int levelHeight(int level) const;
+    int levelColumns(int level) const { return (levelWidth(level) + tileSize - 1) / tileSize; }
+    int levelRows(int level) const { return (levelHeight(level) + tileSize - 1) / tileSize; }
+    int tileExtent(int levelSize, int index) const;
+    std::string tilePath(int level, int x, int y, const char* extension) const;
+
+    void workerLoop();
+    void writeBaseTile(Job& job);
+    void writeParentTile(const Job& job);
+    void writeTileImage(int level, int x, int y, const std::vector<unsigned char>& rgb);
+    void childDone(int level, int x, int y);
+
+    std::string path;
+    int width, height, tileSize, maxLevel;
+    size_t maxQueued;
+    Colorizer colorizer;
+
+    std::mutex mutex;
+    std::condition_variable jobReady, spaceReady, idle;
+    std::deque<Job> jobs;
+    std::map<std::pair<int, std::pair<int, int>>, int> childCounts;
+    int running = 0;
+    bool stopping = false;
+    bool failed = false;
+    std::vector<std::thread> workers;
+};
@@ -0,0 +1,257 @@
+#include "RealTime.h"
+#include "CommandLine.h"
+#include "Physics.h"
+#include "Scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#elif defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+const int REAL_TIME_BINS = 100000;
+const size_t REAL_TIME_STACK = 256 * 1024;     // stack touched before the first step
+
+// steady_clock is CLOCK_MONOTONIC on Linux, so its time points are valid
+// absolute deadlines for clock_nanosleep.
+static void sleepUntil(std::chrono::steady_clock::time_point deadline) {
+#ifdef __linux__
+    auto since = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    timespec wake;
+    wake.tv_sec = (time_t)(since / 1000000000);
+    wake.tv_nsec = (long)(since % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(deadline);
+#endif
+}
+
+static void touchStack() {
+    char stack[REAL_TIME_STACK];
+    volatile char* touch = stack;
+    for (size_t i = 0; i < REAL_TIME_STACK; i += 4096) {
+        touch[i] = 0;
+    }
+}
+
+void RealTimeLoop::start(const RealTimeSettings& chosen, std::function<void()> stepFunction) {
+    stop();
+    settings = chosen;
+    step = std::move(stepFunction);
+    latencyBins.assign(REAL_TIME_BINS, 0);
+    computeBins.assign(REAL_TIME_BINS, 0);
+    worstLatency = worstCompute = 0.0;
+    result = RealTimeStats();
+    stopping = false;
+    thread = std::thread(&RealTimeLoop::run, this);
+}
+
+// Percentile q of a histogram of 1 us bins, as the bin's upper edge.
+static double binPercentile(const std::vector<unsigned int>& bins, long long total, double q) {
+    long long needed = (long long)std::ceil(q * total), seen = 0;
+    for (size_t b = 0; b < bins.size(); ++b) {
+        seen += bins[b];
+        if (seen >= needed) {
+            return (b + 1) * 1e-6;
+        }
+    }
+    return bins.size() * 1e-6;
+}
+
+void RealTimeLoop::stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+    stopping = true;
+    thread.join();
+    const double quantiles[3] = { 0.5, 0.99, 0.999 };
+    for (int k = 0; k < 3; ++k) {
+        result.latency[k] = std::min(binPercentile(latencyBins, result.steps, quantiles[k]), worstLatency);
+        result.compute[k] = std::min(binPercentile(computeBins, result.steps, quantiles[k]), worstCompute);
+    }
+    result.latency[3] = worstLatency;
+    result.compute[3] = worstCompute;
+}
+
+void RealTimeLoop::prepare() {
+#ifdef __linux__
+    if (settings.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(settings.cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            result.notes.push_back("could not pin to cpu " + std::to_string(settings.cpu));
+        }
+    }
+    if (settings.fifo) {
+        sched_param parameters;
+        parameters.sched_priority = settings.priority;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters) != 0) {
+            result.notes.push_back("could not switch to SCHED_FIFO (needs CAP_SYS_NICE or root)");
+        }
+    }
+    if (settings.lockMemory) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            result.notes.push_back(std::string("mlockall failed: ") + std::strerror(errno));
+        }
+        // keep freed memory mapped so later allocations reuse faulted pages
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+        char* heap = (char*)malloc(settings.prefault);
+        if (heap) {
+            for (size_t i = 0; i < settings.prefault; i += 4096) {
+                heap[i] = 0;
+            }
+            free(heap);
+        }
+        touchStack();
+    }
+#elif defined(_WIN32)
+    if (settings.cpu >= 0 && !SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << settings.cpu)) {
+        result.notes.push_back("could not pin to cpu " + std::to_string(settings.cpu));
+    }
+    if (settings.fifo && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+        result.notes.push_back("could not raise the thread priority");
+    }
+    if (settings.lockMemory) {
+        result.notes.push_back("memory locking is only done on Linux");
+        touchStack();
+    }
+#else
+    if (settings.cpu >= 0 || settings.fifo || settings.lockMemory) {
+        result.notes.push_back("pinning, SCHED_FIFO and memory locking are only done on Linux");
+    }
+#endif
+}
+
+void RealTimeLoop::run() {
+    prepare();
+    using Clock = std::chrono::steady_clock;
+    const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / settings.rate));
+    Clock::time_point next = Clock::now() + period;
+    while (!stopping.load(std::memory_order_relaxed)) {
+        sleepUntil(next);
+        Clock::time_point woke = Clock::now();
+        step();
+        Clock::time_point done = Clock::now();
+
+        double late = std::chrono::duration<double>(woke - next).count();
+        double spent = std::chrono::duration<double>(done - woke).count();
+        ++latencyBins[std::min(std::max((int)(late * 1e6), 0), REAL_TIME_BINS - 1)];
+        ++computeBins[std::min((int)(spent * 1e6), REAL_TIME_BINS - 1)];
+        worstLatency = std::max(worstLatency, late);
+        worstCompute = std::max(worstCompute, spent);
+        ++result.steps;
+        next += period;
+        if (done > next) {
+            ++result.misses;
+        }
+    }
+}
+
+bool parseRealTimeArguments(int argc, char** argv, RealTimeSettings& settings, bool lockByDefault) {
+    settings.cpu = intArgument(argc, argv, "--cpu", -1);
+    settings.fifo = hasArgument(argc, argv, "--fifo");
+    settings.priority = intArgument(argc, argv, "--priority", 80);
+    settings.lockMemory = lockByDefault ? !hasArgument(argc, argv, "--no-lock") : hasArgument(argc, argv, "--lock");
+    int prefault = intArgument(argc, argv, "--prefault", 64);
+    settings.prefault = (size_t)std::max(prefault, 0) << 20;
+    return settings.cpu >= -1 && settings.priority >= 1 && settings.priority <= 99 && prefault >= 0;
+}
+
+void printRealTimeStats(const RealTimeSettings& settings, const RealTimeStats& stats) {
+    std::cout << stats.steps << " steps at " << settings.rate << " Hz, " << stats.misses << " deadline misses" << std::endl;
+    std::cout << "wake-up latency us: median " << stats.latency[0] * 1e6 << ", p99 " << stats.latency[1] * 1e6
+        << ", p99.9 " << stats.latency[2] * 1e6 << ", worst " << stats.latency[3] * 1e6 << std::endl;
+    std::cout << "step time us: median " << stats.compute[0] * 1e6 << ", p99 " << stats.compute[1] * 1e6
+        << ", p99.9 " << stats.compute[2] * 1e6 << ", worst " << stats.compute[3] * 1e6 << std::endl;
+    for (const std::string& note : stats.notes) {
+        std::cout << "note: " << note << std::endl;
+    }
+}
+
+struct TipSnapshot {
+    std::vector<float> x, y;
+    double time = 0.0;
+};
+
+int runRealTimeCommand(int argc, char** argv) {
+    ChainParameters chain;
+    bool valid = parseChainArguments(argc, argv, chain);
+    RealTimeSettings settings;
+    valid = parseRealTimeArguments(argc, argv, settings) && valid;
+    settings.rate = floatArgument(argc, argv, "--rate", 1000.0f);
+    int count = intArgument(argc, argv, "--chains", 100);
+    double angle = floatArgument(argc, argv, "--angle", 2.0f);
+    double duration = floatArgument(argc, argv, "--time", 10.0f);
+    double frameRate = floatArgument(argc, argv, "--fps", 60.0f);
+    if (!valid || settings.rate <= 0.0 || count < 1 || duration <= 0.0 || frameRate <= 0.0) {
+        std::cerr << "Invalid real-time settings" << std::endl;
+        return -1;
+    }
+
+    ChainScene scene;
+    std::vector<double> angles(chain.links(), angle), rates(chain.links(), 0.0);
+    for (int k = 0; k < count; ++k) {
+        angles[0] = angle + 1e-3 * k;
+        scene.add(k % 32, -(k / 32), chain, angles.data(), rates.data());
+    }
+    TripleBuffer<TipSnapshot> tips;
+    for (TipSnapshot& snapshot : tips.buffers) {
+        snapshot.x.assign(count, 0.0f);
+        snapshot.y.assign(count, 0.0f);
+    }
+
+    const double h = 1.0 / settings.rate;
+    double time = 0.0;
+    // warm the step up once so its scratch is allocated before the clock starts
+    scene.advance(h, 1);
+    time += h;
+    RealTimeLoop loop;
+    loop.start(settings, [&]() {
+        scene.advance(h, 1);
+        time += h;
+        TipSnapshot& out = tips.back();
+        for (int k = 0; k < count; ++k) {
+            double x, y;
+            scene.tip(k, x, y);
+            out.x[k] = (float)x;
+            out.y[k] = (float)y;
+        }
+        out.time = time;
+        tips.publish();
+    });
+
+    // a stand-in renderer on this thread, reading whatever is newest
+    auto begin = std::chrono::steady_clock::now();
+    long long frames = 0, stale = 0;
+    double shown = 0.0;
+    while (std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() < duration) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(1.0 / frameRate));
+        const TipSnapshot& snapshot = tips.read();
+        stale += snapshot.time <= shown;
+        shown = snapshot.time;
+        ++frames;
+    }
+    loop.stop();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << count << " chains of " << chain.links() << " links for " << wall << " s: ";
+    printRealTimeStats(settings, loop.stats());
+    std::cout << "renderer read " << frames << " frames (" << stale << " with no new step), last at t " << shown << std::endl;
+    return 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct RealTimeSettings {
+    double rate = 1000.0;           // steps per second
+    int cpu = -1;                   // core to pin the stepping thread to, -1 leaves it free
+    bool fifo = false;              // SCHED_FIFO at `priority`, which needs CAP_SYS_NICE
+    int priority = 80;
+    bool lockMemory = true;         // mlockall and pre-fault `prefault` bytes of heap
+    size_t prefault = 64u << 20;
+};
+
+struct RealTimeStats {
+    long long steps = 0;
+    long long misses = 0;           // steps that finished after the next deadline
+    // wake-up latency past each deadline and time spent in the step, in
+    // seconds: median, p99, p99.9 and worst
+    double latency[4] = {};
+    double compute[4] = {};
+    std::vector<std::string> notes; // what could not be set up
+};
+
+// Hands the newest snapshot from one writer thread to one reader without
+// either ever waiting: the writer fills its back buffer and swaps it with
+// the middle one, the reader swaps its front buffer with the middle one
+// when that holds something newer. Size the three buffers before use so
+// publishing never allocates.
+template<typename T>
+class TripleBuffer {
+public:
+    T& back() { return buffers[backIndex]; }
+    void publish() { backIndex = middle.exchange(backIndex | FRESH) & INDEX; }
+
+    // The newest published snapshot, or the last one read if none is newer.
+    const T& read() {
+        if (middle.load() & FRESH) {
+            frontIndex = middle.exchange(frontIndex) & INDEX;
+        }
+        return buffers[frontIndex];
+    }
+
+    T buffers[3];
+
+private:
+    static const int INDEX = 3, FRESH = 4;
+    std::atomic<int> middle{ 1 };
+    int backIndex = 0, frontIndex = 2;
+};
+
+// Calls `step` at a fixed rate on a dedicated thread, sleeping to absolute
+// deadlines (clock_nanosleep on Linux) so wake-up jitter never accumulates
+// into drift. A step that runs late is counted as a miss and the next one
+// follows at once, so the simulation keeps pace with the wall clock. On
+// Linux the thread can be pinned to a core and run SCHED_FIFO, with all
+// memory locked and pre-faulted so no page fault lands inside a step;
+// elsewhere these are skipped and noted in the stats. `step` must neither
+// allocate nor block: publish its results through a TripleBuffer.
+class RealTimeLoop {
+public:
+    ~RealTimeLoop() { stop(); }
+
+    void start(const RealTimeSettings& settings, std::function<void()> step);
+    void stop();
+    bool running() const { return thread.joinable(); }
+
+    // Valid after stop().
+    const RealTimeStats& stats() const { return result; }
+
+private:
+    void run();
+    void prepare();
+
+    RealTimeSettings settings;
+    std::function<void()> step;
+    std::thread thread;
+    std::atomic<bool> stopping{ false };
+    // 1 us bins up to REAL_TIME_BINS us, anything later in the last one
+    std::vector<unsigned int> latencyBins, computeBins;
+    double worstLatency = 0.0, worstCompute = 0.0;
+    RealTimeStats result;
+};
+
+// --cpu, --fifo, --priority and --prefault MB; memory is locked unless
+// --no-lock, or only with --lock when not `lockByDefault`.
+bool parseRealTimeArguments(int argc, char** argv, RealTimeSettings& settings, bool lockByDefault = true);
+void printRealTimeStats(const RealTimeSettings& settings, const RealTimeStats& stats);
+
+int runRealTimeCommand(int argc, char** argv);
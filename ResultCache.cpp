@@ -0,0 +1,290 @@
+#include "ResultCache.h"
+#include "CommandLine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+const char CACHE_MAGIC[8] = { 'P', 'N', 'D', 'C', 'A', 'C', 'H', 'E' };
+const uint32_t CACHE_FORMAT = 1;
+const char* CACHE_EXTENSION = ".bin";
+// temporary files older than this belong to writers that died
+const std::chrono::hours CACHE_STALE_TEMP(1);
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t format;
+    uint32_t keyLength;
+    uint64_t payloadSize;
+    uint64_t payloadHash;
+};
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+CacheKey::CacheKey(const std::string& kind) : description(kind) {
+}
+
+CacheKey& CacheKey::add(const char* name, double value) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%a", value);
+    description += std::string(" ") + name + "=" + buffer;
+    return *this;
+}
+
+CacheKey& CacheKey::add(const char* name, long long value) {
+    description += std::string(" ") + name + "=" + std::to_string(value);
+    return *this;
+}
+
+CacheKey& CacheKey::add(const char* name, const std::string& value) {
+    description += std::string(" ") + name + "=" + value;
+    return *this;
+}
+
+std::string CacheKey::hash() const {
+    // two differently seeded 64-bit hashes make accidental name clashes
+    // practically impossible; a clash would still be caught on load
+    uint64_t parts[2] = {
+        hashBytes(description.data(), description.size()),
+        hashBytes(description.data(), description.size(), 0x9e3779b97f4a7c15ULL),
+    };
+    char buffer[33];
+    std::snprintf(buffer, sizeof(buffer), "%016llx%016llx", (unsigned long long)parts[0], (unsigned long long)parts[1]);
+    return buffer;
+}
+
+ResultCache::ResultCache(const std::string& directory, unsigned long long maxBytes)
+    : directory(directory), maxBytes(maxBytes) {
+    std::error_code error;
+    fs::create_directories(directory, error);
+
+    std::vector<std::pair<fs::file_time_type, std::string>> found;
+    const fs::file_time_type stale = fs::file_time_type::clock::now() - CACHE_STALE_TEMP;
+    for (const fs::directory_entry& file : fs::directory_iterator(directory, error)) {
+        std::string name = file.path().filename().string();
+        if (file.path().extension() == ".tmp") {
+            // left behind by a writer that died before its rename; recent
+            // ones may still be being written by another process
+            if (file.last_write_time(error) < stale) {
+                fs::remove(file.path(), error);
+            }
+            continue;
+        }
+        if (file.path().extension() != CACHE_EXTENSION) {
+            continue;
+        }
+        Entry entry;
+        entry.size = file.file_size(error);
+        entries[name] = entry;
+        totalBytes += entry.size;
+        found.push_back(std::make_pair(file.last_write_time(error), name));
+    }
+
+    std::sort(found.begin(), found.end());
+    for (const auto& file : found) {
+        entries[file.second].lastUse = ++useCounter;
+    }
+}
+
+std::string ResultCache::pathFor(const std::string& name) const {
+    return (fs::path(directory) / name).string();
+}
+
+bool ResultCache::load(const CacheKey& key, std::vector<char>& payload) {
+    std::string name = key.hash() + CACHE_EXTENSION;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.find(name) == entries.end()) {
+            return false;
+        }
+    }
+
+    std::string path = pathFor(name);
+    std::ifstream file(path, std::ios::binary);
+    CacheHeader header;
+    bool valid = (bool)file.read((char*)&header, sizeof(header))
+        && std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+        && header.format == CACHE_FORMAT
+        && header.keyLength == key.text().size()
+        && header.payloadSize < (1ULL << 40);
+
+    if (valid) {
+        std::string storedKey(header.keyLength, '\0');
+        payload.resize((size_t)header.payloadSize);
+        valid = file.read(&storedKey[0], storedKey.size())
+            && file.read(payload.data(), payload.size())
+            && storedKey == key.text()
+            && hashBytes(payload.data(), payload.size()) == header.payloadHash;
+    }
+    file.close();
+
+    std::error_code error;
+    if (!valid) {
+        payload.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(name);
+        if (found != entries.end()) {
+            totalBytes -= found->second.size;
+            entries.erase(found);
+        }
+        fs::remove(path, error);
+        return false;
+    }
+
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(name);
+    if (found != entries.end()) {
+        found->second.lastUse = ++useCounter;
+    }
+    return true;
+}
+
+bool ResultCache::store(const CacheKey& key, const void* data, size_t size) {
+    std::string name = key.hash() + CACHE_EXTENSION;
+    std::string path = pathFor(name);
+
+    std::ostringstream tempName;
+    tempName << name << "." << getpid() << "." << std::this_thread::get_id() << ".tmp";
+    std::string tempPath = pathFor(tempName.str());
+
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.format = CACHE_FORMAT;
+    header.keyLength = (uint32_t)key.text().size();
+    header.payloadSize = size;
+    header.payloadHash = hashBytes(data, size);
+
+    // the data must be on disk before the rename makes it visible, or a
+    // crash could leave an empty file under the real name
+    FILE* file = std::fopen(tempPath.c_str(), "wb");
+    bool written = file
+        && std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(key.text().data(), 1, key.text().size(), file) == key.text().size()
+        && std::fwrite(data, 1, size, file) == size
+        && std::fflush(file) == 0;
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0;
+#endif
+    if (file) {
+        written = std::fclose(file) == 0 && written;
+    }
+    if (!written) {
+        std::error_code error;
+        fs::remove(tempPath, error);
+        return false;
+    }
+
+    std::error_code error;
+    fs::rename(tempPath, path, error);
+    if (error) {
+        fs::remove(tempPath, error);
+        return false;
+    }
+
+    touch(name, sizeof(header) + key.text().size() + size);
+    return true;
+}
+
+void ResultCache::touch(const std::string& name, unsigned long long size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[name];
+    totalBytes -= entry.size;
+    entry.size = size;
+    entry.lastUse = ++useCounter;
+    totalBytes += size;
+    evict();
+}
+
+void ResultCache::evict() {
+    if (totalBytes <= maxBytes) {
+        return;
+    }
+    std::vector<std::pair<long long, std::string>> order;
+    for (const auto& entry : entries) {
+        order.push_back(std::make_pair(entry.second.lastUse, entry.first));
+    }
+    std::sort(order.begin(), order.end());
+
+    std::error_code error;
+    for (size_t i = 0; i < order.size() && totalBytes > maxBytes; ++i) {
+        auto found = entries.find(order[i].second);
+        totalBytes -= found->second.size;
+        fs::remove(pathFor(found->first), error);
+        entries.erase(found);
+    }
+}
+
+bool ResultCache::loadFloats(const CacheKey& key, std::vector<float>& values) {
+    std::vector<char> payload;
+    if (!load(key, payload) || payload.size() % sizeof(float) != 0) {
+        return false;
+    }
+    values.resize(payload.size() / sizeof(float));
+    std::memcpy(values.data(), payload.data(), payload.size());
+    return true;
+}
+
+bool ResultCache::storeFloats(const CacheKey& key, const std::vector<float>& values) {
+    return store(key, values.data(), values.size() * sizeof(float));
+}
+
+unsigned long long ResultCache::sizeBytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totalBytes;
+}
+
+static std::mutex sharedCacheMutex;
+static std::unique_ptr<ResultCache> sharedCache;
+static bool sharedCacheConfigured = false;
+
+ResultCache* resultCache() {
+    std::lock_guard<std::mutex> lock(sharedCacheMutex);
+    if (!sharedCacheConfigured) {
+        sharedCache.reset(new ResultCache("cache", 2048ULL << 20));
+        sharedCacheConfigured = true;
+    }
+    return sharedCache.get();
+}
+
+void configureResultCache(const std::string& directory, unsigned long long maxBytes) {
+    std::lock_guard<std::mutex> lock(sharedCacheMutex);
+    sharedCache.reset(directory.empty() ? nullptr : new ResultCache(directory, maxBytes));
+    sharedCacheConfigured = true;
+}
+
+void configureResultCache(int argc, char** argv) {
+    if (hasArgument(argc, argv, "--no-cache")) {
+        configureResultCache("", 0);
+        return;
+    }
+    std::string directory = stringArgument(argc, argv, "--cache", "cache");
+    unsigned long long megabytes = (unsigned long long)std::max(intArgument(argc, argv, "--cache-size", 2048), 1);
+    configureResultCache(directory, megabytes << 20);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Builds the canonical description of everything that affects a result.
+// Doubles are written in hex so the key is exact, and the cache file name is
+// a hash of the whole description.
+class CacheKey {
+public:
+    explicit CacheKey(const std::string& kind);
+
+    CacheKey& add(const char* name, double value);
+    CacheKey& add(const char* name, long long value);
+    CacheKey& add(const char* name, int value) { return add(name, (long long)value); }
+    CacheKey& add(const char* name, const std::string& value);
+
+    const std::string& text() const { return description; }
+    std::string hash() const;
+
+private:
+    std::string description;
+};
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+// Content-addressed result store on disk. Entries are written to a temporary
+// file, synced and renamed into place, so a crash never leaves a torn entry
+// under a real name, and each entry stores its full key and a payload
+// checksum that are verified on load. Once the directory grows past maxBytes the least
+// recently used entries are deleted.
+class ResultCache {
+public:
+    ResultCache(const std::string& directory, unsigned long long maxBytes);
+
+    bool load(const CacheKey& key, std::vector<char>& payload);
+    bool store(const CacheKey& key, const void* data, size_t size);
+
+    bool loadFloats(const CacheKey& key, std::vector<float>& values);
+    bool storeFloats(const CacheKey& key, const std::vector<float>& values);
+
+    unsigned long long sizeBytes();
+
+private:
+    struct Entry {
+        unsigned long long size = 0;
+        long long lastUse = 0;
+    };
+
+    std::string pathFor(const std::string& name) const;
+    void touch(const std::string& name, unsigned long long size);
+    void evict();
+
+    std::string directory;
+    unsigned long long maxBytes;
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;
+    unsigned long long totalBytes = 0;
+    long long useCounter = 0;
+};
+
+// Shared cache used by the map generators and the sweep runner; null when
+// caching is disabled.
+ResultCache* resultCache();
+void configureResultCache(const std::string& directory, unsigned long long maxBytes);
+void configureResultCache(int argc, char** argv);
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+// Reverse-mode automatic differentiation. Every operation on Var values
+// appends its local partial derivatives to the Tape of its operands, and
+// backpropagate() sweeps the tape once from the end, so all derivatives of
+// one output cost a small multiple of evaluating it no matter how many
+// inputs there are. Vars without a tape are constants.
+struct TapeNode {
+    int parent[2];
+    double weight[2];
+};
+
+class Tape {
+public:
+    int push(int a, double weightA, int b, double weightB) {
+        TapeNode node = { { a, b }, { weightA, weightB } };
+        nodes.push_back(node);
+        return (int)nodes.size() - 1;
+    }
+
+    void clear() { nodes.clear(); }
+    size_t size() const { return nodes.size(); }
+
+    // adjoints holds one entry per node, seeded at the outputs; on return
+    // every node holds the derivative of the seeded combination with
+    // respect to it.
+    void backpropagate(std::vector<double>& adjoints) const {
+        for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+            double adjoint = adjoints[i];
+            if (adjoint == 0.0) {
+                continue;
+            }
+            const TapeNode& node = nodes[i];
+            if (node.parent[0] >= 0) adjoints[node.parent[0]] += node.weight[0] * adjoint;
+            if (node.parent[1] >= 0) adjoints[node.parent[1]] += node.weight[1] * adjoint;
+        }
+    }
+
+private:
+    std::vector<TapeNode> nodes;
+};
+
+struct Var {
+    double v;
+    int index;
+    Tape* tape;
+
+    Var() : v(0.0), index(-1), tape(nullptr) {}
+    Var(double value) : v(value), index(-1), tape(nullptr) {}
+
+    static Var variable(Tape& tape, double value) {
+        Var x(value);
+        x.tape = &tape;
+        x.index = tape.push(-1, 0.0, -1, 0.0);
+        return x;
+    }
+
+    Var& operator+=(const Var& b);
+    Var& operator-=(const Var& b);
+    Var& operator*=(const Var& b);
+    Var& operator/=(const Var& b);
+};
+
+inline Var recordVar(double value, const Var& a, double weightA, const Var& b, double weightB) {
+    Tape* tape = a.tape ? a.tape : b.tape;
+    Var r(value);
+    if (tape) {
+        r.tape = tape;
+        r.index = tape->push(a.index, weightA, b.index, weightB);
+    }
+    return r;
+}
+
+inline Var operator-(const Var& a) { return recordVar(-a.v, a, -1.0, Var(), 0.0); }
+inline Var operator+(const Var& a, const Var& b) { return recordVar(a.v + b.v, a, 1.0, b, 1.0); }
+inline Var operator-(const Var& a, const Var& b) { return recordVar(a.v - b.v, a, 1.0, b, -1.0); }
+inline Var operator*(const Var& a, const Var& b) { return recordVar(a.v * b.v, a, b.v, b, a.v); }
+inline Var operator/(const Var& a, const Var& b) {
+    double inverse = 1.0 / b.v;
+    double value = a.v * inverse;
+    return recordVar(value, a, inverse, b, -value * inverse);
+}
+
+inline Var operator+(const Var& a, double b) { return recordVar(a.v + b, a, 1.0, Var(), 0.0); }
+inline Var operator+(double a, const Var& b) { return recordVar(a + b.v, b, 1.0, Var(), 0.0); }
+inline Var operator-(const Var& a, double b) { return recordVar(a.v - b, a, 1.0, Var(), 0.0); }
+inline Var operator-(double a, const Var& b) { return recordVar(a - b.v, b, -1.0, Var(), 0.0); }
+inline Var operator*(const Var& a, double b) { return recordVar(a.v * b, a, b, Var(), 0.0); }
+inline Var operator*(double a, const Var& b) { return recordVar(a * b.v, b, a, Var(), 0.0); }
+inline Var operator/(const Var& a, double b) { return recordVar(a.v / b, a, 1.0 / b, Var(), 0.0); }
+inline Var operator/(double a, const Var& b) { return Var(a) / b; }
+
+inline Var& Var::operator+=(const Var& b) { *this = *this + b; return *this; }
+inline Var& Var::operator-=(const Var& b) { *this = *this - b; return *this; }
+inline Var& Var::operator*=(const Var& b) { *this = *this * b; return *this; }
+inline Var& Var::operator/=(const Var& b) { *this = *this / b; return *this; }
+
+inline bool operator<(const Var& a, const Var& b) { return a.v < b.v; }
+inline bool operator>(const Var& a, const Var& b) { return a.v > b.v; }
+
+inline Var sin(const Var& a) { return recordVar(std::sin(a.v), a, std::cos(a.v), Var(), 0.0); }
+inline Var cos(const Var& a) { return recordVar(std::cos(a.v), a, -std::sin(a.v), Var(), 0.0); }
+inline Var sqrt(const Var& a) {
+    double root = std::sqrt(a.v);
+    return recordVar(root, a, root > 0.0 ? 0.5 / root : 0.0, Var(), 0.0);
+}
+
+inline double value(const Var& a) {
+    return a.v;
+}
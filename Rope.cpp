@@ -0,0 +1,731 @@
+#include "Rope.h"
+#include "Chain.h"
+#include "CommandLine.h"
+#include "Physics.h"
+#include "Stepper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+const int ROPE_THREAD_LINKS = 8192;     // fewer links per thread than this and the barriers dominate
+const int ROPE_SPINS = 64;              // before a waiting thread starts yielding
+
+Rope::Rope(const std::vector<double>& lengths, const std::vector<double>& masses, double g, const RopeSettings& settings)
+    : count((int)lengths.size()), g(g), settings(settings) {
+    const int evens = (count + 1) / 2, odds = count / 2;
+    for (Colour* colour : { &even, &odd }) {
+        int size = colour == &even ? evens : odds;
+        colour->x.assign(size, 0.0);
+        colour->y.assign(size, 0.0);
+        colour->vx.assign(size, 0.0);
+        colour->vy.assign(size, 0.0);
+        colour->px.assign(size, 0.0);
+        colour->py.assign(size, 0.0);
+        colour->inverseMass.resize(size);
+        colour->reach.resize(size);
+    }
+    innerRest.resize(odds);
+    outerRest.resize(evens);
+    innerLambda.assign(odds, 0.0);
+    outerLambda.assign(evens, 0.0);
+    directionX.assign(count, 0.0);
+    directionY.assign(count, 0.0);
+    stiffness.assign(count, 0.0);
+    inverse.assign(9 * (size_t)count, 0.0);
+    spike.assign(9 * (size_t)count, 0.0);
+    right.assign(3 * (size_t)count, 0.0);
+    double reach = 0.0;
+    for (int i = 0; i < count; ++i) {
+        reach += lengths[i];
+        (i % 2 == 0 ? even : odd).inverseMass[i / 2] = 1.0 / masses[i];
+        (i % 2 == 0 ? even : odd).reach[i / 2] = reach;
+        (i % 2 == 0 ? outerRest : innerRest)[i / 2] = lengths[i];
+    }
+
+    int threads = settings.threads > 0 ? settings.threads
+        : std::min((int)std::thread::hardware_concurrency(), evens / ROPE_THREAD_LINKS);
+    threadCount = std::max(std::min(threads, evens), 1);
+    boundaries.resize(threadCount);
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(&Rope::worker, this, i);
+    }
+}
+
+Rope::~Rope() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+}
+
+void Rope::fromAngles(const double* theta, const double* omega) {
+    double x = 0.0, y = 0.0, vx = 0.0, vy = 0.0;
+    for (int i = 0; i < count; ++i) {
+        double length = (i % 2 == 0 ? outerRest : innerRest)[i / 2];
+        double s = std::sin(theta[i]), c = std::cos(theta[i]);
+        x += length * s;
+        y -= length * c;
+        vx += length * omega[i] * c;
+        vy += length * omega[i] * s;
+        Colour& colour = i % 2 == 0 ? even : odd;
+        colour.x[i / 2] = x;
+        colour.y[i / 2] = y;
+        colour.vx[i / 2] = vx;
+        colour.vy[i / 2] = vy;
+    }
+    // the static tension, each link holding up the bobs below it, for a
+    // substep of 1 s until advance() scales it
+    double below = 0.0;
+    for (int i = count - 1; i >= 0; --i) {
+        below += 1.0 / (i % 2 == 0 ? even : odd).inverseMass[i / 2];
+        (i % 2 == 0 ? outerLambda : innerLambda)[i / 2] = -g * below * std::max(std::cos(theta[i]), 0.0);
+    }
+    lambdaStep = 1.0;
+}
+
+void Rope::toAngles(double* theta, double* omega) const {
+    double x = 0.0, y = 0.0, vx = 0.0, vy = 0.0;
+    for (int i = 0; i < count; ++i) {
+        const Colour& colour = i % 2 == 0 ? even : odd;
+        double dx = colour.x[i / 2] - x, dy = colour.y[i / 2] - y;
+        double dvx = colour.vx[i / 2] - vx, dvy = colour.vy[i / 2] - vy;
+        double length = std::sqrt(dx * dx + dy * dy);
+        theta[i] += std::remainder(std::atan2(dx, -dy) - theta[i], 2.0 * M_PI);
+        omega[i] = (dvx * -dy + dvy * dx) / (length * length);
+        x = colour.x[i / 2];
+        y = colour.y[i / 2];
+        vx = colour.vx[i / 2];
+        vy = colour.vy[i / 2];
+    }
+}
+
+void Rope::position(int i, double& x, double& y) const {
+    const Colour& colour = i % 2 == 0 ? even : odd;
+    x = colour.x[i / 2];
+    y = colour.y[i / 2];
+}
+
+void Rope::positions(std::vector<float>& vertices) const {
+    vertices.resize(2 * (count + 1));
+    vertices[0] = vertices[1] = 0.0f;
+    for (int i = 0; i < count; ++i) {
+        const Colour& colour = i % 2 == 0 ? even : odd;
+        vertices[2 * i + 2] = (float)colour.x[i / 2];
+        vertices[2 * i + 3] = (float)colour.y[i / 2];
+    }
+}
+
+double Rope::energy() const {
+    double energy = 0.0;
+    for (const Colour* colour : { &even, &odd }) {
+        for (size_t k = 0; k < colour->x.size(); ++k) {
+            double mass = 1.0 / colour->inverseMass[k];
+            energy += 0.5 * mass * (colour->vx[k] * colour->vx[k] + colour->vy[k] * colour->vy[k]) + mass * g * colour->y[k];
+        }
+    }
+    return energy;
+}
+
+double Rope::largestStretch() const {
+    double stretch = 0.0, x = 0.0, y = 0.0;
+    for (int i = 0; i < count; ++i) {
+        const Colour& colour = i % 2 == 0 ? even : odd;
+        double length = std::hypot(colour.x[i / 2] - x, colour.y[i / 2] - y);
+        stretch = std::max(stretch, std::fabs(length / (i % 2 == 0 ? outerRest : innerRest)[i / 2] - 1.0));
+        x = colour.x[i / 2];
+        y = colour.y[i / 2];
+    }
+    return stretch;
+}
+
+double Rope::length() const {
+    double total = 0.0, x = 0.0, y = 0.0;
+    for (int i = 0; i < count; ++i) {
+        const Colour& colour = i % 2 == 0 ? even : odd;
+        total += std::hypot(colour.x[i / 2] - x, colour.y[i / 2] - y);
+        x = colour.x[i / 2];
+        y = colour.y[i / 2];
+    }
+    return total;
+}
+
+void Rope::advance(double h) {
+    // multipliers are impulses over a substep squared
+    const double hs = h / std::max(settings.substeps, 1);
+    const double scale = hs / lambdaStep;
+    lambdaStep = hs;
+    if (threadCount == 1) {
+        step = h;
+        rescale = scale * scale;
+        run(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        step = h;
+        rescale = scale * scale;
+        ++frame;
+    }
+    started.notify_all();
+    run(0);
+}
+
+void Rope::worker(int thread) {
+    long long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [&]() { return stopping || frame != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = frame;
+        }
+        run(thread);
+    }
+}
+
+// Spinning barrier: the threads reach each of a substep's barriers within
+// microseconds of each other, far sooner than a blocked thread would wake.
+void Rope::wait() {
+    if (threadCount == 1) {
+        return;
+    }
+    long long current = generation.load(std::memory_order_acquire);
+    if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == threadCount) {
+        arrived.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        return;
+    }
+    for (int spin = 0; generation.load(std::memory_order_acquire) == current; ++spin) {
+        if (spin > ROPE_SPINS) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Thread t owns even and odd bobs k in [begin, end), the inner links
+// between them and the outer links into its even bobs; only the outer
+// link at `begin` reaches into a neighbour's block.
+void Rope::run(int thread) {
+    const int evens = (int)even.x.size();
+    const int begin = (int)((long long)evens * thread / threadCount);
+    const int end = (int)((long long)evens * (thread + 1) / threadCount);
+    const double hs = step / std::max(settings.substeps, 1);
+    for (int k = begin; k < end; ++k) {
+        outerLambda[k] *= rescale;
+        if (k < (int)innerLambda.size()) {
+            innerLambda[k] *= rescale;
+        }
+    }
+    for (int substep = 0; substep < settings.substeps; ++substep) {
+        predict(begin, end, hs);
+        for (int sweep = 0; sweep < settings.sweeps; ++sweep) {
+            wait();
+            solveInner(begin, end, hs);
+            wait();
+            solveOuter(begin, end, hs);
+        }
+        wait();
+        for (int iteration = 0; iteration < settings.iterations; ++iteration) {
+            if (!solveChain(thread, begin, end, hs)) {
+                break;
+            }
+        }
+        if (settings.tethers) {
+            tether(begin, end);
+        }
+        finish(begin, end, hs);
+    }
+    wait();
+}
+
+// The sweeps are free functions over restrict pointers so the compiler
+// knows the arrays are disjoint and vectorizes them.
+static void predictBobs(double* __restrict x, double* __restrict y, double* __restrict vx, double* __restrict vy,
+    double* __restrict px, double* __restrict py, int count, double hs, double fall) {
+    for (int k = 0; k < count; ++k) {
+        vy[k] -= fall;
+        px[k] = x[k];
+        py[k] = y[k];
+        x[k] += vx[k] * hs;
+        y[k] += vy[k] * hs;
+    }
+}
+
+// XPBD projection of links a[k] -> b[k] toward their rest lengths.
+static void projectLinks(double* __restrict ax, double* __restrict ay, double* __restrict bx, double* __restrict by,
+    const double* __restrict wa, const double* __restrict wb, const double* __restrict rest, double* __restrict lambda,
+    int count, double alpha) {
+    for (int k = 0; k < count; ++k) {
+        double dx = bx[k] - ax[k], dy = by[k] - ay[k];
+        double length = std::sqrt(dx * dx + dy * dy);
+        double change = (rest[k] - length - alpha * lambda[k]) / (wa[k] + wb[k] + alpha);
+        lambda[k] += change;
+        double scale = change / length;
+        ax[k] -= wa[k] * scale * dx;
+        ay[k] -= wa[k] * scale * dy;
+        bx[k] += wb[k] * scale * dx;
+        by[k] += wb[k] * scale * dy;
+    }
+}
+
+// Long-range attachments: no bob may be further from the pivot than the
+// rope's rest length above it.
+static void tetherBobs(double* __restrict x, double* __restrict y, const double* __restrict reach, int count) {
+    for (int k = 0; k < count; ++k) {
+        double distance = std::sqrt(x[k] * x[k] + y[k] * y[k]);
+        double scale = distance > reach[k] ? reach[k] / distance : 1.0;
+        x[k] *= scale;
+        y[k] *= scale;
+    }
+}
+
+static void finishBobs(const double* __restrict x, const double* __restrict y, double* __restrict vx, double* __restrict vy,
+    const double* __restrict px, const double* __restrict py, int count, double hs) {
+    for (int k = 0; k < count; ++k) {
+        vx[k] = (x[k] - px[k]) / hs;
+        vy[k] = (y[k] - py[k]) / hs;
+    }
+}
+
+void Rope::predict(int begin, int end, double hs) {
+    for (Colour* c : { &even, &odd }) {
+        int stop = std::min(end, (int)c->x.size());
+        if (stop > begin) {
+            predictBobs(&c->x[begin], &c->y[begin], &c->vx[begin], &c->vy[begin], &c->px[begin], &c->py[begin], stop - begin, hs, g * hs);
+        }
+    }
+}
+
+// Link 2k + 1, from even bob k to odd bob k.
+void Rope::solveInner(int begin, int end, double hs) {
+    const int stop = std::min(end, (int)odd.x.size());
+    if (stop > begin) {
+        projectLinks(&even.x[begin], &even.y[begin], &odd.x[begin], &odd.y[begin], &even.inverseMass[begin], &odd.inverseMass[begin],
+            &innerRest[begin], &innerLambda[begin], stop - begin, settings.compliance / (hs * hs));
+    }
+}
+
+// Link 2k, from odd bob k - 1 (the pivot for k = 0) to even bob k.
+void Rope::solveOuter(int begin, int end, double hs) {
+    const double alpha = settings.compliance / (hs * hs);
+    if (begin == 0 && end > 0) {
+        double& x = even.x[0];
+        double& y = even.y[0];
+        double length = std::sqrt(x * x + y * y);
+        double change = (outerRest[0] - length - alpha * outerLambda[0]) / (even.inverseMass[0] + alpha);
+        double scale = even.inverseMass[0] * change / length;
+        outerLambda[0] += change;
+        x += scale * x;
+        y += scale * y;
+        ++begin;
+    }
+    if (end > begin) {
+        projectLinks(&odd.x[begin - 1], &odd.y[begin - 1], &even.x[begin], &even.y[begin], &odd.inverseMass[begin - 1],
+            &even.inverseMass[begin], &outerRest[begin], &outerLambda[begin], end - begin, alpha);
+    }
+}
+
+// 3x3 matrices, row-major.
+static void invert3(const double* a, double* inverse) {
+    const double c0 = a[4] * a[8] - a[5] * a[7], c1 = a[5] * a[6] - a[3] * a[8], c2 = a[3] * a[7] - a[4] * a[6];
+    const double scale = 1.0 / (a[0] * c0 + a[1] * c1 + a[2] * c2);
+    inverse[0] = c0 * scale;
+    inverse[1] = (a[2] * a[7] - a[1] * a[8]) * scale;
+    inverse[2] = (a[1] * a[5] - a[2] * a[4]) * scale;
+    inverse[3] = c1 * scale;
+    inverse[4] = (a[0] * a[8] - a[2] * a[6]) * scale;
+    inverse[5] = (a[2] * a[3] - a[0] * a[5]) * scale;
+    inverse[6] = c2 * scale;
+    inverse[7] = (a[1] * a[6] - a[0] * a[7]) * scale;
+    inverse[8] = (a[0] * a[4] - a[1] * a[3]) * scale;
+}
+
+static void multiply3(const double* a, const double* b, double* product) {
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 3; ++column) {
+            product[3 * row + column] = a[3 * row] * b[column] + a[3 * row + 1] * b[3 + column] + a[3 * row + 2] * b[6 + column];
+        }
+    }
+}
+
+static void apply3(const double* a, const double* v, double* product) {
+    for (int row = 0; row < 3; ++row) {
+        product[row] = a[3 * row] * v[0] + a[3 * row + 1] * v[1] + a[3 * row + 2] * v[2];
+    }
+}
+
+// Unit vector and length of link i, from bob i - 1 (the pivot for i = 0)
+// to bob i.
+void Rope::direction(int i, double& nx, double& ny, double& length) const {
+    double x = 0.0, y = 0.0;
+    if (i > 0) {
+        position(i - 1, x, y);
+    }
+    const Colour& colour = i % 2 == 0 ? even : odd;
+    const double dx = colour.x[i / 2] - x, dy = colour.y[i / 2] - y;
+    length = std::sqrt(dx * dx + dy * dy);
+    nx = dx / length;
+    ny = dy / length;
+}
+
+// Row i of the Newton system, in z_i = (dlambda_i, dx_i, dy_i) of link i and
+// the bob at its end: lower z_{i-1} + diagonal z_i + upper z_{i+1}, with
+// P_i = s_i (I - n_i n_i^T) the geometric stiffness of link i,
+//   lower    = [ 0  -n_i^T ;  0  -P_i ]
+//   diagonal = [ alpha  n_i^T ;  -n_i  m_i I + P_i + P_{i+1} ]
+//   upper    = [ 0  0 ;  n_{i+1}  -P_{i+1} ]
+// Any of them may be null.
+void Rope::blocks(int i, double alpha, double* lower, double* diagonal, double* upper) const {
+    const double nx = directionX[i], ny = directionY[i], s = stiffness[i];
+    const double mx = i + 1 < count ? directionX[i + 1] : 0.0, my = i + 1 < count ? directionY[i + 1] : 0.0;
+    const double t = i + 1 < count ? stiffness[i + 1] : 0.0;
+    const double pxx = s * (1.0 - nx * nx), pxy = -s * nx * ny, pyy = s * (1.0 - ny * ny);
+    const double qxx = t * (1.0 - mx * mx), qxy = -t * mx * my, qyy = t * (1.0 - my * my);
+    if (lower) {
+        const double block[9] = { 0.0, -nx, -ny, 0.0, -pxx, -pxy, 0.0, -pxy, -pyy };
+        std::copy(block, block + 9, lower);
+    }
+    if (diagonal) {
+        const double mass = 1.0 / (i % 2 == 0 ? even : odd).inverseMass[i / 2];
+        const double block[9] = { alpha, nx, ny, -nx, mass + pxx + qxx, pxy + qxy, -ny, pxy + qxy, mass + pyy + qyy };
+        std::copy(block, block + 9, diagonal);
+    }
+    if (upper) {
+        const double block[9] = { 0.0, 0.0, 0.0, mx, -qxx, -qxy, my, -qxy, -qyy };
+        std::copy(block, block + 9, upper);
+    }
+}
+
+// One Newton step of the substep's positions and multipliers, together by
+// every thread. The right-hand side of link i is
+//   -(C_i + alpha lambda_i,  m_i (x_i - predicted_i) - n_i lambda_i + n_{i+1} lambda_{i+1})
+// and s_i = max(-lambda_i, 0) / length_i: only a link under tension (lambda
+// < 0) resists its bobs turning it. Each thread but the last keeps back
+// its last link to join its block to the next and eliminates the rest,
+// carrying how each row depends on the joining link before the block (the
+// spike), then expresses the first and last of them in terms of both
+// joining links; joinBlocks solves for those, and each thread substitutes
+// back through its own block. Returns false without moving
+// anything once every link and bob is within settings.tolerance of
+// solving its row, relative to the link's rest length.
+bool Rope::solveChain(int thread, int begin, int end, double hs) {
+    const double alpha = settings.compliance / (hs * hs);
+    const int first = 2 * begin, last = std::min(2 * end, count);
+    const int stop = thread + 1 < threadCount ? last - 1 : last;
+    Boundary& boundary = boundaries[thread];
+
+    // the next link is worked out again by each thread, so none writes
+    // another's
+    double residual = 0.0, nx, ny, length;
+    direction(first, nx, ny, length);
+    for (int i = first; i < last; ++i) {
+        const Colour& colour = i % 2 == 0 ? even : odd;
+        const int k = i / 2;
+        const double lambda = (i % 2 == 0 ? outerLambda : innerLambda)[k];
+        const double rest = (i % 2 == 0 ? outerRest : innerRest)[k];
+        double nextX = 0.0, nextY = 0.0, nextLength = 1.0, nextLambda = 0.0;
+        if (i + 1 < count) {
+            direction(i + 1, nextX, nextY, nextLength);
+            nextLambda = ((i + 1) % 2 == 0 ? outerLambda : innerLambda)[(i + 1) / 2];
+        }
+        directionX[i] = nx;
+        directionY[i] = ny;
+        stiffness[i] = std::max(-lambda, 0.0) / length;
+        const double mass = 1.0 / colour.inverseMass[k];
+        double* r = &right[3 * i];
+        r[0] = rest - length - alpha * lambda;
+        r[1] = nx * lambda - nextX * nextLambda - mass * (colour.x[k] - colour.px[k] - colour.vx[k] * hs);
+        r[2] = ny * lambda - nextY * nextLambda - mass * (colour.y[k] - colour.py[k] - colour.vy[k] * hs);
+        residual = std::max(residual, std::max(std::fabs(r[0]), std::max(std::fabs(r[1]), std::fabs(r[2])) / mass) / rest);
+        nx = nextX;
+        ny = nextY;
+        length = nextLength;
+    }
+    boundary.residual = residual;
+    wait();
+    for (const Boundary& other : boundaries) {
+        residual = std::max(residual, other.residual);
+    }
+    if (residual <= settings.tolerance) {
+        return false;
+    }
+
+    double lower[9], diagonal[9], upper[9], previous[9], factor[9], product[9], change[3];
+    for (int i = first; i < stop; ++i) {
+        blocks(i, alpha, lower, diagonal, upper);
+        double* r = &right[3 * i];
+        double* s = &spike[9 * i];
+        if (i > first) {
+            multiply3(lower, &inverse[9 * (i - 1)], factor);
+            multiply3(factor, previous, product);
+            apply3(factor, &right[3 * (i - 1)], change);
+            for (int e = 0; e < 9; ++e) {
+                diagonal[e] -= product[e];
+            }
+            for (int e = 0; e < 3; ++e) {
+                r[e] -= change[e];
+            }
+            if (thread > 0) {
+                multiply3(factor, &spike[9 * (i - 1)], product);
+                for (int e = 0; e < 9; ++e) {
+                    s[e] = -product[e];
+                }
+            }
+        }
+        else if (thread > 0) {
+            for (int e = 0; e < 9; ++e) {
+                s[e] = -lower[e];
+            }
+        }
+        invert3(diagonal, &inverse[9 * i]);
+        std::copy(upper, upper + 9, previous);
+    }
+
+    // z_i = value + left z_before + right z_after, from the last link up
+    double value[3], left[9], joined[9];
+    const int tail = stop - 1;
+    apply3(&inverse[9 * tail], &right[3 * tail], value);
+    if (thread > 0) {
+        multiply3(&inverse[9 * tail], &spike[9 * tail], left);
+    }
+    else {
+        std::fill(left, left + 9, 0.0);
+    }
+    std::fill(joined, joined + 9, 0.0);
+    if (thread + 1 < threadCount) {
+        multiply3(&inverse[9 * tail], previous, joined);
+        for (double& entry : joined) {
+            entry = -entry;
+        }
+    }
+    std::copy(value, value + 3, boundary.lastValue);
+    std::copy(left, left + 9, boundary.lastLeft);
+    std::copy(joined, joined + 9, boundary.lastRight);
+    if (thread > 0) {
+        for (int i = tail - 1; i >= first; --i) {
+            const double* solve = &inverse[9 * i];
+            blocks(i, alpha, nullptr, nullptr, upper);
+            apply3(upper, value, change);
+            for (int k = 0; k < 3; ++k) {
+                change[k] = right[3 * i + k] - change[k];
+            }
+            apply3(solve, change, value);
+            multiply3(upper, left, product);
+            for (int k = 0; k < 9; ++k) {
+                product[k] = spike[9 * i + k] - product[k];
+            }
+            multiply3(solve, product, left);
+            multiply3(upper, joined, product);
+            multiply3(solve, product, joined);
+            for (double& entry : joined) {
+                entry = -entry;
+            }
+        }
+        std::copy(value, value + 3, boundary.firstValue);
+        std::copy(left, left + 9, boundary.firstLeft);
+        std::copy(joined, joined + 9, boundary.firstRight);
+    }
+    if (threadCount > 1) {
+        wait();
+        if (thread == 0) {
+            joinBlocks(alpha);
+        }
+        wait();
+    }
+
+    const double none[3] = { 0.0, 0.0, 0.0 };
+    const double* before = thread > 0 ? boundaries[thread - 1].join : none;
+    double z[3] = { boundary.join[0], boundary.join[1], boundary.join[2] };
+    for (int i = stop - 1; i >= first; --i) {
+        blocks(i, alpha, nullptr, nullptr, upper);
+        apply3(upper, z, change);
+        for (int k = 0; k < 3; ++k) {
+            change[k] = right[3 * i + k] - change[k];
+        }
+        if (thread > 0) {
+            double pull[3];
+            apply3(&spike[9 * i], before, pull);
+            for (int k = 0; k < 3; ++k) {
+                change[k] += pull[k];
+            }
+        }
+        apply3(&inverse[9 * i], change, z);
+        move(i, z);
+    }
+    if (thread + 1 < threadCount) {
+        move(last - 1, boundary.join);
+    }
+    wait();
+    return true;
+}
+
+// The joining links' rows with the blocks' ends substituted in form a
+// block tridiagonal system of one row per thread but the last, solved by
+// block elimination into each Boundary's join; the last thread's stays 0.
+void Rope::joinBlocks(double alpha) {
+    const int joins = threadCount - 1;
+    const int evens = (int)even.x.size();
+    std::vector<double> reducedInverse(9 * joins), reducedUpper(9 * joins), reducedRight(3 * joins);
+    double lower[9], diagonal[9], upper[9], product[9], factor[9], change[3];
+    for (int t = 0; t < joins; ++t) {
+        const int q = 2 * (int)((long long)evens * (t + 1) / threadCount) - 1;
+        const Boundary& before = boundaries[t];
+        const Boundary& after = boundaries[t + 1];
+        blocks(q, alpha, lower, diagonal, upper);
+        double* r = &reducedRight[3 * t];
+        std::copy(&right[3 * q], &right[3 * q] + 3, r);
+        apply3(lower, before.lastValue, change);
+        for (int k = 0; k < 3; ++k) {
+            r[k] -= change[k];
+        }
+        apply3(upper, after.firstValue, change);
+        for (int k = 0; k < 3; ++k) {
+            r[k] -= change[k];
+        }
+        multiply3(lower, before.lastRight, product);
+        for (int k = 0; k < 9; ++k) {
+            diagonal[k] += product[k];
+        }
+        multiply3(upper, after.firstLeft, product);
+        for (int k = 0; k < 9; ++k) {
+            diagonal[k] += product[k];
+        }
+        multiply3(upper, after.firstRight, &reducedUpper[9 * t]);
+        if (t > 0) {
+            double reducedLower[9];
+            multiply3(lower, before.lastLeft, reducedLower);
+            multiply3(reducedLower, &reducedInverse[9 * (t - 1)], factor);
+            multiply3(factor, &reducedUpper[9 * (t - 1)], product);
+            apply3(factor, &reducedRight[3 * (t - 1)], change);
+            for (int k = 0; k < 9; ++k) {
+                diagonal[k] -= product[k];
+            }
+            for (int k = 0; k < 3; ++k) {
+                r[k] -= change[k];
+            }
+        }
+        invert3(diagonal, &reducedInverse[9 * t]);
+    }
+    for (int t = joins - 1; t >= 0; --t) {
+        double* r = &reducedRight[3 * t];
+        if (t + 1 < joins) {
+            apply3(&reducedUpper[9 * t], boundaries[t + 1].join, change);
+            for (int k = 0; k < 3; ++k) {
+                r[k] -= change[k];
+            }
+        }
+        apply3(&reducedInverse[9 * t], r, boundaries[t].join);
+    }
+}
+
+void Rope::move(int i, const double* z) {
+    Colour& colour = i % 2 == 0 ? even : odd;
+    (i % 2 == 0 ? outerLambda : innerLambda)[i / 2] += z[0];
+    colour.x[i / 2] += z[1];
+    colour.y[i / 2] += z[2];
+}
+
+void Rope::tether(int begin, int end) {
+    for (Colour* c : { &even, &odd }) {
+        int stop = std::min(end, (int)c->x.size());
+        if (stop > begin) {
+            tetherBobs(&c->x[begin], &c->y[begin], &c->reach[begin], stop - begin);
+        }
+    }
+}
+
+void Rope::finish(int begin, int end, double hs) {
+    for (Colour* c : { &even, &odd }) {
+        int stop = std::min(end, (int)c->x.size());
+        if (stop > begin) {
+            finishBobs(&c->x[begin], &c->y[begin], &c->vx[begin], &c->vy[begin], &c->px[begin], &c->py[begin], stop - begin, hs);
+        }
+    }
+}
+
+int runRopeCommand(int argc, char** argv) {
+    int links = intArgument(argc, argv, "--links", 100000);
+    double span = floatArgument(argc, argv, "--rope-length", 2.0f);
+    double mass = floatArgument(argc, argv, "--rope-mass", 1.0f);
+    double angle = floatArgument(argc, argv, "--angle", 1.0f);
+    double g = floatArgument(argc, argv, "--g", G);
+    double time = floatArgument(argc, argv, "--time", 0.5f);
+    double h = std::atof(stringArgument(argc, argv, "--dt", "0.016666666666666667").c_str());
+    double bound = std::atof(stringArgument(argc, argv, "--max-stretch", "1e-3").c_str());
+    RopeSettings settings;
+    settings.substeps = intArgument(argc, argv, "--substeps", settings.substeps);
+    settings.iterations = intArgument(argc, argv, "--iterations", settings.iterations);
+    settings.sweeps = intArgument(argc, argv, "--sweeps", settings.sweeps);
+    settings.compliance = std::atof(stringArgument(argc, argv, "--compliance", "0").c_str());
+    settings.threads = intArgument(argc, argv, "--threads", 0);
+    settings.tethers = !hasArgument(argc, argv, "--no-tethers");
+    if (links < 1 || span <= 0.0 || mass <= 0.0 || time <= 0.0 || h <= 0.0 || bound <= 0.0 || settings.substeps < 1
+        || settings.iterations < 1 || settings.sweeps < 0 || settings.compliance < 0.0 || settings.threads < 0) {
+        std::cerr << "Invalid rope settings" << std::endl;
+        return -1;
+    }
+
+    std::vector<double> lengths(links, span / links), masses(links, mass / links);
+    std::vector<double> theta(links, angle), omega(links, 0.0);
+    Rope rope(lengths, masses, g, settings);
+    rope.fromAngles(theta.data(), omega.data());
+    double startEnergy = rope.energy();
+
+    long long frames = (long long)std::ceil(time / h);
+    double slowest = 0.0, total = 0.0, stretch = 0.0;
+    for (long long f = 0; f < frames; ++f) {
+        auto begin = std::chrono::steady_clock::now();
+        rope.advance(h);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        slowest = std::max(slowest, seconds);
+        total += seconds;
+        stretch = std::max(stretch, rope.largestStretch());
+    }
+    double x, y;
+    rope.position(links - 1, x, y);
+    std::cout << links << " links, " << settings.substeps << " substeps: " << total / frames * 1e3 << " ms per "
+        << h * 1e3 << " ms frame (slowest " << slowest * 1e3 << "), length " << rope.length() << " of " << span
+        << ", largest link stretch " << stretch
+        << ", energy " << startEnergy << " -> " << rope.energy() << ", tip (" << x << ", " << y << ")" << std::endl;
+    if (!(stretch <= bound)) {
+        std::cerr << "FAILED: a link stretched by " << stretch << ", past --max-stretch " << bound
+            << "; the constraints are not being solved, so raise --substeps or --iterations" << std::endl;
+        return -1;
+    }
+
+    if (links <= CHAIN_MAX_LINKS) {
+        // the same chain in generalized coordinates
+        ChainParameters chain;
+        chain.lengths = lengths;
+        chain.masses = masses;
+        chain.g = g;
+        std::vector<double> state(2 * links, 0.0);
+        std::fill(state.begin(), state.begin() + links, angle);
+        Rk4Stepper rk4(chain);
+        long long steps = frames * settings.substeps * 10;
+        for (long long k = 0; k < steps; ++k) {
+            rk4.advance(state.data(), frames * h / steps);
+        }
+        double rx = 0.0, ry = 0.0;
+        for (int i = 0; i < links; ++i) {
+            rx += lengths[i] * std::sin(state[i]);
+            ry -= lengths[i] * std::cos(state[i]);
+        }
+        rope.toAngles(theta.data(), omega.data());
+        double angleError = 0.0;
+        for (int i = 0; i < links; ++i) {
+            angleError = std::max(angleError, std::fabs(theta[i] - state[i]));
+        }
+        std::cout << "rigid chain tip (" << rx << ", " << ry << "), " << std::hypot(x - rx, y - ry) << " away, angles within "
+            << angleError << ", energy " << rk4.energy(state.data()) << std::endl;
+    }
+    return 0;
+}
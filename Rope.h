@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct RopeSettings {
+    int substeps = 20;          // per advance()
+    int iterations = 8;         // most chain solves per substep
+    int sweeps = 0;             // red-black sweeps per substep before the chain solves
+    double tolerance = 1e-6;    // relative link error at which the chain solves stop
+    double compliance = 0.0;    // inverse link stiffness, m/N; 0 is rigid
+    int threads = 0;            // 0 uses every core on long ropes, one thread on short ones
+    bool tethers = true;        // long-range attachments to the pivot
+};
+
+// Chain of point masses on distance constraints hanging from a pivot at the
+// origin, in maximal coordinates and stepped by extended position-based
+// dynamics with small substeps (XPBD). Each substep's positions x and
+// multipliers lambda solve
+//   M (x - predicted) = grad C^T lambda,   C(x) + alpha lambda = 0
+// by Newton steps. Taking (lambda_i, x_i, y_i) of link i and the bob at
+// its end as one unknown, each couples only to its neighbours, so the
+// Newton system is block tridiagonal with 3x3 blocks and solved in O(n).
+// Its bob blocks carry the links' geometric stiffness -lambda (I - n n^T)
+// / length, which holds a kinked rope under tension from flicking its
+// bobs sideways; without it the steps diverge once the rope is longer
+// than a few hundred links. The multipliers are kept from one substep to
+// the next, and start at the rope's static tension, so two to five steps
+// bring every link within the tolerance with substeps that need not grow
+// with the rope. Each thread eliminates a block of links down to its two
+// ends, one thread solves the small system joining the blocks' last links
+// and each thread then finishes its own block, four barriers per step.
+// Bobs with even and odd index are stored apart, so `sweeps` red-black
+// Gauss-Seidel sweeps (the links from an even bob to the next odd one all
+// at once, then those from odd to even) are unit-stride loops the compiler
+// vectorizes; the chain solves still run after them. The tethers keep each
+// bob within the rest length above it of the pivot should the solves stop
+// short of the tolerance. Energy is slowly lost to the implicit steps.
+class Rope {
+public:
+    Rope(const std::vector<double>& lengths, const std::vector<double>& masses, double g, const RopeSettings& settings);
+    ~Rope();
+
+    int links() const { return count; }
+
+    // Bob positions and velocities from link angles and rates, and back;
+    // toAngles keeps each angle within pi of the one already in `theta`.
+    void fromAngles(const double* theta, const double* omega);
+    void toAngles(double* theta, double* omega) const;
+
+    void advance(double h);
+
+    // Positions of bob i; interleaved x, y of all bobs for drawing.
+    void position(int i, double& x, double& y) const;
+    void positions(std::vector<float>& vertices) const;
+
+    double energy() const;
+    double largestStretch() const;      // relative, over all links
+    double length() const;
+
+private:
+    struct Colour {
+        std::vector<double> x, y, vx, vy, px, py, inverseMass, reach;
+    };
+
+    // What a thread's block of links leaves for joinBlocks: the Newton
+    // step z of its first and last eliminated link as value + left z_before
+    // + right z_after, z_before and z_after being the steps of the links
+    // joining it to the blocks before and after it, and, once solved, the
+    // step z_after.
+    struct Boundary {
+        double firstValue[3], firstLeft[9], firstRight[9];
+        double lastValue[3], lastLeft[9], lastRight[9];
+        double join[3];
+        double residual;
+    };
+
+    void worker(int thread);
+    void run(int thread);
+    void wait();
+    void predict(int begin, int end, double hs);
+    void solveInner(int begin, int end, double hs);
+    void solveOuter(int begin, int end, double hs);
+    void direction(int i, double& nx, double& ny, double& length) const;
+    void blocks(int i, double alpha, double* lower, double* diagonal, double* upper) const;
+    bool solveChain(int thread, int begin, int end, double hs);
+    void joinBlocks(double alpha);
+    void move(int i, const double* z);
+    void tether(int begin, int end);
+    void finish(int begin, int end, double hs);
+
+    int count;
+    double g;
+    RopeSettings settings;
+    Colour even, odd;
+    std::vector<double> innerRest, outerRest;       // links 2k -> 2k + 1 and 2k - 1 -> 2k
+    std::vector<double> innerLambda, outerLambda;
+    double lambdaStep = 1.0;        // substep the multipliers are scaled for
+    double rescale = 1.0;
+    // per link, in chain order, for solveChain: 9 per link for the
+    // matrices and 3 for the right-hand sides
+    std::vector<double> directionX, directionY, stiffness, inverse, spike, right;
+    std::vector<Boundary> boundaries;
+
+    int threadCount;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable started;
+    long long frame = 0;
+    bool stopping = false;
+    double step = 0.0;
+    std::atomic<int> arrived{ 0 };
+    std::atomic<long long> generation{ 0 };
+};
+
+int runRopeCommand(int argc, char** argv);
@@ -0,0 +1,273 @@
+#include "Scene.h"
+#include "Chain.h"
+#include "CommandLine.h"
+#include "Physics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+const int SCENE_BATCH = 64;     // chains a worker claims at a time
+
+int ChainScene::add(double x, double y, const ChainParameters& chain, const double* angles, const double* rates) {
+    owners.insert(owners.end(), chain.links(), chains());
+    offsets.push_back(links());
+    counts.push_back(chain.links());
+    anchorX.push_back(x);
+    anchorY.push_back(y);
+    gravity.push_back(chain.g);
+    lengths.insert(lengths.end(), chain.lengths.begin(), chain.lengths.end());
+    masses.insert(masses.end(), chain.masses.begin(), chain.masses.end());
+    theta.insert(theta.end(), angles, angles + chain.links());
+    omega.insert(omega.end(), rates, rates + chain.links());
+    return chains() - 1;
+}
+
+void ChainScene::clear() {
+    offsets.clear();
+    counts.clear();
+    owners.clear();
+    anchorX.clear();
+    anchorY.clear();
+    gravity.clear();
+    lengths.clear();
+    masses.clear();
+    theta.clear();
+    omega.clear();
+}
+
+void ChainScene::step(int chain, double h) {
+    const int n = counts[chain];
+    double* t = theta.data() + offsets[chain];
+    double* w = omega.data() + offsets[chain];
+    const double* L = lengths.data() + offsets[chain];
+    const double* M = masses.data() + offsets[chain];
+    double accel[CHAIN_MAX_LINKS], probeTheta[CHAIN_MAX_LINKS], probeOmega[CHAIN_MAX_LINKS];
+    double sumTheta[CHAIN_MAX_LINKS], sumOmega[CHAIN_MAX_LINKS];
+
+    chainAccel(n, t, w, L, M, gravity[chain], accel);
+    for (int i = 0; i < n; ++i) {
+        sumTheta[i] = w[i];
+        sumOmega[i] = accel[i];
+        probeTheta[i] = t[i] + 0.5 * h * w[i];
+        probeOmega[i] = w[i] + 0.5 * h * accel[i];
+    }
+    for (int stage = 1; stage < 4; ++stage) {
+        chainAccel(n, probeTheta, probeOmega, L, M, gravity[chain], accel);
+        double weight = stage < 3 ? 2.0 : 1.0;
+        double reach = stage < 2 ? 0.5 * h : h;
+        for (int i = 0; i < n; ++i) {
+            sumTheta[i] += weight * probeOmega[i];
+            sumOmega[i] += weight * accel[i];
+            probeTheta[i] = t[i] + reach * probeOmega[i];
+            probeOmega[i] = w[i] + reach * accel[i];
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        t[i] += h / 6.0 * sumTheta[i];
+        w[i] += h / 6.0 * sumOmega[i];
+    }
+}
+
+ChainScene::~ChainScene() {
+    stopWorkers();
+}
+
+void ChainScene::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+    workers.clear();
+    stopping = false;
+}
+
+void ChainScene::work() {
+    const int total = chains();
+    const int batches = (total + SCENE_BATCH - 1) / SCENE_BATCH;
+    for (int batch = next++; batch < batches; batch = next++) {
+        int end = std::min((batch + 1) * SCENE_BATCH, total);
+        for (int c = batch * SCENE_BATCH; c < end; ++c) {
+            for (int s = 0; s < stepCount; ++s) {
+                step(c, stepSize);
+            }
+        }
+    }
+    finished->wait();
+}
+
+void ChainScene::worker(long long seen) {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [&]() { return stopping || frame != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = frame;
+        }
+        work();
+    }
+}
+
+void ChainScene::advance(double h, int threads, int steps) {
+    const int batches = (chains() + SCENE_BATCH - 1) / SCENE_BATCH;
+    int threadCount = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+    threadCount = std::max(std::min(threadCount, batches), 1);
+    if (!finished || (int)workers.size() != threadCount - 1) {
+        stopWorkers();
+        finished.reset(new Barrier(threadCount));
+        for (int i = 1; i < threadCount; ++i) {
+            workers.emplace_back(&ChainScene::worker, this, frame);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stepSize = h;
+        stepCount = steps;
+        next = 0;
+        ++frame;
+    }
+    started.notify_all();
+    work();
+}
+
+double ChainScene::energy(int chain) const {
+    const int o = offsets[chain];
+    return chainEnergy(counts[chain], theta.data() + o, omega.data() + o, lengths.data() + o, masses.data() + o, gravity[chain]);
+}
+
+void ChainScene::tip(int chain, double& x, double& y) const {
+    x = anchorX[chain];
+    y = anchorY[chain];
+    for (int i = offsets[chain]; i < offsets[chain] + counts[chain]; ++i) {
+        x += lengths[i] * std::sin(theta[i]);
+        y -= lengths[i] * std::cos(theta[i]);
+    }
+}
+
+void ChainScene::vertices(float radius, int segments, std::vector<float>& lines, std::vector<int>& lineFirsts,
+    std::vector<int>& lineCounts, std::vector<float>& bobs, std::vector<int>& bobFirsts, std::vector<int>& bobCounts) const {
+    const int fan = segments + 2;
+    lines.resize(2 * (size_t)(links() + chains()));
+    bobs.resize(2 * (size_t)links() * fan);
+    lineFirsts.resize(chains());
+    lineCounts.resize(chains());
+    bobFirsts.resize(links());
+    bobCounts.assign(links(), fan);
+
+    std::vector<float> ringX(segments + 1), ringY(segments + 1);
+    for (int k = 0; k <= segments; ++k) {
+        ringX[k] = radius * std::cos(2.0f * (float)M_PI * k / segments);
+        ringY[k] = radius * std::sin(2.0f * (float)M_PI * k / segments);
+    }
+
+    for (int c = 0; c < chains(); ++c) {
+        // chain c's strip starts after the c earlier anchors and their links
+        int first = offsets[c] + c;
+        lineFirsts[c] = first;
+        lineCounts[c] = counts[c] + 1;
+        float x = (float)anchorX[c], y = (float)anchorY[c];
+        lines[2 * first] = x;
+        lines[2 * first + 1] = y;
+        for (int i = offsets[c]; i < offsets[c] + counts[c]; ++i) {
+            x += (float)(lengths[i] * std::sin(theta[i]));
+            y -= (float)(lengths[i] * std::cos(theta[i]));
+            int vertex = first + 1 + i - offsets[c];
+            lines[2 * vertex] = x;
+            lines[2 * vertex + 1] = y;
+
+            float* out = &bobs[2 * (size_t)i * fan];
+            bobFirsts[i] = i * fan;
+            out[0] = x;
+            out[1] = y;
+            for (int k = 0; k <= segments; ++k) {
+                out[2 + 2 * k] = x + ringX[k];
+                out[3 + 2 * k] = y + ringY[k];
+            }
+        }
+    }
+}
+
+int runSceneCommand(int argc, char** argv) {
+    ChainParameters chain;
+    bool valid = parseChainArguments(argc, argv, chain);
+    int count = intArgument(argc, argv, "--chains", 1000);
+    double angle = floatArgument(argc, argv, "--angle", 2.0f);
+    double spread = std::atof(stringArgument(argc, argv, "--spread", "1e-9").c_str());
+    double duration = floatArgument(argc, argv, "--time", 20.0f);
+    double h = std::atof(stringArgument(argc, argv, "--dt", "0.001").c_str());
+    double separation = floatArgument(argc, argv, "--separation", 0.1f);
+    int threads = intArgument(argc, argv, "--threads", 0);
+    if (!valid || count < 1 || duration <= 0.0 || h <= 0.0 || threads < 0) {
+        std::cerr << "Invalid scene settings" << std::endl;
+        return -1;
+    }
+
+    // a butterfly-effect wall: chain k starts k * spread further out
+    ChainScene scene;
+    std::vector<double> angles(chain.links()), rates(chain.links(), 0.0);
+    for (int k = 0; k < count; ++k) {
+        std::fill(angles.begin(), angles.end(), angle + k * spread);
+        scene.add(k % 32, -(k / 32), chain, angles.data(), rates.data());
+    }
+    std::vector<double> start(count);
+    for (int k = 0; k < count; ++k) {
+        start[k] = scene.energy(k);
+    }
+
+    long long steps = std::max((long long)(duration / h + 0.5), 1LL);
+    double seconds = 0.0, separated = -1.0;
+    std::vector<double> tipX(count), tipY(count);
+    // ten steps per dispatch to the workers, between looks at the tips
+    for (long long s = 0; s < steps;) {
+        int batch = (int)std::min<long long>(10, steps - s);
+        auto begin = std::chrono::steady_clock::now();
+        scene.advance(h, threads, batch);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        s += batch;
+        if (separated < 0.0) {
+            // tips measured from their own anchors
+            double reference, referenceY;
+            scene.tip(0, reference, referenceY);
+            for (int k = 1; k < count && separated < 0.0; ++k) {
+                double x, y;
+                scene.tip(k, x, y);
+                double dx = x - (k % 32) - reference, dy = y + (k / 32) - referenceY;
+                if (std::sqrt(dx * dx + dy * dy) > separation) {
+                    separated = s * h;
+                }
+            }
+        }
+    }
+    double drift = 0.0;
+    for (int k = 0; k < count; ++k) {
+        drift = std::max(drift, std::fabs(scene.energy(k) - start[k]));
+    }
+
+    std::vector<float> lines, bobs;
+    std::vector<int> lineFirsts, lineCounts, bobFirsts, bobCounts;
+    auto begin = std::chrono::steady_clock::now();
+    scene.vertices(PENDULUM_RADIUS, 16, lines, lineFirsts, lineCounts, bobs, bobFirsts, bobCounts);
+    double build = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::cout << count << " chains of " << chain.links() << " links: " << seconds * 1e9 / ((double)steps * scene.links())
+        << " ns per link and RK4 step, worst energy error " << drift << std::endl;
+    if (separated >= 0.0) {
+        std::cout << "a chain starting " << spread << " apart moved its tip " << separation << " from the first by t " << separated << std::endl;
+    }
+    else {
+        std::cout << "no tip moved " << separation << " from the first within t " << duration << std::endl;
+    }
+    std::cout << "vertices for two draw calls (" << lineFirsts.size() << " strips, " << bobFirsts.size() << " fans) built in "
+        << build * 1e3 << " ms" << std::endl;
+    return 0;
+}
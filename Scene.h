@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Barrier.h"
+#include "Stepper.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Many independent chains, each with its own anchor, links and gravity,
+// pooled in one set of arrays: chain c's links are offset(c) ..
+// offset(c) + links(c) - 1 of theta, omega and the parameters. Chains are
+// stepped in batches claimed by worker threads kept from one advance() to
+// the next, and all of them are turned into two vertex lists with
+// per-chain ranges, so every link is drawn by one multi-draw call and
+// every bob by another.
+class ChainScene {
+public:
+    std::vector<double> theta, omega;
+
+    ChainScene() = default;
+    ~ChainScene();
+    ChainScene(const ChainScene&) = delete;
+    ChainScene& operator=(const ChainScene&) = delete;
+
+    // Up to CHAIN_MAX_LINKS links; returns the chain's index.
+    int add(double anchorX, double anchorY, const ChainParameters& chain, const double* theta, const double* omega);
+    void clear();
+
+    int chains() const { return (int)offsets.size(); }
+    int links() const { return (int)lengths.size(); }
+    int links(int chain) const { return counts[chain]; }
+    int offset(int chain) const { return offsets[chain]; }
+    int owner(int link) const { return owners[link]; }
+    double length(int link) const { return lengths[link]; }
+    double mass(int link) const { return masses[link]; }
+    void anchor(int chain, double& x, double& y) const { x = anchorX[chain]; y = anchorY[chain]; }
+
+    // `steps` RK4 steps of every chain, each batch of chains taken through
+    // all of them by one worker; 0 threads uses every core. The workers
+    // wait between calls and are only started again when their number
+    // changes.
+    void advance(double h, int threads, int steps = 1);
+
+    double energy(int chain) const;
+    // Position of the last bob of a chain.
+    void tip(int chain, double& x, double& y) const;
+
+    // Line strips from each anchor through its chain's bobs, and a
+    // triangle fan of `segments` around every bob, with the first vertex
+    // and vertex count of each strip and fan, ready for glMultiDrawArrays.
+    void vertices(float radius, int segments, std::vector<float>& lines, std::vector<int>& lineFirsts,
+        std::vector<int>& lineCounts, std::vector<float>& bobs, std::vector<int>& bobFirsts, std::vector<int>& bobCounts) const;
+
+private:
+    void step(int chain, double h);
+    void worker(long long seen);
+    void work();
+    void stopWorkers();
+
+    std::vector<int> offsets, counts, owners;
+    std::vector<double> anchorX, anchorY, gravity;
+    std::vector<double> lengths, masses;
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Barrier> finished;
+    std::mutex mutex;
+    std::condition_variable started;
+    long long frame = 0;
+    bool stopping = false;
+    double stepSize = 0.0;
+    int stepCount = 0;
+    std::atomic<int> next{ 0 };
+};
+
+int runSceneCommand(int argc, char** argv);
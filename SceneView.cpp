@@ -0,0 +1,132 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "SceneView.h"
+#include "Physics.h"
+#include "Scene.h"
+
+const int SCENE_VIEW_COLUMNS = 24;
+const int SCENE_VIEW_ROWS = 24;
+const double SCENE_VIEW_SPREAD = 1e-6;     // between neighbouring starting angles
+const double SCENE_VIEW_ANGLE = 2.0;
+const int SCENE_VIEW_SEGMENTS = 8;
+
+const char* sceneVertexShaderSource = R"(
+#version 330 core
+layout(location = 0) in vec2 aPos;
+void main()
+{
+    gl_Position = vec4(aPos * 0.5, 0.0, 1.0);
+}
+)";
+
+const char* sceneFragmentShaderSource = R"(
+#version 330 core
+out vec4 FragColor;
+uniform vec3 color;
+void main()
+{
+    FragColor = vec4(color, 1.0);
+}
+)";
+
+static bool sceneEnabled = false;
+static ChainScene scene;
+static std::vector<float> lines, bobs;
+static std::vector<int> lineFirsts, lineCounts, bobFirsts, bobCounts;
+static unsigned int sceneShader = 0, sceneVAO = 0, sceneVBO = 0;
+
+static unsigned int compileSceneShader() {
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &sceneVertexShaderSource, nullptr);
+    glCompileShader(vertexShader);
+
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &sceneFragmentShaderSource, nullptr);
+    glCompileShader(fragmentShader);
+
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    return program;
+}
+
+// the view spans -2..2 both ways; each chain gets a cell of the grid
+static void startScene() {
+    scene.clear();
+    double cell = 4.0 / SCENE_VIEW_COLUMNS;
+    ChainParameters chain;
+    chain.lengths.assign(2, 0.22 * cell);
+    chain.masses.assign(2, INITIAL_MASS);
+    chain.g = G;
+    double rates[2] = { 0.0, 0.0 };
+    for (int row = 0; row < SCENE_VIEW_ROWS; ++row) {
+        for (int column = 0; column < SCENE_VIEW_COLUMNS; ++column) {
+            int k = row * SCENE_VIEW_COLUMNS + column;
+            double angles[2] = { SCENE_VIEW_ANGLE + k * SCENE_VIEW_SPREAD, SCENE_VIEW_ANGLE + k * SCENE_VIEW_SPREAD };
+            scene.add(-2.0 + (column + 0.5) * cell, 2.0 - (row + 0.5) * cell, chain, angles, rates);
+        }
+    }
+}
+
+void initSceneView(int width, int height) {
+    (void)width;
+    (void)height;
+    sceneShader = compileSceneShader();
+    glGenVertexArrays(1, &sceneVAO);
+    glGenBuffers(1, &sceneVBO);
+    glBindVertexArray(sceneVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, sceneVBO);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void shutdownSceneView() {
+    scene.clear();
+    glDeleteVertexArrays(1, &sceneVAO);
+    glDeleteBuffers(1, &sceneVBO);
+    glDeleteProgram(sceneShader);
+}
+
+bool sceneViewActive() {
+    return sceneEnabled;
+}
+
+void toggleSceneView() {
+    sceneEnabled = !sceneEnabled;
+    if (sceneEnabled) {
+        startScene();
+    }
+}
+
+void renderSceneView() {
+    scene.advance(dt, 0);
+    scene.vertices(0.25f * PENDULUM_RADIUS, SCENE_VIEW_SEGMENTS, lines, lineFirsts, lineCounts, bobs, bobFirsts, bobCounts);
+
+    // links and bobs share one buffer, bobs after the links
+    const int lineVertices = (int)lines.size() / 2;
+    for (int& first : bobFirsts) {
+        first += lineVertices;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, sceneVBO);
+    glBufferData(GL_ARRAY_BUFFER, (lines.size() + bobs.size()) * sizeof(float), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, lines.size() * sizeof(float), lines.data());
+    glBufferSubData(GL_ARRAY_BUFFER, lines.size() * sizeof(float), bobs.size() * sizeof(float), bobs.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUseProgram(sceneShader);
+    int colorLocation = glGetUniformLocation(sceneShader, "color");
+    glBindVertexArray(sceneVAO);
+    glUniform3f(colorLocation, 0.6f, 0.6f, 0.6f);
+    glMultiDrawArrays(GL_LINE_STRIP, lineFirsts.data(), lineCounts.data(), (GLsizei)lineFirsts.size());
+    glUniform3f(colorLocation, 1.0f, 0.0f, 0.0f);
+    glMultiDrawArrays(GL_TRIANGLE_FAN, bobFirsts.data(), bobCounts.data(), (GLsizei)bobFirsts.size());
+    glBindVertexArray(0);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Live view of a wall of chains: double pendulums started a hair apart on
+// a grid, all stepped together each frame and drawn with two multi-draw
+// calls.
+void initSceneView(int width, int height);
+void shutdownSceneView();
+
+bool sceneViewActive();
+void toggleSceneView();
+
+void renderSceneView();
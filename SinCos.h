@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cmath>
+#include <type_traits>
+
+// Sine and cosine in straight-line arithmetic, so loops calling them
+// vectorize without -ffast-math or a vector math library. The angle is
+// reduced by the nearest multiple k of pi/2, subtracted in three parts
+// (Cody-Waite) so the remainder stays exact while |k| < 2^20, and the fdlibm
+// minimax polynomials on [-pi/4, pi/4] give sine and cosine of the
+// remainder, within a couple of ulp of std::sin and std::cos in double.
+// k is rounded by adding and removing 1.5 * 2^mantissa, which needs the
+// default rounding mode and no reassociation (/fp:precise, no -ffast-math).
+// NaN and infinity come back as NaN.
+template<typename T>
+inline void sinCos(T x, T& sine, T& cosine) {
+    const bool single = std::is_same<T, float>::value;
+    const T magic = single ? T(12582912.0) : T(6755399441055744.0);
+    const T part1 = single ? T(1.5703125) : T(1.57079632673412561417e+00);
+    const T part2 = single ? T(4.837512969970703125e-4) : T(6.07710050630396597660e-11);
+    const T part3 = single ? T(7.54978995489188216e-8) : T(2.02226624879595063154e-21);
+
+    T k = (x * T(0.63661977236758134308) + magic) - magic;
+    // out-of-range and NaN angles take quadrant 0 rather than an undefined conversion
+    const int quadrant = (int)(std::isless(std::fabs(k), T(1e6)) ? k : T(0));
+    T r = ((x - k * part1) - k * part2) - k * part3;
+    T z = r * r;
+
+    T s = r + r * z * (T(-1.66666666666666324348e-01) + z * (T(8.33333333332248946124e-03)
+        + z * (T(-1.98412698298579493134e-04) + z * (T(2.75573137070700676789e-06)
+        + z * (T(-2.50507602534068634195e-08) + z * T(1.58969099521155010221e-10))))));
+    T c = T(1) - T(0.5) * z + z * z * (T(4.16666666666666019037e-02) + z * (T(-1.38888888888741095749e-03)
+        + z * (T(2.48015872894767294178e-05) + z * (T(-2.75573143513906633035e-07)
+        + z * (T(2.08757232129817482790e-09) + z * T(-1.13596475577881948265e-11))))));
+
+    T swappedS = quadrant & 1 ? c : s;
+    T swappedC = quadrant & 1 ? s : c;
+    sine = quadrant & 2 ? -swappedS : swappedS;
+    cosine = (quadrant + 1) & 2 ? -swappedC : swappedC;
+}
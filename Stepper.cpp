@@ -0,0 +1,148 @@
+#include "Stepper.h"
+#include "Chain.h"
+#include "CommandLine.h"
+#include "GaussLegendre.h"
+#include "Physics.h"
+#include "Projection.h"
+#include "Taylor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+double ChainStepper::energy(const double* state) const {
+    int n = chain.links();
+    return chainEnergy(n, state, state + n, chain.lengths.data(), chain.masses.data(), chain.g);
+}
+
+void SymplecticEulerStepper::advance(double* state, double h) {
+    int n = chain.links();
+    double accel[CHAIN_MAX_LINKS];
+    chainAccel(n, state, state + n, chain.lengths.data(), chain.masses.data(), chain.g, accel);
+    for (int i = 0; i < n; ++i) {
+        state[n + i] += accel[i] * h;
+        state[i] += state[n + i] * h;
+    }
+}
+
+void Rk2Stepper::advance(double* state, double h) {
+    int n = chain.links();
+    double rate[2 * CHAIN_MAX_LINKS], probe[2 * CHAIN_MAX_LINKS] = {};
+    chainDerivative(n, state, chain.lengths.data(), chain.masses.data(), chain.g, rate);
+    for (int i = 0; i < 2 * n; ++i) {
+        probe[i] = state[i] + 0.5 * h * rate[i];
+    }
+    chainDerivative(n, probe, chain.lengths.data(), chain.masses.data(), chain.g, rate);
+    for (int i = 0; i < 2 * n; ++i) {
+        state[i] += h * rate[i];
+    }
+}
+
+void Rk4Stepper::advance(double* state, double h) {
+    chainRk4Step(chain.links(), state, h, chain.lengths.data(), chain.masses.data(), chain.g);
+}
+
+std::unique_ptr<ChainStepper> makeStepper(const std::string& name, const ChainParameters& chain, double tolerance) {
+    const std::string suffix = "+project";
+    if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        std::unique_ptr<ChainStepper> inner = makeStepper(name.substr(0, name.size() - suffix.size()), chain, tolerance);
+        return inner ? std::unique_ptr<ChainStepper>(new EnergyProjectionStepper(std::move(inner))) : nullptr;
+    }
+    if (name == "euler") {
+        return std::unique_ptr<ChainStepper>(new SymplecticEulerStepper(chain));
+    }
+    if (name == "rk2") {
+        return std::unique_ptr<ChainStepper>(new Rk2Stepper(chain));
+    }
+    if (name == "rk4") {
+        return std::unique_ptr<ChainStepper>(new Rk4Stepper(chain));
+    }
+    if (name == "gauss2" || name == "gauss3") {
+        return std::unique_ptr<ChainStepper>(new GaussLegendreStepper(chain, name == "gauss2" ? 2 : 3));
+    }
+    if (name == "taylor") {
+        TaylorSettings settings;
+        settings.tolerance = tolerance;
+        return std::unique_ptr<ChainStepper>(new TaylorStepper(chain, settings));
+    }
+    return nullptr;
+}
+
+bool parseChainArguments(int argc, char** argv, ChainParameters& chain) {
+    int links = intArgument(argc, argv, "--links", 2);
+    std::vector<double> lengths = parseValues(findArgument(argc, argv, "--length"), INITIAL_LENGTH);
+    std::vector<double> masses = parseValues(findArgument(argc, argv, "--mass"), INITIAL_MASS);
+    chain.g = floatArgument(argc, argv, "--g", G);
+    if (links < 1 || links > CHAIN_MAX_LINKS || lengths.empty() || masses.empty()
+        || ((int)lengths.size() != 1 && (int)lengths.size() != links) || ((int)masses.size() != 1 && (int)masses.size() != links)) {
+        return false;
+    }
+    chain.lengths.resize(links);
+    chain.masses.resize(links);
+    for (int i = 0; i < links; ++i) {
+        chain.lengths[i] = lengths[std::min(i, (int)lengths.size() - 1)];
+        chain.masses[i] = masses[std::min(i, (int)masses.size() - 1)];
+        if (chain.lengths[i] <= 0.0 || chain.masses[i] <= 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int runDriftCommand(int argc, char** argv) {
+    ChainParameters chain;
+    bool valid = parseChainArguments(argc, argv, chain);
+    int n = chain.links();
+    std::string integrator = stringArgument(argc, argv, "--integrator", "gauss2");
+    std::vector<double> angles = parseValues(findArgument(argc, argv, "--angles"), 1.0);
+    std::vector<double> omegas = parseValues(findArgument(argc, argv, "--omegas"), 0.0);
+    double h = std::atof(stringArgument(argc, argv, "--dt", "0.02").c_str());
+    long long steps = (long long)std::atof(stringArgument(argc, argv, "--steps", "1e6").c_str());
+    long long report = (long long)std::atof(stringArgument(argc, argv, "--report", "0").c_str());
+    double tolerance = std::atof(stringArgument(argc, argv, "--tolerance", "1e-12").c_str());
+    int projectEvery = intArgument(argc, argv, "--project", 0);
+    std::unique_ptr<ChainStepper> stepper = makeStepper(integrator, chain, tolerance);
+    if (stepper && projectEvery > 0) {
+        stepper.reset(new EnergyProjectionStepper(std::move(stepper), projectEvery));
+    }
+    valid = valid && stepper && h > 0.0 && steps > 0 && report >= 0 && projectEvery >= 0 && !angles.empty() && !omegas.empty();
+    if (!valid) {
+        std::cerr << "Invalid drift settings" << std::endl;
+        return -1;
+    }
+    if (report == 0) {
+        report = std::max(steps / 20, 1LL);
+    }
+
+    std::vector<double> state(2 * n);
+    for (int i = 0; i < n; ++i) {
+        state[i] = angles[std::min(i, (int)angles.size() - 1)];
+        state[n + i] = omegas[std::min(i, (int)omegas.size() - 1)];
+    }
+    double start = stepper->energy(state.data());
+    double worst = 0.0;
+    auto begin = std::chrono::steady_clock::now();
+    for (long long k = 1; k <= steps; ++k) {
+        stepper->advance(state.data(), h);
+        double error = std::fabs(stepper->energy(state.data()) - start);
+        worst = std::max(worst, error);
+        if (k % report == 0 || k == steps) {
+            std::cout << "t " << k * h << ": energy error " << error << ", worst " << worst << std::endl;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << stepper->name() << " dt " << h << ": " << steps << " steps, " << seconds * 1e9 / steps
+        << " ns per step, worst energy error " << worst << " of " << std::fabs(start);
+    if (GaussLegendreStepper* gauss = dynamic_cast<GaussLegendreStepper*>(stepper.get())) {
+        std::cout << ", " << (double)gauss->iterations() / steps << " iterations per step, "
+            << gauss->refreshes() << " refactorizations, " << gauss->splits() << " split steps, "
+            << gauss->failures() << " unconverged steps";
+    }
+    if (EnergyProjectionStepper* projection = dynamic_cast<EnergyProjectionStepper*>(stepper.get())) {
+        std::cout << ", " << projection->projections() << " projections moving omega by " << projection->meanCorrection()
+            << " on average and " << projection->largestCorrection() << " at most, " << projection->skipped() << " skipped";
+    }
+    std::cout << std::endl;
+    return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ChainParameters {
+    std::vector<double> lengths{ 0.7, 0.7 };
+    std::vector<double> masses{ 1.0, 1.0 };
+    double g = 9.81;
+
+    int links() const { return (int)lengths.size(); }
+};
+
+// Common interface of the chain integrators. States are theta_1..theta_n
+// followed by omega_1..omega_n. Fixed-step methods take one step of h per
+// advance(); adaptive ones take as many internal steps as they need to
+// cover h.
+class ChainStepper {
+public:
+    explicit ChainStepper(const ChainParameters& chain) : chain(chain) {}
+    virtual ~ChainStepper() {}
+
+    virtual void advance(double* state, double h) = 0;
+    virtual std::string name() const = 0;
+
+    const ChainParameters& parameters() const { return chain; }
+    int size() const { return 2 * chain.links(); }
+    double energy(const double* state) const;
+
+protected:
+    ChainParameters chain;
+};
+
+// The update of the live view: omega from the accelerations, then theta
+// from the new omega.
+class SymplecticEulerStepper : public ChainStepper {
+public:
+    using ChainStepper::ChainStepper;
+    void advance(double* state, double h) override;
+    std::string name() const override { return "euler"; }
+};
+
+// Explicit midpoint; cheap and second order, for coarse propagators.
+class Rk2Stepper : public ChainStepper {
+public:
+    using ChainStepper::ChainStepper;
+    void advance(double* state, double h) override;
+    std::string name() const override { return "rk2"; }
+};
+
+class Rk4Stepper : public ChainStepper {
+public:
+    using ChainStepper::ChainStepper;
+    void advance(double* state, double h) override;
+    std::string name() const override { return "rk4"; }
+};
+
+// "euler", "rk2", "rk4", "gauss2", "gauss3" or "taylor" (adaptive, to
+// `tolerance`), any of them followed by "+project" to project onto the
+// starting energy after every step; null for an unknown name.
+std::unique_ptr<ChainStepper> makeStepper(const std::string& name, const ChainParameters& chain, double tolerance);
+
+// Fills chain from --links, --length and --mass (one value or one per link)
+// and --g; false if they do not describe a chain.
+bool parseChainArguments(int argc, char** argv, ChainParameters& chain);
+
+// Energy error of a long fixed-step run with any integrator, sampled every
+// --report steps, with the cost per step; --project K projects onto the
+// starting energy every K steps.
+int runDriftCommand(int argc, char** argv);
@@ -0,0 +1,471 @@
+#include "Sweep.h"
+#include "CommandLine.h"
+#include "Lyapunov.h"
+#include "Physics.h"
+#include "ResultCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+const char* SWEEP_MANIFEST = "manifest.txt";
+const char* SWEEP_RESULTS = "results.csv";
+const char* SWEEP_TABLE = "summary.csv";
+const char* SWEEP_RESULTS_HEADER = "id,g,lengthRatio,massRatio,energy,energyDrift,flips,lyapunov,check";
+const int SWEEP_DRIFT_EVERY = 10;
+const size_t SWEEP_BATCH = 16;
+
+static bool syncFile(FILE* file) {
+    if (std::fflush(file) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Replaces `path` with `content` through a synced temporary file, so a
+// crash leaves either the old file or the whole new one.
+static bool replaceFile(const std::string& path, const std::string& content) {
+    std::string temp = path + ".tmp";
+    FILE* file = std::fopen(temp.c_str(), "wb");
+    bool written = file && std::fwrite(content.data(), 1, content.size(), file) == content.size() && syncFile(file);
+    if (file) {
+        written = std::fclose(file) == 0 && written;
+    }
+    std::error_code error;
+    if (written) {
+        fs::rename(temp, path, error);
+    }
+    if (!written || error) {
+        fs::remove(temp, error);
+        return false;
+    }
+    return true;
+}
+
+void sweepInitialState(const SweepJob& job, const SweepSettings& s, double state[4]) {
+    double L1 = s.length, L2 = s.length * job.lengthRatio;
+    double M1 = s.mass, M2 = s.mass * job.massRatio;
+    double scale = ((M1 + M2) * L1 + M2 * L2) * job.g;
+    double energy = std::max(job.energy, 0.0);
+
+    // potential above the rest state with both arms at theta is scale * (1 - cos theta)
+    if (energy <= 2.0 * scale) {
+        state[0] = state[1] = std::acos(1.0 - energy / scale);
+        state[2] = state[3] = 0.0;
+    }
+    else {
+        state[0] = state[1] = M_PI;
+        state[2] = std::sqrt(2.0 * (energy - 2.0 * scale) / ((M1 + M2) * L1 * L1));
+        state[3] = 0.0;
+    }
+}
+
+std::vector<SweepMetrics> runSweepJobs(const std::vector<SweepJob>& jobs, const SweepSettings& s) {
+    std::vector<SweepMetrics> results(jobs.size());
+
+    // the whole batch is stepped together in tangent space, and the drift and
+    // flips are read off the same base trajectories
+    std::vector<LyapunovMember> members(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        double state[4];
+        sweepInitialState(jobs[i], s, state);
+        LyapunovMember& m = members[i];
+        m.theta1 = state[0];
+        m.theta2 = state[1];
+        m.omega1 = state[2];
+        m.omega2 = state[3];
+        m.L1 = s.length;
+        m.L2 = s.length * jobs[i].lengthRatio;
+        m.M1 = s.mass;
+        m.M2 = s.mass * jobs[i].massRatio;
+        m.g = jobs[i].g;
+    }
+    LyapunovSettings lyapunov;
+    lyapunov.dt = s.dt;
+    lyapunov.time = s.time;
+    lyapunov.threads = 1;
+    lyapunov.energyEvery = SWEEP_DRIFT_EVERY;
+    std::vector<LyapunovOrbit> orbits;
+    std::vector<double> exponents = computeLyapunovExponents(members, lyapunov, &orbits);
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const LyapunovMember& m = members[i];
+        double scale = ((m.M1 + m.M2) * m.L1 + m.M2 * m.L2) * m.g;
+        results[i].energyDrift = orbits[i].energyDrift / scale;
+        results[i].flips = orbits[i].flips;
+        results[i].lyapunov = exponents[i];
+    }
+    return results;
+}
+
+SweepMetrics runSweepJob(const SweepJob& job, const SweepSettings& s) {
+    return runSweepJobs(std::vector<SweepJob>(1, job), s)[0];
+}
+
+static CacheKey sweepCacheKey(const SweepJob& job, const SweepSettings& s) {
+    CacheKey key("sweep");
+    key.add("equations", EQUATIONS_VERSION)
+        .add("integrator", std::string("symplectic-euler"))
+        .add("metrics", std::string("drift,flips,lyapunov-tangent,one-orbit"))
+        .add("dt", s.dt).add("time", s.time).add("g", job.g)
+        .add("L1", s.length).add("L2", s.length * job.lengthRatio)
+        .add("M1", s.mass).add("M2", s.mass * job.massRatio)
+        .add("energy", job.energy);
+    return key;
+}
+
+static std::string formatResultRow(const SweepJob& job, const SweepMetrics& m) {
+    char buffer[512];
+    std::snprintf(buffer, sizeof(buffer), "%lld,%.17g,%.17g,%.17g,%.17g,%.9g,%lld,%.9g",
+        job.id, job.g, job.lengthRatio, job.massRatio, job.energy, m.energyDrift, m.flips, m.lyapunov);
+    std::string row(buffer);
+    std::snprintf(buffer, sizeof(buffer), ",%016llx", (unsigned long long)hashBytes(row.data(), row.size()));
+    return row + buffer;
+}
+
+// A row only counts as committed if it is complete and its check matches,
+// so a line torn by a crash is treated as not done.
+static bool parseResultRow(const std::string& line, long long& id) {
+    size_t comma = line.rfind(',');
+    if (comma == std::string::npos) {
+        return false;
+    }
+    std::string row = line.substr(0, comma);
+    char expected[17];
+    std::snprintf(expected, sizeof(expected), "%016llx", (unsigned long long)hashBytes(row.data(), row.size()));
+    if (line.substr(comma + 1) != expected) {
+        return false;
+    }
+    return std::sscanf(row.c_str(), "%lld", &id) == 1;
+}
+
+static bool writeManifest(const std::string& path, const SweepSettings& s, const std::vector<SweepJob>& jobs) {
+    std::ostringstream file;
+    file.precision(17);
+    file << "# pendulums sweep manifest v1\n";
+    file << "length " << s.length << "\nmass " << s.mass << "\ndt " << s.dt << "\ntime " << s.time << "\n";
+    for (const SweepJob& job : jobs) {
+        file << "job " << job.id << " " << job.g << " " << job.lengthRatio << " " << job.massRatio << " " << job.energy << "\n";
+    }
+    return replaceFile(path, file.str());
+}
+
+static bool readManifest(const std::string& path, SweepSettings& s, std::vector<SweepJob>& jobs) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string field;
+        stream >> field;
+        if (field == "length") stream >> s.length;
+        else if (field == "mass") stream >> s.mass;
+        else if (field == "dt") stream >> s.dt;
+        else if (field == "time") stream >> s.time;
+        else if (field == "job") {
+            SweepJob job;
+            stream >> job.id >> job.g >> job.lengthRatio >> job.massRatio >> job.energy;
+            if (stream) {
+                jobs.push_back(job);
+            }
+        }
+    }
+    return !jobs.empty();
+}
+
+// Reads the committed rows, rewriting the journal without a torn tail;
+// false if that rewrite failed, since rows appended after a torn line
+// would be lost with it.
+static bool readCompleted(const std::string& path, std::vector<std::string>& rows, std::set<long long>& done) {
+    std::ifstream file(path, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    bool torn = false;
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string::npos) {
+            torn = true;
+            break;
+        }
+        std::string line = content.substr(start, end - start);
+        start = end + 1;
+        long long id;
+        if (line == SWEEP_RESULTS_HEADER) {
+            continue;
+        }
+        if (parseResultRow(line, id) && done.insert(id).second) {
+            rows.push_back(line);
+        }
+        else {
+            torn = true;
+        }
+    }
+
+    if (torn) {
+        std::string clean = std::string(SWEEP_RESULTS_HEADER) + "\n";
+        for (const std::string& row : rows) {
+            clean += row + "\n";
+        }
+        return replaceFile(path, clean);
+    }
+    return true;
+}
+
+// The settings and job grid the command line asks for.
+static void requestedSweep(int argc, char** argv, SweepSettings& settings, std::vector<SweepJob>& jobs) {
+    settings.length = floatArgument(argc, argv, "--length", INITIAL_LENGTH);
+    settings.mass = floatArgument(argc, argv, "--mass", INITIAL_MASS);
+    settings.dt = floatArgument(argc, argv, "--dt", (float)settings.dt);
+    settings.time = floatArgument(argc, argv, "--time", (float)settings.time);
+
+    std::vector<double> gs = parseValues(findArgument(argc, argv, "--g"), G);
+    std::vector<double> lengthRatios = parseValues(findArgument(argc, argv, "--length-ratio"), 1.0);
+    std::vector<double> massRatios = parseValues(findArgument(argc, argv, "--mass-ratio"), 1.0);
+    std::vector<double> energies = parseValues(findArgument(argc, argv, "--energy"), 10.0);
+    for (double g : gs) {
+        for (double lengthRatio : lengthRatios) {
+            for (double massRatio : massRatios) {
+                for (double energy : energies) {
+                    SweepJob job;
+                    job.id = (long long)jobs.size();
+                    job.g = g;
+                    job.lengthRatio = lengthRatio;
+                    job.massRatio = massRatio;
+                    job.energy = energy;
+                    jobs.push_back(job);
+                }
+            }
+        }
+    }
+}
+
+// The distinct values of one job field, in the order the grid first
+// takes them.
+static std::vector<double> sweepAxis(const std::vector<SweepJob>& jobs, double SweepJob::*field) {
+    std::vector<double> values;
+    for (const SweepJob& job : jobs) {
+        if (std::find(values.begin(), values.end(), job.*field) == values.end()) {
+            values.push_back(job.*field);
+        }
+    }
+    return values;
+}
+
+// The arguments given on the command line that disagree with a saved
+// sweep, each with the value asked for and the saved one; empty if none
+// do. Arguments left out take the saved values. The manifest holds 17
+// digits, so equal values read back exactly.
+static std::string sweepDifference(int argc, char** argv, const SweepSettings& saved, const std::vector<SweepJob>& savedJobs,
+    const SweepSettings& wanted) {
+    std::ostringstream difference;
+    auto compare = [&](const char* name, std::vector<double> asked, const std::vector<double>& had) {
+        if (!hasArgument(argc, argv, name)) {
+            return;
+        }
+        std::vector<double> distinct;
+        for (double value : asked) {
+            if (std::find(distinct.begin(), distinct.end(), value) == distinct.end()) {
+                distinct.push_back(value);
+            }
+        }
+        if (distinct == had) {
+            return;
+        }
+        difference << (difference.tellp() > 0 ? "; " : "") << name << " ";
+        for (size_t i = 0; i < asked.size(); ++i) {
+            difference << (i > 0 ? "," : "") << asked[i];
+        }
+        difference << " where it has ";
+        for (size_t i = 0; i < had.size(); ++i) {
+            difference << (i > 0 ? "," : "") << had[i];
+        }
+    };
+    compare("--length", { wanted.length }, { saved.length });
+    compare("--mass", { wanted.mass }, { saved.mass });
+    compare("--dt", { wanted.dt }, { saved.dt });
+    compare("--time", { wanted.time }, { saved.time });
+    compare("--g", parseValues(findArgument(argc, argv, "--g"), G), sweepAxis(savedJobs, &SweepJob::g));
+    compare("--length-ratio", parseValues(findArgument(argc, argv, "--length-ratio"), 1.0), sweepAxis(savedJobs, &SweepJob::lengthRatio));
+    compare("--mass-ratio", parseValues(findArgument(argc, argv, "--mass-ratio"), 1.0), sweepAxis(savedJobs, &SweepJob::massRatio));
+    compare("--energy", parseValues(findArgument(argc, argv, "--energy"), 10.0), sweepAxis(savedJobs, &SweepJob::energy));
+    return difference.str();
+}
+
+int runSweepCommand(int argc, char** argv) {
+    configureResultCache(argc, argv);
+    ResultCache* cache = resultCache();
+
+    std::string directory = stringArgument(argc, argv, "--dir", "sweep");
+    std::string manifestPath = (fs::path(directory) / SWEEP_MANIFEST).string();
+    std::string resultsPath = (fs::path(directory) / SWEEP_RESULTS).string();
+
+    SweepSettings settings, requested;
+    settings.threads = requested.threads = intArgument(argc, argv, "--threads", 0);
+    std::vector<SweepJob> jobs, requestedJobs;
+    requestedSweep(argc, argv, requested, requestedJobs);
+    bool forceNew = hasArgument(argc, argv, "--force-new");
+
+    if (!forceNew && readManifest(manifestPath, settings, jobs)) {
+        // a bare --dir resumes whatever is there; given arguments have to match it
+        std::string difference = sweepDifference(argc, argv, settings, jobs, requested);
+        if (!difference.empty()) {
+            std::cerr << "The sweep in " << directory << " was started with other settings (" << difference
+                << "); rerun with its own arguments or none to resume, or add --force-new to start over" << std::endl;
+            return -1;
+        }
+        std::cout << "Resuming sweep in " << directory << " (" << jobs.size() << " jobs)" << std::endl;
+    }
+    else {
+        settings = requested;
+        jobs = requestedJobs;
+        std::error_code error;
+        fs::create_directories(directory, error);
+        if (forceNew) {
+            fs::remove(resultsPath, error);
+            fs::remove(fs::path(directory) / SWEEP_TABLE, error);
+        }
+        if (jobs.empty() || settings.dt <= 0.0 || settings.time <= 0.0 || !writeManifest(manifestPath, settings, jobs)) {
+            std::cerr << "Failed to create sweep manifest in " << directory << std::endl;
+            return -1;
+        }
+        std::cout << "Created sweep in " << directory << " (" << jobs.size() << " jobs)" << std::endl;
+    }
+
+    std::vector<std::string> rows;
+    std::set<long long> done;
+    if (!readCompleted(resultsPath, rows, done)) {
+        std::cerr << "Failed to rewrite the torn end of " << resultsPath << std::endl;
+        return -1;
+    }
+    std::vector<SweepJob> pending;
+    for (const SweepJob& job : jobs) {
+        if (!done.count(job.id)) {
+            pending.push_back(job);
+        }
+    }
+    std::cout << done.size() << " already done, " << pending.size() << " to run" << std::endl;
+
+    std::error_code error;
+    bool fresh = !fs::exists(resultsPath, error) || fs::file_size(resultsPath, error) == 0;
+    FILE* journal = std::fopen(resultsPath.c_str(), "ab");
+    if (!journal) {
+        std::cerr << "Failed to open " << resultsPath << std::endl;
+        return -1;
+    }
+    if (fresh && (std::fprintf(journal, "%s\n", SWEEP_RESULTS_HEADER) < 0 || !syncFile(journal))) {
+        std::cerr << "Failed to write " << resultsPath << std::endl;
+        std::fclose(journal);
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next{ 0 };
+    std::atomic<long long> cacheHits{ 0 };
+    std::mutex journalMutex;
+    size_t completed = 0;
+    bool journalFailed = false;
+
+    int threadCount = std::max(settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency(), 1);
+    const size_t batch = std::max<size_t>(std::min(SWEEP_BATCH, pending.size() / threadCount), 1);
+
+    auto commit = [&](const SweepJob& job, const SweepMetrics& metrics) {
+        // one complete line per job, synced before the job counts as done
+        std::string row = formatResultRow(job, metrics) + "\n";
+        std::lock_guard<std::mutex> lock(journalMutex);
+        if (journalFailed) {
+            return;
+        }
+        if (std::fwrite(row.data(), 1, row.size(), journal) != row.size() || !syncFile(journal)) {
+            // the job is not done; stop handing out more and let a rerun resume
+            journalFailed = true;
+            next = pending.size();
+            return;
+        }
+        rows.push_back(row.substr(0, row.size() - 1));
+        if (++completed % std::max<size_t>(pending.size() / 20, 1) == 0 || completed == pending.size()) {
+            std::cout << completed << "/" << pending.size() << " jobs" << std::endl;
+        }
+    };
+
+    auto worker = [&]() {
+        for (size_t first = next.fetch_add(batch); first < pending.size(); first = next.fetch_add(batch)) {
+            std::vector<SweepJob> misses;
+            for (size_t i = first; i < std::min(first + batch, pending.size()); ++i) {
+                SweepMetrics metrics;
+                std::vector<char> payload;
+                if (cache && cache->load(sweepCacheKey(pending[i], settings), payload) && payload.size() == sizeof(metrics)) {
+                    std::memcpy(&metrics, payload.data(), sizeof(metrics));
+                    ++cacheHits;
+                    commit(pending[i], metrics);
+                }
+                else {
+                    misses.push_back(pending[i]);
+                }
+            }
+            if (misses.empty()) {
+                continue;
+            }
+
+            std::vector<SweepMetrics> results = runSweepJobs(misses, settings);
+            for (size_t i = 0; i < misses.size(); ++i) {
+                if (cache) {
+                    cache->store(sweepCacheKey(misses[i], settings), &results[i], sizeof(results[i]));
+                }
+                commit(misses[i], results[i]);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+    if (std::fclose(journal) != 0 || journalFailed) {
+        std::cerr << "Failed to write " << resultsPath << " after " << completed << " of " << pending.size()
+            << " jobs; rerun to resume" << std::endl;
+        return -1;
+    }
+
+    std::sort(rows.begin(), rows.end(), [](const std::string& a, const std::string& b) {
+        return std::atoll(a.c_str()) < std::atoll(b.c_str());
+    });
+    std::ofstream table((fs::path(directory) / SWEEP_TABLE).string());
+    table << "id,g,lengthRatio,massRatio,energy,energyDrift,flips,lyapunov\n";
+    for (const std::string& row : rows) {
+        table << row.substr(0, row.rfind(',')) << "\n";
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Sweep finished in " << seconds << " s (" << cacheHits << " from cache), table in "
+        << (fs::path(directory) / SWEEP_TABLE).string() << std::endl;
+    return table ? 0 : -1;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct SweepJob {
+    long long id = 0;
+    double g = 9.81;
+    double lengthRatio = 1.0;
+    double massRatio = 1.0;
+    double energy = 1.0;
+};
+
+struct SweepSettings {
+    double length = 0.7;
+    double mass = 1.0;
+    double dt = 0.001;
+    double time = 60.0;
+    int threads = 0;
+};
+
+struct SweepMetrics {
+    double energyDrift = 0.0;
+    long long flips = 0;
+    double lyapunov = 0.0;
+};
+
+// Double pendulum with L1 = length, M1 = mass, L2 = lengthRatio * L1 and
+// M2 = massRatio * M1, started with both arms at the same angle (plus a
+// kick to the first arm above the upright energy) so that its energy above
+// the hanging rest state equals job.energy.
+void sweepInitialState(const SweepJob& job, const SweepSettings& settings, double state[4]);
+// The batch version integrates the jobs' Lyapunov tangents side by side.
+SweepMetrics runSweepJob(const SweepJob& job, const SweepSettings& settings);
+std::vector<SweepMetrics> runSweepJobs(const std::vector<SweepJob>& jobs, const SweepSettings& settings);
+
+int runSweepCommand(int argc, char** argv);
@@ -0,0 +1,355 @@
+#include "Taylor.h"
+#include "Chain.h"
+#include "CommandLine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+const int TAYLOR_MIN_ORDER = 4;
+const int TAYLOR_MAX_ORDER = 40;
+
+// Scalar that records the operations done on it into a TaylorNode list
+// instead of computing them. Constants fold on the spot.
+struct TaylorTrace {
+    double constant;
+    int index;
+    std::vector<TaylorNode>* program;
+
+    TaylorTrace() : constant(0.0), index(-1), program(nullptr) {}
+    TaylorTrace(double value) : constant(value), index(-1), program(nullptr) {}
+
+    TaylorTrace& operator+=(const TaylorTrace& b);
+    TaylorTrace& operator-=(const TaylorTrace& b);
+    TaylorTrace& operator*=(const TaylorTrace& b);
+};
+
+static TaylorTrace recordNode(std::vector<TaylorNode>* program, TaylorOp op, int a, int b, double constant) {
+    TaylorNode node = { op, a, b, constant };
+    program->push_back(node);
+    TaylorTrace r;
+    r.program = program;
+    r.index = (int)program->size() - 1;
+    return r;
+}
+
+static int constantNode(std::vector<TaylorNode>* program, double value) {
+    return recordNode(program, TAYLOR_CONSTANT, -1, -1, value).index;
+}
+
+inline TaylorTrace operator+(const TaylorTrace& a, const TaylorTrace& b) {
+    if (!a.program && !b.program) return TaylorTrace(a.constant + b.constant);
+    if (!a.program) return recordNode(b.program, TAYLOR_ADD_CONSTANT, b.index, -1, a.constant);
+    if (!b.program) return recordNode(a.program, TAYLOR_ADD_CONSTANT, a.index, -1, b.constant);
+    return recordNode(a.program, TAYLOR_ADD, a.index, b.index, 0.0);
+}
+
+inline TaylorTrace operator*(const TaylorTrace& a, const TaylorTrace& b) {
+    if (!a.program && !b.program) return TaylorTrace(a.constant * b.constant);
+    if (!a.program) return recordNode(b.program, TAYLOR_SCALE, b.index, -1, a.constant);
+    if (!b.program) return recordNode(a.program, TAYLOR_SCALE, a.index, -1, b.constant);
+    return recordNode(a.program, TAYLOR_MUL, a.index, b.index, 0.0);
+}
+
+inline TaylorTrace operator-(const TaylorTrace& a) {
+    return a * TaylorTrace(-1.0);
+}
+
+inline TaylorTrace operator-(const TaylorTrace& a, const TaylorTrace& b) {
+    if (!a.program || !b.program) return a + (-b);
+    return recordNode(a.program, TAYLOR_SUB, a.index, b.index, 0.0);
+}
+
+inline TaylorTrace operator/(const TaylorTrace& a, const TaylorTrace& b) {
+    if (!b.program) return a * TaylorTrace(1.0 / b.constant);
+    int numerator = a.program ? a.index : constantNode(b.program, a.constant);
+    return recordNode(b.program, TAYLOR_DIV, numerator, b.index, 0.0);
+}
+
+inline TaylorTrace operator+(const TaylorTrace& a, double b) { return a + TaylorTrace(b); }
+inline TaylorTrace operator+(double a, const TaylorTrace& b) { return TaylorTrace(a) + b; }
+inline TaylorTrace operator-(const TaylorTrace& a, double b) { return a - TaylorTrace(b); }
+inline TaylorTrace operator-(double a, const TaylorTrace& b) { return TaylorTrace(a) - b; }
+inline TaylorTrace operator*(const TaylorTrace& a, double b) { return a * TaylorTrace(b); }
+inline TaylorTrace operator*(double a, const TaylorTrace& b) { return TaylorTrace(a) * b; }
+inline TaylorTrace operator/(const TaylorTrace& a, double b) { return a / TaylorTrace(b); }
+
+TaylorTrace& TaylorTrace::operator+=(const TaylorTrace& b) { *this = *this + b; return *this; }
+TaylorTrace& TaylorTrace::operator-=(const TaylorTrace& b) { *this = *this - b; return *this; }
+TaylorTrace& TaylorTrace::operator*=(const TaylorTrace& b) { *this = *this * b; return *this; }
+
+// sin and cos of an argument are always recorded together, since each
+// one's recurrence needs the other; asking for the second reuses the pair
+static TaylorTrace sinCos(const TaylorTrace& a, bool wantCos) {
+    if (!a.program) {
+        return TaylorTrace(wantCos ? std::cos(a.constant) : std::sin(a.constant));
+    }
+    std::vector<TaylorNode>& program = *a.program;
+    int sine = -1;
+    for (size_t i = 0; i < program.size(); ++i) {
+        if (program[i].op == TAYLOR_SIN && program[i].a == a.index) {
+            sine = (int)i;
+        }
+    }
+    if (sine < 0) {
+        sine = recordNode(a.program, TAYLOR_SIN, a.index, -1, 0.0).index;
+        recordNode(a.program, TAYLOR_COS, a.index, -1, 0.0);
+    }
+    TaylorTrace r;
+    r.program = a.program;
+    r.index = wantCos ? sine + 1 : sine;
+    return r;
+}
+
+inline TaylorTrace sin(const TaylorTrace& a) { return sinCos(a, false); }
+inline TaylorTrace cos(const TaylorTrace& a) { return sinCos(a, true); }
+
+TaylorStepper::TaylorStepper(const ChainParameters& chain, const TaylorSettings& settings)
+    : ChainStepper(chain), settings(settings) {
+    degree = settings.order > 0 ? settings.order
+        : (int)std::ceil(-0.5 * std::log(std::max(settings.tolerance, 1e-300)) + 1.0);
+    degree = std::min(std::max(degree, TAYLOR_MIN_ORDER), TAYLOR_MAX_ORDER);
+
+    int n = chain.links();
+    TaylorTrace state[2 * CHAIN_MAX_LINKS];
+    for (int i = 0; i < 2 * n; ++i) {
+        state[i] = recordNode(&program, TAYLOR_INPUT, -1, -1, 0.0);
+    }
+    TaylorTrace rate[2 * CHAIN_MAX_LINKS];
+    chainDerivative(n, state, chain.lengths.data(), chain.masses.data(), chain.g, rate);
+    for (int i = 0; i < 2 * n; ++i) {
+        outputs.push_back(rate[i].program ? rate[i].index : constantNode(&program, rate[i].constant));
+    }
+    coefficients.assign(program.size() * (degree + 1), 0.0);
+}
+
+void TaylorStepper::expand(const double* state) {
+    const int stride = degree + 1;
+    const int size = 2 * chain.links();
+    double* c = coefficients.data();
+    for (int i = 0; i < size; ++i) {
+        c[i * stride] = state[i];
+    }
+
+    for (int k = 0; k < degree; ++k) {
+        for (size_t node = size; node < program.size(); ++node) {
+            const TaylorNode& op = program[node];
+            double* out = c + node * stride;
+            const double* a = op.a >= 0 ? c + (size_t)op.a * stride : nullptr;
+            const double* b = op.b >= 0 ? c + (size_t)op.b * stride : nullptr;
+            switch (op.op) {
+            case TAYLOR_INPUT:
+                break;
+            case TAYLOR_CONSTANT:
+                out[k] = k == 0 ? op.constant : 0.0;
+                break;
+            case TAYLOR_ADD:
+                out[k] = a[k] + b[k];
+                break;
+            case TAYLOR_SUB:
+                out[k] = a[k] - b[k];
+                break;
+            case TAYLOR_ADD_CONSTANT:
+                out[k] = k == 0 ? a[k] + op.constant : a[k];
+                break;
+            case TAYLOR_SCALE:
+                out[k] = op.constant * a[k];
+                break;
+            case TAYLOR_MUL: {
+                double sum = 0.0;
+                for (int j = 0; j <= k; ++j) {
+                    sum += a[j] * b[k - j];
+                }
+                out[k] = sum;
+                break;
+            }
+            case TAYLOR_DIV: {
+                double sum = a[k];
+                for (int j = 1; j <= k; ++j) {
+                    sum -= b[j] * out[k - j];
+                }
+                out[k] = sum / b[0];
+                break;
+            }
+            case TAYLOR_SIN: {
+                double* cosine = out + stride;
+                if (k == 0) {
+                    out[0] = std::sin(a[0]);
+                    cosine[0] = std::cos(a[0]);
+                    break;
+                }
+                double sine = 0.0, cos = 0.0;
+                for (int j = 1; j <= k; ++j) {
+                    sine += j * a[j] * cosine[k - j];
+                    cos -= j * a[j] * out[k - j];
+                }
+                out[k] = sine / k;
+                cosine[k] = cos / k;
+                break;
+            }
+            case TAYLOR_COS:
+                break;
+            }
+        }
+        for (int i = 0; i < size; ++i) {
+            c[i * stride + k + 1] = c[(size_t)outputs[i] * stride + k] / (k + 1);
+        }
+    }
+}
+
+double TaylorStepper::step(double* state, double maxStep) {
+    const int stride = degree + 1;
+    const int size = 2 * chain.links();
+    expand(state);
+
+    double scale = 1.0;
+    double last = 0.0, previous = 0.0;
+    for (int i = 0; i < size; ++i) {
+        scale = std::max(scale, std::fabs(state[i]));
+        last = std::max(last, std::fabs(coefficients[i * stride + degree]));
+        previous = std::max(previous, std::fabs(coefficients[i * stride + degree - 1]));
+    }
+    double epsilon = settings.tolerance * scale;
+    double h = std::numeric_limits<double>::infinity();
+    if (previous > 0.0) h = std::min(h, std::pow(epsilon / previous, 1.0 / (degree - 1)));
+    if (last > 0.0) h = std::min(h, std::pow(epsilon / last, 1.0 / degree));
+    h *= std::exp(-0.7 / (degree - 1));
+    h = std::min(std::min(h, maxStep), settings.maxStep);
+
+    for (int i = 0; i < size; ++i) {
+        const double* x = &coefficients[i * stride];
+        double sum = x[degree];
+        for (int k = degree - 1; k >= 0; --k) {
+            sum = sum * h + x[k];
+        }
+        state[i] = sum;
+    }
+    ++stepCount;
+    return h;
+}
+
+void TaylorStepper::denseState(double t, double* out) const {
+    const int stride = degree + 1;
+    for (int i = 0; i < 2 * chain.links(); ++i) {
+        const double* x = &coefficients[i * stride];
+        double sum = x[degree];
+        for (int k = degree - 1; k >= 0; --k) {
+            sum = sum * t + x[k];
+        }
+        out[i] = sum;
+    }
+}
+
+void TaylorStepper::advance(double* state, double h) {
+    double done = 0.0;
+    while (done < h) {
+        double remaining = h - done;
+        double taken = step(state, remaining);
+        if (taken >= remaining) {
+            break;
+        }
+        done += taken;
+    }
+}
+
+static double stateDistance(const std::vector<double>& a, const std::vector<double>& b) {
+    double distance = 0.0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        distance = std::max(distance, std::fabs(a[i] - b[i]));
+    }
+    return distance;
+}
+
+int runTaylorCommand(int argc, char** argv) {
+    ChainParameters chain;
+    bool valid = parseChainArguments(argc, argv, chain);
+    int n = chain.links();
+    std::vector<double> angles = parseValues(findArgument(argc, argv, "--angles"), 1.0);
+    std::vector<double> omegas = parseValues(findArgument(argc, argv, "--omegas"), 0.0);
+    double time = floatArgument(argc, argv, "--time", 10.0f);
+    double tolerance = std::atof(stringArgument(argc, argv, "--tolerance", "1e-12").c_str());
+    int samples = intArgument(argc, argv, "--samples", 0);
+    std::string outPath = stringArgument(argc, argv, "--out", "taylor.csv");
+    valid = valid && time > 0.0 && tolerance > 0.0 && !angles.empty() && !omegas.empty() && samples >= 0;
+    if (!valid) {
+        std::cerr << "Invalid Taylor settings" << std::endl;
+        return -1;
+    }
+
+    std::vector<double> start(2 * n);
+    for (int i = 0; i < n; ++i) {
+        start[i] = angles[std::min(i, (int)angles.size() - 1)];
+        start[n + i] = omegas[std::min(i, (int)omegas.size() - 1)];
+    }
+
+    // reference at a thousandth of the tolerance
+    TaylorSettings referenceSettings;
+    referenceSettings.tolerance = std::max(tolerance * 1e-3, 1e-17);
+    TaylorStepper reference(chain, referenceSettings);
+    std::vector<double> exact = start;
+    reference.advance(exact.data(), time);
+
+    TaylorSettings settings;
+    settings.tolerance = tolerance;
+    TaylorStepper taylor(chain, settings);
+    std::ofstream dense;
+    if (samples > 0) {
+        dense.open(outPath);
+        if (!dense) {
+            std::cerr << "Failed to write " << outPath << std::endl;
+            return -1;
+        }
+        dense << "t";
+        for (int i = 0; i < n; ++i) dense << ",theta" << i + 1;
+        for (int i = 0; i < n; ++i) dense << ",omega" << i + 1;
+        dense << "\n" << std::setprecision(17);
+    }
+    std::vector<double> state = start, sample(2 * n);
+    int written = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (double t = 0.0; t < time;) {
+        double taken = taylor.step(state.data(), time - t);
+        // samples falling inside this step come from its polynomial
+        for (; written < samples; ++written) {
+            double sampleTime = time * written / std::max(samples - 1, 1);
+            if (sampleTime > t + taken) {
+                break;
+            }
+            taylor.denseState(sampleTime - t, sample.data());
+            dense << sampleTime;
+            for (double value : sample) dense << "," << value;
+            dense << "\n";
+        }
+        t = taken >= time - t ? time : t + taken;
+    }
+    double taylorSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double taylorError = stateDistance(state, exact);
+    std::cout << "taylor order " << taylor.order() << ": " << taylor.steps() << " steps in " << taylorSeconds
+        << " s, error " << taylorError << ", energy drift " << taylor.energy(state.data()) - taylor.energy(start.data())
+        << std::endl;
+
+    // halve the RK4 step until it is as accurate
+    Rk4Stepper rk4(chain);
+    for (double dt = 0.01; dt > 1e-6; dt *= 0.5) {
+        long long steps = (long long)std::ceil(time / dt);
+        double h = time / steps;
+        state = start;
+        begin = std::chrono::steady_clock::now();
+        for (long long k = 0; k < steps; ++k) {
+            rk4.advance(state.data(), h);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        double error = stateDistance(state, exact);
+        std::cout << "rk4 dt " << h << ": " << steps << " steps in " << seconds << " s, error " << error;
+        if (error <= taylorError) {
+            std::cout << " (" << seconds / taylorSeconds << "x the Taylor cost)" << std::endl;
+            break;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Stepper.h"
+
+#include <string>
+#include <vector>
+
+struct TaylorSettings {
+    double tolerance = 1e-12;
+    int order = 0;              // 0 picks it from the tolerance
+    double maxStep = 1.0;
+};
+
+enum TaylorOp {
+    TAYLOR_INPUT,
+    TAYLOR_CONSTANT,
+    TAYLOR_ADD,
+    TAYLOR_SUB,
+    TAYLOR_ADD_CONSTANT,
+    TAYLOR_SCALE,
+    TAYLOR_MUL,
+    TAYLOR_DIV,
+    TAYLOR_SIN,                 // followed by the TAYLOR_COS of the same argument
+    TAYLOR_COS
+};
+
+struct TaylorNode {
+    TaylorOp op;
+    int a;
+    int b;
+    double constant;
+};
+
+// Taylor series integrator for the chain equations. The equations of
+// motion are recorded once as a list of elementary operations; each step
+// then propagates Taylor coefficients through that list one order at a
+// time (the recursive formulas for products, quotients, sines and cosines
+// only need lower orders), so order p costs O(p^2) per operation. Order
+// and step follow Jorba and Zou: p from the tolerance, the step from the
+// decay of the last two coefficients. The step's polynomial is kept, so
+// the state anywhere inside it comes for free.
+class TaylorStepper : public ChainStepper {
+public:
+    TaylorStepper(const ChainParameters& chain, const TaylorSettings& settings);
+
+    void advance(double* state, double h) override;
+    std::string name() const override { return "taylor"; }
+
+    int order() const { return degree; }
+    long long steps() const { return stepCount; }
+
+    // One step of the length the coefficients allow, at most maxStep;
+    // returns the length taken.
+    double step(double* state, double maxStep);
+
+    // State t into the last step, 0 <= t <= its length.
+    void denseState(double t, double* out) const;
+
+private:
+    void expand(const double* state);
+
+    TaylorSettings settings;
+    int degree;
+    std::vector<TaylorNode> program;
+    std::vector<int> outputs;
+    std::vector<double> coefficients;   // degree + 1 per node
+    long long stepCount = 0;
+};
+
+int runTaylorCommand(int argc, char** argv);
@@ -0,0 +1,86 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+TileScheduler::TileScheduler(int threads) {
+    threads = std::max(threads, 1);
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(&TileScheduler::workerLoop, this);
+    }
+}
+
+TileScheduler::~TileScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        for (const std::shared_ptr<TileJob>& job : queue) {
+            job->cancel = true;
+        }
+        queue.clear();
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void TileScheduler::submit(const std::shared_ptr<TileJob>& job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(job);
+    }
+    wake.notify_one();
+}
+
+void TileScheduler::cancel(const std::shared_ptr<TileJob>& job) {
+    job->cancel = true;
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.erase(std::remove(queue.begin(), queue.end(), job), queue.end());
+}
+
+void TileScheduler::updatePriorities(const std::function<double(const TileJob&)>& priority) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const std::shared_ptr<TileJob>& job : queue) {
+        job->priority = priority(*job);
+    }
+}
+
+std::vector<std::shared_ptr<TileJob>> TileScheduler::takeFinished() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::shared_ptr<TileJob>> result;
+    result.swap(finished);
+    return result;
+}
+
+int TileScheduler::queuedCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return (int)queue.size();
+}
+
+void TileScheduler::workerLoop() {
+    for (;;) {
+        std::shared_ptr<TileJob> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            auto best = std::min_element(queue.begin(), queue.end(),
+                [](const std::shared_ptr<TileJob>& a, const std::shared_ptr<TileJob>& b) {
+                    return a->priority < b->priority;
+                });
+            job = *best;
+            queue.erase(best);
+        }
+
+        if (!job->cancel) {
+            job->compute(*job);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!job->cancel) {
+            finished.push_back(job);
+        }
+    }
+}
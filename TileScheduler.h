@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TileKey {
+    int level = 0;
+    int x = 0;
+    int y = 0;
+
+    bool operator<(const TileKey& other) const {
+        if (level != other.level) return level < other.level;
+        if (y != other.y) return y < other.y;
+        return x < other.x;
+    }
+    bool operator==(const TileKey& other) const {
+        return level == other.level && x == other.x && y == other.y;
+    }
+};
+
+struct TileJob {
+    TileKey key;
+    int stage = 0;
+    int resolution = 0;
+    double priority = 0.0;
+    std::atomic<bool> cancel{ false };
+    std::function<void(TileJob&)> compute;
+
+    std::vector<float> values;
+    std::vector<unsigned char> rgb;
+};
+
+// Runs tile jobs on background threads, always taking the queued job with
+// the lowest priority value next. Cancelling a job drops it from the queue
+// or, if it is already running, raises its cancel flag for the compute
+// function to poll. Finished jobs are collected by the UI thread.
+class TileScheduler {
+public:
+    explicit TileScheduler(int threads);
+    ~TileScheduler();
+
+    void submit(const std::shared_ptr<TileJob>& job);
+    void cancel(const std::shared_ptr<TileJob>& job);
+    void updatePriorities(const std::function<double(const TileJob&)>& priority);
+    std::vector<std::shared_ptr<TileJob>> takeFinished();
+
+    int queuedCount();
+
+private:
+    void workerLoop();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::shared_ptr<TileJob>> queue;
+    std::vector<std::shared_ptr<TileJob>> finished;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+};